@@ -64,6 +64,8 @@ extern char const *convert_atr(int oldatr);
 extern int atr_comm_match(dbref thing, dbref player, int type, int end,
                           char const *str, int just_match, char *atrname,
                           char **abp, dbref *errobj);
+extern void atr_comm_forget(dbref thing);
+extern int atr_comm_hears(dbref thing);
 extern int atr_comm_divmatch(dbref thing, dbref player, int type, int end,
                              char const *str, int just_match, char *atrname,
                              char **abp, dbref *errobj);
@@ -87,6 +89,7 @@ extern char *atr_value(ATTR *atr);
 extern char *
 safe_atr_value(ATTR *atr)
   __attribute_malloc__;
+extern void atr_value_stats(dbref player);
 
 
 /* possible attribute flags */
@@ -118,6 +121,10 @@ safe_atr_value(ATTR *atr)
 #define AF_MHEAR        0x20000000    /* ^-listens can be triggered by %! */
 #define AF_AHEAR        0x40000000    /* ^-listens can be triggered by anyone */
 
+/* What atr_comm_hears() reports */
+#define HEARS_LISTEN    0x1     /* Has a @listen */
+#define HEARS_PATTERNS  0x2     /* Has ^-patterns, its own or inherited */
+
 /* external predefined attributes. */
     extern ATTR attr[];
 
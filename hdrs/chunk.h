@@ -19,6 +19,7 @@ u_int_16 chunk_fetch(chunk_reference_t reference,
 u_int_16 chunk_len(chunk_reference_t reference);
 unsigned char chunk_derefs(chunk_reference_t reference);
 void chunk_migration(int count, chunk_reference_t ** references);
+int chunk_fragmentation(void);
 int chunk_num_swapped(void);
 void chunk_init(void);
 enum chunk_stats_type { CSTATS_SUMMARY, CSTATS_REGIONG, CSTATS_PAGINGG,
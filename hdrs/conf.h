@@ -18,6 +18,12 @@
 
 #define OOREF_DECL      char __ooref_set = 0
 
+/* Database files can be compressed by zlib inside the MUSH, through
+ * stdio streams made with fopencookie(), when both are available. */
+#if defined(HAS_ZLIB) && defined(HAS_GNULIBC) && !defined(WIN32)
+#define BUILTIN_COMPRESSION
+#endif
+
 #define ENTER_OOREF     if(options.twinchecks && ooref == NOTHING) { \
                           ooref = executor; \
                           __ooref_set = 1; \
@@ -162,15 +168,24 @@ struct options_table {
   int player_queue_limit; /**< Maximum commands a player can queue at once */
   int queue_chunk;      /**< Number of commands run from queue when no input from sockets is waiting */
   int active_q_chunk;   /**< Number of commands run from queue when input from sockets is waiting */
+  int queue_slice;      /**< Msecs of queue run when no input is waiting, 0 to use queue_chunk */
+  int active_q_slice;   /**< Msecs of queue run when input is waiting, 0 to use active_q_chunk */
+  int queue_weight;     /**< Turn length of an ordinary owner when time-slicing */
+  int queue_admin_weight;       /**< Turn length of an admin owner when time-slicing */
   int func_nest_lim;    /**< Maximum function recursion depth */
   int func_invk_lim;    /**< Maximum number of function invocations */
   int call_lim;         /**< Maximum parser calls allowed in a queue cycle */
+  int pcode_cache;      /**< Number of compiled attributes to keep */
+  int regexp_cache;     /**< Number of compiled regexps to keep */
+  int attr_value_cache; /**< Bytes of uncompressed attribute values to keep */
   char log_wipe_passwd[256];    /**< Password for logwipe command */
   char money_singular[32];      /**< Currency unit name, singular */
   char money_plural[32];        /**< Currency unit name, plural */
   char compressprog[256];       /**< Program to compress database dumps */
   char uncompressprog[256];     /**< Program to uncompress database dumps */
   char compresssuff[256];       /**< Suffix for compressed dump files */
+  int compress_builtin;         /**< Compress dumps with zlib, not a program? */
+  int compress_level;           /**< zlib compression level, 0-9 */
   char chatdb[256];             /**< Name of the chat database file */
   int max_player_chans;         /**< Number of channels a player can create */
   int max_channels;             /**< Total maximum allowed channels */
@@ -233,6 +248,10 @@ struct options_table {
   int player_name_spaces;       /**< Can players have multiword names? */
   int max_aliases;              /**< Maximum allowed aliases per player */
   int forking_dump;     /**< Should we fork to dump? */
+  int binary_dump;      /**< Should we dump a binary snapshot? */
+  int dump_shards;      /**< Number of files to split text dumps into */
+  int dump_journals;    /**< Journal checkpoints between full dumps */
+  int hot_restart;      /**< Keep a memory image across @shutdown/reboot? */
   int restrict_building;        /**< Is the builder power required to build? */
   int free_objects;     /**< If builder power is required, can you create without it? */
   int flags_on_examine; /**< Are object flags shown when it's examined? */
@@ -275,7 +294,9 @@ struct options_table {
   int max_global_fns;   /**< Maximum number of functions */
   char chunk_swap_file[256];    /**< Name of the attribute swap file */
   int chunk_cache_memory;       /**< Memory to use for the attribute cache */
+  int chunk_mmap;               /**< Let the kernel page attributes? */
   int chunk_migrate_amount;     /**< Number of attrs to migrate each second */
+  int chunk_migrate_time;       /**< Msecs of migration each second, 0 for fixed */
   int read_remote_desc; /**< Can players read DESCRIBE attribute remotely? */
 #ifdef HAS_OPENSSL
   char ssl_private_key_file[256];       /**< File to load the server's cert from */
@@ -448,6 +469,9 @@ int cf_time(const char *opt, const char *val, void *loc, int maxval,
 #define RECURSION_LIMIT (options.func_nest_lim)
 #define FUNCTION_LIMIT (options.func_invk_lim)
 #define CALL_LIMIT (options.call_lim)
+#define COMPILED_ATTR_CACHE (options.pcode_cache)
+#define REGEXP_CACHE (options.regexp_cache)
+#define ATTR_VALUE_CACHE (options.attr_value_cache)
 #define TINY_MATH (options.tiny_math)
 #define NEWLINE_ONE_CHAR (options.newline_one_char)
 #define ONLY_ASCII_NAMES (options.ascii_names)
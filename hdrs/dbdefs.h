@@ -38,6 +38,9 @@ extern dbref first_free;        /* pointer to free list */
 #define Home(x)     (db[(x)].exits)
 #define Exits(x)    (db[(x)].exits)
 #define List(x)     (db[(x)].list)
+#define CommIndex(x) (db[(x)].comm_index)
+#define AtrIndex(x) (db[(x)].atr_index)
+#define QueueCount(x) (db[(x)].queue)
 
 /* These are only for exits */
 #define Source(x)   (db[(x)].exits)
@@ -273,6 +276,7 @@ struct object {
   dbref zone;                   /**< zone master object number */
   int penn;                     /**< number of pennies object contains */
   int warnings;                 /**< bitflags of warning types */
+  int queue;                    /**< queue entries charged to it (QUEUE) */
   time_t creation_time;         /**< Time/date of object creation */
   /** Last modifiction time.
    * For players, the number of failed logins.
@@ -288,6 +292,8 @@ struct object {
   struct rplog_t rplog;
 #endif /* RPMODE_SYS */
   ALIST *list;                  /**< list of attributes on the object */
+  struct comm_index *comm_index;        /**< $-commands and ^-listens on it */
+  struct atr_index *atr_index;  /**< Sorted index of a long attribute list */
 };
 
 /** A structure to hold database statistics.
@@ -311,6 +317,21 @@ extern dbref db_top;
 extern void *get_objdata(dbref thing, const char *keybase);
 extern void *set_objdata(dbref thing, const char *keybase, void *data);
 extern void clear_objdata(dbref thing);
+extern int objdata_slot(const char *keybase);
+extern void *get_objdata_slot(dbref thing, int slot);
+extern void *set_objdata_slot(dbref thing, int slot, void *data);
+extern void objdata_stats(dbref player);
+
+/* Secondary indexes on the object table, used by searches */
+#define OBJ_INDEX_OWNER    0    /**< Objects by owner */
+#define OBJ_INDEX_ZONE     1    /**< Objects by zone */
+#define OBJ_INDEX_PARENT   2    /**< Objects by parent */
+#define OBJ_INDEX_DIVISION 3    /**< Objects by division */
+#define OBJ_INDEXES        4    /**< Number of indexes */
+extern void obj_index_update(dbref thing);
+extern int obj_index_count(int which, dbref key);
+extern int obj_index_list(int which, dbref key, dbref *list);
+extern void obj_index_reset(void);
 extern void convert_object_powers(dbref, int); /* the code is in division.c.. 
                                                     * but proto put here cause it uses the object struct
                                                     */
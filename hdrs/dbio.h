@@ -26,7 +26,15 @@ extern void db_write_labeled_dbref(FILE * f, char const *label, dbref value);
 extern void db_write_flag_db(FILE *);
 
 extern dbref db_write(FILE * f, int flag);
+extern dbref db_write_manifest(FILE * f, int shards, int generation);
+extern dbref db_write_shard(FILE * f, dbref start, dbref end);
+extern dbref db_write_journal(FILE * f, const char *base);
+extern void db_journal_reset(void);
+extern int db_journal_scan(void);
+extern void db_journal_clear(void);
+extern void db_journal_stop(void);
 extern int db_paranoid_write(FILE * f, int flag);
+extern int db_dump_flags(void);
 
 /* Input functions */
 extern const char *getstring_noalloc(FILE * f);
@@ -42,6 +50,33 @@ extern int load_flag_db(FILE *);
 
 extern void init_postconvert();
 
-extern dbref db_read(FILE * f);
+extern dbref db_read(FILE * f, const char *filename);
+extern int db_read_manifest(FILE * f, int *generation);
+extern void db_shard_name(char *buff, size_t len, const char *filename,
+                          int shard, int generation);
+extern void db_grow(dbref newtop);
+extern void db_free(void);
+extern void db_loaded_object(dbref i);
+extern void init_objdata(int size);
+
+/* From game.c */
+extern FILE *db_open(const char *filename);
+extern int db_close(FILE * f);
+
+#ifdef BUILTIN_COMPRESSION
+/* From dbzlib.c */
+extern FILE *dbz_open(const char *filename, const char *mode);
+#endif
+
+/* Binary snapshots, from dbsnap.c */
+
+/** Suffix added to the database file name for binary snapshots */
+#define SNAPSHOT_SUFFIX ".snap"
+/** Suffix of the snapshot handed from one process to the next by
+ * @shutdown/reboot */
+#define HOT_IMAGE_SUFFIX ".hot"
+
+extern dbref db_write_snapshot(FILE * f);
+extern dbref db_read_snapshot(const char *filename);
 
 #endif
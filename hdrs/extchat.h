@@ -114,8 +114,13 @@ struct chanlist {
   struct chanlist *next;        /**< Next channel in list */
 };
 
-#define Chanlist(x) ((struct chanlist *)get_objdata(x, "CHANNELS"))
-#define s_Chanlist(x, y) set_objdata(x, "CHANNELS", (void *)y)
+extern int chanlist_slot;
+/** The object data slot that channel lists are kept in */
+#define Chanlist_Slot() \
+  (chanlist_slot >= 0 ? chanlist_slot : \
+   (chanlist_slot = objdata_slot("CHANNELS")))
+#define Chanlist(x) ((struct chanlist *)get_objdata_slot(x, Chanlist_Slot()))
+#define s_Chanlist(x, y) set_objdata_slot(x, Chanlist_Slot(), (void *)y)
 
 /** A structure for passing channel data to notify_anything */
 struct na_cpass {
@@ -64,6 +64,7 @@ extern void notify_list(dbref speaker, dbref thing, const char *atr,
 extern dbref short_page(const char *match);
 extern dbref visible_short_page(dbref player, const char *match);
 extern void do_doing(dbref player, const char *message);
+extern void output_queue_stats(dbref player);
 
 /* from funtime.c */
 extern int etime_to_secs(char *str1, int *secs);
@@ -233,6 +234,7 @@ extern int sql_env[2]; /* Sql Environment */
 #endif
 extern void do_second(void);
 extern int do_top(int ncom);
+extern int do_top_slice(int msecs);
 extern void do_halt(dbref owner, const char *ncom, dbref victim);
 extern void parse_que(dbref player, const char *command, dbref cause);
 extern void div_parse_que(dbref division, const char *command, dbref called_division, dbref player);
@@ -249,6 +251,7 @@ extern int queue_attribute_useatr(dbref executor, ATTR *a, dbref enactor);
 extern void dequeue_semaphores(dbref thing, char const *aname, int count,
                                int all, int drain);
 extern void shutdown_queues(void);
+extern void queue_arena_stats(dbref player);
 extern void do_hourly(void);
 
 extern void init_namedregs(HASHTAB *);
@@ -282,6 +285,9 @@ extern dbref tooref;
 
 int parse_chat(dbref player, char *command);
 extern void fork_and_dump(int forking);
+extern void checkpoint_database(void);
+extern int dump_hot_image(void);
+extern void checkpoint_failed(void);
 void reserve_fd(void);
 void release_fd(void);
 
@@ -586,6 +592,8 @@ extern int safe_ansi_string2(ansi_string *as, size_t start, size_t len, char *bu
       char contents[BUFFER_LEN];
       int pe_flags;
       char *errmess;
+      ATTR *attrib;             /**< Attribute it came from, if any */
+      unsigned long serial;     /**< Its compiled form, or 0 */
     } ufun_attrib;
     extern int fetch_ufun_attrib(char *attrname, dbref executor,
                                  ufun_attrib * ufun, int accept_lambda);
@@ -627,6 +635,12 @@ extern int safe_ansi_string2(ansi_string *as, size_t start, size_t len, char *bu
                                  int cs);
     extern int quick_regexp_match(const char *RESTRICT s,
                                   const char *RESTRICT d, int cs);
+    struct pcre_extra;
+    extern struct real_pcre *regexp_get(const char *s, int flags,
+                                        struct pcre_extra **study,
+                                        const char **errptr);
+    extern void regexp_release(struct real_pcre *re);
+    extern void regexp_cache_stats(dbref player);
     extern int wild_match_case(const char *RESTRICT s, const char *RESTRICT d,
                                int cs);
     extern int quick_wild(const char *RESTRICT tsr, const char *RESTRICT dstr);
@@ -695,6 +709,7 @@ extern int safe_ansi_string2(ansi_string *as, size_t start, size_t len, char *bu
     extern const char *set_name(dbref obj, const char *newname);
     extern dbref new_object(void);
     extern const char *set_lmod(dbref obj, const char *lmod);
+    extern void mark_dirty(dbref thing);
 
 /* local.c */
     void local_startup(void);
@@ -48,6 +48,17 @@ struct flagspace {
   FLAG_ALIAS *flag_alias_table; /**< Pointer to flag alias table */
 };
 
+typedef struct flag_column FLAG_COLUMN;
+
+/** A set of objects.
+ * A bitmap with one bit per dbref, used to narrow down searches by
+ * flag or power before looking at each object.
+ */
+struct flag_column {
+  int words;                    /**< Length of bits */
+  unsigned long *bits;          /**< The bitmap */
+};
+
 
 /* From flags.c */
 extern int has_flag_by_name(dbref thing, const char *flag, int type);
@@ -74,6 +85,17 @@ extern int has_bit(object_flag_type bitmask, int bitpos);
 extern int has_all_bits(const char *ns, object_flag_type source, object_flag_type bitmask);
 extern int null_flagmask(const char *ns, object_flag_type source);
 extern int has_any_bits(const char *ns, object_flag_type source, object_flag_type bitmask);
+extern void flag_columns_update(dbref thing);
+extern void flag_columns_reset(void);
+extern FLAG_COLUMN *new_flag_column(void);
+extern void destroy_flag_column(FLAG_COLUMN *col);
+extern int flag_column_isset(FLAG_COLUMN *col, dbref thing);
+extern int flag_column_select(FLAG_COLUMN *col, const char *fstr, int islong,
+                              int type, int objtypes);
+extern int power_column_select(FLAG_COLUMN *col, div_pbits powers);
+extern int flag_column_count(FLAG_COLUMN *col, dbref low, dbref high);
+extern int flag_column_list(FLAG_COLUMN *col, dbref low, dbref high,
+                            dbref *list);
 extern object_flag_type string_to_bits(const char *ns, const char *str);
 extern const char *bits_to_string(const char *ns, object_flag_type bitmask, dbref privs,
                                   dbref thing);
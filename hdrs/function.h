@@ -87,6 +87,7 @@ struct userfn_entry {
 };
 
 extern USERFN_ENTRY *userfn_tab;
+extern unsigned long function_table_version;
 
 extern void do_userfn(char *buff, char **bp,
                       dbref obj, ATTR *attrib,
@@ -38,7 +38,7 @@ extern void do_allhalt(dbref player);
 extern void do_allrestart(dbref player);
 extern void do_restart(void);
 extern void do_restart_com(dbref player, const char *arg1);
-/* Only QID_ACTIVE, QID_FALSE, and QID_FREEZE actually get thrown on a qid cell.
+/* Only QID_ACTIVE and QID_FREEZE actually get kept on a queue entry.
  *  * other are just used to pass in function shit */
 enum qid_flags {QID_ACTIVE, QID_KILL, QID_FREEZE, QID_CONT, QID_TIME, QID_QUERY_T, QID_FALSE};
 extern int do_signal_qid(dbref signalby, int qid, enum qid_flags qid_flags, int time);
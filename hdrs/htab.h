@@ -5,14 +5,14 @@
 
 #define SOME_KEY_LEN 10
 
-#define HTAB_UPSCALE   4
-#define HTAB_DOWNSCALE 2
+#define HTAB_MIN_SIZE  16       /**< Fewest slots a table has */
+#define HTAB_MIGRATE   16       /**< Old slots moved per call while resizing */
 
 typedef struct hashentry HASHENT;
 /** A hash table entry.
  */
 struct hashentry {
-  struct hashentry *next;       /**< Pointer to next entry */
+  unsigned int hashval;         /**< Full hash of the key */
   void *data;                   /**< Data for this entry */
   /* int extra_size; */
   char key[SOME_KEY_LEN];       /**< Key for this entry */
@@ -22,12 +22,23 @@ struct hashentry {
 
 typedef struct hashtable HASHTAB;
 /** A hash table.
+ * Open addressing with linear probing. Each slot keeps the full hash
+ * of its entry next to the pointer to it, in a separate array, so a
+ * probe only follows pointers to entries whose hash matches. Growing
+ * the table moves a few slots into the new arrays on each later call,
+ * rather than all at once.
  */
 struct hashtable {
-  int hashsize;                 /**< Size of hash table */
-  int mask;                     /**< Mask for entries in table */
+  int hashsize;                 /**< Number of slots */
+  int mask;                     /**< hashsize - 1 */
   int entries;                  /**< Number of entries stored */
-  HASHENT **buckets;            /**< Pointer to pointer to entries */
+  int deleted;                  /**< Number of deleted slots */
+  unsigned int *hashes;         /**< Hash in each slot, or empty/deleted */
+  HASHENT **buckets;            /**< Entry in each slot */
+  int old_size;                 /**< Slots in the table being resized from */
+  int migrated;                 /**< Old slots already moved */
+  unsigned int *old_hashes;     /**< Old table hashes, while resizing */
+  HASHENT **old_buckets;        /**< Old table entries, while resizing */
   int last_hval;                /**< State for hashfirst & hashnext. */
   HASHENT *last_entry;          /**< State for hashfirst & hashnext. */
   int entry_size;               /**< Size of each entry */
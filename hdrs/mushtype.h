@@ -114,6 +114,7 @@ struct text_block {
   struct text_block *nxt;       /**< Pointer to next block in queue */
   unsigned char *start;         /**< Start of text */
   unsigned char *buf;           /**< Current position in text */
+  int size;                     /**< Bytes allocated at buf */
 };
 /** A queue of text blocks.
  */
@@ -179,8 +180,10 @@ struct descriptor_data {
   struct mail *mailp;   /**< Pointer to start of player's mail chain */
 #endif
   int conn_flags;       /**< Flags of connection (telnet status, etc.) */
+  int ev_ready;         /**< Readiness latched from sockev_wait() */
   unsigned long input_chars;    /**< Characters received */
   unsigned long output_chars;   /**< Characters sent */
+  unsigned long output_flushes; /**< Writes made to send them */
   int width;                    /**< Screen width */
   int height;                   /**< Screen height */
   char *ttype;                  /**< Terminal type */
@@ -17,6 +17,7 @@ int ssl_handshake(SSL * ssl);
 int ssl_need_accept(int state);
 int ssl_need_handshake(int state);
 int ssl_want_write(int state);
+int ssl_want_read(int state);
 int ssl_read(SSL * ssl, int state, int net_read_ready, int net_write_ready,
              char *buf, int bufsize, int *bytes_read);
 int ssl_write(SSL * ssl, int state, int net_read_ready, int net_write_ready,
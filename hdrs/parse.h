@@ -151,6 +151,28 @@ int process_expression(char *buff, char **bp, char const **str,
                        dbref executor, dbref caller, dbref enactor,
                        int eflags, int tflags, PE_Info * pe_info);
 
+/** Local state of one level of process_expression().
+ * The compiled attribute evaluator (pcode.c) keeps this in step with
+ * the interpreter so it can hand a level back to pe_resume() at any
+ * point. Nothing else should need it.
+ */
+typedef struct pe_state {
+  char *startpos;       /**< Where this level's output began */
+  int had_space;        /**< Has this level output a space? */
+  int gender;           /**< Cached enactor gender, or -1 */
+  int retval;           /**< Return value so far */
+} PE_State;
+
+int pe_resume(char *buff, char **bp, char const **str,
+              dbref executor, dbref caller, dbref enactor,
+              int eflags, int tflags, PE_Info * pe_info, PE_State * state);
+int pe_substitute(char *buff, char **bp, char const **str,
+                  dbref executor, dbref caller, dbref enactor,
+                  PE_Info * pe_info, int *gcache);
+void pe_call_function(FUN *fp, char *buff, char **bp, int nfargs,
+                      char **fargs, int *arglens, dbref executor,
+                      dbref caller, dbref enactor, PE_Info * pe_info);
+
 /* buff is a pointer to a BUFFER_LEN string to contain the expression
  * result.  *bp is the point in buff at which the result should be written.
  * *bp will be updated to point one past the result of the expression,
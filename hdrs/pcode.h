@@ -0,0 +1,25 @@
+/**
+ * \file pcode.h
+ *
+ * \brief Compiled attribute values.
+ *
+ * Attributes that are evaluated over and over (u() targets and
+ * @functions) are parsed once into a tree of nodes with their function
+ * names already looked up, and that tree is run in place of
+ * process_expression(). See pcode.c for the gory details.
+ */
+
+#ifndef _PCODE_H_
+#define _PCODE_H_
+
+typedef struct pcode PCODE;
+
+PCODE *pcode_get(ATTR *atr, int eflags);
+PCODE *pcode_lookup(ATTR *atr, unsigned long serial);
+unsigned long pcode_serial(PCODE *pc);
+int pcode_run(PCODE *pc, char *buff, char **bp, dbref executor,
+              dbref caller, dbref enactor, PE_Info * pe_info);
+void pcode_forget(ATTR *atr);
+void pcode_stats(dbref player);
+
+#endif                          /* _PCODE_H_ */
@@ -3,17 +3,18 @@
 #ifndef PTAB_H
 #define PTAB_H
 
-struct ptab_entry;
+struct ptab_node;
 /** Prefix table.
  * This structure represents a prefix table. In a prefix table, 
  * data is looked up by the best matching prefix of the given key.
+ * Keys are kept in a compressed radix trie, folded to lower case.
  */
 typedef struct ptab {
   int state;                    /**< Internal table state */
-  int len;                      /**< Table size */
-  int maxlen;                   /**< Maximum table size */
-  int current;                  /**< Internal table state */
-  struct ptab_entry **tab;      /**< Pointer to array of entries */
+  int len;                      /**< Number of entries */
+  struct ptab_node *root;       /**< Root node of the trie */
+  struct ptab_node *current;    /**< Next node for iteration */
+  struct ptab_node *stop;       /**< Subtree being iterated */
 } PTAB;
 
 
@@ -29,6 +30,7 @@ void ptab_stats_header(dbref);
 void ptab_stats(dbref, PTAB *, const char *);
 void *ptab_firstentry_new(PTAB *, char *key);
 void *ptab_nextentry_new(PTAB *, char *key);
+void *ptab_firstentry_prefix(PTAB *, const char *prefix, char *key);
 #define ptab_firstentry(x) ptab_firstentry_new(x,NULL)
 #define ptab_nextentry(x) ptab_nextentry_new(x,NULL)
 
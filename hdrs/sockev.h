@@ -0,0 +1,49 @@
+/**
+ * \file sockev.h
+ *
+ * \brief Socket readiness backends and the main loop timer wheel.
+ *
+ * shovechars() registers each socket it cares about once, and asks
+ * the backend which of them became ready. On Linux this is epoll,
+ * elsewhere a select() emulation of the same interface. See sockev.c.
+ */
+
+#ifndef _SOCKEV_H_
+#define _SOCKEV_H_
+
+#ifdef I_SYS_TIME
+#include <sys/time.h>
+#endif
+
+/* Interest and readiness bits */
+#define SOCKEV_READ     0x01    /**< Readable, or hung up */
+#define SOCKEV_WRITE    0x02    /**< Writable */
+#define SOCKEV_EDGE     0x10    /**< Register for edge-triggered reports */
+
+int sockev_init(void);
+const char *sockev_backend(void);
+int sockev_max_fds(void);
+int sockev_add(int fd, int events, void *data);
+void sockev_mod(int fd, int events);
+void sockev_del(int fd);
+int sockev_wait(long msec);
+int sockev_result(int n, int *fd, void **data);
+
+/** A timer on the main loop's timer wheel. */
+typedef struct sockev_timer SOCKEV_TIMER;
+struct sockev_timer {
+  SOCKEV_TIMER *next;           /**< Next timer in the same wheel slot */
+  SOCKEV_TIMER **prevp;         /**< Link pointing at this timer, or NULL */
+  unsigned long expires;        /**< Tick at which the timer fires */
+  long interval;                /**< Repeat every this many msec, or 0 */
+  void (*fn) (void *);          /**< Function to call when it fires */
+  void *data;                   /**< Argument to fn */
+};
+
+void sockev_timer_set(SOCKEV_TIMER *t, long msec, long interval,
+                      void (*fn) (void *), void *data);
+void sockev_timer_cancel(SOCKEV_TIMER *t);
+void sockev_timer_run(struct timeval *now);
+long sockev_timer_next(struct timeval *now);
+
+#endif                          /* _SOCKEV_H_ */
@@ -348,6 +348,7 @@ do_attribute_access(dbref player, char *name, char *perms, int retroactive)
       if ((ap2 = atr_get_noparent(i, name))) {
         AL_FLAGS(ap2) = flags;
         AL_CREATOR(ap2) = player;
+        atr_comm_forget(i);
       }
     }
   }
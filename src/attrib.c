@@ -11,6 +11,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "conf.h"
+#include "case.h"
 #include "externs.h"
 #include "chunk.h"
 #include "attrib.h"
@@ -25,6 +26,7 @@
 #include "mushdb.h"
 #include "lock.h"
 #include "log.h"
+#include "pcode.h"
 #include "confmagic.h"
 
 #ifdef WIN32
@@ -87,6 +89,32 @@ static ATTR *find_atr_pos_in_list(ATTR *** pos, char const *name);
 static int can_create_attr(dbref player, dbref obj, char const *atr_name,
                            int flags);
 static ATTR *find_atr_in_list(ATTR * atr, char const *name);
+static ATTR *find_atr_on_obj(dbref thing, ATTR *atr, char const *name);
+static void atr_value_forget(ATTR *atr);
+
+/** Objects with at least this many attributes get a sorted index of
+ * them, so that finding one doesn't mean walking the whole list.
+ */
+#define ATR_INDEX_MIN 32
+
+typedef struct atr_index ATR_INDEX;
+
+/** A sorted array of an object's attributes.
+ * It holds the same attributes in the same order as the object's
+ * attribute list, which stays the way to iterate over them.
+ */
+struct atr_index {
+  int count;                    /**< Number of attributes */
+  int alloced;                  /**< Number of slots allocated */
+  ATTR **atrs;                  /**< The attributes */
+};
+
+static ATR_INDEX *atr_index_get(dbref thing);
+static ATTR *atr_index_search(ATR_INDEX *idx, char const *name, int *pos);
+static void atr_index_insert(dbref thing, ATR_INDEX *idx, int pos,
+                             ATTR *ptr);
+static void atr_index_remove(dbref thing, ATTR *ptr);
+static void atr_index_free(dbref thing);
 
 /** Utility define for can_write_attr_internal and can_create_attr.
  * \param p the player trying to write
@@ -264,6 +292,137 @@ find_atr_in_list(ATTR * atr, char const *name)
   return NULL;
 }
 
+/* Find an attribute on an object by name, through its index if it
+ * has one. Otherwise the list is searched from atr onwards, as with
+ * find_atr_in_list().
+ */
+static ATTR *
+find_atr_on_obj(dbref thing, ATTR *atr, char const *name)
+{
+  ATR_INDEX *idx;
+  int pos;
+
+  if ((idx = atr_index_get(thing)))
+    return atr_index_search(idx, name, &pos);
+  return find_atr_in_list(atr, name);
+}
+
+/* Get an object's attribute index, building it if the object has
+ * grown enough attributes to need one.
+ */
+static ATR_INDEX *
+atr_index_get(dbref thing)
+{
+  ATR_INDEX *idx;
+  ATTR *ptr;
+  int n;
+
+  if ((idx = AtrIndex(thing)) || AttrCount(thing) < ATR_INDEX_MIN)
+    return idx;
+  /* AttrCount() can run ahead of the list, so count it properly */
+  for (n = 0, ptr = List(thing); ptr; ptr = AL_NEXT(ptr))
+    n++;
+  if (n < ATR_INDEX_MIN)
+    return NULL;
+  idx = (ATR_INDEX *) mush_malloc(sizeof(ATR_INDEX), "atr_index");
+  if (!idx)
+    return NULL;
+  idx->alloced = n * 2;
+  idx->atrs = (ATTR **) mush_malloc(idx->alloced * sizeof(ATTR *),
+                                    "atr_index.atrs");
+  if (!idx->atrs) {
+    mush_free(idx, "atr_index");
+    return NULL;
+  }
+  for (n = 0, ptr = List(thing); ptr; ptr = AL_NEXT(ptr))
+    idx->atrs[n++] = ptr;
+  idx->count = n;
+  AtrIndex(thing) = idx;
+  return idx;
+}
+
+/* Binary search an attribute index by name. Returns the attribute or
+ * NULL, and sets *pos to where it is or would be inserted.
+ */
+static ATTR *
+atr_index_search(ATR_INDEX *idx, char const *name, int *pos)
+{
+  int lo = 0, hi = idx->count, mid, comp;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    comp = strcoll(name, AL_NAME(idx->atrs[mid]));
+    if (comp == 0) {
+      *pos = mid;
+      return idx->atrs[mid];
+    }
+    if (comp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  *pos = lo;
+  return NULL;
+}
+
+/* Add a newly linked attribute to an object's index at pos. */
+static void
+atr_index_insert(dbref thing, ATR_INDEX *idx, int pos, ATTR *ptr)
+{
+  if (idx->count >= idx->alloced) {
+    ATTR **atrs;
+    int alloced = idx->alloced * 2;
+    atrs = (ATTR **) mush_malloc(alloced * sizeof(ATTR *), "atr_index.atrs");
+    if (!atrs) {
+      atr_index_free(thing);
+      return;
+    }
+    memcpy(atrs, idx->atrs, idx->count * sizeof(ATTR *));
+    mush_free(idx->atrs, "atr_index.atrs");
+    idx->atrs = atrs;
+    idx->alloced = alloced;
+  }
+  memmove(idx->atrs + pos + 1, idx->atrs + pos,
+          (idx->count - pos) * sizeof(ATTR *));
+  idx->atrs[pos] = ptr;
+  idx->count++;
+}
+
+/* Take an attribute that's being unlinked out of its object's index.
+ * The index goes away once the object is back down to a size where
+ * walking the list is cheap.
+ */
+static void
+atr_index_remove(dbref thing, ATTR *ptr)
+{
+  ATR_INDEX *idx;
+  int pos;
+
+  if (!(idx = AtrIndex(thing)))
+    return;
+  if (idx->count <= ATR_INDEX_MIN / 2
+      || atr_index_search(idx, AL_NAME(ptr), &pos) != ptr) {
+    atr_index_free(thing);
+    return;
+  }
+  idx->count--;
+  memmove(idx->atrs + pos, idx->atrs + pos + 1,
+          (idx->count - pos) * sizeof(ATTR *));
+}
+
+/* Throw away an object's attribute index. */
+static void
+atr_index_free(dbref thing)
+{
+  ATR_INDEX *idx;
+
+  if (!(idx = AtrIndex(thing)))
+    return;
+  AtrIndex(thing) = NULL;
+  mush_free(idx->atrs, "atr_index.atrs");
+  mush_free(idx, "atr_index");
+}
+
 /** Find the place to insert/delete an attribute with the specified name.
  * \param pos a pointer to the ATTR ** holding the list position
  * \param name the attribute name to look for
@@ -411,7 +570,7 @@ can_create_attr(dbref player, dbref obj, char const *atr_name, int flags)
   for (p = strchr(missing_name, '`'); p; p = strchr(p + 1, '`')) {
     *p = '\0';
     if (atr != &tmpatr)
-      atr = find_atr_in_list(atr, missing_name);
+      atr = find_atr_on_obj(obj, atr, missing_name);
     if (!atr) {
       atr = &tmpatr;
       AL_CREATOR(atr) = ooref != NOTHING ? Owner(ooref) : Owner(player);
@@ -454,7 +613,9 @@ static ATTR *
 create_atr(dbref thing, char const *atr_name)
 {
   ATTR *ptr, **ins;
+  ATR_INDEX *idx;
   char const *name;
+  int pos = 0;
 
   /* put the name in the string table */
   name = st_insert(atr_name, &atr_names);
@@ -474,10 +635,18 @@ create_atr(dbref thing, char const *atr_name)
 
   /* link it in */
   ins = &List(thing);
-  (void) find_atr_pos_in_list(&ins, AL_NAME(ptr));
+  if ((idx = atr_index_get(thing))) {
+    (void) atr_index_search(idx, AL_NAME(ptr), &pos);
+    if (pos > 0)
+      ins = &AL_NEXT(idx->atrs[pos - 1]);
+  } else
+    (void) find_atr_pos_in_list(&ins, AL_NAME(ptr));
   AL_NEXT(ptr) = *ins;
   *ins = ptr;
   AttrCount(thing)++;
+  if (idx)
+    atr_index_insert(thing, idx, pos, ptr);
+  atr_comm_forget(thing);
 
   return ptr;
 }
@@ -513,6 +682,7 @@ atr_new_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   ptr = create_atr(thing, atr);
   if (!ptr)
     return;
+  mark_dirty(thing);
 
   if((lock = dup_bool(wlock))) 
     AL_WLock(ptr) = lock;
@@ -583,7 +753,7 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   }
 
   /* walk the list, looking for a preexisting value */
-  ptr = find_atr_in_list(List(thing), atr);
+  ptr = find_atr_on_obj(thing, List(thing), atr);
 
   /* check for permission to modify existing atr */
   if ((ptr && AF_Safe(ptr))) {
@@ -608,7 +778,7 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     for (p = strchr(missing_name, '`'); p; p = strchr(p + 1, '`')) {
       *p = '\0';
 
-      ptr = find_atr_in_list(ptr, missing_name);
+      ptr = find_atr_on_obj(thing, ptr, missing_name);
 
       if (!ptr) {
         ptr = create_atr(thing, missing_name);
@@ -662,6 +832,7 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
     lmbuf[strlen(lmbuf) + 1] = '\0';
     set_lmod(thing, lmbuf);
   }
+  mark_dirty(thing);
 
   /* change owner */
   AL_CREATOR(ptr) = Owner(player);
@@ -670,6 +841,9 @@ atr_add(dbref thing, const char *RESTRICT atr, const char *RESTRICT s,
   AL_MODTIME(ptr) = mudtime;
 
   /* replace string with new string */
+  pcode_forget(ptr);
+  atr_value_forget(ptr);
+  atr_comm_forget(thing);
   if (ptr->data)
     chunk_delete(ptr->data);
   if (!s || !*s) {
@@ -708,14 +882,21 @@ int
 atr_clr(dbref thing, char const *atr, dbref player)
 {
   ATTR *ptr, **prev, *sub;
+  ATR_INDEX *idx;
   size_t len;
+  int pos;
 
   tooref = ooref;
   if (player == GOD)
     ooref = NOTHING;
 
   prev = &List(thing);
-  ptr = find_atr_pos_in_list(&prev, atr);
+  if ((idx = atr_index_get(thing))) {
+    ptr = atr_index_search(idx, atr, &pos);
+    if (pos > 0)
+      prev = &AL_NEXT(idx->atrs[pos - 1]);
+  } else
+    ptr = find_atr_pos_in_list(&prev, atr);
 
   if (!ptr) {
     ooref = tooref;
@@ -744,9 +925,14 @@ atr_clr(dbref thing, char const *atr, dbref player)
     lmbuf[strlen(lmbuf) + 1] = '\0';
     set_lmod(thing, lmbuf);
   }
+  mark_dirty(thing);
 
   *prev = AL_NEXT(ptr);
+  atr_index_remove(thing, ptr);
+  atr_comm_forget(thing);
 
+  pcode_forget(ptr);
+  atr_value_forget(ptr);
   if (ptr->data)
     chunk_delete(ptr->data);
 
@@ -766,7 +952,10 @@ atr_clr(dbref thing, char const *atr, dbref player)
     ptr = *prev;
     while (ptr && strlen(AL_NAME(ptr)) > len && AL_NAME(ptr)[len] == '`') {
       *prev = AL_NEXT(ptr);
+      atr_index_remove(thing, ptr);
 
+      pcode_forget(ptr);
+      atr_value_forget(ptr);
       if (ptr->data)
         chunk_delete(ptr->data);
       st_delete(AL_NAME(ptr), &atr_names);
@@ -828,7 +1017,7 @@ atr_get(dbref obj, char const *atrname)
       if (target != obj) {
         for (p = strchr(name, '`'); p; p = strchr(p + 1, '`')) {
           *p = '\0';
-          atr = find_atr_in_list(atr, name);
+          atr = find_atr_on_obj(target, atr, name);
           if (!atr || AF_Private(atr)) {
             *p = '`';
             goto continue_target;
@@ -838,7 +1027,7 @@ atr_get(dbref obj, char const *atrname)
       }
 
       /* Now actually find the attribute. */
-      atr = find_atr_in_list(atr, name);
+      atr = find_atr_on_obj(target, atr, name);
       global_parent_depth[1] = atr_on_obj = target;
       if (atr && (target == obj || !AF_Private(atr))) {
         global_parent_depth[0] = parent_depth;
@@ -886,7 +1075,7 @@ atr_get_noparent(dbref thing, char const *atr)
     return NULL;
 
   /* try real name */
-  ptr = find_atr_in_list(List(thing), atr);
+  ptr = find_atr_on_obj(thing, List(thing), atr);
   if (ptr)
     return ptr;
 
@@ -896,7 +1085,7 @@ atr_get_noparent(dbref thing, char const *atr)
   atr = AL_NAME(ptr);
 
   /* try alias */
-  ptr = find_atr_in_list(List(thing), atr);
+  ptr = find_atr_on_obj(thing, List(thing), atr);
   if (ptr)
     return ptr;
 
@@ -962,8 +1151,11 @@ atr_free(dbref thing)
 {
   ATTR *ptr;
 
+  atr_comm_forget(thing);
+  atr_index_free(thing);
   if (!List(thing))
     return;
+  mark_dirty(thing);
 
   if (!IsPlayer(thing)) {
     char lmbuf[1024];
@@ -980,6 +1172,8 @@ atr_free(dbref thing)
     if (AL_RLock(ptr) != TRUE_BOOLEXP)
       free_boolexp(AL_RLock(ptr));
 
+    pcode_forget(ptr);
+    atr_value_forget(ptr);
     if (ptr->data)
       chunk_delete(ptr->data);
     st_delete(AL_NAME(ptr), &atr_names);
@@ -1005,6 +1199,8 @@ atr_cpy(dbref dest, dbref source)
 
   max_attrs = (Many_Attribs(dest) ? HARD_MAX_ATTRCOUNT : MAX_ATTRCOUNT);
   List(dest) = NULL;
+  CommIndex(dest) = NULL;       /* Copied along with the rest of source */
+  AtrIndex(dest) = NULL;
   for (ptr = List(source); ptr; ptr = AL_NEXT(ptr))
     if (!AF_Nocopy(ptr)
         && (AttrCount(dest) < max_attrs)) {
@@ -1083,191 +1279,373 @@ use_attr(UsedAttr ** prev, char const *name, int no_prog)
   return &prev[0]->next;
 }
 
-/** Match input against a $command or ^listen attribute.
- * This function attempts to match a string against either the $commands
- * or ^listens on an object. Matches may be glob or regex matches, 
- * depending on the attribute's flags. With the reasonably safe assumption
- * that most of the matches are going to fail, the faster non-capturing
- * glob match is done first, and the capturing version only called when
- * we already know it'll match. Due to the way PCRE works, there's no
- * advantage to doing something similar for regular expression matches.
- * \param thing object containing attributes to check.
- * \param player the enactor, for privilege checks.
- * \param type either '$' or '^', indicating the type of attribute to check.
- * \param end character that denotes the end of a command (usually ':').
- * \param str string to match against attributes.
- * \param just_match if true, return match without executing code.
- * \param atrname used to return the list of matching object/attributes.
- * \param abp pointer to end of atrname.
- * \param errobj if an attribute matches, but the lock fails, this pointer
- *        is used to return the failing dbref. If NULL, we don't bother.
- * \return number of attributes that matched, or 0
+/* Command indexes.
+ *
+ * Matching a command against an object used to mean copying and
+ * decompressing every $-command on it and its parents, for every
+ * command typed near it. Instead, each object gets an index of its own
+ * $-commands and ^-listens, already split into pattern and action, the
+ * first time it's checked. It's thrown away whenever an attribute on the
+ * object is added, changed, removed, chowned or has its flags changed,
+ * and rebuilt when next needed.
+ *
+ * Which parent attributes an object inherits depends on the attribute
+ * names on the object and everything between it and the parent, so
+ * the inherited commands are worked out once and kept as a chain
+ * alongside the object's own index. The chain remembers which index of
+ * each ancestor it was built from, and is rebuilt when the parents or
+ * any of those indexes have changed.
+ *
+ * Entries keep their own copies of everything needed to run a command,
+ * and indexes and chains are reference counted, because evaluating a
+ * lock during matching can change the very attributes being matched.
  */
-int
-atr_comm_match(dbref thing, dbref player, int type, int end,
-               char const *str, int just_match, char *atrname, char **abp,
-               dbref * errobj)
+
+/** A $-command or ^-listen, split and ready to match. */
+typedef struct comm_entry COMM_ENTRY;
+struct comm_entry {
+  COMM_ENTRY *next;             /**< Next entry, in attribute list order */
+  ATTR *atr;                    /**< The attribute, while the index is live */
+  char const *name;             /**< The attribute name */
+  char const *pattern;          /**< The pattern, without the $ or ^ */
+  char const *action;           /**< The code after the end character */
+  char const *prefix;           /**< Literal text input must start with */
+  int prefix_len;               /**< Length of prefix */
+  int flags;                    /**< The attribute's flags */
+  dbref creator;                /**< The attribute's creator */
+};
+
+typedef struct comm_index COMM_INDEX;
+typedef struct comm_chain COMM_CHAIN;
+
+/** The index of one object's own commands and listens. */
+struct comm_index {
+  int refs;                     /**< Object, chains and matches using it */
+  unsigned long serial;         /**< Tells rebuilt indexes apart */
+  int end;                      /**< The character patterns end with */
+  int listen;                   /**< Does the object have a @listen? */
+  COMM_ENTRY *entries[2];       /**< $-commands and ^-listens */
+  COMM_CHAIN *chain[2];         /**< Inherited ones, built on demand */
+};
+
+/** One ancestor an inherited command chain was built from. */
+typedef struct comm_link {
+  dbref parent;                 /**< The ancestor */
+  COMM_INDEX *idx;              /**< Its index at the time */
+  unsigned long serial;         /**< And that index's serial number */
+} COMM_LINK;
+
+/** An inherited command and the parent it comes from. */
+typedef struct comm_cand {
+  struct comm_cand *next;       /**< Next in matching order */
+  dbref parent;                 /**< The parent it's on */
+  COMM_ENTRY *entry;            /**< The command itself */
+} COMM_CAND;
+
+/** The commands an object inherits from its parents. */
+struct comm_chain {
+  int refs;                     /**< Owner and matches using it */
+  int depth;                    /**< Number of ancestors */
+  COMM_LINK *links;             /**< The ancestors */
+  COMM_CAND *cands;             /**< The inherited commands */
+};
+
+static unsigned long comm_serial = 0;
+
+static COMM_INDEX *comm_index_get(dbref thing, int end);
+static void comm_index_release(COMM_INDEX *idx);
+static COMM_CHAIN *comm_chain_get(dbref thing, COMM_INDEX *idx, int which);
+static void comm_chain_release(COMM_CHAIN *chain);
+static COMM_ENTRY *comm_entry_new(ATTR *ptr, int end);
+static int comm_entry_match(COMM_ENTRY *e, char const *str);
+
+/** Characters a regexp can start with literally, for the prefix filter */
+#define COMM_LITERAL(c) (isalnum((unsigned char) (c)) \
+                         || ((c) && strchr(" !\"#%&',-/:;<=>@_`~", (c))))
+
+/** Throw away an object's command index.
+ * Called whenever an attribute on the object changes in a way that
+ * might change its $-commands or ^-listens, or those it passes on to
+ * its children.
+ * \param thing the object.
+ */
+void
+atr_comm_forget(dbref thing)
 {
-  int flag_mask;
-  ATTR *ptr;
-  int parent_depth;
-  char tbuf1[BUFFER_LEN];
-  char tbuf2[BUFFER_LEN];
-  char *s;
-  int match, match_found;
-  dbref parent;
-  UsedAttr *used_list, **prev;
-  ATTR *skip[ATTRIBUTE_NAME_LIMIT / 2];
-  int skipcount;
-  int lock_checked = 0;
-  dbref local_ooref;
+  COMM_INDEX *idx;
 
-  /* check for lots of easy ways out */
-  if ((type != '$' && type != '^') || !GoodObject(thing) || Halted(thing)
-      || (type == '$' && NoCommand(thing)))
-    return 0;
+  if (!GoodObject(thing) || !(idx = CommIndex(thing)))
+    return;
+  CommIndex(thing) = NULL;
+  comm_index_release(idx);
+}
 
-  if (type == '$') {
-    flag_mask = AF_COMMAND;
-    parent_depth = GoodObject(Parent(thing));
-  } else {
-    flag_mask = AF_LISTEN;
-    if (ThingInhearit(thing) || RoomInhearit(thing)) {
-      parent_depth = GoodObject(Parent(thing));
-    } else {
-      parent_depth = 0;
+static void
+comm_index_release(COMM_INDEX *idx)
+{
+  COMM_ENTRY *e;
+  int i;
+
+  if (--idx->refs > 0)
+    return;
+  for (i = 0; i < 2; i++) {
+    if (idx->chain[i])
+      comm_chain_release(idx->chain[i]);
+    while ((e = idx->entries[i])) {
+      idx->entries[i] = e->next;
+      mush_free(e, "comm_entry");
     }
   }
+  mush_free(idx, "comm_index");
+}
+
+static void
+comm_chain_release(COMM_CHAIN *chain)
+{
+  COMM_CAND *c;
+  int i;
+
+  if (--chain->refs > 0)
+    return;
+  while ((c = chain->cands)) {
+    chain->cands = c->next;
+    mush_free(c, "comm_cand");
+  }
+  for (i = 0; i < chain->depth; i++)
+    comm_index_release(chain->links[i].idx);
+  if (chain->links)
+    mush_free(chain->links, "comm_links");
+  mush_free(chain, "comm_chain");
+}
 
-  match = 0;
-  used_list = NULL;
-  prev = &used_list;
+/* Split a $-command or ^-listen into its pattern and action.
+ * Returns NULL if there's no unescaped end character in it. */
+static COMM_ENTRY *
+comm_entry_new(ATTR *ptr, int end)
+{
+  COMM_ENTRY *e;
+  char const *value, *s;
+  char *buf, *to;
+  size_t nlen, vlen;
+
+  value = atr_value(ptr);
+  s = value;
+  do {
+    s = strchr(s + 1, end);
+  } while (s && s[-1] == '\\');
+  if (!s)
+    return NULL;
+
+  nlen = strlen(AL_NAME(ptr)) + 1;
+  vlen = strlen(value) + 1;
+  e = mush_malloc(sizeof(COMM_ENTRY) + nlen + vlen, "comm_entry");
+  if (!e)
+    mush_panic("Unable to allocate memory for command index");
+  buf = (char *) (e + 1);
+  memcpy(buf, AL_NAME(ptr), nlen);
+  e->name = buf;
+  buf += nlen;
+
+  /* The pattern, skipping the $ or ^, with \: turned into : for regexps */
+  e->pattern = to = buf;
+  for (value++; value < s; value++, to++) {
+    if (AF_Regexp(ptr) && *value == '\\' && value + 1 < s
+        && *(value + 1) == ':')
+      value++;
+    *to = *value;
+  }
+  *to++ = '\0';
+  strcpy(to, s + 1);
+  e->action = to;
+
+  e->next = NULL;
+  e->atr = ptr;
+  e->flags = AL_FLAGS(ptr);
+  e->creator = AL_CREATOR(ptr);
+
+  /* Find the literal text any matching input has to start with */
+  e->prefix = e->pattern;
+  e->prefix_len = 0;
+  if (!AF_Regexp(e)) {
+    while (e->pattern[e->prefix_len]
+           && !strchr("*?\\", e->pattern[e->prefix_len]))
+      e->prefix_len++;
+  } else if (*e->pattern == '^' && !strchr(e->pattern, '|')) {
+    e->prefix = e->pattern + 1;
+    while (COMM_LITERAL(e->prefix[e->prefix_len]))
+      e->prefix_len++;
+    /* A quantifier makes the character before it optional */
+    if (e->prefix_len && e->prefix[e->prefix_len]
+        && strchr("*+?{", e->prefix[e->prefix_len]))
+      e->prefix_len--;
+  }
+  return e;
+}
+
+/* Get an object's own command index, building it if needed. */
+static COMM_INDEX *
+comm_index_get(dbref thing, int end)
+{
+  COMM_INDEX *idx;
+  COMM_ENTRY *e, **tail[2];
+  ATTR *ptr;
+  ATTR *skip[ATTRIBUTE_NAME_LIMIT / 2];
+  int skipcount;
+
+  idx = CommIndex(thing);
+  if (idx && idx->end == end)
+    return idx;
+  if (idx)
+    atr_comm_forget(thing);
+
+  idx = mush_malloc(sizeof(COMM_INDEX), "comm_index");
+  if (!idx)
+    mush_panic("Unable to allocate memory for command index");
+  idx->refs = 1;
+  idx->serial = ++comm_serial;
+  idx->end = end;
+  idx->listen = 0;
+  idx->entries[0] = idx->entries[1] = NULL;
+  idx->chain[0] = idx->chain[1] = NULL;
+  tail[0] = &idx->entries[0];
+  tail[1] = &idx->entries[1];
 
   skipcount = 0;
-  /* do_rawlog(LT_TRACE, "Searching %s:", Name(thing)); */
   for (ptr = List(thing); ptr; ptr = AL_NEXT(ptr)) {
     if (skipcount && ptr == skip[skipcount - 1]) {
       size_t len = strrchr(AL_NAME(ptr), '`') - AL_NAME(ptr);
       while (AL_NEXT(ptr) && strlen(AL_NAME(AL_NEXT(ptr))) > len &&
-             AL_NAME(AL_NEXT(ptr))[len] == '`') {
+             AL_NAME(AL_NEXT(ptr))[len] == '`')
         ptr = AL_NEXT(ptr);
-        /* do_rawlog(LT_TRACE, "  Skipping %s", AL_NAME(ptr)); */
-      }
       skipcount--;
       continue;
     }
-    if (parent_depth)
-      prev = use_attr(prev, AL_NAME(ptr), AF_Noprog(ptr));
+    if (!strcmp(AL_NAME(ptr), "LISTEN"))
+      idx->listen = 1;
     if (AF_Noprog(ptr)) {
       skip[skipcount] = atr_sub_branch(ptr);
       if (skip[skipcount])
         skipcount++;
       continue;
     }
-    if (!(AL_FLAGS(ptr) & flag_mask))
-      continue;
-    strcpy(tbuf1, atr_value(ptr));
-    s = tbuf1;
-    do {
-      s = strchr(s + 1, end);
-    } while (s && s[-1] == '\\');
-    if (!s)
-      continue;
-    *s++ = '\0';
-    if (type == '^' && !AF_Ahear(ptr)) {
-      if ((thing == player && !AF_Mhear(ptr))
-          || (thing != player && AF_Mhear(ptr)))
-        continue;
+    if (AL_FLAGS(ptr) & AF_COMMAND) {
+      if ((e = comm_entry_new(ptr, end))) {
+        *tail[0] = e;
+        tail[0] = &e->next;
+      }
     }
-
-    if (AF_Regexp(ptr)) {
-      /* Turn \: into : */
-      char *from, *to;
-      for (from = tbuf1, to = tbuf2; *from; from++, to++) {
-        if (*from == '\\' && *(from + 1) == ':')
-          from++;
-        *to = *from;
+    if (AL_FLAGS(ptr) & AF_LISTEN) {
+      if ((e = comm_entry_new(ptr, end))) {
+        *tail[1] = e;
+        tail[1] = &e->next;
       }
-      *to = '\0';
-    } else
-      strcpy(tbuf2, tbuf1);
+    }
+  }
 
-    match_found = 0;
-    if (AF_Regexp(ptr)) {
-      if (regexp_match_case(tbuf2 + 1, str, AF_Case(ptr))) {
-        match_found = 1;
-        match++;
-      }
-    } else {
-      if (quick_wild_new(tbuf2 + 1, str, AF_Case(ptr))) {
-        match_found = 1;
-        match++;
-        wild_match_case(tbuf2 + 1, str, AF_Case(ptr));
-      }
+  CommIndex(thing) = idx;
+  return idx;
+}
+
+/* Get the commands (which == 0) or listens (which == 1) thing inherits
+ * from its parents, working them out again if anything has changed. */
+static COMM_CHAIN *
+comm_chain_get(dbref thing, COMM_INDEX *idx, int which)
+{
+  COMM_CHAIN *chain;
+  COMM_CAND **tail;
+  COMM_ENTRY *cursor;
+  COMM_INDEX *pidx;
+  ATTR *ptr;
+  ATTR *skip[ATTRIBUTE_NAME_LIMIT / 2];
+  int skipcount, depth, flag_mask;
+  dbref parent;
+  UsedAttr *used_list, **prev;
+
+  if ((chain = idx->chain[which])) {
+    for (depth = 0, parent = Parent(thing);
+         depth < MAX_PARENTS && parent != NOTHING;
+         depth++, parent = Parent(parent)) {
+      if (depth >= chain->depth || chain->links[depth].parent != parent
+          || !(pidx = CommIndex(parent)) || pidx != chain->links[depth].idx
+          || pidx->serial != chain->links[depth].serial
+          || pidx->end != idx->end)
+        break;
     }
-    if (match_found) {
-      /* We only want to do the lock check once, so that any side
-       * effects in the lock are only performed once per utterance.
-       * Thus, '$foo *r:' and '$foo b*:' on the same object will only
-       * run the lock once for 'foo bar'.
-       */
-      if (!lock_checked) {
-        lock_checked = 1;
-        if ((type == '$' && !eval_lock(player, thing, Command_Lock))
-            || (type == '^' && !eval_lock(player, thing, Listen_Lock))
-            || !eval_lock(player, thing, Use_Lock)) {
-          match--;
-          if (errobj)
-            *errobj = thing;
-          /* If we failed the lock, there's no point in continuing at all. */
-          goto exit_sequence;
-        }
-      }
-      if (atrname && abp) {
-        safe_chr(' ', atrname, abp);
-        safe_dbref(thing, atrname, abp);
-        safe_chr('/', atrname, abp);
-        safe_str(AL_NAME(ptr), atrname, abp);
-      }
-      if (!just_match) {
-        local_ooref = ooref;
-        ooref = AL_CREATOR(ptr);
-        parse_que(thing, s, player);
-        ooref = local_ooref;
-      }
+    if ((depth >= MAX_PARENTS || parent == NOTHING) && depth == chain->depth)
+      return chain;
+    idx->chain[which] = NULL;
+    comm_chain_release(chain);
+  }
+
+  chain = mush_malloc(sizeof(COMM_CHAIN), "comm_chain");
+  if (!chain)
+    mush_panic("Unable to allocate memory for command index");
+  chain->refs = 1;
+  chain->depth = 0;
+  chain->links = NULL;
+  chain->cands = NULL;
+  tail = &chain->cands;
+  flag_mask = which ? AF_LISTEN : AF_COMMAND;
+
+  for (depth = 0, parent = Parent(thing);
+       depth < MAX_PARENTS && parent != NOTHING;
+       depth++, parent = Parent(parent)) ;
+  if (depth) {
+    chain->links = mush_malloc(depth * sizeof(COMM_LINK), "comm_links");
+    if (!chain->links)
+      mush_panic("Unable to allocate memory for command index");
+  }
+
+  /* Note the names of all the attributes on the child */
+  used_list = NULL;
+  prev = &used_list;
+  skipcount = 0;
+  for (ptr = List(thing); ptr; ptr = AL_NEXT(ptr)) {
+    if (skipcount && ptr == skip[skipcount - 1]) {
+      size_t len = strrchr(AL_NAME(ptr), '`') - AL_NAME(ptr);
+      while (AL_NEXT(ptr) && strlen(AL_NAME(AL_NEXT(ptr))) > len &&
+             AL_NAME(AL_NEXT(ptr))[len] == '`')
+        ptr = AL_NEXT(ptr);
+      skipcount--;
+      continue;
+    }
+    prev = use_attr(prev, AL_NAME(ptr), AF_Noprog(ptr));
+    if (AF_Noprog(ptr)) {
+      skip[skipcount] = atr_sub_branch(ptr);
+      if (skip[skipcount])
+        skipcount++;
     }
   }
 
-  /* Don't need to free used_list here, because if !parent_depth,
-   * we would never have allocated it. */
-  if (!parent_depth)
-    return match;
+  /* And see what's left over on each parent in turn */
+  for (parent = Parent(thing); chain->depth < depth;
+       parent = Parent(parent)) {
+    pidx = comm_index_get(parent, idx->end);
+    pidx->refs++;
+    chain->links[chain->depth].parent = parent;
+    chain->links[chain->depth].idx = pidx;
+    chain->links[chain->depth].serial = pidx->serial;
+    chain->depth++;
+    cursor = pidx->entries[which];
 
-  for (parent_depth = MAX_PARENTS, parent = Parent(thing);
-       parent_depth-- && parent != NOTHING; parent = Parent(parent)) {
-    /* do_rawlog(LT_TRACE, "Searching %s:", Name(parent)); */
     skipcount = 0;
     prev = &used_list;
     for (ptr = List(parent); ptr; ptr = AL_NEXT(ptr)) {
       if (skipcount && ptr == skip[skipcount - 1]) {
         size_t len = strrchr(AL_NAME(ptr), '`') - AL_NAME(ptr);
         while (AL_NEXT(ptr) && strlen(AL_NAME(AL_NEXT(ptr))) > len &&
-               AL_NAME(AL_NEXT(ptr))[len] == '`') {
+               AL_NAME(AL_NEXT(ptr))[len] == '`')
           ptr = AL_NEXT(ptr);
-          /* do_rawlog(LT_TRACE, "  Skipping %s", AL_NAME(ptr)); */
-        }
         skipcount--;
         continue;
       }
       if (AF_Private(ptr)) {
-        /* do_rawlog(LT_TRACE, "Private %s:", AL_NAME(ptr)); */
         skip[skipcount] = atr_sub_branch(ptr);
         if (skip[skipcount])
           skipcount++;
         continue;
       }
       if (find_attr(&prev, AL_NAME(ptr))) {
-        /* do_rawlog(LT_TRACE, "Found %s:", AL_NAME(ptr)); */
         if (prev[0]->no_prog || AF_Noprog(ptr)) {
           skip[skipcount] = atr_sub_branch(ptr);
           if (skip[skipcount])
@@ -1279,7 +1657,6 @@ atr_comm_match(dbref thing, dbref player, int type, int end,
       if (GoodObject(Parent(parent)))
         prev = use_attr(prev, AL_NAME(ptr), AF_Noprog(ptr));
       if (AF_Noprog(ptr)) {
-        /* do_rawlog(LT_TRACE, "NoProg %s:", AL_NAME(ptr)); */
         skip[skipcount] = atr_sub_branch(ptr);
         if (skip[skipcount])
           skipcount++;
@@ -1287,92 +1664,245 @@ atr_comm_match(dbref thing, dbref player, int type, int end,
       }
       if (!(AL_FLAGS(ptr) & flag_mask))
         continue;
-      strcpy(tbuf1, atr_value(ptr));
-      s = tbuf1;
-      do {
-        s = strchr(s + 1, end);
-      } while (s && s[-1] == '\\');
-      if (!s)
+      /* The parent's own index has everything we could want, in order */
+      while (cursor && cursor->atr != ptr)
+        cursor = cursor->next;
+      if (!cursor)
         continue;
-      *s++ = '\0';
-      if (type == '^' && !AF_Ahear(ptr)) {
-        if ((thing == player && !AF_Mhear(ptr))
-            || (thing != player && AF_Mhear(ptr)))
-          continue;
-      }
+      *tail = mush_malloc(sizeof(COMM_CAND), "comm_cand");
+      if (!*tail)
+        mush_panic("Unable to allocate memory for command index");
+      (*tail)->next = NULL;
+      (*tail)->parent = parent;
+      (*tail)->entry = cursor;
+      tail = &(*tail)->next;
+    }
+  }
 
-      if (AF_Regexp(ptr)) {
-        /* Turn \: into : */
-        char *from, *to;
-        for (from = tbuf1, to = tbuf2; *from; from++, to++) {
-          if (*from == '\\' && *(from + 1) == ':')
-            from++;
-          *to = *from;
-        }
-        *to = '\0';
-      } else
-        strcpy(tbuf2, tbuf1);
+  while (used_list) {
+    UsedAttr *temp = used_list->next;
+    mush_free(used_list, "used_attr");
+    used_list = temp;
+  }
 
-      match_found = 0;
-      if (AF_Regexp(ptr)) {
-        if (regexp_match_case(tbuf2 + 1, str, AF_Case(ptr))) {
-          match_found = 1;
-          match++;
-        }
-      } else {
-        if (quick_wild_new(tbuf2 + 1, str, AF_Case(ptr))) {
-          match_found = 1;
-          match++;
-          wild_match_case(tbuf2 + 1, str, AF_Case(ptr));
-        }
+  idx->chain[which] = chain;
+  return chain;
+}
+
+/** How can an object hear things said around it?
+ * This lets notify skip over objects with no \@listen and no ^-patterns
+ * without looking through their attributes, which makes a difference
+ * in rooms full of objects.
+ * \param thing the object.
+ * \return a bitmask of HEARS_LISTEN and HEARS_PATTERNS.
+ */
+int
+atr_comm_hears(dbref thing)
+{
+  COMM_INDEX *idx;
+  int hears = 0;
+
+  if (!GoodObject(thing))
+    return 0;
+  idx = comm_index_get(thing, ':');
+  if (idx->listen)
+    hears |= HEARS_LISTEN;
+  if (idx->entries[1])
+    hears |= HEARS_PATTERNS;
+  else if ((ThingInhearit(thing) || RoomInhearit(thing))
+           && GoodObject(Parent(thing))
+           && comm_chain_get(thing, idx, 1)->cands)
+    hears |= HEARS_PATTERNS;
+  return hears;
+}
+
+/* Does input match an indexed command or listen pattern? Fills in the
+ * wildcard or regexp captures if it does. */
+static int
+comm_entry_match(COMM_ENTRY *e, char const *str)
+{
+  int i;
+
+  if (AF_Case(e)) {
+    if (strncmp(e->prefix, str, e->prefix_len))
+      return 0;
+  } else {
+    for (i = 0; i < e->prefix_len; i++)
+      if (DOWNCASE(e->prefix[i]) != DOWNCASE(str[i]))
+        return 0;
+  }
+
+  if (AF_Regexp(e))
+    return regexp_match_case(e->pattern, str, AF_Case(e));
+  if (quick_wild_new(e->pattern, str, AF_Case(e))) {
+    wild_match_case(e->pattern, str, AF_Case(e));
+    return 1;
+  }
+  return 0;
+}
+
+/** Match input against a $command or ^listen attribute.
+ * This function attempts to match a string against either the $commands
+ * or ^listens on an object. Matches may be glob or regex matches, 
+ * depending on the attribute's flags. With the reasonably safe assumption
+ * that most of the matches are going to fail, the faster non-capturing
+ * glob match is done first, and the capturing version only called when
+ * we already know it'll match. Due to the way PCRE works, there's no
+ * advantage to doing something similar for regular expression matches.
+ * The patterns come from the object's command index, so most commands
+ * are turned down without looking at the attributes at all.
+ * \param thing object containing attributes to check.
+ * \param player the enactor, for privilege checks.
+ * \param type either '$' or '^', indicating the type of attribute to check.
+ * \param end character that denotes the end of a command (usually ':').
+ * \param str string to match against attributes.
+ * \param just_match if true, return match without executing code.
+ * \param atrname used to return the list of matching object/attributes.
+ * \param abp pointer to end of atrname.
+ * \param errobj if an attribute matches, but the lock fails, this pointer
+ *        is used to return the failing dbref. If NULL, we don't bother.
+ * \return number of attributes that matched, or 0
+ */
+int
+atr_comm_match(dbref thing, dbref player, int type, int end,
+               char const *str, int just_match, char *atrname, char **abp,
+               dbref * errobj)
+{
+  int which;
+  int parent_depth;
+  int match;
+  dbref parent;
+  COMM_INDEX *idx;
+  COMM_CHAIN *chain = NULL;
+  COMM_ENTRY *e;
+  COMM_CAND *c;
+  int lock_checked = 0;
+  dbref local_ooref;
+
+  /* check for lots of easy ways out */
+  if ((type != '$' && type != '^') || !GoodObject(thing) || Halted(thing)
+      || (type == '$' && NoCommand(thing)))
+    return 0;
+
+  if (type == '$') {
+    which = 0;
+    parent_depth = GoodObject(Parent(thing));
+  } else {
+    which = 1;
+    if (ThingInhearit(thing) || RoomInhearit(thing)) {
+      parent_depth = GoodObject(Parent(thing));
+    } else {
+      parent_depth = 0;
+    }
+  }
+
+  idx = comm_index_get(thing, end);
+  if (parent_depth) {
+    chain = comm_chain_get(thing, idx, which);
+    if (!chain->cands)
+      chain = NULL;
+  }
+  if (!idx->entries[which] && !chain)
+    return 0;
+
+  /* Evaluating a lock can change attributes, and with them the index */
+  idx->refs++;
+  if (chain)
+    chain->refs++;
+
+  match = 0;
+  for (e = idx->entries[which]; e; e = e->next) {
+    if (type == '^' && !AF_Ahear(e)) {
+      if ((thing == player && !AF_Mhear(e))
+          || (thing != player && AF_Mhear(e)))
+        continue;
+    }
+    if (!comm_entry_match(e, str))
+      continue;
+    match++;
+    /* We only want to do the lock check once, so that any side
+     * effects in the lock are only performed once per utterance.
+     * Thus, '$foo *r:' and '$foo b*:' on the same object will only
+     * run the lock once for 'foo bar'.
+     */
+    if (!lock_checked) {
+      lock_checked = 1;
+      if ((type == '$' && !eval_lock(player, thing, Command_Lock))
+          || (type == '^' && !eval_lock(player, thing, Listen_Lock))
+          || !eval_lock(player, thing, Use_Lock)) {
+        match--;
+        if (errobj)
+          *errobj = thing;
+        /* If we failed the lock, there's no point in continuing at all. */
+        goto exit_sequence;
       }
-      if (match_found) {
-        /* Since we're still checking the lock on the child, not the
-         * parent, we don't actually want to reset lock_checked with
-         * each parent checked.  Sorry for the misdirection, Alan.
-         *  - Alex */
-        if (!lock_checked) {
-          lock_checked = 1;
-          if ((type == '$' && !eval_lock(player, thing, Command_Lock))
-              || (type == '^' && !eval_lock(player, thing, Listen_Lock))
-              || !eval_lock(player, thing, Use_Lock)) {
-            match--;
-            if (errobj)
-              *errobj = thing;
-            /* If we failed the lock, there's no point in continuing at all. */
-            goto exit_sequence;
-          }
-        }
-        if (atrname && abp) {
-          safe_chr(' ', atrname, abp);
-          if (Can_Examine(player, parent))
-            safe_dbref(parent, atrname, abp);
-          else
-            safe_dbref(thing, atrname, abp);
+    }
+    if (atrname && abp) {
+      safe_chr(' ', atrname, abp);
+      safe_dbref(thing, atrname, abp);
+      safe_chr('/', atrname, abp);
+      safe_str(e->name, atrname, abp);
+    }
+    if (!just_match) {
+      local_ooref = ooref;
+      ooref = e->creator;
+      parse_que(thing, e->action, player);
+      ooref = local_ooref;
+    }
+  }
 
-          safe_chr('/', atrname, abp);
-          safe_str(AL_NAME(ptr), atrname, abp);
-        }
-        if (!just_match) {
-          local_ooref = ooref;
-          ooref = AL_CREATOR(ptr);
-          if (AL_FLAGS(ptr) & AF_POWINHERIT)
-            div_parse_que(parent, s, thing, player);
-          else
-            parse_que(thing, s, player);
-          ooref = local_ooref;
-        }
+  for (c = chain ? chain->cands : NULL; c; c = c->next) {
+    e = c->entry;
+    parent = c->parent;
+    if (type == '^' && !AF_Ahear(e)) {
+      if ((thing == player && !AF_Mhear(e))
+          || (thing != player && AF_Mhear(e)))
+        continue;
+    }
+    if (!comm_entry_match(e, str))
+      continue;
+    match++;
+    /* Since we're still checking the lock on the child, not the
+     * parent, we don't actually want to reset lock_checked with
+     * each parent checked.  Sorry for the misdirection, Alan.
+     *  - Alex */
+    if (!lock_checked) {
+      lock_checked = 1;
+      if ((type == '$' && !eval_lock(player, thing, Command_Lock))
+          || (type == '^' && !eval_lock(player, thing, Listen_Lock))
+          || !eval_lock(player, thing, Use_Lock)) {
+        match--;
+        if (errobj)
+          *errobj = thing;
+        /* If we failed the lock, there's no point in continuing at all. */
+        goto exit_sequence;
       }
     }
+    if (atrname && abp) {
+      safe_chr(' ', atrname, abp);
+      if (Can_Examine(player, parent))
+        safe_dbref(parent, atrname, abp);
+      else
+        safe_dbref(thing, atrname, abp);
+
+      safe_chr('/', atrname, abp);
+      safe_str(e->name, atrname, abp);
+    }
+    if (!just_match) {
+      local_ooref = ooref;
+      ooref = e->creator;
+      if (e->flags & AF_POWINHERIT)
+        div_parse_que(parent, e->action, thing, player);
+      else
+        parse_que(thing, e->action, player);
+      ooref = local_ooref;
+    }
   }
 
-  /* This is where I wish for 'try {} finally {}'... */
 exit_sequence:
-  while (used_list) {
-    UsedAttr *temp = used_list->next;
-    mush_free(used_list, "used_attr");
-    used_list = temp;
-  }
+  if (chain)
+    comm_chain_release(chain);
+  comm_index_release(idx);
   return match;
 }
 
@@ -1954,6 +2484,7 @@ do_atrlock(dbref player, const char *arg1, const char *arg2,
         lmbuf[strlen(lmbuf) + 1] = '\0';
         set_lmod(thing, lmbuf);
         AL_CREATOR(ptr) = creator;
+        atr_comm_forget(thing);
         notify_format(player, "Unlocked attribute %slock.",
                       write_lock ? "write" : "read");
         free_boolexp(write_lock ? AL_WLock(ptr) : AL_RLock(ptr));
@@ -1973,6 +2504,7 @@ do_atrlock(dbref player, const char *arg1, const char *arg2,
           lmbuf[strlen(lmbuf) + 1] = '\0';
           set_lmod(thing, lmbuf);
           AL_CREATOR(ptr) = creator;
+          atr_comm_forget(thing);
           notify_format(player, "Locked attribute %slock.",
                         write_lock ? "write" : "read");
           free_boolexp(write_lock ? AL_WLock(ptr) : AL_RLock(ptr));
@@ -2046,6 +2578,8 @@ do_atrchown(dbref player, const char *arg1, const char *arg2)
         return;
       }
       AL_CREATOR(ptr) = ooref != NOTHING ? Owner(ooref) : Owner(new_owner);
+      atr_comm_forget(thing);
+      mark_dirty(thing);
       notify(player, T("Attribute owner changed."));
       return;
     } else {
@@ -2250,7 +2784,7 @@ can_write_attr_internal(dbref player, dbref obj, ATTR * atr, int safe)
   atr = List(obj);
   for (p = strchr(missing_name, '`'); p; p = strchr(p + 1, '`')) {
     *p = '\0';
-    atr = find_atr_in_list(atr, missing_name);
+    atr = find_atr_on_obj(obj, atr, missing_name);
     if (!atr)
       return 0;
     if (Cannot_Write_This_Attr(player, atr, obj, safe, !atr_match(atr->name), AL_CREATOR(atr))) {
@@ -2282,16 +2816,158 @@ atr_get_compressed_data(ATTR * atr)
   return buffer;
 }
 
+/** Size of the attribute value hash table. Must be a power of 2. */
+#define AV_HASH_SIZE 4096
+
+typedef struct av_entry AV_ENTRY;
+
+/** An uncompressed attribute value kept for reuse. */
+struct av_entry {
+  ATTR *atr;                    /**< The attribute */
+  chunk_reference_t data;       /**< The chunk the value was read from */
+  size_t size;                  /**< Memory used */
+  AV_ENTRY *hnext;              /**< Next in hash bucket */
+  AV_ENTRY *prev;               /**< Previous in LRU list (more recently used) */
+  AV_ENTRY *next;               /**< Next in LRU list (less recently used) */
+  int len;                      /**< Length of the value */
+  char value[1];                /**< The value itself */
+};
+
+static AV_ENTRY *av_hash[AV_HASH_SIZE];
+static AV_ENTRY *av_head = NULL, *av_tail = NULL;
+static int av_count = 0;
+static size_t av_memory = 0;
+static unsigned long av_hits = 0, av_misses = 0, av_evicted = 0;
+
+#define av_bucket(atr) \
+  ((((size_t) (atr)) / sizeof(ATTR)) & (AV_HASH_SIZE - 1))
+
+/* Take an entry out of the value cache and free it. */
+static void
+av_drop(AV_ENTRY *e)
+{
+  AV_ENTRY **pp;
+
+  for (pp = &av_hash[av_bucket(e->atr)]; *pp; pp = &(*pp)->hnext)
+    if (*pp == e) {
+      *pp = e->hnext;
+      break;
+    }
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    av_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    av_tail = e->prev;
+  av_count--;
+  av_memory -= e->size;
+  mush_free(e, "atr_value");
+}
+
+/* Forget the cached value of an attribute that's being changed or freed. */
+static void
+atr_value_forget(ATTR *atr)
+{
+  AV_ENTRY *e;
+
+  if (!av_count)
+    return;
+  for (e = av_hash[av_bucket(atr)]; e; e = e->hnext)
+    if (e->atr == atr) {
+      av_drop(e);
+      return;
+    }
+}
+
+/* Find the uncompressed value of an attribute, decompressing it and
+ * adding it to the cache if it isn't there yet. Returns NULL if the
+ * value isn't cached; then *text is the value if it had to be
+ * decompressed anyway, or NULL if the caller should do it.
+ */
+static AV_ENTRY *
+av_get(ATTR *atr, char **text)
+{
+  AV_ENTRY *e;
+  size_t b;
+  int len;
+
+  *text = NULL;
+  if (ATTR_VALUE_CACHE <= 0 || !atr->data || (AL_FLAGS(atr) & AF_ANON))
+    return NULL;
+  b = av_bucket(atr);
+  for (e = av_hash[b]; e; e = e->hnext)
+    if (e->atr == atr)
+      break;
+  if (e) {
+    if (e->data == atr->data) {
+      av_hits++;
+      if (e != av_head) {
+        e->prev->next = e->next;
+        if (e->next)
+          e->next->prev = e->prev;
+        else
+          av_tail = e->prev;
+        e->prev = NULL;
+        e->next = av_head;
+        av_head->prev = e;
+        av_head = e;
+      }
+      return e;
+    }
+    /* The chunk moved or was replaced behind our back */
+    av_drop(e);
+  }
+  av_misses++;
+  *text = uncompress(atr_get_compressed_data(atr));
+  len = strlen(*text);
+  if (sizeof(AV_ENTRY) + len > (size_t) ATTR_VALUE_CACHE / 4)
+    return NULL;
+  e = (AV_ENTRY *) mush_malloc(sizeof(AV_ENTRY) + len, "atr_value");
+  if (!e)
+    return NULL;
+  e->atr = atr;
+  e->data = atr->data;
+  e->size = sizeof(AV_ENTRY) + len;
+  e->len = len;
+  memcpy(e->value, *text, len + 1);
+  e->hnext = av_hash[b];
+  av_hash[b] = e;
+  e->prev = NULL;
+  e->next = av_head;
+  if (av_head)
+    av_head->prev = e;
+  av_head = e;
+  if (!av_tail)
+    av_tail = e;
+  av_count++;
+  av_memory += e->size;
+  while (av_memory > (size_t) ATTR_VALUE_CACHE && av_tail != e) {
+    av_drop(av_tail);
+    av_evicted++;
+  }
+  return e;
+}
+
 /** Return the uncompressed data for an attribute in a static buffer.
  * This is a wrapper function, to centralize the use of compression/
- * decompression on attributes.
+ * decompression on attributes. Recently used values are kept
+ * uncompressed, so busy attributes are only decompressed once.
  * \param atr the attribute struct from which to get the data reference.
  * \return a pointer to the uncompressed data, in a static buffer.
  */
 char *
 atr_value(ATTR * atr)
 {
-  return uncompress(atr_get_compressed_data(atr));
+  static char buff[BUFFER_LEN];
+  AV_ENTRY *e;
+  char *text;
+
+  if (!(e = av_get(atr, &text)))
+    return text ? text : uncompress(atr_get_compressed_data(atr));
+  memcpy(buff, e->value, e->len + 1);
+  return buff;
 }
 
 /** Return the uncompressed data for an attribute in a dynamic buffer.
@@ -2303,5 +2979,23 @@ atr_value(ATTR * atr)
 char *
 safe_atr_value(ATTR * atr)
 {
-  return safe_uncompress(atr_get_compressed_data(atr));
+  AV_ENTRY *e;
+  char *text;
+
+  if (!(e = av_get(atr, &text)))
+    return text ? strdup(text) : safe_uncompress(atr_get_compressed_data(atr));
+  return strdup(e->value);
+}
+
+/** Report on the attribute value cache.
+ * \param player player to notify.
+ */
+void
+atr_value_stats(dbref player)
+{
+  notify(player, "Attribute Values:");
+  notify_format(player,
+                "%d cached, using %lu of %d bytes. %lu hits, %lu misses, "
+                "%lu evicted.", av_count, (unsigned long) av_memory,
+                ATTR_VALUE_CACHE, av_hits, av_misses, av_evicted);
 }
@@ -53,6 +53,7 @@
 #ifdef I_SYS_STAT
 #include <sys/stat.h>
 #endif
+#include <sys/uio.h>
 #endif                          /* !WIN32 */
 #include <time.h>
 #ifdef I_SYS_WAIT
@@ -90,12 +91,6 @@
 #undef INFO_SLAVE
 #endif
 
-#ifndef COMPILE_CONSOLE
-#ifdef INFO_SLAVE
-#include <sys/uio.h>
-#endif
-#endif
-
 #include "externs.h"
 #include "chunk.h"
 #include "mushdb.h"
@@ -125,6 +120,7 @@
 #include "attrib.h"
 #include "game.h"
 #include "dbio.h"
+#include "sockev.h"
 #include "confmagic.h"
 #include "modules.h"
 #include "lua.h"
@@ -320,7 +316,6 @@ int main(int argc, char **argv);
 #endif
 #endif
 void set_signals(void);
-static struct timeval *timeval_sub(struct timeval *now, struct timeval *then);
 #ifdef WIN32
 /** Windows doesn't have gettimeofday(), so we implement it here */
 #define our_gettimeofday(now) win_gettimeofday((now))
@@ -330,7 +325,6 @@ static void win_gettimeofday(struct timeval *now);
 #define our_gettimeofday(now) gettimeofday((now), (struct timezone *)NULL)
 #endif
 static long int msec_diff(struct timeval *now, struct timeval *then);
-static struct timeval *msec_add(struct timeval *t, int x);
 static void update_quotas(struct timeval *last, struct timeval *current);
 
 #ifdef COMPILE_CONSOLE
@@ -379,6 +373,7 @@ static void logout_sock(DESC *d);
 static void shutdownsock(DESC *d);
 static DESC *initializesock(int s, char *addr, char *ip, int use_ssl);
 int process_output(DESC *d);
+static int send_queue(DESC *d, int *want);
 /* Notify.c */
 extern void free_text_block(struct text_block *t);
 extern void add_to_queue(struct text_queue *q, const unsigned char *b, int n);
@@ -594,6 +589,8 @@ main(int argc, char **argv)
 
   set_signals();
 
+  sockev_init();
+
 #ifndef COMPILE_CONSOLE
 #ifdef INFO_SLAVE
   make_info_slave();
@@ -782,27 +779,6 @@ win_gettimeofday(struct timeval *now)
 
 #endif
 
-/** Return the difference between two timeval structs as a timeval struct.
- * \param now pointer to the timeval to subtract from.
- * \param then pointer to the timeval to subtract.
- * \return pointer to a statically allocated timeval of the difference.
- */
-static struct timeval *
-timeval_sub(struct timeval *now, struct timeval *then)
-{
-  static struct timeval mytime;
-  mytime.tv_sec = now->tv_sec;
-  mytime.tv_usec = now->tv_usec;
-
-  mytime.tv_sec -= then->tv_sec;
-  mytime.tv_usec -= then->tv_usec;
-  if (mytime.tv_usec < 0) {
-    mytime.tv_usec += 1000000;
-    mytime.tv_sec--;
-  }
-  return &mytime;
-}
-
 /** Return the difference between two timeval structs in milliseconds.
  * \param now pointer to the timeval to subtract from.
  * \param then pointer to the timeval to subtract.
@@ -822,26 +798,6 @@ msec_diff(struct timeval *now, struct timeval *then)
     return 0;
 }
 
-/** Add a given number of milliseconds to a timeval.
- * \param t pointer to a timeval struct.
- * \param x number of milliseconds to add to t.
- * \return address of static timeval struct representing the sum.
- */
-static struct timeval *
-msec_add(struct timeval *t, int x)
-{
-  static struct timeval mytime;
-  mytime.tv_sec = t->tv_sec;
-  mytime.tv_usec = t->tv_usec;
-  mytime.tv_sec += x / 1000;
-  mytime.tv_usec += (x % 1000) * 1000;
-  if (mytime.tv_usec >= 1000000) {
-    mytime.tv_sec += mytime.tv_usec / 1000000;
-    mytime.tv_usec = mytime.tv_usec % 1000000;
-  }
-  return &mytime;
-}
-
 /** Update each descriptor's allowed rate of issuing commands.
  * Players are rate-limited; they may only perform up to a certain
  * number of commands per time slice. This function is run periodically
@@ -906,6 +862,15 @@ bad_empabb_value:
 }
 
 
+/* Per-second tick for dispatch(), run off the timer wheel */
+static SOCKEV_TIMER second_timer;
+
+static void
+second_tick(void *data __attribute__ ((__unused__)))
+{
+  globals.on_second = 1;
+}
+
 static void
 #ifdef COMPILE_CONSOLE
 shovechars()
@@ -915,21 +880,24 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
 {
   /* this is the main game loop */
 
-  fd_set input_set, output_set;
   time_t now;
-  struct timeval last_slice, current_time, then;
-  struct timeval next_slice, *returned_time;
-  struct timeval timeout, slice_timeout;
-  int found;
-  int queue_timeout;
+  struct timeval last_slice, current_time;
+  long timeout;
+  int found, busy, want, n, fd, ready;
+  void *data;
   DESC *d, *dnext;
 #ifndef COMPILE_CONSOLE
+  int sock_ready;
+#ifdef HAS_OPENSSL
+  int sslsock_ready;
+#endif
 #ifndef INFO_SLAVE
   DESC *newd;
   int result;
 #endif
   int avail_descriptors;
 #ifdef INFO_SLAVE
+  int slave_ready;
   union sockaddr_u addr;
   socklen_t addr_len;
   int newsock;
@@ -953,11 +921,24 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
     }
 #endif
   }
+  sockev_add(sock, SOCKEV_READ, NULL);
+#ifdef HAS_OPENSSL
+  if (sslsock)
+    sockev_add(sslsock, SOCKEV_READ, NULL);
+#endif
 #endif /* COMPILE_CONSOLE */
   our_gettimeofday(&last_slice);
 
 #ifndef COMPILE_CONSOLE
-  avail_descriptors = how_many_fds() - 4;
+  avail_descriptors = how_many_fds();
+  if (avail_descriptors > sockev_max_fds())
+    avail_descriptors = sockev_max_fds();
+#ifdef INFO_SLAVE
+  /* Pending lookups are still kept in an fd_set */
+  if (avail_descriptors > FD_SETSIZE)
+    avail_descriptors = FD_SETSIZE;
+#endif
+  avail_descriptors -= 4;
 #ifdef INFO_SLAVE
   avail_descriptors -= 2;       /* reserve some more for setting up the slave */
   FD_ZERO(&info_pending);
@@ -968,7 +949,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
 #endif /* COMPILE_CONSOLE */
   do_rawlog(LT_ERR, "RESTART FINISHED.");
 
-  our_gettimeofday(&then);
+  sockev_timer_set(&second_timer, 1000, 1000, second_tick, NULL);
 
   while (shutdown_flag == 0) {
     our_gettimeofday(&current_time);
@@ -977,11 +958,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
     last_slice.tv_sec = current_time.tv_sec;
     last_slice.tv_usec = current_time.tv_usec;
 
-    if (msec_diff(&current_time, &then) >= 1000) {
-      globals.on_second = 1;
-      then.tv_sec = current_time.tv_sec;
-      then.tv_usec = current_time.tv_usec;
-    }
+    sockev_timer_run(&current_time);
 
     process_commands();
 
@@ -1007,74 +984,41 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
     /* test for events */
     dispatch();
 
-    /* any queued robot commands waiting? */
-    /* timeout.tv_sec used to be set to que_next(), the number of
-     * seconds before something on the queue needed to run, but this
-     * caused a problem with stuff that had to be triggered by alarm
-     * signal every second, so we're reduced to what's below:
+    /* Sleep until the next timer is due, unless there are queued
+     * robot commands to run right now, or descriptors that we already
+     * know are ready but haven't been served yet. Players with input
+     * waiting on their command quota get woken up after a slice.
      */
-    queue_timeout = que_next();
-    timeout.tv_sec = queue_timeout ? 1 : 0;
-    timeout.tv_usec = 0;
-
-    returned_time = msec_add(&last_slice, COMMAND_TIME_MSEC);
-    next_slice.tv_sec = returned_time->tv_sec;
-    next_slice.tv_usec = returned_time->tv_usec;
-
-    returned_time = timeval_sub(&next_slice, &current_time);
-    slice_timeout.tv_sec = returned_time->tv_sec;
-    slice_timeout.tv_usec = returned_time->tv_usec;
-    /* Make sure slice_timeout cannot have a negative time. Better
-       safe than sorry. */
-    if (slice_timeout.tv_sec < 0)
-      slice_timeout.tv_sec = 0;
-    if (slice_timeout.tv_usec < 0)
-      slice_timeout.tv_usec = 0;
-
-    FD_ZERO(&input_set);
-    FD_ZERO(&output_set);
+    our_gettimeofday(&current_time);
+    timeout = sockev_timer_next(&current_time);
+    if (que_next() == 0)
+      timeout = 0;
+
+    busy = 0;
 #ifndef COMPILE_CONSOLE
-    if (ndescriptors < avail_descriptors)
-      FD_SET(sock, &input_set);
-#ifdef HAS_OPENSSL
-    if (sslsock)
-      FD_SET(sslsock, &input_set);
-#endif
-#ifdef INFO_SLAVE
-    if (info_slave_state > 0)
-      FD_SET(info_slave, &input_set);
-#endif
+    sockev_mod(sock, (ndescriptors < avail_descriptors) ? SOCKEV_READ : 0);
 #endif /* COMPILE_CONSOLE */
     for (d = descriptor_list; d; d = d->next) {
+      want = 0;
       if (d->input.head) {
-        timeout.tv_sec = slice_timeout.tv_sec;
-        timeout.tv_usec = slice_timeout.tv_usec;
-#ifdef COMPILE_CONSOLE
-      } else {
-        if(d->descriptor == 0)
-          FD_SET(STDIN_FILENO, &input_set);
-        else
-          FD_SET(d->descriptor, &input_set);
-      }
+        if (timeout < 0 || timeout > COMMAND_TIME_MSEC)
+          timeout = COMMAND_TIME_MSEC;
+      } else if (d->ev_ready & SOCKEV_READ)
+        busy++;
+      else
+        want |= SOCKEV_READ;
       if (d->output.head) {
-        if(d->descriptor == 0)
-          FD_SET(STDOUT_FILENO, &output_set);
+        if (d->ev_ready & SOCKEV_WRITE)
+          busy++;
         else
-          FD_SET(d->descriptor, &output_set);
+          want |= SOCKEV_WRITE;
       }
-#else /* COMPILE_CONSOLE */
-      } else
-        FD_SET(d->descriptor, &input_set);
-      if (d->output.head)
-        FD_SET(d->descriptor, &output_set);
-#endif /* COMPILE_CONSOLE */
+      sockev_mod(d->descriptor, want);
     }
+    if (busy)
+      timeout = 0;
 
-#ifdef COMPILE_CONSOLE
-    found = select(2, &input_set, &output_set, (fd_set *) 0, &timeout);
-#else
-    found = select(maxd, &input_set, &output_set, (fd_set *) 0, &timeout);
-#endif
+    found = sockev_wait(timeout);
     if (found < 0) {
 #ifdef WIN32
       if (found == SOCKET_ERROR && WSAGetLastError() != WSAEINTR)
@@ -1082,7 +1026,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
       if (errno != EINTR)
 #endif
       {
-        perror("select");
+        perror("sockev_wait");
         return;
       }
 #ifndef COMPILE_CONSOLE
@@ -1100,16 +1044,56 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
     } else {
       /* if !found then time for robot commands */
 
-      if (!found) {
-        do_top(options.queue_chunk);
+      if (!found && !busy) {
+        if (options.queue_slice)
+          do_top_slice(options.queue_slice);
+        else
+          do_top(options.queue_chunk);
         continue;
       } else {
-        do_top(options.active_q_chunk);
+        if (options.active_q_slice)
+          do_top_slice(options.active_q_slice);
+        else
+          do_top(options.active_q_chunk);
       }
       now = mudtime;
+
+      /* Latch what we were told in the descriptors. It stays set
+       * until a read or write would block, since an edge-triggered
+       * backend won't tell us again.
+       */
 #ifndef COMPILE_CONSOLE
+      sock_ready = 0;
+#ifdef HAS_OPENSSL
+      sslsock_ready = 0;
+#endif
 #ifdef INFO_SLAVE
-      if (info_slave_state > 0 && FD_ISSET(info_slave, &input_set)) {
+      slave_ready = 0;
+#endif
+#endif /* COMPILE_CONSOLE */
+      for (n = 0; n < found; n++) {
+        if (!(ready = sockev_result(n, &fd, &data)))
+          continue;
+        if (data) {
+          ((DESC *) data)->ev_ready |= ready;
+          continue;
+        }
+#ifndef COMPILE_CONSOLE
+        if (fd == sock)
+          sock_ready = 1;
+#ifdef HAS_OPENSSL
+        else if (sslsock && fd == sslsock)
+          sslsock_ready = 1;
+#endif
+#ifdef INFO_SLAVE
+        else if (info_slave_state > 0 && fd == info_slave)
+          slave_ready = 1;
+#endif
+#endif /* COMPILE_CONSOLE */
+      }
+#ifndef COMPILE_CONSOLE
+#ifdef INFO_SLAVE
+      if (slave_ready) {
         if (info_slave_state == 1)
           promote_info_slave();
         else {
@@ -1123,7 +1107,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
             query_info_slave(newsock);
       }
 
-      if (FD_ISSET(sock, &input_set)) {
+      if (sock_ready) {
         addr_len = sizeof(addr);
         newsock = accept(sock, (struct sockaddr *) &addr, &addr_len);
         if (newsock < 0) {
@@ -1136,7 +1120,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
           maxd = newsock + 1;
       }
 #ifdef HAS_OPENSSL
-      if (sslsock && FD_ISSET(sslsock, &input_set)) {
+      if (sslsock_ready) {
         addr_len = sizeof(addr);
         newsock = accept(sslsock, (struct sockaddr *) &addr, &addr_len);
         if (newsock < 0) {
@@ -1150,7 +1134,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
       }
 #endif
 #else                           /* INFO_SLAVE */
-      if (FD_ISSET(sock, &input_set)) {
+      if (sock_ready) {
         if (!(newd = new_connection(sock, &result, 0))) {
           if (test_connection(result) < 0)
             continue;           /* this should _not_ be return. */
@@ -1161,7 +1145,7 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
         }
       }
 #ifdef HAS_OPENSSL
-      if (sslsock && FD_ISSET(sslsock, &input_set)) {
+      if (sslsock_ready) {
         if (!(newd = new_connection(sslsock, &result, 1))) {
           if (test_connection(result) < 0)
             continue;           /* this should _not_ be return. */
@@ -1176,44 +1160,27 @@ shovechars(Port_t port, Port_t sslport __attribute__ ((__unused__)))
 #endif /* COMPILE_CONSOLE */
       for (d = descriptor_list; d; d = dnext) {
         dnext = d->next;
-#ifdef COMPILE_CONSOLE
-        if (d->descriptor == 0) {
-          input_ready = FD_ISSET(STDIN_FILENO, &input_set);
-          output_ready = FD_ISSET(STDOUT_FILENO, &output_set);
-        } else {
-          input_ready = FD_ISSET(d->descriptor, &input_set);
-          output_ready = FD_ISSET(d->descriptor, &output_set);
-        }
+        input_ready = (d->ev_ready & SOCKEV_READ) && !d->input.head;
+        output_ready = (d->ev_ready & SOCKEV_WRITE) && d->output.head;
         if (input_ready) {
           if (!process_input(d, output_ready)) {
             shutdownsock(d);
-            if(d->descriptor == 0)
+#ifdef COMPILE_CONSOLE
+            if (d->descriptor == 0)
               return;
+#endif /* COMPILE_CONSOLE */
             continue;
           }
         }
         if (output_ready) {
           if (!process_output(d)) {
             shutdownsock(d);
+#ifdef COMPILE_CONSOLE
             if (d->descriptor == 0)
               return;
+#endif /* COMPILE_CONSOLE */
           }
         }
-#else /* COMPILE_CONSOLE */
-        input_ready = FD_ISSET(d->descriptor, &input_set);
-        output_ready = FD_ISSET(d->descriptor, &output_set);
-        if (input_ready) {
-          if (!process_input(d, output_ready)) {
-            shutdownsock(d);
-            continue;
-          }
-        }
-        if (output_ready) {
-          if (!process_output(d)) {
-            shutdownsock(d);
-          }
-        }
-#endif /* COMPILE_CONSOLE */
       }
     }
   }
@@ -1600,6 +1567,7 @@ shutdownsock(DESC *d)
   clearstrings(d);
 #ifdef COMPILE_CONSOLE
   if (d->descriptor != 0) {
+    sockev_del(d->descriptor);
     shutdown(d->descriptor, 2);
     closesocket(d->descriptor);
   } else {
@@ -1634,6 +1602,7 @@ shutdownsock(DESC *d)
     d->conn_flags = CONN_DEFAULT;
     d->input_chars = 0;
     d->output_chars = 0;
+    d->output_flushes = 0;
     d->ttype = mush_strdup("unknown", "terminal description");
     d->checksum[0] = '\0';
     d->su_exit_path = NULL;
@@ -1662,6 +1631,7 @@ shutdownsock(DESC *d)
     mush_free((Malloc_t) d, "descriptor");
   }
 #else /* COMPILE_CONSOLE */
+  sockev_del(d->descriptor);
   shutdown(d->descriptor, 2);
   closesocket(d->descriptor);
   if (d->prev)
@@ -1731,6 +1701,7 @@ initializesock(int s, char *addr, char *ip, int use_ssl
   d->conn_flags = CONN_DEFAULT;
   d->input_chars = 0;
   d->output_chars = 0;
+  d->output_flushes = 0;
   d->ttype = mush_strdup("unknown", "terminal description");
   d->checksum[0] = '\0';
   d->su_exit_path = NULL;
@@ -1751,6 +1722,16 @@ initializesock(int s, char *addr, char *ip, int use_ssl
   descriptor_list = d;
   d->width = 78;
   d->height = 24;
+  /* A new socket can be written to; we'll hear when it can be read.
+   * SSL connections stay level-triggered, since the SSL layer may
+   * need the socket in a different direction than we asked for. */
+  d->ev_ready = SOCKEV_WRITE;
+#if !defined(COMPILE_CONSOLE) && defined(HAS_OPENSSL)
+  sockev_add(s, SOCKEV_READ | SOCKEV_WRITE |
+             ((use_ssl && sslsock) ? 0 : SOCKEV_EDGE), d);
+#else
+  sockev_add(s, SOCKEV_READ | SOCKEV_WRITE | SOCKEV_EDGE, d);
+#endif
 #ifndef COMPILE_CONSOLE
 #ifdef HAS_OPENSSL
   if (use_ssl && sslsock) {
@@ -1788,6 +1769,7 @@ make_info_slave(void)
 
   if (info_slave_state != 0) {
     if (info_slave_pid > 0) {
+      sockev_del(info_slave);
       closesocket(info_slave);
       kill(info_slave_pid, 15);
       info_slave_pid = -1;
@@ -1875,6 +1857,7 @@ make_info_slave(void)
   info_reap_spill = 0;
   if (info_slave >= maxd)
     maxd = info_slave + 1;
+  sockev_add(info_slave, SOCKEV_READ, NULL);
 #ifdef HAS_SOCKETPAIR
   promote_info_slave();
 #endif
@@ -1903,8 +1886,10 @@ promote_info_slave(void)
     make_info_slave();
     return;
   }
+  sockev_del(info_slave);
   closesocket(info_slave);
   info_slave = newsock;
+  sockev_add(info_slave, SOCKEV_READ, NULL);
 #endif
   make_nonblocking(info_slave);
   /* Do authentication here, if we care */
@@ -2134,6 +2119,7 @@ kill_info_slave(void)
 
       block_a_signal(SIGCHLD);
 
+      sockev_del(info_slave);
       closesocket(info_slave);
       kill(info_slave_pid, 15);
       /* Have to wait long enough for the info_slave to actually
@@ -2158,6 +2144,39 @@ kill_info_slave(void)
 
 
 
+/* Most blocks handed to a single writev() */
+#define OUTPUT_IOV 16
+
+/** Send as much of a descriptor's output queue as one call allows.
+ * Where writev() is available, this gathers up to OUTPUT_IOV blocks
+ * into a single write; otherwise it sends the head block.
+ * \param d pointer to descriptor to send output to.
+ * \param want set to the number of bytes offered to the socket.
+ * \return the result of the write.
+ */
+static int
+send_queue(DESC *d, int *want)
+{
+#ifndef WIN32
+  struct iovec iov[OUTPUT_IOV];
+  struct text_block *cur;
+  int n;
+
+  *want = 0;
+  for (n = 0, cur = d->output.head; cur && n < OUTPUT_IOV;
+       cur = cur->nxt, n++) {
+    iov[n].iov_base = (void *) cur->start;
+    iov[n].iov_len = cur->nchars;
+    *want += cur->nchars;
+  }
+  return writev(d->descriptor, iov, n);
+#else
+  *want = d->output.head->nchars;
+  return send(d->descriptor, d->output.head->start, d->output.head->nchars,
+              0);
+#endif
+}
+
 /** Flush pending output for a descriptor.
  * This function actually sends the queued output over the descriptor's
  * socket.
@@ -2168,8 +2187,8 @@ kill_info_slave(void)
 int
 process_output(DESC *d)
 {
-  struct text_block **qp, *cur;
-  int cnt;
+  struct text_block *cur;
+  int cnt, want, left;
 #ifndef COMPILE_CONSOLE
 #ifdef HAS_OPENSSL
   int input_ready = 0;
@@ -2187,6 +2206,7 @@ process_output(DESC *d)
       return 0;
     } else if (ssl_need_handshake(d->ssl_state)) {
       /* We're still not ready to send to this connection. Alas. */
+      d->ev_ready = 0;
       return 1;
     }
   }
@@ -2201,32 +2221,20 @@ process_output(DESC *d)
       return 0;
     } else if (ssl_need_accept(d->ssl_state)) {
       /* We're still not ready to send to this connection. Alas. */
+      d->ev_ready = 0;
       return 1;
     }
   }
-  if (d->ssl) {
-    /* process_output, alas, gets called from all kinds of places.
-     * We need to know if the descriptor is waiting on input, though.
-     * So let's find out
-     */
-    struct timeval pad;
-    fd_set input_set;
-
-    pad.tv_sec = 0;
-    pad.tv_usec = 0;
-    FD_ZERO(&input_set);
-    FD_SET(d->descriptor, &input_set);
-    input_ready = select(d->descriptor + 1, &input_set, NULL, NULL, &pad);
-    if (input_ready < 0) {
-      /* Well, shoot, we have no idea. Guess and proceed. */
-      perror("select in process_output");
-      input_ready = 0;
-    }
-  }
+  /* process_output, alas, gets called from all kinds of places.
+   * We need to know if the descriptor is waiting on input, though,
+   * and the main loop has been keeping track. */
+  if (d->ssl)
+    input_ready = (d->ev_ready & SOCKEV_READ) ? 1 : 0;
 #endif
 #endif /* COMPILE_CONSOLE */
 
-  for (qp = &d->output.head; ((cur = *qp) != NULL);) {
+  while ((cur = d->output.head) != NULL) {
+    want = cur->nchars;
 #ifdef COMPILE_CONSOLE
     if (d->descriptor == 0)
       cnt = write(STDOUT_FILENO, cur->start, cur->nchars);
@@ -2237,12 +2245,14 @@ process_output(DESC *d)
       cnt = 0;
       d->ssl_state = ssl_write(d->ssl, d->ssl_state, input_ready, 1, cur->start,
                                cur->nchars, &cnt);
-      if (ssl_want_write(d->ssl_state))
+      if (ssl_want_write(d->ssl_state)) {
+        d->ev_ready &= ~SOCKEV_WRITE;
         return 1;               /* Need to retry */
+      }
     } else {
 #endif
 #endif /* COMPILE_CONSOLE */
-      cnt = send(d->descriptor, cur->start, cur->nchars, 0);
+      cnt = send_queue(d, &want);
       if (cnt < 0) {
 #ifdef WIN32
         if (cnt == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK)
@@ -2253,7 +2263,11 @@ process_output(DESC *d)
         if (errno == EWOULDBLOCK)
 #endif
 #endif
+        {
+          /* Wait to hear that it's writable again */
+          d->ev_ready &= ~SOCKEV_WRITE;
           return 1;
+        }
         return 0;
       }
 #ifndef COMPILE_CONSOLE
@@ -2263,19 +2277,24 @@ process_output(DESC *d)
 #endif
     d->output_size -= cnt;
     d->output_chars += cnt;
-    if (cnt == cur->nchars) {
-      if (!cur->nxt)
-        d->output.tail = qp;
-      *qp = cur->nxt;
+    d->output_flushes++;
+    for (left = cnt; left > 0 && (cur = d->output.head) != NULL;) {
+      if (left < cur->nchars) {
+        cur->nchars -= left;
+        cur->start += left;
+        break;
+      }
+      left -= cur->nchars;
+      d->output.head = cur->nxt;
+      if (!d->output.head)
+        d->output.tail = &d->output.head;
 #ifdef DEBUG
       do_rawlog(LT_ERR, "free_text_block(0x%x) at 2.", cur);
 #endif                          /* DEBUG */
       free_text_block(cur);
-      continue;                 /* do not adv ptr */
     }
-    cur->nchars -= cnt;
-    cur->start += cnt;
-    break;
+    if (cnt < want)
+      break;                    /* The socket's full */
   }
   return 1;
 }
@@ -2620,6 +2639,7 @@ process_input(DESC *d, int output_ready __attribute__ ((__unused__)))
         return 0;
       } else if (ssl_need_handshake(d->ssl_state)) {
         /* We're still not ready to send to this connection. Alas. */
+        d->ev_ready = 0;
         return 1;
       }
     }
@@ -2634,6 +2654,7 @@ process_input(DESC *d, int output_ready __attribute__ ((__unused__)))
         return 0;
       } else if (ssl_need_accept(d->ssl_state)) {
         /* We're still not ready to send to this connection. Alas. */
+        d->ev_ready = 0;
         return 1;
       }
     }
@@ -2648,6 +2669,8 @@ process_input(DESC *d, int output_ready __attribute__ ((__unused__)))
       d->ssl_state = 0;
       return 0;
     }
+    if (got <= 0 || ssl_want_read(d->ssl_state))
+      d->ev_ready &= ~SOCKEV_READ;
   } else {
 #endif
 #endif /* COMPILE_CONSOLE */
@@ -2661,19 +2684,26 @@ process_input(DESC *d, int output_ready __attribute__ ((__unused__)))
     got = recv(d->descriptor, tbuf1, sizeof tbuf1, 0);
 #endif /* COMPILE_CONSOLE */
     if (got <= 0) {
-      /* At this point, select() says there's data waiting to be read from
-       * the socket, but we shouldn't assume that read() will actually get it
-       * and blindly act like a got of -1 is a disconnect-worthy error.
+      /* At this point, the event backend says there's data waiting to be
+       * read from the socket, but we shouldn't assume that read() will
+       * actually get it and blindly act like a got of -1 is a
+       * disconnect-worthy error.
        */
 #ifdef EAGAIN
       if ((errno == EWOULDBLOCK) || (errno == EAGAIN) || (errno == EINTR))
 #else
       if ((errno == EWOULDBLOCK) || (errno == EINTR))
 #endif
+      {
+        if (errno != EINTR)
+          d->ev_ready &= ~SOCKEV_READ;
         return 1;
-      else
+      } else
         return 0;
     }
+    /* A short read means we've emptied the socket for now */
+    if (got < (int) sizeof tbuf1)
+      d->ev_ready &= ~SOCKEV_READ;
 #ifndef COMPILE_CONSOLE
 #ifdef HAS_OPENSSL
   }
@@ -3447,12 +3477,14 @@ reaper(int sig __attribute__ ((__unused__)))
       if (WIFSIGNALED(my_stat)) {
         do_rawlog(LT_ERR, T("ERROR! forking dump exited with signal %d"),
                   WTERMSIG(my_stat));
+        checkpoint_failed();
       } else if (WIFEXITED(my_stat) && WEXITSTATUS(my_stat) == 0) {
         time(&globals.last_dump_time);
         if (DUMP_NOFORK_COMPLETE && *DUMP_NOFORK_COMPLETE)
           flag_broadcast(0, 0, "%s", DUMP_NOFORK_COMPLETE);
 
-      }
+      } else
+        checkpoint_failed();
       forked_dump_pid = -1;
     }
   }
@@ -5105,6 +5137,7 @@ close_ssl_connections(void)
   }
   /* Close server socket */
   ssl_close_connection(ssl_master_socket);
+  sockev_del(sslsock);
   shutdown(sslsock, 2);
   closesocket(sslsock);
   sslsock = 0;
@@ -5302,6 +5335,7 @@ load_reboot_db(void)
     }
     d->input_chars = 0;
     d->output_chars = 0;
+    d->output_flushes = 0;
     d->output_size = 0;
     d->output.head = 0;
     d->output.tail = &d->output.head;
@@ -5336,6 +5370,8 @@ load_reboot_db(void)
       d->next = descriptor_list;
       d->prev = NULL;
       descriptor_list = d;
+      d->ev_ready = SOCKEV_READ | SOCKEV_WRITE;
+      sockev_add(d->descriptor, SOCKEV_READ | SOCKEV_WRITE | SOCKEV_EDGE, d);
       if (d->connected && d->player && GoodObject(d->player) &&
           IsPlayer(d->player))
         set_flag_internal(d->player, "CONNECTED");
@@ -5557,6 +5593,7 @@ COMMAND(cmd_su) {
         did_it(player, Division(player), "SDOUT", NULL, NULL,  NULL, "ASDOUT", Location(player));
         add_to_div_exit_path(player, Division(player));
         Division(player) = target;
+        obj_index_update(player);
         /* triger did_it on incoming division.. to i guess set 'em for something.. *shrugs* */
         did_it(player, Division(player), "SDIN", tprintf("You have switched into Division: %s", object_header(player, Division(player)))
               , NULL,  NULL, "ASDIN", Location(player));
@@ -5668,6 +5705,7 @@ COMMAND(cmd_su) {
         /* Trigger ASDOUT */
         did_it(player, Division(player), "SDOUT", NULL, NULL,  NULL, "ASDOUT", Location(player));
         Division(player) = div_obj;
+        obj_index_update(player);
         /* Trigger SDIN */
         did_it(player, Division(player), "SDIN", tprintf("You have went back to your other division: %s", object_header(player, div_obj))
                  , NULL,  NULL, "ASDIN", Location(player));
@@ -5798,6 +5836,9 @@ do_reboot(dbref player, int flag)
   sql_shutdown();
   shutdown_queues();
   fork_and_dump(0);
+  /* A paranoid reboot should load the text dump it just checked */
+  if (!flag)
+    dump_hot_image();
 #ifndef PROFILING
 #ifndef WIN32
   /* Some broken libcs appear to retain the itimer across exec!
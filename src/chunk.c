@@ -222,6 +222,7 @@
 #include <io.h>
 #else
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 #include <errno.h>
 
@@ -238,6 +239,14 @@
 #pragma warning( disable : 4761)        /* disable warning re conversion */
 #endif
 
+#if !defined(WIN32) && !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#if !defined(WIN32) && defined(MAP_ANONYMOUS)
+/** Regions can be kept in one big mapping instead of a swap file. */
+#define CHUNK_MMAP
+#endif
+
 /* A whole bunch of debugging #defines. */
 /** Basic debugging stuff - are assertions checked? */
 #undef CHUNK_DEBUG
@@ -352,6 +361,23 @@ static int ignore;      /**< Used to shut up compiler warnings when not assertin
 /** Sentinel value used to mark unused cache regions. */
 #define INVALID_REGION_ID 0xffff
 
+/** Distance between regions in the chunk_mmap mapping.
+ * This is REGION_SIZE rounded up to a page boundary, so that each
+ * region can be given its own madvise() hints. */
+#define REGION_STRIDE 65536
+
+/** Regions with average derefs at or below this are advised cold
+ * under chunk_mmap. */
+#define COLD_REGION_DEREFS 16
+
+/** Regions with average derefs above this are advised hot under
+ * chunk_mmap. */
+#define HOT_REGION_DEREFS (CHUNK_DEREF_MAX / 2)
+
+/** How many regions are looked at for new madvise() hints after
+ * each round of migration. */
+#define ADVISE_REGIONS_PER_PASS 64
+
 /**
  * \verbatim
  * The chunk headers look like this:
@@ -548,8 +574,14 @@ typedef struct region {
                                            counts on period change! */
   RegionHeader *in_memory;      /**< cache entry; NULL if paged out */
   u_int_16 oddballs[NUM_ODDBALLS];      /**< chunk offsets with odd derefs */
+  unsigned char advice;         /**< last madvise() hint, with chunk_mmap */
 } Region;
 
+/* Region advice under chunk_mmap */
+#define ADVISED_NORMAL 0
+#define ADVISED_COLD 1
+#define ADVISED_HOT 2
+
 #define RegionDerefs(region) \
   (regions[(region)].used_count \
    ? (regions[(region)].total_derefs >> \
@@ -577,6 +609,34 @@ static int swap_fd_child = -1;
 #endif
 static char child_filename[300];
 
+/** With chunk_mmap, the start of the mapping that holds every region,
+ * which the kernel pages instead of us. NULL when using the swap file.
+ */
+static char *chunk_map = NULL;
+static u_int_16 advise_cursor;  /**< Next region to give hints for */
+static int stat_advise_cold;    /**< Number of regions advised cold */
+static int stat_advise_hot;     /**< Number of regions advised hot */
+
+/** One read in this many is recorded, and counts this many derefs.
+ * Must be a power of two. */
+#define READ_SAMPLE 4
+/** How many sampled reads are held before they're merged. */
+#define READ_LOG_SIZE 4096
+/** Sampled reads not yet added to the chunks' deref counts.
+ * Readers only append here, so region data isn't written between
+ * updates. Every update of the regions merges the log first, so the
+ * references in it are always to live chunks. */
+static chunk_reference_t read_log[READ_LOG_SIZE];
+static int read_log_count;      /**< Entries in read_log */
+static unsigned int read_tick;  /**< Reads seen, for sampling */
+static int count_reads = 1;     /**< Are reads being counted at all? */
+
+/** How many once-a-minute fragmentation samples are kept. */
+#define FRAG_HISTORY 16
+static int frag_history[FRAG_HISTORY];  /**< Fragmentation, newest first */
+static int frag_samples;        /**< Number of samples in frag_history */
+static time_t frag_next_sample; /**< When to take the next sample */
+
 /** Deref scale control.
  * When the deref counts get too big, the current period is incremented
  * and all derefs are divided by 2. */
@@ -614,6 +674,7 @@ static int stat_page_in;                /**< Number of page-ins */
 static int stat_migrate_slide;          /**< Number of slide migrations */
 static int stat_migrate_move;           /**< Number of move migrations */
 static int stat_migrate_away;           /**< Number of chunk evictions */
+static int stat_migrate_bytes;          /**< Bytes moved by migration */
 static int stat_create;                 /**< Number of chunk creations */
 static int stat_delete;                 /**< Number of chunk deletions */
 
@@ -636,6 +697,8 @@ static int noisy_log = 0;
  * Forward decls
  */
 static void find_oddballs(u_int_16 region);
+static void merge_reads(void);
+static void advise_regions(void);
 
 /*
  * Debug routines
@@ -1242,20 +1305,13 @@ read_cache_region(fd_type fd, RegionHeader * rhp, u_int_16 region)
 
   debug_log("read_cache_region %04x", region);
 
+#ifdef WIN32
   /* Try to seek up to 3 times... */
   for (j = 0; j < 3; j++)
-#ifdef WIN32
     if (SetFilePointer(fd, file_offset, NULL, FILE_BEGIN) == file_offset)
       break;
-#else
-    if (lseek(fd, file_offset, SEEK_SET) == file_offset)
-      break;
-#endif
   if (j >= 3)
-#ifdef WIN32
     mush_panicf("chunk swap file seek, GetLastError %d", GetLastError());
-#else
-    mush_panicf("chunk swap file seek, errno %d: %s", errno, strerror(errno));
 #endif
   pos = (char *) rhp;
   remaining = REGION_SIZE;
@@ -1267,7 +1323,10 @@ read_cache_region(fd_type fd, RegionHeader * rhp, u_int_16 region)
     }
 #endif
 #else
-    done = read(fd, pos, remaining);
+    /* Positioned reads and writes leave the file offset alone, so
+     * processes sharing the descriptor (sharded dumps) can't upset
+     * each other's seeks. */
+    done = pread(fd, pos, remaining, file_offset + (pos - (char *) rhp));
 #endif
     if (done >= 0) {
       remaining -= done;
@@ -1305,20 +1364,13 @@ write_cache_region(fd_type fd, RegionHeader * rhp, u_int_16 region)
 
   debug_log("write_cache_region %04x", region);
 
+#ifdef WIN32
   /* Try to seek up to 3 times... */
   for (j = 0; j < 3; j++)
-#ifdef WIN32
     if (SetFilePointer(fd, file_offset, NULL, FILE_BEGIN) == file_offset)
       break;
-#else
-    if (lseek(fd, file_offset, SEEK_SET) == file_offset)
-      break;
-#endif
   if (j >= 3)
-#ifdef WIN32
     mush_panicf("chunk swap file seek, GetLastError %d", GetLastError());
-#else
-    mush_panicf("chunk swap file seek, errno %d: %s", errno, strerror(errno));
 #endif
   pos = (char *) rhp;
   remaining = REGION_SIZE;
@@ -1332,7 +1384,7 @@ write_cache_region(fd_type fd, RegionHeader * rhp, u_int_16 region)
     done = write(fd, pos, remaining);
 #endif
 #else
-    done = write(fd, pos, remaining);
+    done = pwrite(fd, pos, remaining, file_offset + (pos - (char *) rhp));
 #endif
     if (done >= 0) {
       remaining -= done;
@@ -1362,6 +1414,10 @@ touch_cache_region(RegionHeader * rhp)
 {
   debug_log("touch_cache_region %04x", rhp->region_id);
 
+  /* Mapped regions aren't cached by us. Linking them would write to
+   * the headers of other regions, and fault them in. */
+  if (chunk_map)
+    return;
   if (cache_head == rhp)
     return;
   if (cache_tail == rhp)
@@ -1430,6 +1486,40 @@ find_available_cache_region(void)
   return rhp;
 }
 
+/** Bring the deref counts of an in-memory region up to date.
+ * Regions that weren't in memory at a period change are halved
+ * (once per period missed) when they are next used.
+ * \param region the region to update.
+ */
+static void
+update_region_derefs(u_int_16 region)
+{
+  Region *rp = regions + region;
+  u_int_32 offset;
+  unsigned int shift;
+
+  if (rp->period_last_touched == curr_period)
+    return;
+  shift = curr_period - rp->period_last_touched;
+  if (shift > 8) {
+    rp->total_derefs = 0;
+    for (offset = FIRST_CHUNK_OFFSET_IN_REGION;
+         offset < REGION_SIZE; offset += ChunkFullLen(region, offset)) {
+      ChunkDerefs(region, offset) = 0;
+    }
+  } else {
+    rp->total_derefs = 0;
+    for (offset = FIRST_CHUNK_OFFSET_IN_REGION;
+         offset < REGION_SIZE; offset += ChunkFullLen(region, offset)) {
+      if (ChunkIsFree(region, offset))
+        continue;
+      ChunkDerefs(region, offset) >>= shift;
+      rp->total_derefs += ChunkDerefs(region, offset);
+    }
+  }
+  rp->period_last_touched = curr_period;
+}
+
 /** Bring a paged out region back into memory.
  * If neccessary, make room by paging another region out.
  * \param region the region to bring in.
@@ -1439,14 +1529,17 @@ bring_in_region(u_int_16 region)
 {
   Region *rp = regions + region;
   RegionHeader *rhp, *prev, *next;
-  u_int_32 offset;
-  unsigned int shift;
 
   debug_log("bring_in_region %04x", region);
 
   ASSERT(region < region_count);
-  if (rp->in_memory)
+  if (rp->in_memory) {
+    /* Mapped regions are never paged out by us, so they catch up
+     * with period changes the first time they're used after one. */
+    if (chunk_map)
+      update_region_derefs(region);
     return;
+  }
   rhp = find_available_cache_region();
   ASSERT(rhp->region_id == INVALID_REGION_ID);
 
@@ -1469,32 +1562,140 @@ bring_in_region(u_int_16 region)
   touch_cache_region(rhp);
 
   /* make derefs current */
-  if (rp->period_last_touched != curr_period) {
-    shift = curr_period - rp->period_last_touched;
-    if (shift > 8) {
-      rp->total_derefs = 0;
-      for (offset = FIRST_CHUNK_OFFSET_IN_REGION;
-           offset < REGION_SIZE; offset += ChunkFullLen(region, offset)) {
-        ChunkDerefs(region, offset) = 0;
-      }
-    } else {
-      rp->total_derefs = 0;
-      for (offset = FIRST_CHUNK_OFFSET_IN_REGION;
-           offset < REGION_SIZE; offset += ChunkFullLen(region, offset)) {
-        if (ChunkIsFree(region, offset))
-          continue;
-        ChunkDerefs(region, offset) >>= shift;
-        rp->total_derefs += ChunkDerefs(region, offset);
-      }
-    }
-    rp->period_last_touched = curr_period;
-  }
+  update_region_derefs(region);
 
   /* keep statistics */
   stat_page_in++;
   stat_paging_histogram[RegionDerefs(region)]++;
 }
 
+/** Get a region ready to be read from.
+ * Unlike bring_in_region(), this doesn't write to a mapped region;
+ * its deref counts are left to catch up when it's next changed.
+ * \param region the region to read.
+ */
+static void
+read_region(u_int_16 region)
+{
+  if (chunk_map)
+    return;
+  bring_in_region(region);
+  touch_cache_region(regions[region].in_memory);
+}
+
+/** Add the sampled reads to the deref counts of their chunks. */
+static void
+merge_reads(void)
+{
+  u_int_16 region, offset;
+  unsigned int derefs;
+  int j;
+
+  for (j = 0; j < read_log_count; j++) {
+    region = ChunkReferenceToRegion(read_log[j]);
+    offset = ChunkReferenceToOffset(read_log[j]);
+    bring_in_region(region);
+    derefs = ChunkDerefs(region, offset);
+    if (derefs >= CHUNK_DEREF_MAX)
+      continue;
+    derefs += READ_SAMPLE;
+    if (derefs >= CHUNK_DEREF_MAX) {
+      derefs = CHUNK_DEREF_MAX;
+      stat_deref_maxxed++;
+    }
+    regions[region].total_derefs += derefs - ChunkDerefs(region, offset);
+    ChunkDerefs(region, offset) = derefs;
+  }
+  read_log_count = 0;
+}
+
+/** Pass the deref counts of some mapped regions on to the kernel.
+ * Regions that are rarely used are advised cold, so they're the
+ * first to be paged out, and the busiest ones are asked for, so
+ * they're paged back in ahead of use. A few regions are looked at
+ * each time, and madvise() is only called when the advice changes.
+ */
+static void
+advise_regions(void)
+{
+#ifdef CHUNK_MMAP
+  Region *rp;
+  int j, derefs, advice;
+
+  for (j = 0; j < ADVISE_REGIONS_PER_PASS && region_count; j++) {
+    if (advise_cursor >= region_count)
+      advise_cursor = 0;
+    rp = regions + advise_cursor;
+    derefs = RegionDerefs(advise_cursor);
+    if (!rp->used_count || derefs <= COLD_REGION_DEREFS)
+      advice = ADVISED_COLD;
+    else if (derefs > HOT_REGION_DEREFS)
+      advice = ADVISED_HOT;
+    else
+      advice = ADVISED_NORMAL;
+    if (advice != rp->advice) {
+      switch (advice) {
+      case ADVISED_COLD:
+#ifdef MADV_COLD
+        madvise(rp->in_memory, REGION_STRIDE, MADV_COLD);
+#endif
+        stat_advise_cold++;
+        break;
+      case ADVISED_HOT:
+        madvise(rp->in_memory, REGION_STRIDE, MADV_WILLNEED);
+        stat_advise_hot++;
+        break;
+      default:
+        madvise(rp->in_memory, REGION_STRIDE, MADV_NORMAL);
+        break;
+      }
+      rp->advice = advice;
+    }
+    advise_cursor++;
+  }
+#endif
+}
+
+/** Count the mapped regions that are at least partly in memory.
+ * \param pages set to the number of pages in memory.
+ * \return the number of regions with pages in memory.
+ */
+static int
+resident_regions(int *pages)
+{
+  int count = 0;
+#ifdef CHUNK_MMAP
+  static unsigned char *vec = NULL;
+  static size_t pagesize = 0;
+  size_t npages, k;
+  u_int_16 region;
+  int any;
+
+  *pages = 0;
+  if (!pagesize) {
+    pagesize = sysconf(_SC_PAGESIZE);
+    vec = mush_malloc(REGION_STRIDE / pagesize + 1, "chunk mincore vector");
+    if (!vec)
+      mush_panic("chunk mincore vector allocation failure");
+  }
+  npages = (REGION_STRIDE + pagesize - 1) / pagesize;
+  for (region = 0; region < region_count; region++) {
+    if (mincore(regions[region].in_memory, REGION_STRIDE, (void *) vec) < 0)
+      continue;
+    any = 0;
+    for (k = 0; k < npages; k++)
+      if (vec[k] & 1) {
+        (*pages)++;
+        any = 1;
+      }
+    count += any;
+  }
+#else
+  *pages = 0;
+#endif
+  return count;
+}
+
 /*
  * Utility Routines - Regions
  */
@@ -1532,8 +1733,15 @@ create_region(void)
   regions[region].largest_free_chunk = regions[region].free_bytes;
   regions[region].total_derefs = 0;
   regions[region].period_last_touched = curr_period;
-  if (!regions[region].in_memory)
-    regions[region].in_memory = find_available_cache_region();
+  if (!regions[region].in_memory) {
+    if (chunk_map) {
+      regions[region].in_memory =
+        (RegionHeader *) (chunk_map + (size_t) region * REGION_STRIDE);
+      regions[region].advice = ADVISED_NORMAL;
+      cached_region_count++;
+    } else
+      regions[region].in_memory = find_available_cache_region();
+  }
   regions[region].in_memory->region_id = region;
   regions[region].in_memory->first_free = FIRST_CHUNK_OFFSET_IN_REGION;
   write_free_chunk(region, FIRST_CHUNK_OFFSET_IN_REGION,
@@ -1734,6 +1942,7 @@ static void
 chunk_statistics(dbref player)
 {
   const char *s;
+  char trend[100];
   int overhead;
   int free_count = 0;
   int free_bytes = 0;
@@ -1784,22 +1993,42 @@ chunk_statistics(dbref player)
   overhead = region_count * REGION_SIZE + region_array_len * sizeof(Region);
   STAT_OUT(tprintf("Storage:   %10d total (%2d%% saturation)",
                    overhead, used_bytes * 100 / overhead));
-  STAT_OUT(tprintf("Regions:   %10d total, %8d cached",
-                   region_count, cached_region_count));
-  STAT_OUT(tprintf("Paging:    %10d out, %10d in",
-                   stat_page_out, stat_page_in));
+  if (chunk_map) {
+    int pages, resident;
+
+    resident = resident_regions(&pages);
+    STAT_OUT(tprintf("Regions:   %10d mapped, %8d resident (%d KB)",
+                     region_count, resident,
+                     (int) (pages * (sysconf(_SC_PAGESIZE) / 1024))));
+    STAT_OUT(tprintf("Advice:    %10d cold, %10d hot",
+                     stat_advise_cold, stat_advise_hot));
+  } else {
+    STAT_OUT(tprintf("Regions:   %10d total, %8d cached",
+                     region_count, cached_region_count));
+    STAT_OUT(tprintf("Paging:    %10d out, %10d in",
+                     stat_page_out, stat_page_in));
+  }
   STAT_OUT(" ");
   STAT_OUT(tprintf("Period:    %10d (%10d accesses so far, %10d chunks at max)",
                    curr_period, stat_deref_count, stat_deref_maxxed));
   STAT_OUT(tprintf("Activity:  %10d creates, %10d deletes this period",
                    stat_create, stat_delete));
-  STAT_OUT(tprintf("Migration: %10d moves this period",
-                   stat_migrate_slide + stat_migrate_move));
+  STAT_OUT(tprintf("Migration: %10d moves this period (%d bytes)",
+                   stat_migrate_slide + stat_migrate_move,
+                   stat_migrate_bytes));
   STAT_OUT(tprintf("             %10d slide    %10d move",
                    stat_migrate_slide, stat_migrate_move));
   STAT_OUT(tprintf("             %10d in region%10d out of region",
                    stat_migrate_slide + stat_migrate_move - stat_migrate_away,
                    stat_migrate_away));
+  trend[0] = '\0';
+  if (frag_samples > 5)
+    sprintf(trend, ", %d%% 5 minutes ago", frag_history[5]);
+  if (frag_samples > 15)
+    sprintf(trend + strlen(trend), ", %d%% 15 minutes ago", frag_history[15]);
+  STAT_OUT(tprintf("Fragments: %9d%% of free space now%s",
+                   free_bytes ? (free_bytes - free_large) * 100 / free_bytes
+                   : 0, trend));
 }
 
 /** Show just the page counts.
@@ -1998,6 +2227,7 @@ migrate_slide(u_int_16 region, u_int_16 offset, int which)
   }
 
   stat_migrate_slide++;
+  stat_migrate_bytes += o_len;
 
 #ifdef CHUNK_PARANOID
   if (!region_is_valid(region)) {
@@ -2066,6 +2296,7 @@ migrate_move(u_int_16 region, u_int_16 offset, int which, int align)
   free_chunk(s_reg, s_off);
 
   stat_migrate_move++;
+  stat_migrate_bytes += s_len;
 
 #ifdef CHUNK_PARANOID
   if (!region_is_valid(region)) {
@@ -2156,6 +2387,7 @@ void
 chunk_delete(chunk_reference_t reference)
 {
   u_int_16 region, offset;
+  merge_reads();
   region = ChunkReferenceToRegion(reference);
   offset = ChunkReferenceToOffset(reference);
   ASSERT(region < region_count);
@@ -2190,20 +2422,20 @@ chunk_fetch(chunk_reference_t reference,
   region = ChunkReferenceToRegion(reference);
   offset = ChunkReferenceToOffset(reference);
   ASSERT(region < region_count);
-  bring_in_region(region);
+  read_region(region);
 #ifdef CHUNK_PARANOID
   verify_used_chunk(region, offset);
 #endif
   len = ChunkLen(region, offset);
   if (len <= buffer_len)
     memcpy(buffer, ChunkDataPtr(region, offset), len);
-  touch_cache_region(regions[region].in_memory);
-  stat_deref_count++;
-  if (ChunkDerefs(region, offset) < CHUNK_DEREF_MAX) {
-    ChunkDerefs(region, offset)++;
-    regions[region].total_derefs++;
-    if (ChunkDerefs(region, offset) == CHUNK_DEREF_MAX)
-      stat_deref_maxxed++;
+  if (count_reads) {
+    stat_deref_count++;
+    if (!(++read_tick & (READ_SAMPLE - 1))) {
+      if (read_log_count >= READ_LOG_SIZE)
+        merge_reads();
+      read_log[read_log_count++] = reference;
+    }
   }
   return len;
 }
@@ -2231,14 +2463,35 @@ unsigned char
 chunk_derefs(chunk_reference_t reference)
 {
   u_int_16 region, offset;
+  unsigned int shift;
   region = ChunkReferenceToRegion(reference);
   offset = ChunkReferenceToOffset(reference);
   ASSERT(region < region_count);
-  bring_in_region(region);
+  read_region(region);
 #ifdef CHUNK_PARANOID
   verify_used_chunk(region, offset);
 #endif
-  return ChunkDerefs(region, offset);
+  /* A mapped region may not have caught up with the period yet */
+  shift = curr_period - regions[region].period_last_touched;
+  return shift > 8 ? 0 : ChunkDerefs(region, offset) >> shift;
+}
+
+/** Measure how fragmented the free space is.
+ * Free space outside the largest hole in its region can only take
+ * small chunks, so it counts as fragmented. Migration fills it in.
+ * \return the percentage of free space that is fragmented.
+ */
+int
+chunk_fragmentation(void)
+{
+  int free_bytes = 0, free_large = 0;
+  u_int_16 rid;
+
+  for (rid = 0; rid < region_count; rid++) {
+    free_bytes += regions[rid].free_bytes;
+    free_large += regions[rid].largest_free_chunk;
+  }
+  return free_bytes ? (free_bytes - free_large) * 100 / free_bytes : 0;
 }
 
 /** Migrate allocated chunks around.
@@ -2256,6 +2509,8 @@ chunk_migration(int count, chunk_reference_t ** references)
 
   debug_log("*** chunk_migration starts, count = %d", count);
 
+  merge_reads();
+
   /* Before everything, see if we need a new period. */
   total = 0;
   for (region = 0; region < region_count; region++) {
@@ -2303,6 +2558,18 @@ chunk_migration(int count, chunk_reference_t ** references)
   m_references = NULL;
   m_count = 0;
 
+  if (chunk_map)
+    advise_regions();
+
+  if (mudtime >= frag_next_sample) {
+    memmove(frag_history + 1, frag_history,
+            (FRAG_HISTORY - 1) * sizeof frag_history[0]);
+    frag_history[0] = chunk_fragmentation();
+    if (frag_samples < FRAG_HISTORY)
+      frag_samples++;
+    frag_next_sample = mudtime + 60;
+  }
+
   debug_log("*** chunk_migration ends", count);
 }
 
@@ -2340,9 +2607,33 @@ chunk_init(void)
   if (swap_fd == INVALID_HANDLE_VALUE)
     mush_panicf("Cannot open swap file: %d", GetLastError());
 #else
-  swap_fd = open(CHUNK_SWAP_FILE, O_RDWR | O_TRUNC | O_CREAT, 0600);
-  if (swap_fd < 0)
-    mush_panicf("Cannot open swap file: %s", strerror(errno));
+#ifdef CHUNK_MMAP
+  if (options.chunk_mmap) {
+    /* Room for every possible region; pages are only allocated as
+     * they're touched, and a forked dump shares them copy-on-write. */
+    chunk_map = mmap(NULL, (size_t) INVALID_REGION_ID * REGION_STRIDE,
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS
+#ifdef MAP_NORESERVE
+                     | MAP_NORESERVE
+#endif
+                     , -1, 0);
+    if (chunk_map == MAP_FAILED) {
+      do_rawlog(LT_ERR, "CHUNK: Unable to map attribute storage (%s), "
+                "using %s instead", strerror(errno), CHUNK_SWAP_FILE);
+      chunk_map = NULL;
+    }
+  }
+#else
+  if (options.chunk_mmap)
+    do_rawlog(LT_ERR, "CHUNK: chunk_mmap isn't supported here, using %s",
+              CHUNK_SWAP_FILE);
+#endif
+  if (!chunk_map) {
+    swap_fd = open(CHUNK_SWAP_FILE, O_RDWR | O_TRUNC | O_CREAT, 0600);
+    if (swap_fd < 0)
+      mush_panicf("Cannot open swap file: %s", strerror(errno));
+  }
 #endif
   curr_period = 0;
 
@@ -2412,6 +2703,8 @@ chunk_new_period(void)
   u_int_16 region, offset;
   int shift;
 
+  merge_reads();
+
 #ifdef LOG_CHUNK_STATS
   /* Log stats */
   chunk_statistics(NOTHING);
@@ -2424,10 +2717,12 @@ chunk_new_period(void)
   stat_migrate_slide = 0;
   stat_migrate_move = 0;
   stat_migrate_away = 0;
+  stat_migrate_bytes = 0;
   stat_create = 0;
   stat_delete = 0;
 
-  /* make derefs current */
+  /* make derefs current; with chunk_mmap, the cache list is empty
+   * and regions are brought up to date as they're used. */
   for (rhp = cache_head; rhp; rhp = rhp->next) {
     region = rhp->region_id;
     if (region == INVALID_REGION_ID)
@@ -2515,6 +2810,9 @@ chunk_fork_parent(void)
 void
 chunk_fork_child(void)
 {
+  /* The child's deref counts are thrown away when it exits, and
+   * keeping them would only unshare pages. */
+  count_reads = 0;
   if (swap_fd_child < 0)
     return;
 
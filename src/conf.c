@@ -80,6 +80,10 @@ COBRA_CONF conftable[] = {
    sizeof options.uncompressprog, 0,
    "files"}
   ,
+  {"compress_builtin", cf_bool, &options.compress_builtin, 2, 0, "files"}
+  ,
+  {"compress_level", cf_int, &options.compress_level, 9, 0, "files"}
+  ,
   {"access_file", cf_str, options.access_file, sizeof options.access_file, 0,
    "files"}
   ,
@@ -216,6 +220,14 @@ COBRA_CONF conftable[] = {
 
   {"forking_dump", cf_bool, &options.forking_dump, 2, 0, "dump"}
   ,
+  {"binary_dump", cf_bool, &options.binary_dump, 2, 0, "dump"}
+  ,
+  {"dump_shards", cf_int, &options.dump_shards, 64, 0, "dump"}
+  ,
+  {"dump_journals", cf_int, &options.dump_journals, 1000, 0, "dump"}
+  ,
+  {"hot_restart", cf_bool, &options.hot_restart, 2, 0, "dump"}
+  ,
   {"dump_message", cf_str, options.dump_message, sizeof options.dump_message, 0,
    "dump"}
   ,
@@ -328,6 +340,16 @@ COBRA_CONF conftable[] = {
   {"active_queue_chunk", cf_int, &options.active_q_chunk, 100000, 0,
    "limits"}
   ,
+  {"queue_slice", cf_int, &options.queue_slice, 10000, 0, "limits"}
+  ,
+  {"active_queue_slice", cf_int, &options.active_q_slice, 10000, 0,
+   "limits"}
+  ,
+  {"queue_weight", cf_int, &options.queue_weight, 1000, 0, "limits"}
+  ,
+  {"queue_admin_weight", cf_int, &options.queue_admin_weight, 1000, 0,
+   "limits"}
+  ,
   {"function_recursion_limit", cf_int, &options.func_nest_lim, 100000, 0,
    "limits"}
   ,
@@ -337,6 +359,15 @@ COBRA_CONF conftable[] = {
   {"call_limit", cf_int, &options.call_lim, 1000000, 0,
    "limits"}
   ,
+  {"compiled_attribute_cache", cf_int, &options.pcode_cache, 100000, 0,
+   "limits"}
+  ,
+  {"regexp_cache", cf_int, &options.regexp_cache, 100000, 0,
+   "limits"}
+  ,
+  {"attribute_value_cache", cf_int, &options.attr_value_cache, 2000000000,
+   0, "limits"}
+  ,
   {"player_name_len", cf_int, &options.player_name_len, BUFFER_LEN, 0,
    "limits"}
   ,
@@ -486,9 +517,14 @@ COBRA_CONF conftable[] = {
   {"chunk_cache_memory", cf_int, &options.chunk_cache_memory,
    1000000000, 65510 * 2, "files"}
   ,
+  {"chunk_mmap", cf_bool, &options.chunk_mmap, 2, 0, "files"}
+  ,
   {"chunk_migrate", cf_int, &options.chunk_migrate_amount, 100000, 0,
    "limits"}
   ,
+  {"chunk_migrate_time", cf_int, &options.chunk_migrate_time, 1000, 0,
+   "limits"}
+  ,
 #ifdef HAS_OPENSSL
   {"ssl_private_key_file", cf_str, options.ssl_private_key_file,
    sizeof options.ssl_private_key_file, 0, "files"}
@@ -1090,6 +1126,10 @@ conf_default_set(void)
   options.player_queue_limit = 100;
   options.queue_chunk = 3;
   options.active_q_chunk = 0;
+  options.queue_slice = 0;
+  options.active_q_slice = 0;
+  options.queue_weight = 1;
+  options.queue_admin_weight = 4;
   options.func_nest_lim = 50;
   options.func_invk_lim = 2500;
   options.call_lim = 0;
@@ -1108,6 +1148,8 @@ conf_default_set(void)
   strcpy(options.uncompressprog, "uncompress");
   strcpy(options.compresssuff, ".Z");
 #endif                          /* WIN32 */
+  options.compress_builtin = 0;
+  options.compress_level = 6;
   strcpy(options.connect_file[0], "txt/connect.txt");
   strcpy(options.motd_file[0], "txt/motd.txt");
   strcpy(options.newuser_file[0], "txt/newuser.txt");
@@ -1171,6 +1213,10 @@ conf_default_set(void)
   options.player_name_spaces = 0;
   options.max_aliases = 3;
   options.forking_dump = 1;
+  options.binary_dump = 0;
+  options.dump_shards = 1;
+  options.dump_journals = 0;
+  options.hot_restart = 1;
   options.restrict_building = 0;
   options.free_objects = 1;
   options.flags_on_examine = 1;
@@ -1209,9 +1255,14 @@ conf_default_set(void)
   options.queue_entry_cpu_time = 1500;
   options.ascii_names = 1;
   options.call_lim = 10000;
+  options.pcode_cache = 512;
+  options.regexp_cache = 256;
+  options.attr_value_cache = 1000000;
   strcpy(options.chunk_swap_file, "data/chunkswap");
   options.chunk_cache_memory = 1000000;
+  options.chunk_mmap = 0;
   options.chunk_migrate_amount = 50;
+  options.chunk_migrate_time = 10;
   options.read_remote_desc = 0;
 #ifdef HAS_OPENSSL
   strcpy(options.ssl_private_key_file, "");
@@ -1390,6 +1441,14 @@ config_file_startup(const char *conf, int restrictions)
     *options.compressprog = 0;
     *options.compresssuff = 0;
 
+#endif
+#ifndef BUILTIN_COMPRESSION
+    if (options.compress_builtin) {
+      do_rawlog(LT_ERR,
+                T
+                ("CONFIG: compress_builtin needs zlib, which this MUSH was built without. Using compress_program instead."));
+      options.compress_builtin = 0;
+    }
 #endif
 
   }
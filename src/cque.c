@@ -37,13 +37,26 @@
 #include "confmagic.h"
 
 
-#define MAX_QID 16384
+#define MAX_QID 65536
 
 extern dbref global_parent_depth[1];
 EVAL_CONTEXT global_eval_context;
 
-enum qid_flags qid_table[MAX_QID];      /**< List of flagged qids. */
-int  qid_cnt;                   /**< What QID we're at */
+/** Where a queue entry currently lives. */
+enum bque_where {
+  QW_NONE,                      /**< Dequeued and executing, or being freed */
+  QW_READY,                     /**< On the player or object queue */
+  QW_WAIT,                      /**< Waiting on a timer */
+  QW_SEM                        /**< Blocked on a semaphore */
+};
+
+/** Which timer structure holds a queue entry. */
+enum bque_timer {
+  QT_NONE,                      /**< Not timed */
+  QT_WAIT,                      /**< On the wait heap */
+  QT_SEM,                       /**< On the semaphore timeout heap */
+  QT_FROZEN                     /**< Frozen; its time is pushed back each second */
+};
 
 /** A queue entry.
  * This structure reprsents a queue entry on a linked list of queue
@@ -51,7 +64,15 @@ int  qid_cnt;                   /**< What QID we're at */
  */
 typedef struct bque {
   struct bque *next;                    /**< pointer to next entry on queue */
+  struct bque *prev;            /**< previous entry on the player or semaphore queue */
+  struct bque *rnext;           /**< next entry of the same owner on the player queue */
+  struct bque *rprev;           /**< previous entry of the same owner on the player queue */
+  struct bque *anext;           /**< next entry on the same object/attribute */
+  struct bque *aprev;           /**< previous entry on the same object/attribute */
+  struct bque *onext;           /**< next entry on the same semaphore object */
+  struct bque *oprev;           /**< previous entry on the same semaphore object */
   dbref player;                 /**< player who will do command */
+  dbref owner;                  /**< owner of player, for scheduling */
   dbref queued;                 /**< object whose QUEUE gets incremented for this command */
   dbref cause;                  /**< player causing command (for %N) */
   dbref realcause;              /** most of the time same as cause.. except for divisions. */
@@ -67,12 +88,68 @@ typedef struct bque {
 #endif
   char fqueued;                 /**< function inserted into queue  */
   enum qid_flags qid; /**<  queue identification # */
-  HASHTAB namedregs;
+  enum qid_flags state;         /**< QID_ACTIVE or QID_FREEZE */
+  enum bque_where where;        /**< Which queue it is on */
+  enum bque_timer timer;        /**< Which timer structure it is on */
+  int heap;                     /**< Index into that timer structure */
+  unsigned long seq;            /**< Breaks ties between equal times */
+  unsigned long order;          /**< Order it was put on the semaphore queue */
+  int nregs;                    /**< Number of named registers */
+  char *regs;                   /**< Named registers, as name/value pairs */
+  int arena;                    /**< Size class of the entry, or -1 */
 } BQUE;
 
-static BQUE *qfirst = NULL, *qlast = NULL, *qwait = NULL;
+/** A growable array of queue entries.
+ * Used as a binary min-heap on (left, seq) for the timers, and as a
+ * plain unordered array for frozen entries.
+ */
+typedef struct bque_heap {
+  BQUE **list;                  /**< The entries */
+  int count;                    /**< Number in use */
+  int size;                     /**< Number allocated */
+} BQUE_HEAP;
+
+/** The entries blocked on one semaphore object/attribute, or on any
+ * attribute of one object, in the order they were queued.
+ */
+typedef struct bque_semlist {
+  BQUE *head;                   /**< Oldest entry */
+  BQUE *tail;                   /**< Newest entry */
+} BQUE_SEMLIST;
+
+/** An owner's share of the player queue.
+ * When the queue is time-sliced, owners with commands ready take turns
+ * in a ring, each running commands until it has used up its turn.
+ */
+typedef struct queue_owner {
+  BQUE *head;                   /**< Its oldest entry on the player queue */
+  BQUE *tail;                   /**< Its newest entry on the player queue */
+  dbref rnext;                  /**< Next owner in the ring, or NOTHING */
+  dbref rprev;                  /**< Previous owner in the ring, or NOTHING */
+  long credit;                  /**< Usecs left in its turn, may be negative */
+  unsigned long runs;           /**< Commands run since startup */
+  double secs;                  /**< Seconds spent running them */
+} QUEUE_OWNER;
+
+/** Usecs of turn per point of queue_weight */
+#define QUEUE_QUANTUM 1000L
+
+static BQUE *qfirst = NULL, *qlast = NULL;
 static BQUE *qlfirst = NULL, *qllast = NULL;
 static BQUE *qsemfirst = NULL, *qsemlast = NULL;
+static BQUE_HEAP qwait = { NULL, 0, 0 };        /**< Timed waits */
+static BQUE_HEAP qsemtime = { NULL, 0, 0 };     /**< Semaphore timeouts */
+static BQUE_HEAP qfrozen = { NULL, 0, 0 };      /**< Frozen timed entries */
+static HASHTAB qsemlists;       /**< "#obj/ATTR" and "#obj" to BQUE_SEMLIST */
+static unsigned long qseq = 0;  /**< Last seq/order handed out */
+static QUEUE_OWNER *qowners = NULL;     /**< Indexed by owner dbref */
+static int qowners_size = 0;    /**< Number of qowners allocated */
+static dbref qturn = NOTHING;   /**< Owner whose turn it is */
+static int qturn_started = 0;   /**< Has qturn been given its turn yet? */
+
+static BQUE *qid_entry[MAX_QID];        /**< Queue entry holding each qid */
+static unsigned int qid_used[MAX_QID / 32];     /**< Bitmap of qids in use */
+static unsigned int qid_full[MAX_QID / 1024];   /**< Bitmap of full qid_used words */
 
 static int add_to_generic(dbref player, int am, const char *name, int flags);
 static int add_to(dbref player, int am);
@@ -89,10 +166,33 @@ int que_next(void);
 static void show_queue(dbref player, dbref victim, int q_type,
                        int q_quiet, int q_all, BQUE *q_ptr, int *tot, int *self,
                        int *del);
-static void check_qsigs(BQUE **qchk);
+static void show_wait_queue(dbref player, dbref victim, int q_quiet,
+                            int q_all, int *tot, int *self, int *del);
+static void show_entry(dbref player, dbref victim, int q_type, int q_quiet,
+                       int q_all, BQUE *tmp, int *tot, int *self, int *del);
 static void do_raw_restart(dbref victim);
 static int waitable_attr(dbref thing, const char *atr);
 static void shutdown_a_queue(BQUE **head, BQUE **tail);
+static void ready_entry(BQUE *entry);
+static int bque_before(BQUE *a, BQUE *b);
+static void heap_add(BQUE_HEAP *h, BQUE *entry, enum bque_timer timer);
+static void heap_sift_up(BQUE_HEAP *h, int i);
+static void heap_sift_down(BQUE_HEAP *h, int i);
+static BQUE *heap_remove(BQUE_HEAP *h, int i);
+static void timer_set(BQUE *entry);
+static void timer_clear(BQUE *entry);
+static BQUE_SEMLIST *semlist_get(dbref thing, const char *aname, int create);
+static void semlist_add(BQUE *entry);
+static void semlist_remove(BQUE *entry);
+static int order_cmp(const void *a, const void *b);
+static BQUE *new_qentry(const char *command, const char *semattr);
+static void release_qentry(BQUE *entry);
+static QUEUE_OWNER *queue_owner(dbref owner);
+static void qowner_add(BQUE *entry);
+static void qready_remove(BQUE *entry);
+static BQUE *qready_next(void);
+static int run_queue(int ncom, long usecs);
+static void run_qentry(BQUE *entry);
 
 extern sig_atomic_t cpu_time_limit_hit; /**< Have we used too much CPU? */
 
@@ -103,29 +203,40 @@ extern sig_atomic_t cpu_time_limit_hit; /**< Have we used too much CPU? */
 
 
 void init_qids() {
-        int i;
-
         /* set whole thing to NULL */
-        for(i = 0; i < MAX_QID; i++)
-                qid_table[i] = QID_FALSE;
-        qid_table[MAX_QID] = '\0';
-        qid_cnt = 0;
+        memset(qid_entry, 0, sizeof qid_entry);
+        memset(qid_used, 0, sizeof qid_used);
+        memset(qid_full, 0, sizeof qid_full);
+        hashinit(&qsemlists, 256, sizeof(BQUE_SEMLIST));
 }
 
-int create_qid() { /* find an unused QID */
-        int i;
+int create_qid() { /* find the lowest unused QID */
+        int i, w, b;
 
-        for(i = 0; i < MAX_QID; i++)
-                if(qid_table[i] == QID_FALSE)
+        for(i = 0; i < MAX_QID / 1024; i++)
+                if(qid_full[i] != ~0U)
                         break;
         /* No Good QID */
-        if(qid_table[i] != QID_FALSE || i == MAX_QID)
+        if(i == MAX_QID / 1024)
                 return -1;
-        if(i > qid_cnt) /* set this so we don't go too high looking for a qid */
-                qid_cnt = i;
+        for(w = i * 32; qid_used[w] == ~0U; w++)
+                ;
+        for(b = 0; qid_used[w] & (1U << b); b++)
+                ;
         /* flag the QID entry & return it */
-        qid_table[i] = QID_ACTIVE;
-        return i;
+        qid_used[w] |= 1U << b;
+        if(qid_used[w] == ~0U)
+                qid_full[w / 32] |= 1U << (w % 32);
+        return w * 32 + b;
+}
+
+/* Give a qid back to create_qid() */
+static void
+release_qid(int qid)
+{
+  qid_entry[qid] = NULL;
+  qid_used[qid / 32] &= ~(1U << (qid % 32));
+  qid_full[qid / 1024] &= ~(1U << ((qid / 32) % 32));
 }
 
 /* Returns true if the attribute on thing can be used as a semaphore.
@@ -176,10 +287,22 @@ add_to_generic(dbref player, int am, const char *name, int flags)
   return (num);
 }
 
+/* The count lives in the object itself; the QUEUE attribute is kept
+ * as a copy of it for softcode to read.
+ */
 static int
 add_to(dbref player, int am)
 {
-  return (add_to_generic(player, am, "QUEUE", NOTHING));
+  char buff[20];
+
+  QueueCount(player) += am;
+  if (QueueCount(player)) {
+    sprintf(buff, "%d", QueueCount(player));
+    (void) atr_add(player, "QUEUE", buff, GOD, NOTHING);
+  } else {
+    (void) atr_clr(player, "QUEUE", GOD);
+  }
+  return QueueCount(player);
 }
 
 static int
@@ -209,36 +332,426 @@ queue_limit(dbref player)
 void
 free_qentry(BQUE *point)
 {
-  int a;
-
 #ifdef _SWMP_
   sqenv_clear(sql_env[0]);
 #endif
   /* first free up the QID */
-  qid_table[point->qid] = QID_FALSE;
-  if(point->qid == qid_cnt) {
-          for(a = qid_cnt; a > -1; a--)
-                  if(qid_table[a] != QID_FALSE)
-                          break;
-          if(qid_table[a] != QID_FALSE)
-                  qid_cnt = a;
-          else  /* nothing on the queue at all.. set us down to 0 */
-                  qid_cnt = 0;
+  release_qid(point->qid);
+  release_qentry(point);
+}
+
+/* Put an entry on the back of the player queue if a player caused it,
+ * or of the object queue otherwise.
+ */
+static void
+ready_entry(BQUE *entry)
+{
+  entry->next = NULL;
+  entry->where = QW_READY;
+  if (IsPlayer(entry->cause)) {
+    entry->prev = qlast;
+    if (qlast) {
+      qlast->next = entry;
+      qlast = entry;
+    } else
+      qlast = qfirst = entry;
+    qowner_add(entry);
+  } else {
+    if (qllast) {
+      qllast->next = entry;
+      qllast = entry;
+    } else
+      qllast = qlfirst = entry;
   }
-  for (a = 0; a < 10; a++)
-    if (point->env[a]) {
-      mush_free((Malloc_t) point->env[a], "bqueue_env");
+}
+
+/* Timers.
+ * Timed waits and semaphore timeouts each sit on a binary heap ordered
+ * by when they go off, with ties broken by seq so that entries due in
+ * the same second run in the order they were (re)scheduled, as they
+ * did when the wait queue was a sorted list. Frozen entries are kept
+ * off the heaps, in an unordered array.
+ */
+
+static int
+bque_before(BQUE *a, BQUE *b)
+{
+  if (a->left != b->left)
+    return a->left < b->left;
+  return a->seq < b->seq;
+}
+
+static void
+heap_sift_up(BQUE_HEAP *h, int i)
+{
+  BQUE *entry = h->list[i];
+  int parent;
+
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!bque_before(entry, h->list[parent]))
+      break;
+    h->list[i] = h->list[parent];
+    h->list[i]->heap = i;
+    i = parent;
+  }
+  h->list[i] = entry;
+  entry->heap = i;
+}
+
+static void
+heap_sift_down(BQUE_HEAP *h, int i)
+{
+  BQUE *entry = h->list[i];
+  int child;
+
+  while ((child = 2 * i + 1) < h->count) {
+    if (child + 1 < h->count && bque_before(h->list[child + 1], h->list[child]))
+      child++;
+    if (!bque_before(h->list[child], entry))
+      break;
+    h->list[i] = h->list[child];
+    h->list[i]->heap = i;
+    i = child;
+  }
+  h->list[i] = entry;
+  entry->heap = i;
+}
+
+static void
+heap_add(BQUE_HEAP *h, BQUE *entry, enum bque_timer timer)
+{
+  if (h->count == h->size) {
+    h->size = h->size ? h->size * 2 : 64;
+    h->list = (BQUE **) realloc(h->list, h->size * sizeof(BQUE *));
+    if (!h->list)
+      mush_panic("Out of memory growing the queue timers");
+  }
+  entry->timer = timer;
+  entry->seq = ++qseq;
+  h->list[h->count] = entry;
+  entry->heap = h->count++;
+  if (timer != QT_FROZEN)
+    heap_sift_up(h, entry->heap);
+}
+
+/* Take entry i off a heap (or the frozen array) and return it */
+static BQUE *
+heap_remove(BQUE_HEAP *h, int i)
+{
+  BQUE *entry = h->list[i];
+  enum bque_timer timer = entry->timer;
+
+  entry->timer = QT_NONE;
+  entry->heap = -1;
+  if (i != --h->count) {
+    BQUE *moved = h->list[h->count];
+
+    h->list[i] = moved;
+    moved->heap = i;
+    if (timer != QT_FROZEN) {
+      heap_sift_up(h, i);
+      if (moved->heap == i)
+        heap_sift_down(h, i);
     }
+  }
+  return entry;
+}
+
+/* Take an entry off whichever timer holds it */
+static void
+timer_clear(BQUE *entry)
+{
+  switch (entry->timer) {
+  case QT_WAIT:
+    heap_remove(&qwait, entry->heap);
+    break;
+  case QT_SEM:
+    heap_remove(&qsemtime, entry->heap);
+    break;
+  case QT_FROZEN:
+    heap_remove(&qfrozen, entry->heap);
+    break;
+  case QT_NONE:
+    break;
+  }
+}
+
+/* (Re)file a waiting entry under the right timer for its time and
+ * state. Entries already due stay live even if frozen, since they'd
+ * have gone off on the next second anyway.
+ */
+static void
+timer_set(BQUE *entry)
+{
+  timer_clear(entry);
+  if (entry->where == QW_SEM && entry->left == 0)
+    return;                     /* semaphore wait without a timeout */
+  if (entry->state == QID_FREEZE && entry->left > mudtime)
+    heap_add(&qfrozen, entry, QT_FROZEN);
+  else if (entry->where == QW_SEM)
+    heap_add(&qsemtime, entry, QT_SEM);
+  else
+    heap_add(&qwait, entry, QT_WAIT);
+}
+
+/* Semaphore lists.
+ * Besides the global semaphore queue, each entry is linked into a list
+ * for its object/attribute pair and one for its object, so @notify and
+ * @drain only look at the entries they'll dequeue.
+ */
+
+static BQUE_SEMLIST *
+semlist_get(dbref thing, const char *aname, int create)
+{
+  char key[BUFFER_LEN];
+  BQUE_SEMLIST *list;
+
+  if (aname)
+    snprintf(key, sizeof key, "#%d/%s", thing, aname);
+  else
+    snprintf(key, sizeof key, "#%d", thing);
+  list = (BQUE_SEMLIST *) hashfind(key, &qsemlists);
+  if (!list && create) {
+    list = (BQUE_SEMLIST *) mush_malloc(sizeof(BQUE_SEMLIST), "bqueue_semlist");
+    list->head = list->tail = NULL;
+    hashadd(key, list, &qsemlists);
+  }
+  return list;
+}
+
+static void
+semlist_drop(dbref thing, const char *aname, BQUE_SEMLIST *list)
+{
+  char key[BUFFER_LEN];
+
+  if (aname)
+    snprintf(key, sizeof key, "#%d/%s", thing, aname);
+  else
+    snprintf(key, sizeof key, "#%d", thing);
+  hashdelete(key, &qsemlists);
+  mush_free(list, "bqueue_semlist");
+}
+
+/* Put an entry on the back of the semaphore queue */
+static void
+semlist_add(BQUE *entry)
+{
+  BQUE_SEMLIST *list;
+
+  entry->where = QW_SEM;
+  entry->order = ++qseq;
+  entry->next = NULL;
+  if ((entry->prev = qsemlast))
+    qsemlast->next = entry;
+  else
+    qsemfirst = entry;
+  qsemlast = entry;
+
+  list = semlist_get(entry->sem, entry->semattr, 1);
+  entry->anext = NULL;
+  if ((entry->aprev = list->tail))
+    list->tail->anext = entry;
+  else
+    list->head = entry;
+  list->tail = entry;
+
+  list = semlist_get(entry->sem, NULL, 1);
+  entry->onext = NULL;
+  if ((entry->oprev = list->tail))
+    list->tail->onext = entry;
+  else
+    list->head = entry;
+  list->tail = entry;
+}
+
+/* Take an entry off the semaphore queue and its timer */
+static void
+semlist_remove(BQUE *entry)
+{
+  BQUE_SEMLIST *list;
+
+  timer_clear(entry);
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    qsemfirst = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    qsemlast = entry->prev;
+
+  list = semlist_get(entry->sem, entry->semattr, 0);
+  if (entry->aprev)
+    entry->aprev->anext = entry->anext;
+  else
+    list->head = entry->anext;
+  if (entry->anext)
+    entry->anext->aprev = entry->aprev;
+  else
+    list->tail = entry->aprev;
+  if (!list->head)
+    semlist_drop(entry->sem, entry->semattr, list);
+
+  list = semlist_get(entry->sem, NULL, 0);
+  if (entry->oprev)
+    entry->oprev->onext = entry->onext;
+  else
+    list->head = entry->onext;
+  if (entry->onext)
+    entry->onext->oprev = entry->oprev;
+  else
+    list->tail = entry->oprev;
+  if (!list->head)
+    semlist_drop(entry->sem, NULL, list);
+
+  entry->next = entry->prev = NULL;
+  entry->where = QW_NONE;
+}
+
+static int
+order_cmp(const void *a, const void *b)
+{
+  const BQUE *x = *(const BQUE * const *) a;
+  const BQUE *y = *(const BQUE * const *) b;
+
+  if (x->order < y->order)
+    return -1;
+  return x->order > y->order;
+}
+
+/* Queue entry arenas.
+ * Each queue entry is a single block holding the BQUE followed by
+ * copies of its command, semaphore attribute, %0-%9, %q- and named
+ * registers. Blocks come in power-of-two size classes, and freed ones
+ * are kept on a free list per class for the next entry of that size.
+ */
+
+#define BQUE_ARENA_MIN 1024     /**< Smallest block size */
+#define BQUE_CLASSES 5          /**< Size classes, up to 16K */
+#define BQUE_POOL 256           /**< Most free blocks kept per class */
+
+static BQUE *bque_pool[BQUE_CLASSES];   /**< Free blocks per class */
+static int bque_pooled[BQUE_CLASSES];   /**< Blocks on each free list */
+static int bque_inuse[BQUE_CLASSES + 1];        /**< Blocks in use, last is oversize */
+static unsigned long bque_allocs[BQUE_CLASSES + 1];     /**< Blocks malloc()ed */
+static unsigned long bque_reuses[BQUE_CLASSES]; /**< Blocks taken from the pool */
+
+/* Copy a string into an arena, advancing the arena pointer */
+static char *
+arena_copy(char **ap, const char *str)
+{
+  char *start = *ap;
+  size_t len = strlen(str) + 1;
+
+  memcpy(start, str, len);
+  *ap += len;
+  return start;
+}
+
+/* Make a queue entry for command, with copies of the registers that
+ * are being passed on to it. Only the strings are filled in.
+ */
+static BQUE *
+new_qentry(const char *command, const char *semattr)
+{
+  size_t len;
+  int a, c, nregs = 0;
+  char *key, *ap;
+  BQUE *tmp;
+
+  len = sizeof(BQUE) + strlen(command) + 1;
+  if (semattr)
+    len += strlen(semattr) + 1;
+  for (a = 0; a < 10; a++)
+    if (global_eval_context.wnxt[a])
+      len += strlen(global_eval_context.wnxt[a]) + 1;
   for (a = 0; a < NUMQ; a++)
-    if (point->rval[a]) {
-      mush_free((Malloc_t) point->rval[a], "bqueue_rval");
-    }
-  free_namedregs(&point->namedregs);
-  if (point->semattr)
-    mush_free((Malloc_t) point->semattr, "bqueue_semattr");
-  if (point->comm)
-    mush_free((Malloc_t) point->comm, "bqueue_comm");
-  mush_free((Malloc_t) point, "BQUE");
+    if (global_eval_context.rnxt[a] && global_eval_context.rnxt[a][0])
+      len += strlen(global_eval_context.rnxt[a]) + 1;
+  for (key = hash_firstentry_key(&global_eval_context.namedregs); key;
+       key = hash_nextentry_key(&global_eval_context.namedregs)) {
+    len += strlen(key) + 1;
+    len += strlen(get_namedreg(&global_eval_context.namedregs, key)) + 1;
+    nregs++;
+  }
+
+  for (c = 0; c < BQUE_CLASSES && (size_t) (BQUE_ARENA_MIN << c) < len; c++) ;
+  if (c == BQUE_CLASSES) {
+    tmp = (BQUE *) mush_malloc(len, "BQUE");
+    tmp->arena = -1;
+    bque_allocs[c]++;
+  } else if ((tmp = bque_pool[c])) {
+    bque_pool[c] = tmp->next;
+    bque_pooled[c]--;
+    bque_reuses[c]++;
+  } else {
+    tmp = (BQUE *) mush_malloc(BQUE_ARENA_MIN << c, "BQUE");
+    tmp->arena = c;
+    bque_allocs[c]++;
+  }
+  bque_inuse[c]++;
+
+  ap = (char *) tmp + sizeof(BQUE);
+  tmp->comm = arena_copy(&ap, command);
+  tmp->semattr = semattr ? arena_copy(&ap, semattr) : NULL;
+  for (a = 0; a < 10; a++)
+    if (!global_eval_context.wnxt[a])
+      tmp->env[a] = NULL;
+    else
+      tmp->env[a] = arena_copy(&ap, global_eval_context.wnxt[a]);
+  for (a = 0; a < NUMQ; a++)
+    if (!global_eval_context.rnxt[a] || !global_eval_context.rnxt[a][0])
+      tmp->rval[a] = NULL;
+    else
+      tmp->rval[a] = arena_copy(&ap, global_eval_context.rnxt[a]);
+  tmp->nregs = nregs;
+  tmp->regs = ap;
+  for (key = hash_firstentry_key(&global_eval_context.namedregs); key;
+       key = hash_nextentry_key(&global_eval_context.namedregs)) {
+    arena_copy(&ap, key);
+    arena_copy(&ap, get_namedreg(&global_eval_context.namedregs, key));
+  }
+  return tmp;
+}
+
+/* Give a queue entry's block back to the pool, or to malloc */
+static void
+release_qentry(BQUE *entry)
+{
+  int c = entry->arena;
+
+  if (c < 0) {
+    bque_inuse[BQUE_CLASSES]--;
+    mush_free(entry, "BQUE");
+    return;
+  }
+  bque_inuse[c]--;
+  if (bque_pooled[c] < BQUE_POOL) {
+    entry->next = bque_pool[c];
+    bque_pool[c] = entry;
+    bque_pooled[c]++;
+  } else
+    mush_free(entry, "BQUE");
+}
+
+/** Report on queue entry memory for \@stats/tables.
+ * \param player the enactor.
+ */
+void
+queue_arena_stats(dbref player)
+{
+  int c;
+
+  notify(player, "Queue Entries:");
+  for (c = 0; c < BQUE_CLASSES; c++)
+    notify_format(player,
+                  "%6d bytes: %d in use, %d of %d free pooled. %lu "
+                  "allocated, %lu reused.", BQUE_ARENA_MIN << c,
+                  bque_inuse[c], bque_pooled[c], BQUE_POOL, bque_allocs[c],
+                  bque_reuses[c]);
+  notify_format(player, "  Oversize: %d in use. %lu allocated.",
+                bque_inuse[BQUE_CLASSES], bque_allocs[BQUE_CLASSES]);
 }
 
 static int
@@ -306,7 +819,6 @@ pay_queue(dbref player, const char *command)
 void
 parse_que(dbref player, const char *command, dbref cause)
 {
-  int a;
   BQUE *tmp;
   int qid;
   if (!IsPlayer(player) && (Halted(player)))
@@ -315,11 +827,14 @@ parse_que(dbref player, const char *command, dbref cause)
     return;
   if((qid = create_qid()) == -1) /* No room for a process ID, don't do anything */
           return;
-  tmp = (BQUE *) mush_malloc(sizeof(BQUE), "BQUE");
+  tmp = new_qentry(command, NULL);
   tmp->qid = qid;
-  tmp->comm = mush_strdup(command, "bqueue_comm");
-  tmp->semattr = NULL;
+  tmp->state = QID_ACTIVE;
+  tmp->timer = QT_NONE;
+  tmp->heap = -1;
+  qid_entry[qid] = tmp;
   tmp->player = player;
+  tmp->owner = Owner(player);
   tmp->queued = QUEUE_PER_OWNER ? Owner(player) : player;
   tmp->next = NULL;
   tmp->left = 0;
@@ -330,51 +845,28 @@ parse_que(dbref player, const char *command, dbref cause)
   tmp->sql_env[0] = sql_env[0];
   tmp->sql_env[1] = sql_env[1];
 #endif
-  for (a = 0; a < 10; a++)
-    if (!global_eval_context.wnxt[a])
-      tmp->env[a] = NULL;
-    else {
-      tmp->env[a] = mush_strdup(global_eval_context.wnxt[a], "bqueue_env");
-    }
-  for (a = 0; a < NUMQ; a++)
-    if (!global_eval_context.rnxt[a] || !global_eval_context.rnxt[a][0])
-      tmp->rval[a] = NULL;
-    else {
-      tmp->rval[a] = mush_strdup(global_eval_context.rnxt[a], "bqueue_rval");
-    }
-  init_namedregs(&tmp->namedregs);
-  copy_namedregs(&tmp->namedregs, &global_eval_context.namedregs);
 
-  if (IsPlayer(cause)) {
-    if (qlast) {
-      qlast->next = tmp;
-      qlast = tmp;
-    } else
-      qlast = qfirst = tmp;
-  } else {
-    if (qllast) {
-      qllast->next = tmp;
-      qllast = tmp;
-    } else
-      qllast = qlfirst = tmp;
-  }
+  ready_entry(tmp);
 }
 
 void
 div_parse_que(dbref division, const char *command, dbref called_division, dbref player)
 {
-  int a, qid;
+  int qid;
   BQUE *tmp;
 
   if (!IsPlayer(division) && (Halted(division)))
     return;
   if((qid = create_qid()) == -1) /* No room to process shit.. don't do shit */
           return;
-  tmp = (BQUE *) mush_malloc(sizeof(BQUE), "BQUE");
+  tmp = new_qentry(command, NULL);
   tmp->qid = qid;
-  tmp->comm = mush_strdup(command, "bqueue_comm");
-  tmp->semattr = NULL;
+  tmp->state = QID_ACTIVE;
+  tmp->timer = QT_NONE;
+  tmp->heap = -1;
+  qid_entry[qid] = tmp;
   tmp->player = division;
+  tmp->owner = Owner(division);
   tmp->queued = QUEUE_PER_OWNER ? Owner(division) : division;
   tmp->next = NULL;
   tmp->left = 0;
@@ -382,33 +874,7 @@ div_parse_que(dbref division, const char *command, dbref called_division, dbref
   tmp->realcause = called_division;
   tmp->ooref = options.twinchecks ? ooref : NOTHING;
   tmp->fqueued = 0;
-  for (a = 0; a < 10; a++)
-    if (!global_eval_context.wnxt[a])
-      tmp->env[a] = NULL;
-    else {
-      tmp->env[a] = mush_strdup(global_eval_context.wnxt[a], "bqueue_env");
-    }
-  for (a = 0; a < NUMQ; a++)
-    if (!global_eval_context.rnxt[a] || !global_eval_context.rnxt[a][0])
-      tmp->rval[a] = NULL;
-    else {
-      tmp->rval[a] = mush_strdup(global_eval_context.rnxt[a], "bqueue_rval");
-    }
-  init_namedregs(&tmp->namedregs);
-  copy_namedregs(&tmp->namedregs, &global_eval_context.namedregs);
-  if (IsPlayer(player)) {
-    if (qlast) {
-      qlast->next = tmp;
-      qlast = tmp;
-    } else
-      qlast = qfirst = tmp;
-  } else {
-    if (qllast) {
-      qllast->next = tmp;
-      qllast = tmp;
-    } else
-      qllast = qlfirst = tmp;
-  }
+  ready_entry(tmp);
 }
 
 
@@ -499,7 +965,7 @@ wait_que(dbref player, int wait, char *command, dbref cause, dbref sem,
          const char *semattr, int until, char finvoc)
 {
   BQUE *tmp;
-  int a, qid;
+  int qid;
   if (wait == 0) {
     if (sem != NOTHING)
       add_to_sem(sem, -1, semattr);
@@ -510,13 +976,17 @@ wait_que(dbref player, int wait, char *command, dbref cause, dbref sem,
     return -1;
   if((qid = create_qid()) < 0) /* can't obtain a QID */
           return -1;
-  tmp = (BQUE *) mush_malloc(sizeof(BQUE), "BQUE");
+  tmp = new_qentry(command, sem == NOTHING ? NULL :
+                   (semattr ? semattr : "SEMAPHORE"));
   tmp->qid = qid;
-  tmp->comm = mush_strdup(command, "bqueue_comm");
+  tmp->state = QID_ACTIVE;
+  tmp->timer = QT_NONE;
+  tmp->heap = -1;
+  qid_entry[qid] = tmp;
   tmp->player = player;
+  tmp->owner = Owner(player);
   tmp->queued = QUEUE_PER_OWNER ? Owner(player) : player;
   tmp->realcause = tmp->cause = cause;
-  tmp->semattr = NULL;
   tmp->next = NULL;
   tmp->ooref = ooref; /* catch state ooref */
   tmp->fqueued = finvoc;
@@ -524,23 +994,6 @@ wait_que(dbref player, int wait, char *command, dbref cause, dbref sem,
   tmp->sql_env[0] = sql_env[0];
   tmp->sql_env[1] = sql_env[1];
 #endif
-  for (a = 0; a < 10; a++) {
-    if (!global_eval_context.wnxt[a])
-      tmp->env[a] = NULL;
-    else {
-      tmp->env[a] = mush_strdup(global_eval_context.wnxt[a], "bqueue_env");
-    }
-  }
-  for (a = 0; a < NUMQ; a++) {
-    if (!global_eval_context.rnxt[a] || !global_eval_context.rnxt[a][0])
-      tmp->rval[a] = NULL;
-    else {
-      tmp->rval[a] = mush_strdup(global_eval_context.rnxt[a], "bqueue_rval");
-    }
-  }
-  init_namedregs(&tmp->namedregs);
-  copy_namedregs(&tmp->namedregs, &global_eval_context.namedregs);
-
   if (until) {
     tmp->left = wait;
   } else {
@@ -551,30 +1004,13 @@ wait_que(dbref player, int wait, char *command, dbref cause, dbref sem,
   }
   tmp->sem = sem;
   if (sem == NOTHING) {
-    /* No semaphore, put on normal wait queue, sorted by time */
-    BQUE *point, *trail = NULL;
-
-    for (point = qwait;
-         point && (point->left <= tmp->left); point = point->next)
-      trail = point;
-
-    tmp->next = point;
-    if (trail != NULL)
-      trail->next = tmp;
-    else
-      qwait = tmp;
+    /* No semaphore, put on the wait heap, ordered by time */
+    tmp->where = QW_WAIT;
   } else {
-
     /* Put it on the end of the semaphore queue */
-    tmp->semattr =
-      mush_strdup(semattr ? semattr : "SEMAPHORE", "bqueue_semattr");
-    if (qsemlast != NULL) {
-      qsemlast->next = tmp;
-      qsemlast = tmp;
-    } else {
-      qsemfirst = qsemlast = tmp;
-    }
+    semlist_add(tmp);
   }
+  timer_set(tmp);
   return qid;
 }
 
@@ -587,7 +1023,9 @@ wait_que(dbref player, int wait, char *command, dbref cause, dbref sem,
 void
 do_second(void)
 {
-  BQUE *trail = NULL, *point, *next;
+  BQUE *point;
+  BQUE **expired;
+  int i, n;
   /* move contents of low priority queue onto end of normal one 
    * this helps to keep objects from getting out of control since 
    * its effects on other objects happen only after one second 
@@ -599,63 +1037,173 @@ do_second(void)
       qlast->next = qlfirst;
     else
       qfirst = qlfirst;
-    qlast = qllast;
+    for (point = qlfirst; point; point = point->next) {
+      point->prev = qlast;
+      qlast = point;
+      qowner_add(point);
+    }
     qllast = qlfirst = NULL;
   }
-  /* do resort signal checks */
-  check_qsigs(&qwait);
-  check_qsigs(&qsemfirst);
+  /* frozen entries don't get any closer to going off */
+  for (i = 0; i < qfrozen.count; i++) {
+    qfrozen.list[i]->left++;
+    qfrozen.list[i]->seq = ++qseq;
+  }
   /* check regular wait queue */
 
-  while (qwait && qwait->left <= mudtime) {
-    point = qwait;
-    qwait = point->next;
-    point->next = NULL;
+  while (qwait.count && qwait.list[0]->left <= mudtime) {
+    point = heap_remove(&qwait, 0);
     point->left = 0;
-    if (IsPlayer(point->cause)) {
-      if (qlast) {
-        qlast->next = point;
-        qlast = point;
-      } else
-        qlast = qfirst = point;
-    } else {
-      if (qllast) {
-        qllast->next = point;
-        qllast = point;
-      } else
-        qllast = qlfirst = point;
+    ready_entry(point);
+  }
+
+  /* check for semaphore timeouts. These run in the order they were
+   * put on the semaphore queue, not the order they timed out in.
+   */
+  if (!qsemtime.count || qsemtime.list[0]->left > mudtime)
+    return;
+  expired = (BQUE **) mush_malloc(qsemtime.count * sizeof(BQUE *),
+                                  "bqueue_expired");
+  for (n = 0; qsemtime.count && qsemtime.list[0]->left <= mudtime; n++)
+    expired[n] = heap_remove(&qsemtime, 0);
+  qsort(expired, n, sizeof(BQUE *), order_cmp);
+  for (i = 0; i < n; i++) {
+    point = expired[i];
+    semlist_remove(point);
+    add_to_sem(point->sem, -1, point->semattr);
+    point->sem = NOTHING;
+    ready_entry(point);
+  }
+  mush_free(expired, "bqueue_expired");
+}
+
+/* Queue owners.
+ * Every entry on the player queue is also on its owner's list, and
+ * owners with entries there sit in a ring. When the queue is run by
+ * time (queue_slice), qready_next() goes round the ring, giving each
+ * owner a turn of queue_weight (or queue_admin_weight) msecs. Time an
+ * owner runs over its turn is taken out of its next ones.
+ */
+
+static QUEUE_OWNER *
+queue_owner(dbref owner)
+{
+  int i;
+
+  if (owner >= qowners_size) {
+    i = qowners_size;
+    qowners_size = db_top > owner ? db_top : owner + 1;
+    qowners = (QUEUE_OWNER *) realloc(qowners,
+                                      qowners_size * sizeof(QUEUE_OWNER));
+    if (!qowners)
+      mush_panic("Out of memory growing the queue owners");
+    for (; i < qowners_size; i++) {
+      qowners[i].head = qowners[i].tail = NULL;
+      qowners[i].rnext = qowners[i].rprev = NOTHING;
+      qowners[i].credit = 0;
+      qowners[i].runs = 0;
+      qowners[i].secs = 0.0;
     }
   }
+  return &qowners[owner];
+}
+
+/* Add an entry that just went on the player queue to its owner's list,
+ * putting the owner at the back of the ring if it wasn't on it.
+ */
+static void
+qowner_add(BQUE *entry)
+{
+  QUEUE_OWNER *o = queue_owner(entry->owner);
+
+  entry->rnext = NULL;
+  if ((entry->rprev = o->tail))
+    o->tail->rnext = entry;
+  else
+    o->head = entry;
+  o->tail = entry;
+  if (o->rnext != NOTHING)
+    return;
+  if (qturn == NOTHING) {
+    o->rnext = o->rprev = entry->owner;
+    qturn = entry->owner;
+    qturn_started = 0;
+  } else {
+    o->rnext = qturn;
+    o->rprev = qowners[qturn].rprev;
+    qowners[o->rprev].rnext = entry->owner;
+    qowners[qturn].rprev = entry->owner;
+  }
+}
 
-  /* check for semaphore timeouts */
+/* Take an entry off the player queue and its owner's list */
+static void
+qready_remove(BQUE *entry)
+{
+  QUEUE_OWNER *o = &qowners[entry->owner];
+  dbref owner = entry->owner;
+
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    qfirst = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    qlast = entry->prev;
+  entry->next = entry->prev = NULL;
+  entry->where = QW_NONE;
 
-  for (point = qsemfirst, trail = NULL; point; point = next) {
-    if (point->left == 0 || point->left > mudtime) {
-      next = (trail = point)->next;
-      continue;                 /* skip non-timed, frozen, and those that haven't gone off yet */
+  if (entry->rprev)
+    entry->rprev->rnext = entry->rnext;
+  else
+    o->head = entry->rnext;
+  if (entry->rnext)
+    entry->rnext->rprev = entry->rprev;
+  else
+    o->tail = entry->rprev;
+  if (o->head)
+    return;
+
+  /* Out of commands, so out of the ring. Any overrun is kept. */
+  if (o->rnext == owner)
+    qturn = NOTHING;
+  else {
+    qowners[o->rprev].rnext = o->rnext;
+    qowners[o->rnext].rprev = o->rprev;
+    if (qturn == owner) {
+      qturn = o->rnext;
+      qturn_started = 0;
     }
-    if (trail != NULL)
-      trail->next = next = point->next;
-    else
-      qsemfirst = next = point->next;
-    if (point == qsemlast)
-      qsemlast = trail;
-    add_to_sem(point->sem, -1, point->semattr);
-    point->sem = NOTHING;
-    point->next = NULL;
-    if (IsPlayer(point->cause)) {
-      if (qlast) {
-        qlast->next = point;
-        qlast = point;
-      } else
-        qlast = qfirst = point;
-    } else {
-      if (qllast) {
-        qllast->next = point;
-        qllast = point;
-      } else
-        qllast = qlfirst = point;
+  }
+  o->rnext = o->rprev = NOTHING;
+  if (o->credit > 0)
+    o->credit = 0;
+}
+
+/* Pick the next entry to run off the player queue */
+static BQUE *
+qready_next(void)
+{
+  QUEUE_OWNER *o;
+  int weight;
+
+  if (!options.queue_slice && !options.active_q_slice)
+    return qfirst;
+  if (qturn == NOTHING)
+    return NULL;
+  for (;;) {
+    o = &qowners[qturn];
+    if (!qturn_started) {
+      weight = (GoodObject(qturn) && TC_Admin(qturn)) ?
+        options.queue_admin_weight : options.queue_weight;
+      o->credit += (weight > 0 ? weight : 1) * QUEUE_QUANTUM;
+      qturn_started = 1;
     }
+    if (o->credit > 0)
+      return o->head;
+    qturn = o->rnext;
+    qturn_started = 0;
   }
 }
 
@@ -668,92 +1216,142 @@ do_second(void)
 int
 do_top(int ncom)
 {
-  int a, i;
+  return run_queue(ncom, 0);
+}
+
+/** Execute commands from the queue for a while.
+ * This function dequeues and executes commands on the normal
+ * priority (player) queue until msecs have gone by, running at
+ * least one if there are any.
+ * \param msecs milliseconds to run the queue for.
+ * \return number of commands executed.
+ */
+int
+do_top_slice(int msecs)
+{
+  return run_queue(INT_MAX, msecs * 1000L);
+}
+
+/* Run up to ncom commands, stopping early once usecs (if not 0) have
+ * gone by. Each one's time is charged to its owner.
+ */
+static int
+run_queue(int ncom, long usecs)
+{
+  int i;
+  long took, spent = 0;
   BQUE *entry;
-  char tbuf[BUFFER_LEN];
-  char *r;
-  char const *s;
-  dbref local_ooref;
-  int break_count;
+  QUEUE_OWNER *o;
+  struct timeval start, end;
 
-  for (i = 0; i < ncom; i++) {
+  for (i = 0; i < ncom && (!usecs || spent < usecs); i++) {
 
-    if (!qfirst) {
+    if (!(entry = qready_next())) {
       strcpy(global_eval_context.ccom, "");
       return i;
     }
     /* We must dequeue before execution, so that things like
      * queued @kick or @ps get a sane queue image.
      */
-    entry = qfirst;
-    if (!(qfirst = entry->next))
-      qlast = NULL;
-    if (GoodObject(entry->player) && !IsGarbage(entry->player)) {
-      global_eval_context.cplr = entry->player;
+    qready_remove(entry);
+    gettimeofday(&start, NULL);
+    run_qentry(entry);
+    gettimeofday(&end, NULL);
+    took = (end.tv_sec - start.tv_sec) * 1000000L +
+      (end.tv_usec - start.tv_usec);
+    if (took < 0)
+      took = 0;
+    spent += took;
+    o = queue_owner(entry->owner);
+    /* Credit is only topped up by qready_next() while the queue runs
+     * by time, so only charge it then too. */
+    if (options.queue_slice || options.active_q_slice)
+      o->credit -= took;
+    o->runs++;
+    o->secs += took / 1000000.0;
+    free_qentry(entry);
+  }
+
+  return i;
+}
+
+/* Execute a queue entry that has been taken off the queue */
+static void
+run_qentry(BQUE *entry)
+{
+  int a;
+  char tbuf[BUFFER_LEN];
+  char *r;
+  char const *s;
+  dbref local_ooref;
+  int break_count;
+
+  if (GoodObject(entry->player) && !IsGarbage(entry->player)) {
+    global_eval_context.cplr = entry->player;
 #ifdef _SWMP_
-      sql_env[0] = entry->sql_env[0];
-      sql_env[1] = entry->sql_env[1];
+    sql_env[0] = entry->sql_env[0];
+    sql_env[1] = entry->sql_env[1];
 #endif
-      giveto(global_eval_context.cplr, QUEUE_COST);
-      add_to(entry->queued, -1);
-      entry->player = 0;
-      if (IsPlayer(global_eval_context.cplr) || !Halted(global_eval_context.cplr)) {
-        for (a = 0; a < 10; a++)
-          global_eval_context.wenv[a] = entry->env[a];
-        for (a = 0; a < NUMQ; a++) {
-          if (entry->rval[a])
-            strcpy(global_eval_context.renv[a], entry->rval[a]);
-          else
-            global_eval_context.renv[a][0] = '\0';
-        }
-        copy_namedregs(&global_eval_context.namedregs, &entry->namedregs);
-        global_eval_context.process_command_port = 0;
-        s = entry->comm;
-        global_eval_context.break_called = 0;
-        break_count = 100;
-        *(global_eval_context.break_replace) = '\0';
-        start_cpu_timer();
-        while (!cpu_time_limit_hit && *s) {
-          r = global_eval_context.ccom;
-          local_ooref = ooref;
-          ooref = entry->ooref;
-          if(!entry->fqueued) {
-            process_expression(global_eval_context.ccom, &r, &s, global_eval_context.cplr, entry->cause,
-                             entry->realcause, PE_NOTHING, PT_SEMI, NULL);
-            *r = '\0';
-            if (*s == ';')
-              s++;
-             strcpy(tbuf, global_eval_context.ccom);
-             process_command(global_eval_context.cplr, tbuf, entry->cause, entry->realcause, 0);
-             if(global_eval_context.break_called) {
-               global_eval_context.break_called = 0;
-               s = global_eval_context.break_replace;
-               if(!*global_eval_context.break_replace) {
-                 ooref = local_ooref;
-                 break;
-               }
-               break_count--;
-               if(!break_count) {
-                 notify(global_eval_context.cplr, T("@break recursion exceeded."));
-                 ooref = local_ooref;
-                 break;
-               }
+    giveto(global_eval_context.cplr, QUEUE_COST);
+    add_to(entry->queued, -1);
+    entry->player = 0;
+    if (IsPlayer(global_eval_context.cplr) || !Halted(global_eval_context.cplr)) {
+      for (a = 0; a < 10; a++)
+        global_eval_context.wenv[a] = entry->env[a];
+      for (a = 0; a < NUMQ; a++) {
+        if (entry->rval[a])
+          strcpy(global_eval_context.renv[a], entry->rval[a]);
+        else
+          global_eval_context.renv[a][0] = '\0';
+      }
+      for (a = 0, r = entry->regs; a < entry->nregs; a++) {
+        set_namedreg(&global_eval_context.namedregs, r, r + strlen(r) + 1);
+        r += strlen(r) + 1;
+        r += strlen(r) + 1;
+      }
+      global_eval_context.process_command_port = 0;
+      s = entry->comm;
+      global_eval_context.break_called = 0;
+      break_count = 100;
+      *(global_eval_context.break_replace) = '\0';
+      start_cpu_timer();
+      while (!cpu_time_limit_hit && *s) {
+        r = global_eval_context.ccom;
+        local_ooref = ooref;
+        ooref = entry->ooref;
+        if(!entry->fqueued) {
+          process_expression(global_eval_context.ccom, &r, &s, global_eval_context.cplr, entry->cause,
+                           entry->realcause, PE_NOTHING, PT_SEMI, NULL);
+          *r = '\0';
+          if (*s == ';')
+            s++;
+           strcpy(tbuf, global_eval_context.ccom);
+           process_command(global_eval_context.cplr, tbuf, entry->cause, entry->realcause, 0);
+           if(global_eval_context.break_called) {
+             global_eval_context.break_called = 0;
+             s = global_eval_context.break_replace;
+             if(!*global_eval_context.break_replace) {
+               ooref = local_ooref;
+               break;
              }
-          } else {
-                  process_expression(global_eval_context.ccom, &r, &s, global_eval_context.cplr, entry->cause, entry->realcause, PE_DEFAULT, 
-                                  PT_DEFAULT, (PE_Info *) NULL);
-                  *r = '\0';
-                  notify(global_eval_context.cplr, global_eval_context.ccom);
-          }
-          ooref = local_ooref;
+             break_count--;
+             if(!break_count) {
+               notify(global_eval_context.cplr, T("@break recursion exceeded."));
+               ooref = local_ooref;
+               break;
+             }
+           }
+        } else {
+                process_expression(global_eval_context.ccom, &r, &s, global_eval_context.cplr, entry->cause, entry->realcause, PE_DEFAULT, 
+                                PT_DEFAULT, (PE_Info *) NULL);
+                *r = '\0';
+                notify(global_eval_context.cplr, global_eval_context.ccom);
         }
-        reset_cpu_timer();
+        ooref = local_ooref;
       }
+      reset_cpu_timer();
     }
-    free_qentry(entry);
   }
-
-  return i;
 }
 
 /** Determine whether it's time to run a queued command.
@@ -768,7 +1366,6 @@ int
 que_next(void)
 {
   int min, curr;
-  BQUE *point;
   /* If there are commands in the player queue, they should be run
    * immediately.
    */
@@ -785,25 +1382,21 @@ que_next(void)
    */
   min = 5;
 
-  /* Wait queue is in sorted order so we only have to look at the first
-     item on it. Anything else is wasted time. */
-  if (qwait) {
-    curr = qwait->left - mudtime;
+  /* The wait and semaphore timeout heaps have their soonest entry on
+     top, so we only have to look at that. */
+  if (qwait.count) {
+    curr = qwait.list[0]->left - mudtime;
     if (curr <= 2)
       return 1;
     if (curr < min)
       min = curr;
   }
-
-  for (point = qsemfirst; point; point = point->next) {
-    if (point->left == 0)       /* no timeout */
-      continue;
-    curr = point->left - mudtime;
+  if (qsemtime.count) {
+    curr = qsemtime.list[0]->left - mudtime;
     if (curr <= 2)
       return 1;
-    if (curr < min) {
+    if (curr < min)
       min = curr;
-    }
   }
 
   return (min - 1);
@@ -833,30 +1426,18 @@ void
 dequeue_semaphores(dbref thing, char const *aname, int count, int all,
                    int drain)
 {
-  BQUE **point;
+  BQUE_SEMLIST *list;
   BQUE *entry;
 
   if (all)
     count = INT_MAX;
 
-  /* Go through the semaphore queue and do it */
-  point = &qsemfirst;
-  while (*point && count > 0) {
-    entry = *point;
-    if (entry->sem != thing || (aname && strcmp(entry->semattr, aname))) {
-      point = &(entry->next);
-      continue;
-    }
+  /* Go through the entries waiting on this semaphore and do them */
+  while (count > 0 && (list = semlist_get(thing, aname, 0))) {
+    entry = list->head;
 
-    /* Remove the queue entry from the semaphore list */
-    *point = entry->next;
-    entry->next = NULL;
-    if (qsemlast == entry) {
-      qsemlast = qsemfirst;
-      if (qsemlast)
-        while (qsemlast->next)
-          qsemlast = qsemlast->next;
-    }
+    /* Remove the queue entry from the semaphore lists */
+    semlist_remove(entry);
 
     /* Update bookkeeping */
     count--;
@@ -868,21 +1449,8 @@ dequeue_semaphores(dbref thing, char const *aname, int count, int all,
       giveto(entry->player, QUEUE_COST);
       add_to(entry->queued, -1);
       free_qentry(entry);
-    } else if (IsPlayer(entry->cause)) {
-      if (qlast) {
-        qlast->next = entry;
-        qlast = entry;
-      } else {
-        qlast = qfirst = entry;
-      }
-    } else {
-      if (qllast) {
-        qllast->next = entry;
-        qllast = entry;
-      } else {
-        qllast = qlfirst = entry;
-      }
-    }
+    } else
+      ready_entry(entry);
   }
 
   /* If @drain/all, clear the relevant attribute(s) */
@@ -1080,34 +1648,76 @@ show_queue(dbref player, dbref victim, int q_type, int q_quiet, int q_all,
            BQUE *q_ptr, int *tot, int *self, int *del)
 {
   BQUE *tmp;
-  for (tmp = q_ptr; tmp; tmp = tmp->next) {
-    (*tot)++;
-    if (!GoodObject(tmp->player))
-      (*del)++;
-    else if (q_all || (Owner(tmp->player) == victim)) {
-      (*self)++;
-      if (!q_quiet && (CanSeeQ(player, victim)
-                       || Owns(tmp->player, player))) {
-        switch (q_type) {
-        case 1:         /* wait queue */
-          notify_format(player, "[QID: %d%s/%ld]%s:%s", tmp->qid, qid_table[tmp->qid] == QID_FREEZE ? "(F)" : "",
-                          tmp->left - mudtime, unparse_object(player, tmp->player), tmp->comm);
-          break;
-        case 2:         /* semaphore queue */
-          if (tmp->left != 0) {
-            notify_format(player, "[QID: %d%s/#%d/%s/%ld]%s:%s", tmp->qid, qid_table[tmp->qid] == QID_FREEZE ? "(F)" : "",
-                            tmp->sem, tmp->semattr, tmp->left - mudtime,
-                          unparse_object(player, tmp->player), tmp->comm);
-          } else {
-            notify_format(player, "[QID: %d%s/#%d/%s]%s:%s", tmp->qid, qid_table[tmp->qid] == QID_FREEZE ? "(F)" : "",
-                            tmp->sem, tmp->semattr, unparse_object(player, tmp->player),
-                          tmp->comm);
-          }
-          break;
-        default:                /* player or object queue */
-          notify_format(player, "[QID: %d%s] %s:%s", tmp->qid, qid_table[tmp->qid] == QID_FREEZE ? "(F)" : "", 
-                          unparse_object(player, tmp->player), tmp->comm);
+  for (tmp = q_ptr; tmp; tmp = tmp->next)
+    show_entry(player, victim, q_type, q_quiet, q_all, tmp, tot, self, del);
+}
+
+static int
+wait_cmp(const void *a, const void *b)
+{
+  BQUE *x = *(BQUE * const *) a;
+  BQUE *y = *(BQUE * const *) b;
+
+  if (bque_before(x, y))
+    return -1;
+  return bque_before(y, x);
+}
+
+/* The wait queue is a heap plus the frozen entries, so sort a copy
+ * of it to show it in the order it'll run.
+ */
+static void
+show_wait_queue(dbref player, dbref victim, int q_quiet, int q_all,
+                int *tot, int *self, int *del)
+{
+  BQUE **list;
+  int i, n = 0;
+
+  if (!qwait.count && !qfrozen.count)
+    return;
+  list = (BQUE **) mush_malloc((qwait.count + qfrozen.count) * sizeof(BQUE *),
+                               "bqueue_show");
+  for (i = 0; i < qwait.count; i++)
+    list[n++] = qwait.list[i];
+  for (i = 0; i < qfrozen.count; i++)
+    if (qfrozen.list[i]->where == QW_WAIT)
+      list[n++] = qfrozen.list[i];
+  qsort(list, n, sizeof(BQUE *), wait_cmp);
+  for (i = 0; i < n; i++)
+    show_entry(player, victim, 1, q_quiet, q_all, list[i], tot, self, del);
+  mush_free(list, "bqueue_show");
+}
+
+static void
+show_entry(dbref player, dbref victim, int q_type, int q_quiet, int q_all,
+           BQUE *tmp, int *tot, int *self, int *del)
+{
+  (*tot)++;
+  if (!GoodObject(tmp->player))
+    (*del)++;
+  else if (q_all || (Owner(tmp->player) == victim)) {
+    (*self)++;
+    if (!q_quiet && (CanSeeQ(player, victim)
+                     || Owns(tmp->player, player))) {
+      switch (q_type) {
+      case 1:         /* wait queue */
+        notify_format(player, "[QID: %d%s/%ld]%s:%s", tmp->qid, tmp->state == QID_FREEZE ? "(F)" : "",
+                        tmp->left - mudtime, unparse_object(player, tmp->player), tmp->comm);
+        break;
+      case 2:         /* semaphore queue */
+        if (tmp->left != 0) {
+          notify_format(player, "[QID: %d%s/#%d/%s/%ld]%s:%s", tmp->qid, tmp->state == QID_FREEZE ? "(F)" : "",
+                          tmp->sem, tmp->semattr, tmp->left - mudtime,
+                        unparse_object(player, tmp->player), tmp->comm);
+        } else {
+          notify_format(player, "[QID: %d%s/#%d/%s]%s:%s", tmp->qid, tmp->state == QID_FREEZE ? "(F)" : "",
+                          tmp->sem, tmp->semattr, unparse_object(player, tmp->player),
+                        tmp->comm);
         }
+        break;
+      default:                /* player or object queue */
+        notify_format(player, "[QID: %d%s] %s:%s", tmp->qid, tmp->state == QID_FREEZE ? "(F)" : "", 
+                        unparse_object(player, tmp->player), tmp->comm);
       }
     }
   }
@@ -1169,7 +1779,7 @@ do_queue(dbref player, const char *what, enum queue_type flag)
     show_queue(player, victim, 0, quick, all, qlfirst, &toq, &oq, &doq);
     if (!quick)
       notify(player, T("Wait Queue:"));
-    show_queue(player, victim, 1, quick, all, qwait, &twq, &wq, &dwq);
+    show_wait_queue(player, victim, quick, all, &twq, &wq, &dwq);
     if (!quick)
       notify(player, T("Semaphore Queue:"));
     show_queue(player, victim, 2, quick, all, qsemfirst, &tsq, &sq, &dsq);
@@ -1178,129 +1788,59 @@ do_queue(dbref player, const char *what, enum queue_type flag)
     notify_format(player,
                   "Totals: Player...%d/%d[%ddel]  Object...%d/%d[%ddel]  Wait...%d/%d  Semaphore...%d/%d",
                   pq, tpq, dpq, oq, toq, doq, wq, twq, sq, tsq);
+    if (!quick) {
+      QUEUE_OWNER *o = queue_owner(victim);
+      notify_format(player, T("Run time for %s: %lu commands in %.3f seconds."),
+                    Name(victim), o->runs, o->secs);
+    }
   }
 }
 
 
-static void check_qsigs(BQUE **qchk) {
- BQUE *next, *save, *trail, *point, *last;
- char qid_chk_t[MAX_QID];
-
-  memset(qid_chk_t, 0, MAX_QID);
-
-  for(save = trail = point = *qchk; point != NULL;point = save) {
-          if(qid_table[point->qid] == QID_ACTIVE) { /* don't have to bother with these */
-                  trail = save;
-                  save = point->next;
-                  qid_chk_t[point->qid] = 1;
-                  continue;
-          } else if(qid_chk_t[point->qid] == 1) {
-                  trail = save;
-                  save = point->next;
-                  continue;
-          }
-          qid_chk_t[point->qid] = 1;
-          /* see what type of PID or on. */
-          switch(qid_table[point->qid]) { /* Check for all possible re-sort signals */
-                  case QID_FREEZE:
-                          point->left++;
-                          break;
-                  case QID_CONT: /* these we're just resorting, set to active */
-                  case QID_TIME:
-                          qid_table[point->qid] = QID_ACTIVE;
-                          break;
-                  default: /* this doesn't happen */
-                          trail = save;
-                          save = point->next;
-                          continue;
-          }
-
-          /* detach the process for a second */
-          /*
-          last = save;
-          save = (trail->next = point->next);
-          trail = last;
-          */
-
-          if(*qchk == point) { /* its the first one.. so adjust the next one to be the first one */
-                  *qchk = save = point->next;
-          } else {
-                  trail->next = save = point->next;
-                  trail = trail;
-          }
-          /* detach. */
-          point->next = NULL;
-          /* retach it */
-          for(last = NULL, next = *qchk; next != NULL && (next->left <= point->left); next = next->next)
-                  last = next;
-          point->next = next;
-          if(last != NULL)
-                  last->next = point;
-          else
-                  *qchk = point;
-  }
-}
-
-/* find a queue by qid and return the queue struct of shit */
-/* qid - qid 
- * qproc - set process we're on
- * qlist - set which queue list we're on
- * return queue process we found
+/* find a queue entry by qid. Entries that are running right now
+ * can't be found.
  */
-BQUE *find_qid(int qid, BQUE **qlist, BQUE **qprev) {
+static BQUE *find_qid(int qid) {
         BQUE *qproc;
 
-        for(*qprev = qproc = qfirst; qproc; *qprev = qproc, qproc = qproc->next)
-                if(qproc->qid == qid) {
-                        return qproc;
-                }
-        for(*qprev = qproc = qlfirst; qproc; *qprev = qproc, qproc = qproc->next)
-                if(qproc->qid == qid) {
-                        return qproc;
-                }
-        for(*qprev = NULL, qproc = qwait; qproc; *qprev = qproc, qproc = qproc->next)
-                if(qproc->qid == qid) {
-                        *qlist = qwait;
-                        return qproc;
-                }
-        for(*qprev = NULL, qproc = qsemfirst; qproc; *qprev = qproc, qproc = qproc->next)
-                if(qproc->qid == qid) {
-                        *qlist = qsemfirst;
-                        return qproc;
-                }
-
-        return NULL;
+        if(qid < 0 || qid >= MAX_QID)
+                return NULL;
+        qproc = qid_entry[qid];
+        if(!qproc || qproc->where == QW_NONE)
+                return NULL;
+        return qproc;
 }
 
 int do_signal_qid(dbref signalby, int qid, enum qid_flags qflags, int time) {
-        BQUE *qproc, *qprev, *qsave;
+        BQUE *qproc;
 
         /* Signal a QID with such & such signal */
         
-        /* First Quick Check to make sure its a valid QID */
-        if(qid > qid_cnt || qid >= MAX_QID || qid_table[qid] == QID_FALSE)
-                return -1;
-        qproc = find_qid(qid, &qsave, &qprev);
-        if(!qproc || qproc->qid != qid)
+        qproc = find_qid(qid);
+        if(!qproc || !GoodObject(qproc->player))
                 return -1;
         /* Check Signals */
         switch(qflags) {
                 case QID_FREEZE:
-                        if(controls(signalby, qproc->player)) 
-                          qid_table[qid] = QID_FREEZE;
-                        else 
+                        if(controls(signalby, qproc->player)) {
+                          qproc->state = QID_FREEZE;
+                          if(qproc->where != QW_READY)
+                            timer_set(qproc);
+                        } else 
                                 return -3;
                         break;
                 case QID_CONT:
-                        if(controls(signalby, qproc->player))
-                                qid_table[qid] = QID_ACTIVE;
-                        else
+                        if(controls(signalby, qproc->player)) {
+                                qproc->state = QID_ACTIVE;
+                                if(qproc->where != QW_READY)
+                                  timer_set(qproc);
+                        } else
                                 return -3;
                         break;
                 case QID_QUERY_T:
                         if(!controls(signalby, qproc->player))
                                 return -3;
-                        if(qsave == qwait || qsave == qsemfirst) {
+                        if(qproc->where != QW_READY) {
                                 return (qproc->left - mudtime);
                         } else return -3;
                 case QID_TIME: /* modify queue time  */
@@ -1308,32 +1848,26 @@ int do_signal_qid(dbref signalby, int qid, enum qid_flags qflags, int time) {
                                 return -3;
                         if(time < 0) /* can't wait negative amount of time */
                                 return 0;
-                        if(!qsave) /* We don't adjust time of regular queue thingies */
+                        if(qproc->where == QW_READY) /* We don't adjust time of regular queue thingies */
                                 return -2;
                         qproc->left = mudtime + time;
                         /* this will let it stay frozen if it is */
-                        if(qid_table[qid] == QID_ACTIVE)
-                          qid_table[qid] = QID_TIME;
+                        timer_set(qproc);
                         break;
                 case QID_KILL:
                                 if(!controls(signalby, qproc->player) && !CanHalt(signalby, qproc->player))
                                         return -3;
                                 add_to(QUEUE_PER_OWNER ? Owner(qproc->player) : qproc->player, -1);
                                 giveto(Owner(qproc->player), QUEUE_COST);
-                                if(!qsave) { /* This is all we have to do for these, isn't that great? */
+                                if(qproc->where == QW_READY) { /* This is all we have to do for these, isn't that great? */
                                         qproc->player = NOTHING;
                                 } else { /* Wait queues or semas
                                           * we have to kill 'em completely from this point */
-                                        if(qprev)
-                                                qprev->next = qproc->next;
-                                        else {
-                                                if(qsave == qwait)
-                                                   qwait = qproc->next;
-                                                else {
-                                                   qsemfirst = qproc->next;
-                                                   add_to_sem(qproc->sem, -1, qproc->semattr);
-                                                }
-                                        }
+                                        if(qproc->where == QW_SEM) {
+                                                semlist_remove(qproc);
+                                                add_to_sem(qproc->sem, -1, qproc->semattr);
+                                        } else
+                                                timer_clear(qproc);
                                         free_qentry(qproc);
                                 }
                         break;
@@ -1355,7 +1889,7 @@ int do_signal_qid(dbref signalby, int qid, enum qid_flags qflags, int time) {
 void
 do_halt(dbref owner, const char *ncom, dbref victim)
 {
-  BQUE *tmp, *trail = NULL, *point, *next;
+  BQUE *tmp, *point, *next;
   int num = 0;
   dbref player;
   if (victim == NOTHING)
@@ -1380,38 +1914,46 @@ do_halt(dbref owner, const char *ncom, dbref victim)
       giveto(player, QUEUE_COST);
       tmp->player = NOTHING;
     }
-  /* remove wait q stuff */
-  for (point = qwait; point; point = next) {
-    if (((point->player == player)
-         || (Owner(point->player) == player))) {
+  /* remove wait q stuff. Collect them first, since taking entries
+   * off the heap moves others around. */
+  if (qwait.count || qfrozen.count) {
+    BQUE **victims;
+    int i, n = 0;
+
+    victims = (BQUE **) mush_malloc((qwait.count + qfrozen.count) *
+                                    sizeof(BQUE *), "bqueue_halt");
+    for (i = 0; i < qwait.count; i++) {
+      point = qwait.list[i];
+      if ((point->player == player) || (Owner(point->player) == player))
+        victims[n++] = point;
+    }
+    for (i = 0; i < qfrozen.count; i++) {
+      point = qfrozen.list[i];
+      if (point->where == QW_WAIT && ((point->player == player)
+                                      || (Owner(point->player) == player)))
+        victims[n++] = point;
+    }
+    for (i = 0; i < n; i++) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qwait = next = point->next;
-      free_qentry(point);
-    } else
-      next = (trail = point)->next;
+      timer_clear(victims[i]);
+      free_qentry(victims[i]);
+    }
+    mush_free(victims, "bqueue_halt");
   }
 
   /* clear semaphore queue */
 
-  for (point = qsemfirst, trail = NULL; point; point = next) {
+  for (point = qsemfirst; point; point = next) {
+    next = point->next;
     if (((point->player == player)
          || (Owner(point->player) == player))) {
       num--;
       giveto(player, QUEUE_COST);
-      if (trail)
-        trail->next = next = point->next;
-      else
-        qsemfirst = next = point->next;
-      if (point == qsemlast)
-        qsemlast = trail;
+      semlist_remove(point);
       add_to_sem(point->sem, -1, point->semattr);
       free_qentry(point);
-    } else
-      next = (trail = point)->next;
+    }
   }
 
   add_to(QUEUE_PER_OWNER ? Owner(player) : player, num);
@@ -1606,10 +2148,26 @@ do_restart_com(dbref player, const char *arg1)
 void
 shutdown_queues(void)
 {
+  BQUE *entry;
+
   shutdown_a_queue(&qfirst, &qlast);
   shutdown_a_queue(&qlfirst, &qllast);
-  shutdown_a_queue(&qsemfirst, &qsemlast);
-  shutdown_a_queue(&qwait, NULL);
+  while ((entry = qsemfirst)) {
+    semlist_remove(entry);
+    entry->next = NULL;
+    shutdown_a_queue(&entry, NULL);
+  }
+  while (qfrozen.count) {
+    /* Only wait entries are left frozen now */
+    entry = heap_remove(&qfrozen, qfrozen.count - 1);
+    entry->next = NULL;
+    shutdown_a_queue(&entry, NULL);
+  }
+  while (qwait.count) {
+    entry = heap_remove(&qwait, qwait.count - 1);
+    entry->next = NULL;
+    shutdown_a_queue(&entry, NULL);
+  }
   free_namedregs(&global_eval_context.namedregs);
   free_namedregs(&global_eval_context.namedregsnxt);
 }
@@ -134,10 +134,12 @@ do_real_open(dbref player, const char *direction, const char *linkto,
     Owner(new_exit) = Owner(player);
     Zone(new_exit) = Zone(player);
     SDIV(new_exit).object = SDIV(player).object;
+    obj_index_update(new_exit);
     SLEVEL(new_exit) = LEVEL(player);
     Source(new_exit) = loc;
     Type(new_exit) = TYPE_EXIT;
     Flags(new_exit) = string_to_bits("FLAG", options.exit_flags);
+    flag_columns_update(new_exit);
     set_lmod(new_exit, "NONE");
 
     /* link it in */
@@ -323,6 +325,7 @@ do_link(dbref player, const char *name, const char *room_name, int preserve)
         Zone(thing) = Zone(player);
         SDIV(thing).object = SDIV(player).object;
         SLEVEL(thing) = LEVEL(player);
+        obj_index_update(thing);
       }
       Location(thing) = room;
 
@@ -416,9 +419,11 @@ do_dig(dbref player, const char *name, char **argv, int tport)
     Owner(room) = Owner(player);
     Zone(room) = Zone(player);
     SDIV(room).object = SDIV(player).object;
+    obj_index_update(room);
     SLEVEL(room) = LEVEL(player);
     Type(room) = TYPE_ROOM;
     Flags(room) = string_to_bits("FLAG", options.room_flags);
+    flag_columns_update(room);
     set_lmod(room, "NONE");
 
     notify_format(player, T("%s created with room number %d."), name, room);
@@ -488,9 +493,11 @@ do_create(dbref player, char *name, int cost)
     Zone(thing) = Zone(player);
     SDIV(thing).object = SDIV(player).object;
     SLEVEL(thing) = LEVEL(player);
+    obj_index_update(thing);
     s_Pennies(thing, cost);
     Type(thing) = TYPE_THING;
     Flags(thing) = string_to_bits("FLAG", options.thing_flags);
+    flag_columns_update(thing);
     set_lmod(thing, "NONE");
 
     /* home is here (if we can link to it) or player's home */
@@ -542,6 +549,7 @@ clone_object(dbref player, dbref thing, const char *newname, int preserve)
   SDIV(clone).object = SDIV(thing).object;
   adjust_powers(clone, player);
   Parent(clone) = Parent(thing);
+  obj_index_update(clone);
   Flags(clone) = clone_flag_bitmask("FLAG", Flags(thing));
   set_lmod(clone, "NONE");
 #ifdef RPMODE_SYS
@@ -549,6 +557,7 @@ clone_object(dbref player, dbref thing, const char *newname, int preserve)
   db[clone].rplog.status = 0;
 #endif
   DPBITS(clone) = NULL;
+  flag_columns_update(clone);
   if (!preserve) {
     Warnings(clone) = 0;        /* zap warnings */
   } else if (Warnings(clone) || DPBITS(clone)) {
@@ -674,9 +683,11 @@ do_clone(dbref player, char *name, char *newname, int preserve)
       SDIV(clone).object = SDIV(thing).object;
       SLEVEL(clone) = LEVEL(thing);
       Parent(clone) = Parent(thing);
+      obj_index_update(clone);
       Flags(clone) = clone_flag_bitmask("FLAG", Flags(thing));
       adjust_powers(clone, player);
       DPBITS(clone) = NULL;
+      flag_columns_update(clone);
 #ifdef RPMODE_SYS
       db[clone].rplog.bufferq = NULL;
       db[clone].rplog.status = 0;
@@ -750,6 +761,7 @@ void copy_zone(dbref executor, dbref zmo) {
     /* Make Room */
     newrooms[i] = copy_room(oldrooms[i], executor);
     Zone(newrooms[i]) = newzone;
+    obj_index_update(newrooms[i]);
   }
 
 
@@ -833,10 +845,12 @@ dbref copy_room(dbref room, dbref newowner) {
   SDIV(new_room).object = SDIV(newowner).object;
 
   Parent(new_room) = Parent(room);
+  obj_index_update(new_room);
   Flags(new_room) = clone_flag_bitmask("FLAG", Flags(room));
   set_lmod(new_room, "NONE");
 
   DPBITS(new_room) = NULL;
+  flag_columns_update(new_room);
 #ifdef RPMODE_SYS
   db[new_room].rplog.bufferq = NULL;
   db[new_room].rplog.status = 0;
@@ -878,10 +892,12 @@ dbref copy_exit(dbref loc, dbref tail, dbref exit, dbref *oldrooms, dbref *newro
 
   Flags(new_exit) = clone_flag_bitmask("FLAG", Flags(exit));
   Parent(new_exit) = Parent(exit);
+  obj_index_update(new_exit);
   atr_cpy(new_exit, exit);
 
 
   DPBITS(new_exit) = NULL;
+  flag_columns_update(new_exit);
 #ifdef RPMODE_SYS
   db[new_exit].rplog.bufferq = NULL;
   db[new_exit].rplog.status = 0;
@@ -918,10 +934,12 @@ dbref copy_zmo(dbref old_zone, dbref new_owner) {
   SDIV(new_zone).object = SDIV(old_zone).object;
   adjust_powers(new_zone, new_owner);
   Parent(new_zone) = Parent(old_zone);
+  obj_index_update(new_zone);
   Flags(new_zone) = clone_flag_bitmask("FLAG", Flags(old_zone));
   set_lmod(new_zone, "NONE");
   Warnings(new_zone) = 0;        /* zap warnings */
   DPBITS(new_zone) = NULL;
+  flag_columns_update(new_zone);
 #ifdef RPMODE_SYS
   db[new_zone].rplog.bufferq = NULL;
   db[new_zone].rplog.status = 0;
@@ -76,10 +76,35 @@ const char *EOD = "***END OF DUMP***\n";
 
 dbref db_size = DB_INITIAL_SIZE;  /**< Current size of db array */
 
-HASHTAB htab_objdata;         /**< Object data hash table */
-HASHTAB htab_objdata_keys;    /**< Object data keys hash table */
+/* Object data: each keybase is given a slot when it's first used, and
+ * each slot has a table of data pointers indexed by dbref. */
+typedef struct objdata_key OBJDATA_KEY;
+struct objdata_key {
+  char *name;                   /* The keybase */
+  void **data;                  /* Data by dbref, or NULL if none yet */
+  int count;                    /* Objects with data under this key */
+};
+static OBJDATA_KEY *objdata_keys = NULL;
+static int objdata_nkeys = 0;
+static dbref objdata_size = 0;  /* Length of every slot's table */
+static dbref objdata_initial = DB_INITIAL_SIZE;
+static unsigned long objdata_gets = 0;
+static unsigned long objdata_sets = 0;
+extern HASHTAB htab_flagspaces;
+
+/* Journaled checkpoints: which objects have changed since the last
+ * save, and a fingerprint of each object as it was then. The arrays
+ * only exist while journals are being written. */
+static unsigned char *journal_dirty = NULL;
+static u_int_32 *journal_sums = NULL;
+static dbref journal_size = 0;
+/* Objects already loaded from a newer journal while reading the db */
+static unsigned char *journal_seen = NULL;
+static dbref journal_seen_size = 0;
+
+#define JOURNAL_BIT(bits, i) ((bits)[(i) >> 3] & (1 << ((i) & 7)))
+#define JOURNAL_SET(bits, i) ((bits)[(i) >> 3] |= (1 << ((i) & 7)))
 
-static void db_grow(dbref newtop);
 
 static void db_write_obj_basic(FILE * f, dbref i, struct object *o);
 int db_paranoid_write_object(FILE * f, dbref i, int flag);
@@ -90,13 +115,26 @@ void db_read_attrs(FILE * f, dbref i, int c);
 int get_list(FILE * f, dbref i);
 static unsigned char * getbytes(FILE * f);
 void putbytes(FILE * f, unsigned char *lbytes, int byte_limit);
-void db_free(void);
 int load_flag_db(FILE *);
 void db_write_flag_db(FILE *);
-static void init_objdata_htab(int size);
 static void db_write_flags(FILE * f);
+static void db_write_objects(FILE * f, dbref start, dbref end);
 static void db_write_powers(FILE * f);
 static dbref db_read_oldstyle(FILE * f);
+static void journal_grow(dbref top);
+static u_int_32 journal_hash(u_int_32 h, const void *data, size_t len);
+static u_int_32 journal_sum(dbref i, size_t flagbytes);
+static size_t journal_flagbytes(void);
+static int db_skip_object(FILE * f);
+static FILE *db_open_journal(const char *filename, int n, dbref *top);
+static dbref obj_index_key(int which, dbref thing);
+static void obj_index_grow(dbref top);
+static void obj_index_file(int which, dbref thing, dbref key);
+static void obj_index_build(void);
+static int db_read_journals(const char *filename);
+static int db_read_generation(FILE * f);
+static int objdata_find(const char *keybase);
+static void objdata_grow(dbref thing);
 
 StrTree object_names;       /**< String tree of object names */
 StrTree _clastmods;
@@ -136,6 +174,7 @@ set_name(dbref obj, const char *newname)
   /* if pointer not null unalloc it */
   if (Name(obj))
     st_delete(Name(obj), &object_names);
+  mark_dirty(obj);
   if (!newname || !*newname)
     return NULL;
   Name(obj) = st_insert(newname, &object_names);
@@ -146,6 +185,7 @@ set_name(dbref obj, const char *newname)
 const char *set_lmod(dbref obj, const char *lmod) {
   if(db[obj].lastmod)
     st_delete(db[obj].lastmod, &_clastmods);
+  mark_dirty(obj);
   if(!lmod || !*lmod) {
     /* this can happen.. */
     LastMod(obj) = st_insert((const char *)"NONE", &_clastmods);
@@ -156,7 +196,10 @@ const char *set_lmod(dbref obj, const char *lmod) {
 
 int db_init = 0;  /**< Has the db array been initialized yet? */
 
-static void
+/** Grow the db array to hold newtop objects, as garbage.
+ * \param newtop the new db_top.
+ */
+void
 db_grow(dbref newtop)
 {
   struct object *newdb;
@@ -195,6 +238,8 @@ db_grow(dbref newtop)
       o = db + initialized;
       o->name = 0;
       o->list = 0;
+      o->comm_index = NULL;
+      o->atr_index = NULL;
       o->location = NOTHING;
       o->contents = NOTHING;
       o->exits = NOTHING;
@@ -211,6 +256,7 @@ db_grow(dbref newtop)
       o->division.object = -1;
       o->division.powergroups = NULL;
       o->warnings = 0;
+      o->queue = 0;
       o->modification_time = o->creation_time = mudtime;
       o->lastmod = NULL;
       o->attrcount = 0;
@@ -256,6 +302,7 @@ new_object(void)
   o->division.object = -1;
   o->division.powergroups = NULL;
   o->warnings = 0;
+  o->queue = 0;
   o->modification_time = o->creation_time = mudtime;
   o->attrcount = 0;
   o->lastmod = NULL;
@@ -265,9 +312,202 @@ new_object(void)
 #endif /* RPMODE_SYS */
   if (current_state.garbage)
     current_state.garbage--;
+  obj_index_update(newobj);
   return newobj;
 }
 
+/* Secondary indexes on the object table, for searches. Each one
+ * threads the objects into doubly linked lists, one per object they
+ * point to: everything owned by #5 is on one list, everything
+ * parented to #7 on another, and so on. They're built the first time
+ * a search asks for one, and kept current after that by calling
+ * obj_index_update() whenever an object's owner, zone, parent or
+ * division changes.
+ */
+
+/** One object's place in one of the search indexes. */
+typedef struct obj_link {
+  dbref key;            /**< The list it's on, or NOTHING */
+  dbref prev;           /**< Previous object on that list */
+  dbref next;           /**< Next object on that list */
+  dbref head;           /**< First object on its own list */
+  int count;            /**< Number of objects on its own list */
+} OBJ_LINK;
+
+static OBJ_LINK *obj_index[OBJ_INDEXES];
+static dbref obj_index_size = 0;
+static int obj_index_built = 0;
+
+/* The value an object is indexed under. */
+static dbref
+obj_index_key(int which, dbref thing)
+{
+  switch (which) {
+  case OBJ_INDEX_OWNER:
+    return Owner(thing);
+  case OBJ_INDEX_ZONE:
+    return Zone(thing);
+  case OBJ_INDEX_PARENT:
+    return Parent(thing);
+  case OBJ_INDEX_DIVISION:
+    return Division(thing);
+  }
+  return NOTHING;
+}
+
+/* Make room in the index arrays for top objects. New slots aren't on
+ * any list. */
+static void
+obj_index_grow(dbref top)
+{
+  OBJ_LINK *links;
+  dbref size, n;
+  int which;
+
+  if (top <= obj_index_size)
+    return;
+  size = obj_index_size ? obj_index_size : DB_INITIAL_SIZE;
+  while (size < top)
+    size *= 2;
+  for (which = 0; which < OBJ_INDEXES; which++) {
+    links = mush_malloc(size * sizeof(OBJ_LINK), "obj_index");
+    if (!links)
+      mush_panic("Unable to allocate memory for search indexes");
+    if (obj_index[which]) {
+      memcpy(links, obj_index[which], obj_index_size * sizeof(OBJ_LINK));
+      mush_free(obj_index[which], "obj_index");
+    }
+    for (n = obj_index_size; n < size; n++) {
+      links[n].key = links[n].prev = links[n].next = NOTHING;
+      links[n].head = NOTHING;
+      links[n].count = 0;
+    }
+    obj_index[which] = links;
+  }
+  obj_index_size = size;
+}
+
+/* Move an object to the list for key in one index, taking it off the
+ * one it was on. Keys that aren't objects don't get a list. */
+static void
+obj_index_file(int which, dbref thing, dbref key)
+{
+  OBJ_LINK *links = obj_index[which];
+  OBJ_LINK *l = links + thing;
+
+  if (!GoodObject(key))
+    key = NOTHING;
+  if (l->key == key)
+    return;
+  if (l->key != NOTHING) {
+    if (l->prev != NOTHING)
+      links[l->prev].next = l->next;
+    else
+      links[l->key].head = l->next;
+    if (l->next != NOTHING)
+      links[l->next].prev = l->prev;
+    links[l->key].count--;
+  }
+  l->key = key;
+  l->prev = l->next = NOTHING;
+  if (key != NOTHING) {
+    l->next = links[key].head;
+    if (l->next != NOTHING)
+      links[l->next].prev = thing;
+    links[key].head = thing;
+    links[key].count++;
+  }
+}
+
+/* Index the whole database. */
+static void
+obj_index_build(void)
+{
+  dbref n;
+  int which;
+
+  obj_index_grow(db_top);
+  obj_index_built = 1;
+  for (n = 0; n < db_top; n++)
+    for (which = 0; which < OBJ_INDEXES; which++)
+      obj_index_file(which, n, obj_index_key(which, n));
+}
+
+/** Bring an object's entries in the search indexes up to date.
+ * Call this after changing the owner, zone, parent or division of an
+ * object, including by copying another object over it.
+ * \param thing the object that changed.
+ */
+void
+obj_index_update(dbref thing)
+{
+  int which;
+
+  if (!obj_index_built || !GoodObject(thing))
+    return;
+  obj_index_grow(db_top);
+  for (which = 0; which < OBJ_INDEXES; which++)
+    obj_index_file(which, thing, obj_index_key(which, thing));
+}
+
+/** How many objects point at an object in one of the search indexes.
+ * \param which the index, an OBJ_INDEX_ value.
+ * \param key the object pointed to.
+ * \return the number of objects pointing to it, or -1 if key isn't
+ * something the index can look up.
+ */
+int
+obj_index_count(int which, dbref key)
+{
+  if (!GoodObject(key))
+    return -1;
+  if (!obj_index_built)
+    obj_index_build();
+  return obj_index[which][key].count;
+}
+
+static int
+dbref_cmp(const void *a, const void *b)
+{
+  return *(const dbref *) a - *(const dbref *) b;
+}
+
+/** List the objects that point at an object in one of the search indexes.
+ * \param which the index, an OBJ_INDEX_ value.
+ * \param key the object pointed to.
+ * \param list an array of at least obj_index_count() dbrefs to fill in.
+ * \return the number of objects, which are put in list in dbref order.
+ */
+int
+obj_index_list(int which, dbref key, dbref *list)
+{
+  dbref n;
+  int count = 0;
+
+  if (obj_index_count(which, key) <= 0)
+    return 0;
+  for (n = obj_index[which][key].head; n != NOTHING;
+       n = obj_index[which][n].next)
+    list[count++] = n;
+  qsort(list, count, sizeof(dbref), dbref_cmp);
+  return count;
+}
+
+/** Throw away the search indexes, as when the database is freed. */
+void
+obj_index_reset(void)
+{
+  int which;
+
+  for (which = 0; which < OBJ_INDEXES; which++)
+    if (obj_index[which]) {
+      mush_free(obj_index[which], "obj_index");
+      obj_index[which] = NULL;
+    }
+  obj_index_size = 0;
+  obj_index_built = 0;
+}
+
 /** Output a long int to a file.
  * \param f file pointer to write to.
  * \param ref value to write.
@@ -720,35 +960,17 @@ db_write_object(FILE * f, dbref i)
   return 0;
 }
 
-/** Write out the object database to disk.
- * \verbatim
- * This function writes the databsae out to disk. The database
- * structure currently looks something like this:
- * +V<header line>
- * +FLAGS LIST
- * <flag data>
- * +POWERS LIST
- * <flag data>
- * ~<number of objects>
- * <object data>
- * \endverbatim
- * \param f file pointer to write to.
- * \param flag 0 for normal dump, DBF_PANIC for panic dumps.
- * \return the number of objects in the database (db_top)
+/** The database flags carried by a dump from this server.
+ * These are the DBF_* bits that db_write() puts in its version header.
+ * Binary snapshots record the same value, so that loading either
+ * format leaves indb_flags set the same way.
+ * \return the DBF_* flags for a normal dump.
  */
-dbref
-db_write(FILE * f, int flag)
+int
+db_dump_flags(void)
 {
-  dbref i;
-  int dbflag;
+  int dbflag = 0;
 
-  /* print a header line to make a later conversion to 2.0 easier to do.
-   * the odd choice of numbers is based on 256*x + 2 offset
-   * The original PennMUSH had x=5 (chat) or x=6 (nochat), and Tiny expects
-   * to deal with that. We need to use some extra flags as well, so
-   * we may be adding to 5/6 as needed, using successive binary numbers.
-   */
-  dbflag = 5 + flag;
   dbflag += DBF_NO_CHAT_SYSTEM;
   dbflag += DBF_WARNINGS;
   dbflag += DBF_CREATION_TIMES;
@@ -771,11 +993,61 @@ db_write(FILE * f, int flag)
   dbflag += DBF_NEW_ATR_LOCK;
   dbflag += DBF_ATR_MODTIME;
 
+  return dbflag;
+}
+
+/* Write the version header, save time and object count of a dump. */
+static void
+db_write_header(FILE * f, int flag)
+{
+  int dbflag;
+
+  /* print a header line to make a later conversion to 2.0 easier to do.
+   * the odd choice of numbers is based on 256*x + 2 offset
+   * The original PennMUSH had x=5 (chat) or x=6 (nochat), and Tiny expects
+   * to deal with that. We need to use some extra flags as well, so
+   * we may be adding to 5/6 as needed, using successive binary numbers.
+   */
+  dbflag = 5 + flag + db_dump_flags();
+
   OUTPUT(fprintf(f, "+V%d\n", dbflag * 256 + 2));
   db_write_labeled_string(f, "savedtime", show_time(mudtime, 1));
 
   OUTPUT(fprintf(f, "~%d\n", db_top));
-  for (i = 0; i < db_top; i++) {
+}
+
+/** Write out the object database to disk.
+ * \verbatim
+ * This function writes the databsae out to disk. The database
+ * structure currently looks something like this:
+ * +V<header line>
+ * +FLAGS LIST
+ * <flag data>
+ * +POWERS LIST
+ * <flag data>
+ * ~<number of objects>
+ * <object data>
+ * \endverbatim
+ * \param f file pointer to write to.
+ * \param flag 0 for normal dump, DBF_PANIC for panic dumps.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write(FILE * f, int flag)
+{
+  db_write_header(f, flag);
+  db_write_objects(f, 0, db_top);
+  OUTPUT(fputs(EOD, f));
+  return db_top;
+}
+
+/* Write the objects from start up to (but not including) end. */
+static void
+db_write_objects(FILE * f, dbref start, dbref end)
+{
+  dbref i;
+
+  for (i = start; i < end; i++) {
 #ifdef WIN32
 #ifndef __MINGW32__
     /* Keep the service manager happy */
@@ -788,6 +1060,263 @@ db_write(FILE * f, int flag)
     OUTPUT(fprintf(f, "!%d\n", i));
     db_write_object(f, i);
   }
+}
+
+/** Write the manifest of a sharded dump.
+ * \verbatim
+ * A sharded dump splits the objects of the database between several
+ * files, so that they can be written at the same time. The manifest
+ * takes the place of the usual database file, and looks like:
+ * +V<header line>
+ * ~<number of objects>
+ * +SHARDS LIST
+ * shards <number of shards>
+ * generation <generation>
+ * \endverbatim
+ * Shard n is in the file named by db_shard_name(). Each dump writes
+ * its shards under a new generation, so the shards of the dump the
+ * manifest replaces are still there until the manifest is in place.
+ * \param f file pointer to write to.
+ * \param shards the number of shards.
+ * \param generation the generation the shards were written under.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write_manifest(FILE * f, int shards, int generation)
+{
+  db_write_header(f, 0);
+  OUTPUT(fprintf(f, "+SHARDS LIST\n"));
+  db_write_labeled_number(f, "shards", shards);
+  db_write_labeled_number(f, "generation", generation);
+  OUTPUT(fputs(EOD, f));
+  return db_top;
+}
+
+/** Write one shard of a sharded dump.
+ * The shard begins with the save time of the dump it belongs to, so
+ * that a shard left over from another dump is not loaded by mistake.
+ * \param f file pointer to write to.
+ * \param start the first dbref in the shard.
+ * \param end the dbref after the last one in the shard.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write_shard(FILE * f, dbref start, dbref end)
+{
+  db_write_labeled_string(f, "savedtime", show_time(mudtime, 1));
+  db_write_objects(f, start, end);
+  OUTPUT(fputs(EOD, f));
+  return db_top;
+}
+
+/** Note that an object has changed since the last checkpoint.
+ * Everything that changes what db_write_object() would write for an
+ * object should call this, so that the next journal includes it.
+ * It does nothing unless journals are being written.
+ * \param thing dbref of the object that changed.
+ */
+void
+mark_dirty(dbref thing)
+{
+  if (!journal_sums || thing < 0 || thing >= db_top)
+    return;
+  if (thing >= journal_size)
+    journal_grow(db_top);
+  JOURNAL_SET(journal_dirty, thing);
+}
+
+/* Make room in the journal arrays for top objects. New objects have
+ * a fingerprint of 0, so the next scan finds them changed. */
+static void
+journal_grow(dbref top)
+{
+  unsigned char *dirty;
+  u_int_32 *sums;
+  dbref size;
+
+  if (top <= journal_size && journal_sums)
+    return;
+  size = journal_size ? journal_size : DB_INITIAL_SIZE;
+  while (size < top)
+    size *= 2;
+  dirty = mush_malloc((size + 7) / 8, "journal.dirty");
+  sums = mush_malloc(size * sizeof(u_int_32), "journal.sums");
+  if (!dirty || !sums)
+    mush_panic("Unable to allocate memory for checkpoint journals");
+  memset(dirty, 0, (size + 7) / 8);
+  memset(sums, 0, size * sizeof(u_int_32));
+  if (journal_sums) {
+    memcpy(dirty, journal_dirty, (journal_size + 7) / 8);
+    memcpy(sums, journal_sums, journal_size * sizeof(u_int_32));
+    mush_free(journal_dirty, "journal.dirty");
+    mush_free(journal_sums, "journal.sums");
+  }
+  journal_dirty = dirty;
+  journal_sums = sums;
+  journal_size = size;
+}
+
+/* FNV-1a, continued over another block of data */
+static u_int_32
+journal_hash(u_int_32 h, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+
+  while (len--) {
+    h ^= *p++;
+    h *= 16777619U;
+  }
+  return h;
+}
+
+/* The size of an object flag bitmask. */
+static size_t
+journal_flagbytes(void)
+{
+  FLAGSPACE *n;
+
+  n = (FLAGSPACE *) hashfind("FLAG", &htab_flagspaces);
+  return n ? (n->flagbits + 7) / 8 : 0;
+}
+
+/* A fingerprint of the fields of an object, to catch changes made
+ * without a call to mark_dirty(). Attribute values and lock keys are
+ * left out: they move between chunks without changing. */
+static u_int_32
+journal_sum(dbref i, size_t flagbytes)
+{
+  struct object *o = db + i;
+  struct power_group_list *pg;
+  u_int_32 h = 2166136261U;
+
+  if (IsGarbage(i))
+    return 1;
+#define JOURNAL_FIELD(x) h = journal_hash(h, &(x), sizeof(x))
+  JOURNAL_FIELD(o->name);
+  JOURNAL_FIELD(o->lastmod);
+  JOURNAL_FIELD(o->location);
+  JOURNAL_FIELD(o->contents);
+  JOURNAL_FIELD(o->exits);
+  JOURNAL_FIELD(o->next);
+  JOURNAL_FIELD(o->parent);
+  JOURNAL_FIELD(o->locks);
+  JOURNAL_FIELD(o->owner);
+  JOURNAL_FIELD(o->zone);
+  JOURNAL_FIELD(o->penn);
+  JOURNAL_FIELD(o->warnings);
+  JOURNAL_FIELD(o->creation_time);
+  JOURNAL_FIELD(o->modification_time);
+  JOURNAL_FIELD(o->list);
+  JOURNAL_FIELD(o->attrcount);
+  JOURNAL_FIELD(o->type);
+  JOURNAL_FIELD(o->division.object);
+  JOURNAL_FIELD(o->division.level);
+  for (pg = o->division.powergroups; pg; pg = pg->next)
+    JOURNAL_FIELD(pg->power_group);
+#undef JOURNAL_FIELD
+  if (o->flags)
+    h = journal_hash(h, o->flags, flagbytes);
+  if (o->division.dp_bytes)
+    h = journal_hash(h, o->division.dp_bytes, DP_BYTES);
+  return h ? h : 2;
+}
+
+/** Start a new chain of journals.
+ * Called when a full dump is made: every object is clean again, and
+ * the fingerprints are taken afresh.
+ */
+void
+db_journal_reset(void)
+{
+  size_t flagbytes = journal_flagbytes();
+  dbref i;
+
+  journal_grow(db_top);
+  for (i = 0; i < db_top; i++)
+    journal_sums[i] = journal_sum(i, flagbytes);
+  memset(journal_dirty, 0, (journal_size + 7) / 8);
+}
+
+/** Find objects that changed without being marked dirty.
+ * Compares every object to its fingerprint from the last checkpoint,
+ * so that a journal isn't missing changes made by code that assigns
+ * to the object directly.
+ * \return the number of objects that will go in the next journal.
+ */
+int
+db_journal_scan(void)
+{
+  size_t flagbytes = journal_flagbytes();
+  u_int_32 sum;
+  dbref i;
+  int count = 0;
+
+  journal_grow(db_top);
+  for (i = 0; i < db_top; i++) {
+    sum = journal_sum(i, flagbytes);
+    if (sum != journal_sums[i]) {
+      journal_sums[i] = sum;
+      JOURNAL_SET(journal_dirty, i);
+    }
+    if (JOURNAL_BIT(journal_dirty, i))
+      count++;
+  }
+  return count;
+}
+
+/** Mark every object clean, once a journal of them has been started. */
+void
+db_journal_clear(void)
+{
+  if (journal_dirty)
+    memset(journal_dirty, 0, (journal_size + 7) / 8);
+}
+
+/** Stop tracking changed objects. */
+void
+db_journal_stop(void)
+{
+  if (journal_sums) {
+    mush_free(journal_dirty, "journal.dirty");
+    mush_free(journal_sums, "journal.sums");
+  }
+  journal_dirty = NULL;
+  journal_sums = NULL;
+  journal_size = 0;
+}
+
+/** Write a checkpoint journal.
+ * \verbatim
+ * A journal holds the objects changed since the previous checkpoint,
+ * and comes after a full dump, whose save time it records:
+ * savedtime <time of this journal>
+ * base <savedtime of the full dump>
+ * ~<number of objects>
+ * !<dbref> and object data, for each changed object
+ * -<dbref> for each changed object that is now garbage
+ * \endverbatim
+ * \param f file pointer to write to.
+ * \param base the savedtime of the full dump the journal follows.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write_journal(FILE * f, const char *base)
+{
+  dbref i;
+
+  db_write_labeled_string(f, "savedtime", show_time(mudtime, 1));
+  db_write_labeled_string(f, "base", base);
+  OUTPUT(fprintf(f, "~%d\n", db_top));
+  for (i = 0; i < db_top && i < journal_size; i++) {
+    if (!JOURNAL_BIT(journal_dirty, i))
+      continue;
+    if (IsGarbage(i)) {
+      OUTPUT(fprintf(f, "-%d\n", i));
+    } else {
+      OUTPUT(fprintf(f, "!%d\n", i));
+      db_write_object(f, i);
+    }
+  }
   OUTPUT(fputs(EOD, f));
   return db_top;
 }
@@ -918,6 +1447,7 @@ db_paranoid_write_object(FILE * f, dbref i, int flag)
       (void) atr_add(i, name, tbuf1, owner, flags);
       list = atr_get_noparent(i, name);
       AL_FLAGS(list) = flags;
+      atr_comm_forget(i);
     }
   }
   return 0;
@@ -1241,6 +1771,8 @@ db_free(void)
     free((char *) db);
     db = NULL;
     db_init = db_top = 0;
+    obj_index_reset();
+    flag_columns_reset();
   }
 }
 
@@ -1482,7 +2014,7 @@ db_read_oldstyle(FILE * f)
       /* make sure database is at least this big *1.5 */
     case '~':
       db_init = (getref(f) * 3) / 2;
-      init_objdata_htab(db_init);
+      init_objdata(db_init);
       break;
       /* Use the MUSH 2.0 header stuff to see what's in this db */
     case '+':
@@ -1716,20 +2248,463 @@ db_read_oldstyle(FILE * f)
   }
 }
 
+/** Finish loading an object.
+ * This function is called once all of an object's fields have been
+ * read, by either database format. It counts the object by type,
+ * truncates overlong names, and registers players.
+ * \param i dbref of the object just loaded.
+ */
+void
+db_loaded_object(dbref i)
+{
+  switch (Typeof(i)) {
+  case TYPE_PLAYER:
+    current_state.players++;
+    current_state.garbage--;
+    break;
+  case TYPE_DIVISION:
+    current_state.divisions++;
+    current_state.garbage--;
+    break;
+  case TYPE_THING:
+    current_state.things++;
+    current_state.garbage--;
+    break;
+  case TYPE_EXIT:
+    current_state.exits++;
+    current_state.garbage--;
+    break;
+  case TYPE_ROOM:
+    current_state.rooms++;
+    current_state.garbage--;
+    break;
+  }
+  if (IsPlayer(i) && (strlen(Name(i)) > (size_t) PLAYER_NAME_LIMIT)) {
+    char buff[BUFFER_LEN + 1];    /* The name plus a NUL */
+    strncpy(buff, Name(i), PLAYER_NAME_LIMIT);
+    buff[PLAYER_NAME_LIMIT] = '\0';
+    set_name(i, buff);
+    do_rawlog(LT_CHECK,
+              T
+              (" * Name of #%d is longer than the maximum, truncating.\n"),
+              i);
+  } else if (!IsPlayer(i) && (strlen(Name(i)) > OBJECT_NAME_LIMIT)) {
+    char buff[OBJECT_NAME_LIMIT + 1];     /* The name plus a NUL */
+    strncpy(buff, Name(i), OBJECT_NAME_LIMIT);
+    buff[OBJECT_NAME_LIMIT] = '\0';
+    set_name(i, buff);
+    do_rawlog(LT_CHECK,
+              T
+              (" * Name of #%d is longer than the maximum, truncating.\n"),
+              i);
+  }
+  if (IsPlayer(i)) {
+    add_player(i);
+    clear_flag_internal(i, "CONNECTED");
+  }
+}
+
+/* Read the fields of object i, whose !<dbref> line has been read. */
+static int
+db_read_object(FILE * f, dbref i)
+{
+  struct object *o;
+  div_pbits div_powers;
+  int c;
+  char *label, *value;
+  /* Thre should be an entry in the enum and following table and
+     switch for each top-level label associated with an
+     object. Not finding a label is not an error; the default
+     set in new_object() is used. Finding a label not listed
+     below is an error. */
+  enum known_labels {
+    LBL_NAME, LBL_LOCATION, LBL_CONTENTS, LBL_EXITS,
+    LBL_NEXT, LBL_PARENT, LBL_LOCKS, LBL_OWNER, LBL_ZONE,
+    LBL_PENNIES, LBL_TYPE, LBL_FLAGS, LBL_POWERGROUPS, LBL_POWERS, LBL_WARNINGS,
+    LBL_CREATED, LBL_MODIFIED, LBL_ATTRS, LBL_ERROR, LBL_LEVEL,
+    LBL_DIVOBJ, LBL_PWRLVL, LBL_LMOD
+  };
+  struct label_table {
+    const char *label;
+    enum known_labels tag;
+  };
+  struct label_table fields[] = {
+    {"name", LBL_NAME},
+    {"location", LBL_LOCATION},
+    {"contents", LBL_CONTENTS},
+    {"exits", LBL_EXITS},
+    {"next", LBL_NEXT},
+    {"parent", LBL_PARENT},
+    {"lockcount", LBL_LOCKS},
+    {"owner", LBL_OWNER},
+    {"zone", LBL_ZONE},
+    {"pennies", LBL_PENNIES},
+    {"type", LBL_TYPE},
+    {"flags", LBL_FLAGS},
+    {"powers", LBL_POWERS},
+    {"warnings", LBL_WARNINGS},
+    {"created", LBL_CREATED},
+    {"modified", LBL_MODIFIED},
+    {"attrcount", LBL_ATTRS},
+    {"division_object", LBL_DIVOBJ},
+    {"level", LBL_LEVEL},
+    {"powerlevel", LBL_PWRLVL},
+    {"powergroup", LBL_POWERGROUPS},
+    {"lastmod", LBL_LMOD},
+     /* Add new label types here. */
+    {NULL, LBL_ERROR}
+  }, *entry;
+  enum known_labels the_label;
+
+  db_grow(i + 1);
+  /* A newer copy of the object was in a journal */
+  if (journal_seen && i < journal_seen_size && JOURNAL_BIT(journal_seen, i))
+    return db_skip_object(f);
+  o = db + i;
+  while (1) {
+    c = fgetc(f);
+    ungetc(c, f);
+    /* At the start of another object, a journal tombstone or the EOD */
+    if (c == '!' || c == '*' || c == '-')
+      break;
+    db_read_labeled_string(f, &label, &value);
+    the_label = LBL_ERROR;
+    /* Look up the right enum value in the label table */
+    for (entry = fields; entry->label; entry++) {
+      if (strcmp(entry->label, label) == 0) {
+        the_label = entry->tag;
+        break;
+      }
+    }
+    switch (the_label) {
+    case LBL_NAME:
+      set_name(i, value);
+      break;
+    case LBL_LOCATION:
+      o->location = qparse_dbref(value);
+      break;
+    case LBL_CONTENTS:
+      o->contents = qparse_dbref(value);
+      break;
+    case LBL_EXITS:
+      o->exits = qparse_dbref(value);
+      break;
+    case LBL_NEXT:
+      o->next = qparse_dbref(value);
+      break;
+    case LBL_PARENT:
+      o->parent = qparse_dbref(value);
+      break;
+    case LBL_LOCKS:
+      get_new_locks(i, f, parse_integer(value));
+      break;
+    case LBL_LEVEL:
+      o->division.level = parse_integer(value); 
+      break;
+    case LBL_PWRLVL:
+      /* Do nothing with this value */
+      break;
+    case LBL_DIVOBJ:
+      o->division.object = qparse_dbref(value);
+      break;
+    case LBL_OWNER:
+      o->owner = qparse_dbref(value);
+      break;
+    case LBL_ZONE:
+      o->zone = qparse_dbref(value);
+      break;
+    case LBL_PENNIES:
+      s_Pennies(i, parse_integer(value));
+      break;
+    case LBL_TYPE:
+      o->type = parse_integer(value);
+      break;
+    case LBL_FLAGS:
+      o->flags = string_to_bits("FLAG", value);
+      /* Clear the GOING flags. If it was scheduled for destruction
+       * when the db was saved, it gets a reprieve.
+       */
+      clear_flag_internal(i, "GOING");
+      clear_flag_internal(i, "GOING_TWICE");
+      break;
+    case LBL_POWERS:
+        div_powers = string_to_dpbits(value);
+        if(power_is_zero(div_powers, DP_BYTES) == 0) {
+          o->division.dp_bytes = NULL;
+          mush_free(div_powers, "POWER_SPOT");
+        } else o->division.dp_bytes =  div_powers;
+      break;
+    case LBL_POWERGROUPS:
+      powergroup_db_set(NOTHING, i, value, 0);
+      break;
+    case LBL_WARNINGS:
+      o->warnings = parse_warnings(NOTHING, value);
+      break;
+    case LBL_CREATED:
+      o->creation_time = (time_t) parse_integer(value);
+      break;
+    case LBL_MODIFIED:
+      o->modification_time = (time_t) parse_integer(value);
+      break;
+    case LBL_LMOD:
+      db[i].lastmod = NULL;
+      set_lmod(i, value);
+      break;
+    case LBL_ATTRS:
+      {
+        int attrcount = parse_integer(value);
+        db_read_attrs(f, i, attrcount);
+      }
+      break;
+    case LBL_ERROR:
+    default:
+      do_rawlog(LT_ERR, T("Unrecognized field '%s' in object #%d"),
+                label, i);
+      return -1;
+    }
+  }
+  db_loaded_object(i);
+  return 0;
+}
+
+/* Read past the fields of an object that isn't wanted. */
+static int
+db_skip_object(FILE * f)
+{
+  char *label, *value;
+  int c;
+
+  while (1) {
+    c = fgetc(f);
+    if (c == EOF)
+      return -1;
+    ungetc(c, f);
+    if (c == '!' || c == '*' || c == '-')
+      return 0;
+    db_read_labeled_string(f, &label, &value);
+  }
+}
+
+/* Open journal n of a dump, and read its header. Returns NULL if it
+ * is missing or follows some other dump. */
+static FILE *
+db_open_journal(const char *filename, int n, dbref *top)
+{
+  char name[BUFFER_LEN];
+  char *tmp;
+  FILE *f;
+
+  snprintf(name, sizeof name, "%s.j%d", filename, n);
+  f = db_open(name);
+  if (!f)
+    return NULL;
+  if (fgetc(f) != 's') {
+    db_close(f);
+    return NULL;
+  }
+  ungetc('s', f);
+  db_read_this_labeled_string(f, "savedtime", &tmp);
+  db_read_this_labeled_string(f, "base", &tmp);
+  if (strcmp(tmp, db_timestamp) != 0 || fgetc(f) != '~') {
+    db_close(f);
+    return NULL;
+  }
+  *top = getref(f);
+  return f;
+}
+
+/* Load the objects in the journals written since the dump being read.
+ * The newest journal is read first, and an object is only loaded from
+ * the first place it's found; the dump itself then skips them. */
+static int
+db_read_journals(const char *filename)
+{
+  FILE *f;
+  dbref i = NOTHING, top;
+  char buff[80];
+  int c, n, journals;
+
+  /* A journal that fails its check ends the chain there */
+  for (journals = 0; (f = db_open_journal(filename, journals + 1, &top));
+       journals++)
+    if (db_close(f) < 0)
+      break;
+  if (!journals)
+    return 0;
+
+  for (n = journals; n > 0; n--) {
+    f = db_open_journal(filename, n, &top);
+    if (!f) {
+      do_rawlog(LT_ERR, T("ERROR: Unable to reopen journal %s.j%d"),
+                filename, n);
+      return -1;
+    }
+    if (!journal_seen) {
+      journal_seen_size = top;
+      journal_seen = mush_malloc((top + 8) / 8, "journal.seen");
+      if (!journal_seen)
+        mush_panic("Unable to allocate memory for checkpoint journals");
+      memset(journal_seen, 0, (top + 8) / 8);
+    }
+    while ((c = fgetc(f)) == '!' || c == '-') {
+      i = getref(f);
+      if (i < 0 || i >= journal_seen_size) {
+        do_rawlog(LT_ERR, T("ERROR: Bad object #%d in journal %s.j%d"), i,
+                  filename, n);
+        db_close(f);
+        return -1;
+      }
+      if (c == '-')
+        db_grow(i + 1);
+      else if (db_read_object(f, i) < 0) {
+        db_close(f);
+        return -1;
+      }
+      JOURNAL_SET(journal_seen, i);
+    }
+    buff[0] = '\0';
+    if (c == '*') {
+      ungetc('*', f);
+      fgets(buff, sizeof buff, f);
+    }
+    if (db_close(f) < 0)
+      return -1;
+    if (strcmp(buff, EOD) != 0) {
+      do_rawlog(LT_ERR, T("ERROR: No end of dump after object #%d in %s.j%d"),
+                i, filename, n);
+      return -1;
+    }
+  }
+  do_rawlog(LT_ERR, T("Replayed %d checkpoint journal%s"), journals,
+            journals == 1 ? "" : "s");
+  return journals;
+}
+
+/** Make the file name of one shard of a sharded dump.
+ * \param buff buffer to store the name in.
+ * \param len size of buff.
+ * \param filename the name of the manifest, without compression suffix.
+ * \param shard the number of the shard.
+ * \param generation the generation in the manifest, or 0 for a
+ * manifest that doesn't have one.
+ */
+void
+db_shard_name(char *buff, size_t len, const char *filename, int shard,
+              int generation)
+{
+  if (generation)
+    snprintf(buff, len, "%s.s%d.g%d", filename, shard, generation);
+  else
+    snprintf(buff, len, "%s.s%d", filename, shard);
+}
+
+/* Read the generation line after the shard count of a manifest, if
+ * there is one. Manifests without one name their shards .s<n>. */
+static int
+db_read_generation(FILE * f)
+{
+  int c, generation = 0;
+
+  c = fgetc(f);
+  if (c == EOF)
+    return 0;
+  ungetc(c, f);
+  if (c == 'g')
+    db_read_this_labeled_number(f, "generation", &generation);
+  return generation;
+}
+
+/** Read the header of a dump to see if it is the manifest of a
+ * sharded dump.
+ * Reading stops at the shard list or at the first object, so the
+ * objects of a dump that isn't sharded are left unread.
+ * \param f file pointer to read from.
+ * \param generation pointer to update to the generation of the shards.
+ * \return the number of shards, or 0 if the file isn't a manifest.
+ */
+int
+db_read_manifest(FILE * f, int *generation)
+{
+  char buff[BUFFER_LEN];
+  char *label;
+  int c, shards = 0;
+
+  *generation = 0;
+  while (fgets(buff, sizeof buff, f) && *buff != '!' && strcmp(buff, EOD)) {
+    if (strcmp(buff, "+SHARDS LIST\n") != 0)
+      continue;
+    db_read_labeled_number(f, &label, &shards);
+    if (strcmp(label, "shards") != 0)
+      return 0;
+    if ((c = fgetc(f)) == 'g') {
+      ungetc(c, f);
+      db_read_labeled_number(f, &label, generation);
+    }
+    return shards;
+  }
+  return 0;
+}
+
+/* Read the objects in one shard of a sharded dump. */
+static int
+db_read_shard(const char *filename, int shard, int generation)
+{
+  char name[BUFFER_LEN];
+  char buff[80];
+  char *tmp;
+  FILE *f;
+  int c;
+  dbref i = NOTHING;
+
+  db_shard_name(name, sizeof name, filename, shard, generation);
+  f = db_open(name);
+  if (!f) {
+    do_rawlog(LT_ERR, T("ERROR: Unable to open database shard %s"), name);
+    return -1;
+  }
+  db_read_this_labeled_string(f, "savedtime", &tmp);
+  if (strcmp(tmp, db_timestamp) != 0) {
+    do_rawlog(LT_ERR, T("ERROR: Database shard %s is from another dump."),
+              name);
+    db_close(f);
+    return -1;
+  }
+  while ((c = fgetc(f)) == '!') {
+    i = getref(f);
+    if (db_read_object(f, i) < 0) {
+      db_close(f);
+      return -1;
+    }
+  }
+  buff[0] = '\0';
+  if (c == '*') {
+    ungetc('*', f);
+    fgets(buff, sizeof buff, f);
+  }
+  if (db_close(f) < 0)
+    return -1;
+  if (strcmp(buff, EOD) != 0) {
+    do_rawlog(LT_ERR, T("ERROR: No end of dump after object #%d in %s"), i,
+              name);
+    return -1;
+  }
+  return 0;
+}
+
 /** Read the object database from a file.
  * This function reads the entire database from a file. See db_write()
- * for some notes about the expected format.
+ * for some notes about the expected format. If the file is the manifest
+ * of a sharded dump, the objects are read from each shard in turn.
  * \param f file pointer to read from.
+ * \param filename the name f was opened as, used to find any shards.
  * \return number of objects in the database.
  */
 dbref
-db_read(FILE * f)
+db_read(FILE * f, const char *filename)
 {
-  int c;
+  int c, shard, shards, generation;
   dbref i = 0;
   char *tmp;
-  struct object *o;
-  div_pbits div_powers;
   /* Changed because CobraMUSH 0.7 and after assume DBF_TYPE_GARBAGE implies
    * a PennMUSH database that needs to be converted. */
   /* int minimum_flags =
@@ -1794,6 +2769,13 @@ db_read(FILE * f)
             init_powers();
           flag_read_all(f, NULL);
         }
+      } else if (c == 'S') {
+        (void) getstring_noalloc(f);
+        db_read_this_labeled_number(f, "shards", &shards);
+        generation = db_read_generation(f);
+        for (shard = 0; shard < shards; shard++)
+          if (db_read_shard(filename, shard, generation) < 0)
+            return -1;
       } else {
         do_rawlog(LT_ERR, T("Unrecognized database format!"));
         return -1;
@@ -1801,207 +2783,15 @@ db_read(FILE * f)
       break;
     case '~':
       db_init = (getref(f) * 3) / 2;
-      init_objdata_htab(db_init);
+      init_objdata(db_init);
+      if (db_read_journals(filename) < 0)
+        return -1;
       break;
     case '!':
       /* Read an object */
-      {
-        char *label, *value;
-        /* Thre should be an entry in the enum and following table and
-           switch for each top-level label associated with an
-           object. Not finding a label is not an error; the default
-           set in new_object() is used. Finding a label not listed
-           below is an error. */
-        enum known_labels {
-          LBL_NAME, LBL_LOCATION, LBL_CONTENTS, LBL_EXITS,
-          LBL_NEXT, LBL_PARENT, LBL_LOCKS, LBL_OWNER, LBL_ZONE,
-          LBL_PENNIES, LBL_TYPE, LBL_FLAGS, LBL_POWERGROUPS, LBL_POWERS, LBL_WARNINGS,
-          LBL_CREATED, LBL_MODIFIED, LBL_ATTRS, LBL_ERROR, LBL_LEVEL,
-          LBL_DIVOBJ, LBL_PWRLVL, LBL_LMOD
-        };
-        struct label_table {
-          const char *label;
-          enum known_labels tag;
-        };
-        struct label_table fields[] = {
-          {"name", LBL_NAME},
-          {"location", LBL_LOCATION},
-          {"contents", LBL_CONTENTS},
-          {"exits", LBL_EXITS},
-          {"next", LBL_NEXT},
-          {"parent", LBL_PARENT},
-          {"lockcount", LBL_LOCKS},
-          {"owner", LBL_OWNER},
-          {"zone", LBL_ZONE},
-          {"pennies", LBL_PENNIES},
-          {"type", LBL_TYPE},
-          {"flags", LBL_FLAGS},
-          {"powers", LBL_POWERS},
-          {"warnings", LBL_WARNINGS},
-          {"created", LBL_CREATED},
-          {"modified", LBL_MODIFIED},
-          {"attrcount", LBL_ATTRS},
-          {"division_object", LBL_DIVOBJ},
-          {"level", LBL_LEVEL},
-          {"powerlevel", LBL_PWRLVL},
-          {"powergroup", LBL_POWERGROUPS},
-          {"lastmod", LBL_LMOD},
-           /* Add new label types here. */
-          {NULL, LBL_ERROR}
-        }, *entry;
-        enum known_labels the_label;
-
-        i = getref(f);
-        db_grow(i + 1);
-        o = db + i;
-        while (1) {
-          c = fgetc(f);
-          ungetc(c, f);
-          /* At the start of another object or the EOD marker */
-          if (c == '!' || c == '*')
-            break;
-          db_read_labeled_string(f, &label, &value);
-          the_label = LBL_ERROR;
-          /* Look up the right enum value in the label table */
-          for (entry = fields; entry->label; entry++) {
-            if (strcmp(entry->label, label) == 0) {
-              the_label = entry->tag;
-              break;
-            }
-          }
-          switch (the_label) {
-          case LBL_NAME:
-            set_name(i, value);
-            break;
-          case LBL_LOCATION:
-            o->location = qparse_dbref(value);
-            break;
-          case LBL_CONTENTS:
-            o->contents = qparse_dbref(value);
-            break;
-          case LBL_EXITS:
-            o->exits = qparse_dbref(value);
-            break;
-          case LBL_NEXT:
-            o->next = qparse_dbref(value);
-            break;
-          case LBL_PARENT:
-            o->parent = qparse_dbref(value);
-            break;
-          case LBL_LOCKS:
-            get_new_locks(i, f, parse_integer(value));
-            break;
-          case LBL_LEVEL:
-            o->division.level = parse_integer(value); 
-            break;
-          case LBL_PWRLVL:
-            /* Do nothing with this value */
-            break;
-          case LBL_DIVOBJ:
-            o->division.object = qparse_dbref(value);
-            break;
-          case LBL_OWNER:
-            o->owner = qparse_dbref(value);
-            break;
-          case LBL_ZONE:
-            o->zone = qparse_dbref(value);
-            break;
-          case LBL_PENNIES:
-            s_Pennies(i, parse_integer(value));
-            break;
-          case LBL_TYPE:
-            o->type = parse_integer(value);
-            switch (Typeof(i)) {
-            case TYPE_PLAYER:
-              current_state.players++;
-              current_state.garbage--;
-              break;
-            case TYPE_DIVISION:
-              current_state.divisions++;
-              current_state.garbage--;
-              break;
-            case TYPE_THING:
-              current_state.things++;
-              current_state.garbage--;
-              break;
-            case TYPE_EXIT:
-              current_state.exits++;
-              current_state.garbage--;
-              break;
-            case TYPE_ROOM:
-              current_state.rooms++;
-              current_state.garbage--;
-              break;
-            }
-            break;
-          case LBL_FLAGS:
-            o->flags = string_to_bits("FLAG", value);
-            /* Clear the GOING flags. If it was scheduled for destruction
-             * when the db was saved, it gets a reprieve.
-             */
-            clear_flag_internal(i, "GOING");
-            clear_flag_internal(i, "GOING_TWICE");
-            break;
-          case LBL_POWERS:
-              div_powers = string_to_dpbits(value);
-              if(power_is_zero(div_powers, DP_BYTES) == 0) {
-                o->division.dp_bytes = NULL;
-                mush_free(div_powers, "POWER_SPOT");
-              } else o->division.dp_bytes =  div_powers;
-            break;
-          case LBL_POWERGROUPS:
-            powergroup_db_set(NOTHING, i, value, 0);
-            break;
-          case LBL_WARNINGS:
-            o->warnings = parse_warnings(NOTHING, value);
-            break;
-          case LBL_CREATED:
-            o->creation_time = (time_t) parse_integer(value);
-            break;
-          case LBL_MODIFIED:
-            o->modification_time = (time_t) parse_integer(value);
-            break;
-          case LBL_LMOD:
-            db[i].lastmod = NULL;
-            set_lmod(i, value);
-            break;
-          case LBL_ATTRS:
-            {
-              int attrcount = parse_integer(value);
-              db_read_attrs(f, i, attrcount);
-            }
-            break;
-          case LBL_ERROR:
-          default:
-            do_rawlog(LT_ERR, T("Unrecognized field '%s' in object #%d"),
-                      label, i);
-            return -1;
-          }
-        }
-        if (IsPlayer(i) && (strlen(o->name) > (size_t) PLAYER_NAME_LIMIT)) {
-          char buff[BUFFER_LEN + 1];    /* The name plus a NUL */
-          strncpy(buff, o->name, PLAYER_NAME_LIMIT);
-          buff[PLAYER_NAME_LIMIT] = '\0';
-          set_name(i, buff);
-          do_rawlog(LT_CHECK,
-                    T
-                    (" * Name of #%d is longer than the maximum, truncating.\n"),
-                    i);
-        } else if (!IsPlayer(i) && (strlen(o->name) > OBJECT_NAME_LIMIT)) {
-          char buff[OBJECT_NAME_LIMIT + 1];     /* The name plus a NUL */
-          strncpy(buff, o->name, OBJECT_NAME_LIMIT);
-          buff[OBJECT_NAME_LIMIT] = '\0';
-          set_name(i, buff);
-          do_rawlog(LT_CHECK,
-                    T
-                    (" * Name of #%d is longer than the maximum, truncating.\n"),
-                    i);
-        }
-        if (IsPlayer(i)) {
-          add_player(i);
-          clear_flag_internal(i, "CONNECTED");
-        }
-      }
+      i = getref(f);
+      if (db_read_object(f, i) < 0)
+        return -1;
       break;
     case '*':
       {
@@ -2013,6 +2803,11 @@ db_read(FILE * f)
           return -1;
         } else {
           loading_db = 0;
+          if (journal_seen) {
+            mush_free(journal_seen, "journal.seen");
+            journal_seen = NULL;
+            journal_seen_size = 0;
+          }
           log_mem_check();
           fix_free_list();
           dbck();
@@ -2029,11 +2824,23 @@ db_read(FILE * f)
   return -1;
 }
 
-static void
-init_objdata_htab(int size)
+/** Throw away all object data, as a new database is loaded.
+ * Keybases keep their slots.
+ * \param size how many objects the database is expected to hold.
+ */
+void
+init_objdata(int size)
 {
-  hashinit(&htab_objdata, size, 4);
-  hashinit(&htab_objdata_keys, 8, 32);
+  int i;
+
+  for (i = 0; i < objdata_nkeys; i++) {
+    if (objdata_keys[i].data)
+      mush_free(objdata_keys[i].data, "objdata");
+    objdata_keys[i].data = NULL;
+    objdata_keys[i].count = 0;
+  }
+  objdata_size = 0;
+  objdata_initial = (size > 0) ? size : DB_INITIAL_SIZE;
 }
 
 void init_postconvert() {
@@ -2090,12 +2897,127 @@ void init_postconvert() {
 
 }
 
-/** Add data to the object data hashtable. 
- * This hash table is typically used to store transient object data
- * that is built at database load and isn't saved to disk, but it
+/* Return a keybase's slot, or -1 if it hasn't been used. */
+static int
+objdata_find(const char *keybase)
+{
+  int i;
+
+  for (i = 0; i < objdata_nkeys; i++)
+    if (!strcmp(objdata_keys[i].name, keybase))
+      return i;
+  return -1;
+}
+
+/** Get the object data slot for a keybase, giving it one if need be.
+ * Code that looks up its data often can keep the slot and use
+ * get_objdata_slot() and set_objdata_slot() instead of the keybase.
+ * \param keybase base string for type of data.
+ * \return the keybase's slot.
+ */
+int
+objdata_slot(const char *keybase)
+{
+  OBJDATA_KEY *keys;
+  int slot;
+
+  if ((slot = objdata_find(keybase)) >= 0)
+    return slot;
+  keys = (OBJDATA_KEY *) realloc(objdata_keys,
+                                 (objdata_nkeys + 1) * sizeof(OBJDATA_KEY));
+  if (!keys)
+    mush_panic("Unable to allocate memory for object data keys");
+  objdata_keys = keys;
+  slot = objdata_nkeys++;
+  objdata_keys[slot].name = mush_strdup(keybase, "objdata");
+  objdata_keys[slot].data = NULL;
+  objdata_keys[slot].count = 0;
+  return slot;
+}
+
+/* Make every slot's table big enough to hold thing. */
+static void
+objdata_grow(dbref thing)
+{
+  void **data;
+  dbref size;
+  int i;
+
+  if (thing < objdata_size)
+    return;
+  size = objdata_size ? objdata_size : objdata_initial;
+  while (size <= thing)
+    size *= 2;
+  for (i = 0; i < objdata_nkeys; i++) {
+    if (!objdata_keys[i].data)
+      continue;
+    data = (void **) mush_malloc(size * sizeof(void *), "objdata");
+    if (!data)
+      mush_panic("Unable to allocate memory for object data");
+    memcpy(data, objdata_keys[i].data, objdata_size * sizeof(void *));
+    memset(data + objdata_size, 0, (size - objdata_size) * sizeof(void *));
+    mush_free(objdata_keys[i].data, "objdata");
+    objdata_keys[i].data = data;
+  }
+  objdata_size = size;
+}
+
+/** Store data for an object in an object data slot.
+ * \param thing dbref of object to associate the data with.
+ * \param slot slot from objdata_slot().
+ * \param data pointer to the data to store, or NULL to clear it.
+ * \return data passed in.
+ */
+void *
+set_objdata_slot(dbref thing, int slot, void *data)
+{
+  OBJDATA_KEY *key;
+
+  if (slot < 0 || slot >= objdata_nkeys || thing < 0)
+    return NULL;
+  objdata_sets++;
+  key = &objdata_keys[slot];
+  if (thing >= objdata_size || !key->data) {
+    if (!data)
+      return NULL;
+    objdata_grow(thing);
+    if (!key->data) {
+      key->data = (void **) mush_malloc(objdata_size * sizeof(void *),
+                                        "objdata");
+      if (!key->data)
+        mush_panic("Unable to allocate memory for object data");
+      memset(key->data, 0, objdata_size * sizeof(void *));
+    }
+  }
+  if (key->data[thing] && !data)
+    key->count--;
+  else if (!key->data[thing] && data)
+    key->count++;
+  key->data[thing] = data;
+  return data;
+}
+
+/** Retrieve data for an object from an object data slot.
+ * \param thing dbref of object data is associated with.
+ * \param slot slot from objdata_slot().
+ * \return data stored for that object in that slot, or NULL.
+ */
+void *
+get_objdata_slot(dbref thing, int slot)
+{
+  objdata_gets++;
+  if (slot < 0 || slot >= objdata_nkeys || thing < 0
+      || thing >= objdata_size || !objdata_keys[slot].data)
+    return NULL;
+  return objdata_keys[slot].data[thing];
+}
+
+/** Add data to the object data table.
+ * The object data table is typically used to store transient object
+ * data that is built at database load and isn't saved to disk, but it
  * can be used for other purposes as well - it's a good general
  * tool for hackers who want to add their own data to objects.
- * This function adds data to the hashtable.
+ * This function adds data to the table.
  * \param thing dbref of object to associate the data with.
  * \param keybase base string for type of data.
  * \param data pointer to the data to store.
@@ -2104,19 +3026,17 @@ void init_postconvert() {
 void *
 set_objdata(dbref thing, const char *keybase, void *data)
 {
-  hashdelete(tprintf("%s_#%d", keybase, thing), &htab_objdata);
-  if (data) {
-    if (hashadd(tprintf("%s_#%d", keybase, thing), data, &htab_objdata) < 0)
+  int slot;
+
+  if ((slot = objdata_find(keybase)) < 0) {
+    if (!data)
       return NULL;
-    if (hash_find(&htab_objdata_keys, keybase) == NULL) {
-      char *newkey = strdup(keybase);
-      hashadd(keybase, (void *) &newkey, &htab_objdata_keys);
-    }
+    slot = objdata_slot(keybase);
   }
-  return data;
+  return set_objdata_slot(thing, slot, data);
 }
 
-/** Retrieve data from the object data hashtable.
+/** Retrieve data from the object data table.
  * \param thing dbref of object data is associated with.
  * \param keybase base string for type of data.
  * \return data stored for that object and keybase, or NULL.
@@ -2124,23 +3044,41 @@ set_objdata(dbref thing, const char *keybase, void *data)
 void *
 get_objdata(dbref thing, const char *keybase)
 {
-  return hashfind(tprintf("%s_#%d", keybase, thing), &htab_objdata);
+  return get_objdata_slot(thing, objdata_find(keybase));
 }
 
-/** Clear all of an object's data from the object data hashtable.
+/** Clear all of an object's data from the object data table.
  * This function clears any data associated with a given object
- * that's in the object data hashtable (under any keybase).
+ * that's in the object data table (under any keybase).
  * It's used before we free the object.
  * \param thing dbref of object data is associated with.
  */
 void
 clear_objdata(dbref thing)
 {
-  char *p;
-  for (p = (char *) hash_firstentry(&htab_objdata_keys);
-       p; p = (char *) hash_nextentry(&htab_objdata_keys)) {
-    set_objdata(thing, p, NULL);
-  }
+  int i;
+
+  if (thing < 0 || thing >= objdata_size)
+    return;
+  for (i = 0; i < objdata_nkeys; i++)
+    if (objdata_keys[i].data && objdata_keys[i].data[thing])
+      set_objdata_slot(thing, i, NULL);
+}
+
+/** Report on the object data table, for @stats/tables.
+ * \param player the enactor.
+ */
+void
+objdata_stats(dbref player)
+{
+  int i;
+
+  notify(player, "Object Data:");
+  for (i = 0; i < objdata_nkeys; i++)
+    notify_format(player, "%-16s %d objects", objdata_keys[i].name,
+                  objdata_keys[i].count);
+  notify_format(player, "%d keys, table size %d. %lu lookups, %lu changes.",
+                objdata_nkeys, objdata_size, objdata_gets, objdata_sets);
 }
 
 /** Create a basic 3-object (Start Room, God, Master Room) database. */
@@ -2159,7 +3097,7 @@ create_minimal_db(void)
   master_room = new_object();   /* #2 */
   master_division = new_object(); /* #3 */
 
-  init_objdata_htab(DB_INITIAL_SIZE);
+  init_objdata(DB_INITIAL_SIZE);
 
   set_name(start_room, "Room Zero");
   Type(start_room) = TYPE_ROOM;
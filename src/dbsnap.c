@@ -0,0 +1,876 @@
+/**
+ * \file dbsnap.c
+ *
+ * \brief Binary snapshots of the CobraMUSH object database.
+ *
+ * A snapshot holds the same objects as the labeled text dump written
+ * by db_write(), laid out so that it can be mapped into memory and
+ * loaded without any parsing beyond following offsets. The file is:
+ *
+ * \verbatim
+ * header        fixed size, with offsets of everything below
+ * object blocks one per non-garbage object, each holding:
+ *                 struct snap_object
+ *                 attrcount x struct snap_attr
+ *                 lockcount x struct snap_lock
+ *                 names, values, flag/power bitmaps, lock bytecode
+ * object index  file offset of each object block
+ * flag map      bit position and name of every flag at dump time
+ * power map     name and bit positions of every power at dump time
+ * string pool   strings shared between objects (attribute names,
+ *               lock types, lastmod, powergroups, the save time)
+ * \endverbatim
+ *
+ * Offsets inside an object block are relative to the start of the
+ * block; string pool offsets are relative to the start of the pool.
+ * Flag and power bitmaps are stored raw, and are only translated bit
+ * by bit if the flag or power tables have changed since the dump.
+ * Lock keys are stored as boolexp bytecode. Attribute values are
+ * stored uncompressed, since the compression tables are not stable
+ * between runs.
+ *
+ * Snapshots are written in the byte order and word size of the
+ * server that wrote them; a server that can't read one directly
+ * refuses it, and the text dump should be used to move a database
+ * between machines.
+ */
+
+#include "copyrite.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef I_SYS_TYPES
+#include <sys/types.h>
+#endif
+#ifdef I_SYS_STAT
+#include <sys/stat.h>
+#endif
+#ifdef I_UNISTD
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+#include <errno.h>
+#include "conf.h"
+#include "dbio.h"
+#include "externs.h"
+#include "mushdb.h"
+#include "attrib.h"
+#include "mymalloc.h"
+#include "game.h"
+#include "flags.h"
+#include "lock.h"
+#include "dbdefs.h"
+#include "log.h"
+#include "htab.h"
+#include "ptab.h"
+#include "chunk.h"
+#include "division.h"
+#include "confmagic.h"
+
+extern long indb_flags;
+extern long flagdb_flags;
+extern int use_flagfile;
+extern int loading_db;
+extern int db_init;
+extern char db_timestamp[100];
+extern HASHTAB htab_flagspaces;
+
+/** Magic string at the start of every snapshot */
+#define SNAP_MAGIC "CobraSnp"
+/** Snapshot format version; bump whenever the layout changes */
+#define SNAP_VERSION 1
+/** Written as-is, to recognize snapshots from other byte orders */
+#define SNAP_BYTEORDER 0x01020304
+/** Alignment of object blocks and the records inside them */
+#define SNAP_ALIGN 8
+
+/** Round a length up to the snapshot alignment */
+#define SNAP_ROUND(n) (((n) + SNAP_ALIGN - 1) & ~((size_t) SNAP_ALIGN - 1))
+
+typedef unsigned long long snap_off;
+
+/** Snapshot file header. */
+struct snap_header {
+  char magic[8];                /**< SNAP_MAGIC */
+  u_int_32 version;             /**< SNAP_VERSION */
+  u_int_32 byteorder;           /**< SNAP_BYTEORDER */
+  u_int_32 header_size;         /**< sizeof(struct snap_header) */
+  u_int_32 object_size;         /**< sizeof(struct snap_object) */
+  u_int_32 attr_size;           /**< sizeof(struct snap_attr) */
+  u_int_32 lock_size;           /**< sizeof(struct snap_lock) */
+  u_int_32 dbflags;             /**< DBF_* flags of the writing server */
+  u_int_32 savedtime;           /**< Pool offset of the save time */
+  int db_top;                   /**< db_top when written */
+  u_int_32 objects;             /**< Number of object blocks */
+  u_int_32 attrs;               /**< Total number of attributes */
+  u_int_32 locks;               /**< Total number of locks */
+  u_int_32 flagcount;           /**< Entries in the flag map */
+  u_int_32 flagbytes;           /**< Length of each flag bitmap */
+  u_int_32 powercount;          /**< Entries in the power map */
+  u_int_32 powerbytes;          /**< Length of each power bitmap */
+  snap_off index;               /**< Offset of the object index */
+  snap_off flagmap;             /**< Offset of the flag map */
+  snap_off powermap;            /**< Offset of the power map */
+  snap_off pool;                /**< Offset of the string pool */
+  snap_off poolsize;            /**< Length of the string pool */
+  snap_off size;                /**< Length of the whole file */
+};
+
+/** One object, at the start of its block. */
+struct snap_object {
+  int dbref;                    /**< The object's dbref */
+  u_int_32 size;                /**< Length of the whole block */
+  int location;                 /**< Location */
+  int contents;                 /**< First item of contents */
+  int exits;                    /**< First exit, or home */
+  int next;                     /**< Next in contents/exits chain */
+  int parent;                   /**< Parent */
+  int owner;                    /**< Owner */
+  int zone;                     /**< Zone */
+  int division;                 /**< Division object */
+  int level;                    /**< Division level */
+  int pennies;                  /**< Pennies */
+  int type;                     /**< Object type */
+  int warnings;                 /**< Warning bits */
+  u_int_32 created;             /**< Creation time */
+  u_int_32 modified;            /**< Modification time */
+  u_int_32 name;                /**< Block offset of the name */
+  u_int_32 lastmod;             /**< Pool offset of the lastmod */
+  u_int_32 powergroups;         /**< Pool offset of powergroup names */
+  u_int_32 flags;               /**< Block offset of the flag bitmap */
+  u_int_32 powers;              /**< Block offset of power bitmap, or 0 */
+  u_int_32 attrcount;           /**< Attributes following the object */
+  u_int_32 lockcount;           /**< Locks following the attributes */
+  u_int_32 pad;
+};
+
+/** One attribute. */
+struct snap_attr {
+  u_int_32 name;                /**< Pool offset of the name */
+  u_int_32 value;               /**< Block offset of the value */
+  int owner;                    /**< Owner */
+  u_int_32 flags;               /**< AF_* flags */
+  u_int_32 modtime;             /**< Modification time */
+  u_int_32 wlock;               /**< Block offset of write lock bytecode */
+  u_int_32 rlock;               /**< Block offset of read lock bytecode */
+  u_int_16 wlock_len;           /**< Length of write lock bytecode */
+  u_int_16 rlock_len;           /**< Length of read lock bytecode */
+  unsigned char derefs;         /**< Deref count of the value */
+  unsigned char wlock_derefs;   /**< Deref count of the write lock */
+  unsigned char rlock_derefs;   /**< Deref count of the read lock */
+  unsigned char pad;
+};
+
+/** One lock. */
+struct snap_lock {
+  u_int_32 type;                /**< Pool offset of the lock type */
+  u_int_32 key;                 /**< Block offset of the key bytecode */
+  int creator;                  /**< Creator */
+  int flags;                    /**< Lock flags */
+  u_int_16 key_len;             /**< Length of the key bytecode */
+  unsigned char derefs;         /**< Deref count of the key */
+  unsigned char pad;
+};
+
+/** One flag map entry. */
+struct snap_flag {
+  u_int_32 bit;                 /**< Bit position when written */
+  u_int_32 name;                /**< Pool offset of the flag name */
+};
+
+/** One power map entry. */
+struct snap_power {
+  u_int_32 name;                /**< Pool offset of the power name */
+  u_int_32 flag_yes;            /**< Bit for Yes */
+  u_int_32 flag_lte;            /**< Bit for YesLTE */
+  u_int_32 flag_lt;             /**< Bit for YesLT */
+};
+
+/** A growable buffer used while writing. */
+struct snap_buf {
+  char *data;                   /**< Contents */
+  size_t len;                   /**< Bytes used */
+  size_t size;                  /**< Bytes allocated */
+};
+
+static struct snap_buf snap_block;      /**< Object block being built */
+static struct snap_buf snap_pool;       /**< String pool being built */
+static HASHTAB snap_names;      /**< Pool offsets of pooled strings */
+
+static void snap_reserve(struct snap_buf *b, size_t size);
+static size_t snap_grow(struct snap_buf *b, size_t n);
+static size_t snap_put(struct snap_buf *b, const void *data, size_t n);
+static u_int_32 snap_pool_str(const char *s);
+static u_int_32 snap_put_lock(boolexp b, u_int_16 *len,
+                              unsigned char *derefs);
+static void snap_fwrite(const void *data, size_t n, FILE * f);
+static void snap_write_object(FILE * f, dbref i, size_t flagbytes);
+static int snap_valid_header(const struct snap_header *h, size_t size);
+static int *snap_flag_remap(const char *base, const struct snap_header *h,
+                            int *identity);
+static int *snap_power_remap(const char *base, const struct snap_header *h,
+                             int *identity);
+static unsigned char *snap_bits(const unsigned char *bits, int snapbytes,
+                                int bytes, const int *remap, int identity,
+                                const char *tag);
+static int snap_read_object(const char *block, size_t avail,
+                            const char *pool, const struct snap_header *h,
+                            const int *flagmap, int flag_identity,
+                            const int *powermap, int power_identity);
+
+/* Make sure a buffer has room for size bytes. */
+static void
+snap_reserve(struct snap_buf *b, size_t size)
+{
+  size_t newsize;
+  char *data;
+
+  if (size <= b->size)
+    return;
+  newsize = b->size ? b->size : BUFFER_LEN * 4;
+  while (size > newsize)
+    newsize *= 2;
+  data = mush_malloc(newsize, "snapshot.buffer");
+  if (!data)
+    mush_panic("Unable to allocate memory for database snapshot");
+  if (b->data) {
+    memcpy(data, b->data, b->len);
+    mush_free(b->data, "snapshot.buffer");
+  }
+  b->data = data;
+  b->size = newsize;
+}
+
+/* Add n zeroed bytes at the aligned end of a buffer, returning their
+ * offset. */
+static size_t
+snap_grow(struct snap_buf *b, size_t n)
+{
+  size_t off = SNAP_ROUND(b->len);
+
+  snap_reserve(b, off + n);
+  memset(b->data + b->len, 0, off + n - b->len);
+  b->len = off + n;
+  return off;
+}
+
+/* Append bytes to a buffer, returning their offset. */
+static size_t
+snap_put(struct snap_buf *b, const void *data, size_t n)
+{
+  size_t off = snap_grow(b, n);
+  memcpy(b->data + off, data, n);
+  return off;
+}
+
+/* Add a string to the pool, once, returning its offset. Offset 0 is
+ * the empty string. */
+static u_int_32
+snap_pool_str(const char *s)
+{
+  void *off;
+  size_t n;
+
+  if (!s || !*s)
+    return 0;
+  if ((off = hashfind(s, &snap_names)))
+    return (u_int_32) (size_t) off;
+  /* Pool strings don't need aligning; append them back to back. */
+  n = strlen(s) + 1;
+  snap_reserve(&snap_pool, snap_pool.len + n);
+  memcpy(snap_pool.data + snap_pool.len, s, n);
+  off = (void *) snap_pool.len;
+  snap_pool.len += n;
+  hashadd(s, off, &snap_names);
+  return (u_int_32) (size_t) off;
+}
+
+/* Copy a lock's bytecode into the object block. */
+static u_int_32
+snap_put_lock(boolexp b, u_int_16 *len, unsigned char *derefs)
+{
+  size_t off;
+
+  if (b == TRUE_BOOLEXP) {
+    *len = 0;
+    *derefs = 0;
+    return 0;
+  }
+  *len = chunk_len(b);
+  *derefs = chunk_derefs(b);
+  off = snap_grow(&snap_block, *len);
+  chunk_fetch(b, (unsigned char *) snap_block.data + off, *len);
+  return off;
+}
+
+static void
+snap_fwrite(const void *data, size_t n, FILE * f)
+{
+  if (n && fwrite(data, 1, n, f) != n)
+    longjmp(db_err, 1);
+}
+
+/* Build and write the block for one object. */
+static void
+snap_write_object(FILE * f, dbref i, size_t flagbytes)
+{
+  struct object *o = db + i;
+  struct snap_object so;
+  struct snap_attr sa;
+  struct snap_lock sl;
+  size_t attrs, locks;
+  ALIST *list;
+  lock_list *ll;
+  const char *value;
+
+  memset(&so, 0, sizeof so);
+  for (list = o->list; list; list = AL_NEXT(list))
+    if (!AF_Nodump(list))
+      so.attrcount++;
+  for (ll = Locks(i); ll; ll = L_NEXT(ll))
+    so.lockcount++;
+
+  /* The object, attribute and lock records are back to back */
+  snap_block.len = 0;
+  snap_grow(&snap_block, sizeof so + so.attrcount * sizeof sa
+            + so.lockcount * sizeof sl);
+  attrs = sizeof so;
+  locks = attrs + so.attrcount * sizeof sa;
+
+  so.dbref = i;
+  so.location = o->location;
+  so.contents = o->contents;
+  so.exits = o->exits;
+  so.next = o->next;
+  so.parent = o->parent;
+  so.owner = o->owner;
+  so.zone = o->zone;
+  so.division = o->division.object;
+  so.level = o->division.level;
+  so.pennies = Pennies(i);
+  so.type = Typeof(i);
+  so.warnings = o->warnings;
+  so.created = (u_int_32) o->creation_time;
+  so.modified = (u_int_32) o->modification_time;
+  so.name = snap_put(&snap_block, o->name ? o->name : "",
+                     o->name ? strlen(o->name) + 1 : 1);
+  so.lastmod = snap_pool_str(o->lastmod);
+  so.powergroups = snap_pool_str(powergroups_list_on(i, 0));
+  so.flags = snap_grow(&snap_block, flagbytes);
+  if (o->flags)
+    memcpy(snap_block.data + so.flags, o->flags, flagbytes);
+  if (o->division.dp_bytes)
+    so.powers = snap_put(&snap_block, o->division.dp_bytes, DP_BYTES);
+
+  for (list = o->list; list; list = AL_NEXT(list)) {
+    if (AF_Nodump(list))
+      continue;
+    memset(&sa, 0, sizeof sa);
+    sa.name = snap_pool_str(AL_NAME(list));
+    sa.owner = Owner(AL_CREATOR(list));
+    sa.flags = AL_FLAGS(list) & ~(AF_NUKED | AF_STATIC | AF_LISTED | AF_ANON);
+    sa.modtime = (u_int_32) AL_MODTIME(list);
+    sa.derefs = AL_DEREFS(list);
+    sa.wlock = snap_put_lock(AL_WLock(list), &sa.wlock_len, &sa.wlock_derefs);
+    sa.rlock = snap_put_lock(AL_RLock(list), &sa.rlock_len, &sa.rlock_derefs);
+    value = atr_value(list);
+    sa.value = snap_put(&snap_block, value, strlen(value) + 1);
+    memcpy(snap_block.data + attrs, &sa, sizeof sa);
+    attrs += sizeof sa;
+  }
+
+  for (ll = Locks(i); ll; ll = L_NEXT(ll)) {
+    memset(&sl, 0, sizeof sl);
+    sl.type = snap_pool_str(L_TYPE(ll));
+    sl.creator = L_CREATOR(ll);
+    sl.flags = L_FLAGS(ll);
+    sl.key = snap_put_lock(L_KEY(ll), &sl.key_len, &sl.derefs);
+    memcpy(snap_block.data + locks, &sl, sizeof sl);
+    locks += sizeof sl;
+  }
+
+  snap_grow(&snap_block, 0);
+  so.size = snap_block.len;
+  memcpy(snap_block.data, &so, sizeof so);
+  snap_fwrite(snap_block.data, snap_block.len, f);
+}
+
+/** Write a binary snapshot of the object database.
+ * The file must be a plain file opened for writing, not a pipe, since
+ * the header is rewritten once the layout is known.
+ * \param f file pointer to write to.
+ * \return the number of objects in the database (db_top)
+ */
+dbref
+db_write_snapshot(FILE * f)
+{
+  struct snap_header h;
+  FLAGSPACE *n;
+  POWER *power;
+  snap_off *index;
+  snap_off off;
+  char pname[BUFFER_LEN];
+  struct snap_flag sf;
+  struct snap_power sp;
+  dbref i;
+  int count = 0;
+  static const char zeros[SNAP_ALIGN];
+
+  n = (FLAGSPACE *) hashfind("FLAG", &htab_flagspaces);
+  if (!n)
+    longjmp(db_err, 1);
+
+  /* A failed dump can leave the last table behind */
+  if (snap_names.buckets)
+    hashfree(&snap_names);
+  hashinit(&snap_names, 256, 0);
+  snap_pool.len = 0;
+  snap_grow(&snap_pool, 1);     /* Offset 0 is "" */
+
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, SNAP_MAGIC, sizeof h.magic);
+  h.version = SNAP_VERSION;
+  h.byteorder = SNAP_BYTEORDER;
+  h.header_size = sizeof(struct snap_header);
+  h.object_size = sizeof(struct snap_object);
+  h.attr_size = sizeof(struct snap_attr);
+  h.lock_size = sizeof(struct snap_lock);
+  h.dbflags = db_dump_flags();
+  h.savedtime = snap_pool_str(show_time(mudtime, 1));
+  h.db_top = db_top;
+  h.flagbytes = (n->flagbits + 7) / 8;
+  h.powerbytes = DP_BYTES;
+
+  index = mush_malloc((db_top + 1) * sizeof(snap_off), "snapshot.index");
+  if (!index)
+    mush_panic("Unable to allocate memory for database snapshot");
+
+  snap_fwrite(&h, sizeof h, f);
+  off = sizeof h;
+  for (i = 0; i < db_top; i++) {
+    if (IsGarbage(i))
+      continue;
+    index[h.objects++] = off;
+    snap_write_object(f, i, h.flagbytes);
+    h.attrs += ((struct snap_object *) snap_block.data)->attrcount;
+    h.locks += ((struct snap_object *) snap_block.data)->lockcount;
+    off += snap_block.len;
+  }
+
+  h.index = off;
+  snap_fwrite(index, h.objects * sizeof(snap_off), f);
+  off += h.objects * sizeof(snap_off);
+  mush_free(index, "snapshot.index");
+
+  h.flagmap = off;
+  for (count = 0; count < n->flagbits; count++) {
+    if (!n->flags[count])
+      continue;
+    sf.bit = count;
+    sf.name = snap_pool_str(n->flags[count]->name);
+    snap_fwrite(&sf, sizeof sf, f);
+    off += sizeof sf;
+    h.flagcount++;
+  }
+
+  h.powermap = off;
+  for (power = ptab_firstentry_new(ps_tab.powers, pname); power;
+       power = ptab_nextentry_new(ps_tab.powers, pname)) {
+    /* Aliases are stored under their own names; skip them. */
+    if (strcasecmp(power->name, pname))
+      continue;
+    sp.name = snap_pool_str(power->name);
+    sp.flag_yes = power->flag_yes;
+    sp.flag_lte = power->flag_lte;
+    sp.flag_lt = power->flag_lt;
+    snap_fwrite(&sp, sizeof sp, f);
+    off += sizeof sp;
+    h.powercount++;
+  }
+
+  h.pool = off;
+  h.poolsize = snap_pool.len;
+  snap_fwrite(snap_pool.data, snap_pool.len, f);
+  off += snap_pool.len;
+  snap_fwrite(zeros, SNAP_ROUND(off) - off, f);
+  h.size = SNAP_ROUND(off);
+
+  hashfree(&snap_names);
+
+  if (fflush(f) != 0 || fseek(f, 0L, SEEK_SET) != 0)
+    longjmp(db_err, 1);
+  snap_fwrite(&h, sizeof h, f);
+  if (fflush(f) != 0)
+    longjmp(db_err, 1);
+  return db_top;
+}
+
+/* Check that a header describes a snapshot this server can load. */
+static int
+snap_valid_header(const struct snap_header *h, size_t size)
+{
+  if (size < sizeof(struct snap_header) ||
+      memcmp(h->magic, SNAP_MAGIC, sizeof h->magic)) {
+    do_rawlog(LT_ERR, T("ERROR: Not a database snapshot."));
+    return 0;
+  }
+  if (h->version != SNAP_VERSION) {
+    do_rawlog(LT_ERR, T("ERROR: Database snapshot is version %u, not %u."),
+              h->version, SNAP_VERSION);
+    return 0;
+  }
+  if (h->byteorder != SNAP_BYTEORDER
+      || h->header_size != sizeof(struct snap_header)
+      || h->object_size != sizeof(struct snap_object)
+      || h->attr_size != sizeof(struct snap_attr)
+      || h->lock_size != sizeof(struct snap_lock)) {
+    do_rawlog(LT_ERR,
+              T
+              ("ERROR: Database snapshot was written on an incompatible machine."));
+    return 0;
+  }
+  if (h->size != size || h->index + h->objects * sizeof(snap_off) > size
+      || h->flagmap + h->flagcount * sizeof(struct snap_flag) > size
+      || h->powermap + h->powercount * sizeof(struct snap_power) > size
+      || h->pool + h->poolsize > size || h->poolsize < 1
+      || h->savedtime >= h->poolsize
+      || ((const char *) h)[h->pool + h->poolsize - 1] != '\0') {
+    /* Every string in the pool must end inside it */
+    do_rawlog(LT_ERR, T("ERROR: Database snapshot is truncated or corrupt."));
+    return 0;
+  }
+  return 1;
+}
+
+/* Map the flag bits of a snapshot onto the current flag table.
+ * Sets identity if the bitmaps can be copied as they are. */
+static int *
+snap_flag_remap(const char *base, const struct snap_header *h, int *identity)
+{
+  const struct snap_flag *sf;
+  const char *pool = base + h->pool;
+  int *remap;
+  FLAG *f;
+  u_int_32 i;
+
+  remap = mush_malloc(h->flagbytes * 8 * sizeof(int) + 1, "snapshot.remap");
+  if (!remap)
+    mush_panic("Unable to allocate memory for database snapshot");
+  for (i = 0; i < h->flagbytes * 8; i++)
+    remap[i] = -1;
+  *identity = 1;
+  sf = (const struct snap_flag *) (base + h->flagmap);
+  for (i = 0; i < h->flagcount; i++, sf++) {
+    if (sf->bit >= h->flagbytes * 8 || sf->name >= h->poolsize)
+      continue;
+    f = match_flag(pool + sf->name);
+    if (f)
+      remap[sf->bit] = f->bitpos;
+    if (!f || f->bitpos != (int) sf->bit)
+      *identity = 0;
+  }
+  return remap;
+}
+
+/* Map the power bits of a snapshot onto the current power table.
+ * Sets identity if the bitmaps can be copied as they are. */
+static int *
+snap_power_remap(const char *base, const struct snap_header *h, int *identity)
+{
+  const struct snap_power *sp;
+  const char *pool = base + h->pool;
+  int *remap;
+  POWER *power;
+  u_int_32 i, bits = h->powerbytes * 8;
+
+  remap = mush_malloc(bits * sizeof(int) + 1, "snapshot.remap");
+  if (!remap)
+    mush_panic("Unable to allocate memory for database snapshot");
+  for (i = 0; i < bits; i++)
+    remap[i] = -1;
+  *identity = 1;
+  sp = (const struct snap_power *) (base + h->powermap);
+  for (i = 0; i < h->powercount; i++, sp++) {
+    if (sp->name >= h->poolsize || sp->flag_yes >= bits
+        || sp->flag_lte >= bits || sp->flag_lt >= bits)
+      continue;
+    power = find_power(pool + sp->name);
+    if (!power) {
+      *identity = 0;
+      continue;
+    }
+    remap[sp->flag_yes] = power->flag_yes;
+    remap[sp->flag_lte] = power->flag_lte;
+    remap[sp->flag_lt] = power->flag_lt;
+    if (power->flag_yes != (int) sp->flag_yes
+        || power->flag_lte != (int) sp->flag_lte
+        || power->flag_lt != (int) sp->flag_lt)
+      *identity = 0;
+  }
+  return remap;
+}
+
+/* Make a bitmap of the current size from a snapshot bitmap. */
+static unsigned char *
+snap_bits(const unsigned char *bits, int snapbytes, int bytes,
+          const int *remap, int identity, const char *tag)
+{
+  unsigned char *result;
+  int i;
+
+  result = mush_malloc(bytes, tag);
+  if (!result)
+    mush_panic("Unable to allocate memory for database snapshot");
+  memset(result, 0, bytes);
+  if (identity) {
+    memcpy(result, bits, snapbytes < bytes ? snapbytes : bytes);
+    return result;
+  }
+  for (i = 0; i < snapbytes * 8; i++)
+    if ((bits[i >> 3] & (1 << (i & 7))) && remap[i] >= 0
+        && remap[i] < bytes * 8)
+      result[remap[i] >> 3] |= 1 << (remap[i] & 7);
+  return result;
+}
+
+/* Load one object block. */
+static int
+snap_read_object(const char *block, size_t avail, const char *pool,
+                 const struct snap_header *h, const int *flagmap,
+                 int flag_identity, const int *powermap, int power_identity)
+{
+  const struct snap_object *so = (const struct snap_object *) block;
+  const struct snap_attr *sa;
+  const struct snap_lock *sl;
+  FLAGSPACE *n;
+  struct object *o;
+  boolexp wlock, rlock, key;
+  dbref i;
+  u_int_32 c;
+
+  if (avail < sizeof(struct snap_object) || so->size > avail
+      || sizeof(struct snap_object) + so->attrcount * sizeof(struct snap_attr)
+      + so->lockcount * sizeof(struct snap_lock) > so->size
+      || so->name >= so->size || so->flags + h->flagbytes > so->size
+      || so->powers + h->powerbytes > so->size
+      || so->lastmod >= h->poolsize || so->powergroups >= h->poolsize
+      || so->dbref < 0 || so->dbref >= h->db_top) {
+    do_rawlog(LT_ERR, T("ERROR: Corrupt object in database snapshot."));
+    return -1;
+  }
+
+  i = so->dbref;
+  db_grow(i + 1);
+  o = db + i;
+  set_name(i, block + so->name);
+  o->location = so->location;
+  o->contents = so->contents;
+  o->exits = so->exits;
+  o->next = so->next;
+  o->parent = so->parent;
+  o->owner = so->owner;
+  o->zone = so->zone;
+  o->division.object = so->division;
+  o->division.level = so->level;
+  s_Pennies(i, so->pennies);
+  o->type = so->type;
+  o->warnings = so->warnings;
+  o->creation_time = (time_t) so->created;
+  o->modification_time = (time_t) so->modified;
+  db[i].lastmod = NULL;
+  set_lmod(i, pool + so->lastmod);
+
+  n = (FLAGSPACE *) hashfind("FLAG", &htab_flagspaces);
+  if (o->flags)
+    destroy_flag_bitmask(o->flags);
+  o->flags = snap_bits((const unsigned char *) block + so->flags,
+                       h->flagbytes, (n->flagbits + 7) / 8, flagmap,
+                       flag_identity, "flag_bitmask");
+  /* Clear the GOING flags. If it was scheduled for destruction
+   * when the db was saved, it gets a reprieve.
+   */
+  clear_flag_internal(i, "GOING");
+  clear_flag_internal(i, "GOING_TWICE");
+
+  if (so->powers) {
+    o->division.dp_bytes =
+      snap_bits((const unsigned char *) block + so->powers, h->powerbytes,
+                DP_BYTES, powermap, power_identity, "POWER_SPOT");
+    if (power_is_zero(o->division.dp_bytes, DP_BYTES) == 0) {
+      mush_free(o->division.dp_bytes, "POWER_SPOT");
+      o->division.dp_bytes = NULL;
+    }
+  }
+  if (pool[so->powergroups])
+    powergroup_db_set(NOTHING, i, pool + so->powergroups, 0);
+
+  sa = (const struct snap_attr *) (block + sizeof(struct snap_object));
+  sl = (const struct snap_lock *) (sa + so->attrcount);
+
+  for (c = 0; c < so->lockcount; c++, sl++) {
+    if (sl->type >= h->poolsize || sl->key + sl->key_len > so->size) {
+      do_rawlog(LT_ERR, T("ERROR: Corrupt lock on object #%d in snapshot."),
+                i);
+      return -1;
+    }
+    if (sl->key_len)
+      key = chunk_create((const unsigned char *) block + sl->key,
+                         sl->key_len, sl->derefs);
+    else
+      key = TRUE_BOOLEXP;
+    add_lock_raw(sl->creator, i, pool + sl->type, key, sl->flags);
+  }
+
+  List(i) = NULL;
+  for (c = 0; c < so->attrcount; c++, sa++) {
+    if (sa->name >= h->poolsize || sa->value >= so->size
+        || sa->wlock + sa->wlock_len > so->size
+        || sa->rlock + sa->rlock_len > so->size) {
+      do_rawlog(LT_ERR,
+                T("ERROR: Corrupt attribute on object #%d in snapshot."), i);
+      return -1;
+    }
+    wlock = sa->wlock_len ? chunk_create((const unsigned char *) block +
+                                         sa->wlock, sa->wlock_len,
+                                         sa->wlock_derefs) : TRUE_BOOLEXP;
+    rlock = sa->rlock_len ? chunk_create((const unsigned char *) block +
+                                         sa->rlock, sa->rlock_len,
+                                         sa->rlock_derefs) : TRUE_BOOLEXP;
+    atr_new_add(i, pool + sa->name, block + sa->value, sa->owner, sa->flags,
+                sa->derefs, wlock, rlock, (time_t) sa->modtime);
+    /* atr_new_add() keeps copies of the locks */
+    free_boolexp(wlock);
+    free_boolexp(rlock);
+  }
+
+  db_loaded_object(i);
+  return 0;
+}
+
+/** Load the object database from a binary snapshot.
+ * The snapshot is mapped into memory where possible, and each object
+ * is built straight from its block.
+ * \param filename name of the snapshot file.
+ * \return number of objects in the database, or -1 on error.
+ */
+dbref
+db_read_snapshot(const char *filename)
+{
+  const struct snap_header *h;
+  const snap_off *index;
+  char *base;
+  int *flagmap, *powermap;
+  int flag_identity, power_identity;
+  struct stat st;
+  size_t size;
+  u_int_32 c;
+  int fd, ok = 1;
+
+  fd = open(filename, O_RDONLY
+#ifdef O_BINARY
+            | O_BINARY
+#endif
+    );
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    do_rawlog(LT_ERR, T("ERROR: Unable to open %s: %s"), filename,
+              strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  size = st.st_size;
+#ifndef WIN32
+  base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    do_rawlog(LT_ERR, T("ERROR: Unable to map %s: %s"), filename,
+              strerror(errno));
+    close(fd);
+    return -1;
+  }
+#ifdef MADV_SEQUENTIAL
+  madvise(base, size, MADV_SEQUENTIAL);
+#endif
+#else
+  base = mush_malloc(size + 1, "snapshot.file");
+  if (!base || read(fd, base, size) != (int) size) {
+    do_rawlog(LT_ERR, T("ERROR: Unable to read %s"), filename);
+    if (base)
+      mush_free(base, "snapshot.file");
+    close(fd);
+    return -1;
+  }
+#endif
+  close(fd);
+
+  h = (const struct snap_header *) base;
+  if (!snap_valid_header(h, size)) {
+#ifndef WIN32
+    munmap(base, size);
+#else
+    mush_free(base, "snapshot.file");
+#endif
+    return -1;
+  }
+
+  log_mem_check();
+  loading_db = 1;
+  clear_players();
+  db_free();
+
+  indb_flags = h->dbflags;
+  if (!use_flagfile)
+    flagdb_flags = indb_flags;
+  strncpy(db_timestamp, base + h->pool + h->savedtime,
+          sizeof db_timestamp - 1);
+  db_timestamp[sizeof db_timestamp - 1] = '\0';
+  do_rawlog(LT_ERR, T("Loading database snapshot saved on %s UTC"),
+            db_timestamp);
+
+  db_init = (h->db_top * 3) / 2;
+  init_objdata(db_init);
+
+  flagmap = snap_flag_remap(base, h, &flag_identity);
+  powermap = snap_power_remap(base, h, &power_identity);
+  if (!flag_identity)
+    do_rawlog(LT_ERR, T("Flag table has changed since the snapshot; "
+                        "translating flags."));
+  if (!power_identity)
+    do_rawlog(LT_ERR, T("Power table has changed since the snapshot; "
+                        "translating powers."));
+
+  index = (const snap_off *) (base + h->index);
+  for (c = 0; c < h->objects; c++) {
+    if (index[c] < h->header_size || index[c] >= h->index
+        || snap_read_object(base + index[c], h->index - index[c],
+                            base + h->pool, h, flagmap, flag_identity,
+                            powermap, power_identity) < 0) {
+      ok = 0;
+      break;
+    }
+  }
+  mush_free(flagmap, "snapshot.remap");
+  mush_free(powermap, "snapshot.remap");
+#ifndef WIN32
+  munmap(base, size);
+#else
+  mush_free(base, "snapshot.file");
+#endif
+
+  if (!ok) {
+    do_rawlog(LT_ERR, T("ERROR: failed after %u objects"), c);
+    return -1;
+  }
+
+  loading_db = 0;
+  log_mem_check();
+  fix_free_list();
+  dbck();
+  log_mem_check();
+  do_rawlog(LT_ERR, "READING: done");
+  return db_top;
+}
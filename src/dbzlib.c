@@ -0,0 +1,166 @@
+/**
+ * \file dbzlib.c
+ *
+ * \brief Database files compressed by zlib inside the MUSH.
+ *
+ * With compress_builtin set, the database, mail and chat files are
+ * read and written in gzip format by zlib, instead of being piped
+ * through compress_program and uncompress_program. The files are
+ * still ordinary stdio streams, made with fopencookie(), so the code
+ * that reads and writes them doesn't change. Errors are logged with
+ * zlib's description of them, and a file that is read is checked
+ * against the CRC in its gzip trailer when it's closed.
+ *
+ * This file doesn't include externs.h, whose compress() and
+ * uncompress() have the same names as zlib's, so it uses plain
+ * malloc() rather than mush_malloc().
+ */
+
+#include "copyrite.h"
+#include "config.h"
+#if defined(HAS_ZLIB) && defined(HAS_GNULIBC)
+#define _GNU_SOURCE             /* For fopencookie() */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef I_SYS_TYPES
+#include <sys/types.h>
+#endif
+
+#include "conf.h"
+#include "dbio.h"
+#include "log.h"
+#include "confmagic.h"
+
+#ifdef BUILTIN_COMPRESSION
+#include <zlib.h>
+
+/* A database file compressed by zlib, read or written through stdio */
+struct dbz_file {
+  gzFile gz;                    /* The zlib stream */
+  int reading;                  /* Is the file open for reading? */
+  char name[BUFFER_LEN];        /* The file name, for error messages */
+};
+
+static ssize_t dbz_read(void *cookie, char *buf, size_t size);
+static ssize_t dbz_write(void *cookie, const char *buf, size_t size);
+static int dbz_close(void *cookie);
+static void dbz_error(struct dbz_file *z);
+
+/** Open a file for zlib to read or write, as a stdio stream.
+ * Plain files can be read as well as gzip ones.
+ * \param filename name of the file, with any compression suffix.
+ * \param mode "rb" to read, or "wb" and a compression level to write.
+ * \return the stream, or NULL if the file can't be opened.
+ */
+FILE *
+dbz_open(const char *filename, const char *mode)
+{
+  static cookie_io_functions_t dbz_io = {
+    dbz_read, dbz_write, NULL, dbz_close
+  };
+  struct dbz_file *z;
+  FILE *f;
+
+  z = malloc(sizeof(struct dbz_file));
+  if (!z)
+    return NULL;
+  strncpy(z->name, filename, sizeof z->name - 1);
+  z->name[sizeof z->name - 1] = '\0';
+  z->reading = (*mode == 'r');
+  z->gz = gzopen(filename, mode);
+  if (!z->gz) {
+    free(z);
+    return NULL;
+  }
+#if ZLIB_VERNUM >= 0x1240
+  gzbuffer(z->gz, 128 * 1024);
+#endif
+  f = fopencookie(z, z->reading ? "r" : "w", dbz_io);
+  if (!f) {
+    gzclose(z->gz);
+    free(z);
+    return NULL;
+  }
+  setvbuf(f, NULL, _IOFBF, 64 * 1024);
+  return f;
+}
+
+/* Report a zlib error on a file. zlib's message starts with the
+ * file name already. */
+static void
+dbz_error(struct dbz_file *z)
+{
+  int err;
+  const char *msg = gzerror(z->gz, &err);
+
+  if (err == Z_ERRNO)
+    do_rawlog(LT_ERR, "ERROR: %s: %s", z->name, strerror(errno));
+  else
+    do_rawlog(LT_ERR, "ERROR: %s", msg);
+}
+
+static ssize_t
+dbz_read(void *cookie, char *buf, size_t size)
+{
+  struct dbz_file *z = cookie;
+  int n;
+
+  n = gzread(z->gz, buf, size);
+  if (n < 0) {
+    dbz_error(z);
+    errno = EIO;
+  }
+  return n;
+}
+
+static ssize_t
+dbz_write(void *cookie, const char *buf, size_t size)
+{
+  struct dbz_file *z = cookie;
+  int n;
+
+  if (!size)
+    return 0;
+  /* stdio takes a write of 0 bytes as an error */
+  n = gzwrite(z->gz, buf, size);
+  if (n <= 0) {
+    dbz_error(z);
+    errno = EIO;
+    return 0;
+  }
+  return n;
+}
+
+/* Files being read are read to the end, so that zlib checks the
+ * gzip trailer even if the reader stopped at the end of dump line. */
+static int
+dbz_close(void *cookie)
+{
+  struct dbz_file *z = cookie;
+  char buf[BUFFER_LEN];
+  int n = 0, ret;
+
+  if (z->reading && !gzdirect(z->gz)) {
+    while ((n = gzread(z->gz, buf, sizeof buf)) > 0) ;
+    if (n < 0)
+      dbz_error(z);
+  }
+  ret = gzclose(z->gz);
+  if (n < 0) {
+    ret = -1;
+  } else if (ret != Z_OK) {
+    do_rawlog(LT_ERR, "ERROR: %s: %s", z->name,
+              ret == Z_ERRNO ? strerror(errno) :
+              ret == Z_BUF_ERROR ? "file is truncated" :
+              "compressed data is corrupt");
+    ret = -1;
+  }
+  free(z);
+  return ret;
+}
+
+#endif                          /* BUILTIN_COMPRESSION */
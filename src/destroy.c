@@ -654,11 +654,12 @@ free_object(dbref thing)
   /* if something is zoned or parented or linked or chained or located
    * to/in destroyed object, undo */
   for (i = 0; i < db_top; i++) {
-    if (Zone(i) == thing) {
-      Zone(i) = NOTHING;
-    }
-    if (Parent(i) == thing) {
-      Parent(i) = NOTHING;
+    if (Zone(i) == thing || Parent(i) == thing) {
+      if (Zone(i) == thing)
+        Zone(i) = NOTHING;
+      if (Parent(i) == thing)
+        Parent(i) = NOTHING;
+      obj_index_update(i);
     }
     if (Home(i) == thing) {
       switch (Typeof(i)) {
@@ -724,6 +725,7 @@ free_object(dbref thing)
   Owner(thing) = GOD;
   Parent(thing) = NOTHING;
   Zone(thing) = NOTHING;
+  obj_index_update(thing);
 #ifdef CHAT_SYSTEM
   remove_all_obj_chan(thing);
 #endif /* CHAT_SYSTEM */
@@ -767,6 +769,7 @@ free_object(dbref thing)
      mush_free(DPBITS(thing), "POWER_SPOT");
      DPBITS(thing) = NULL;
   }
+  flag_columns_update(thing);
   Location(thing) = NOTHING;
   set_name(thing, "Garbage");
   Exits(thing) = NOTHING;
@@ -1100,7 +1103,9 @@ check_divisions(void) {
           if(IsDivision(Parent(check))) {
             do_rawlog(LT_ERR, T("ERROR: Bad Division Parent Structure."));
             Parent(check) = NOTHING;
+            obj_index_update(check);
           }
+      obj_index_update(i);
     }
 }
 
@@ -1139,6 +1144,7 @@ check_fields(void)
         report();
         Owner(thing) = GOD;
       }
+      obj_index_update(thing);
       next = Next(thing);
       if ((!GoodObject(next) || IsGarbage(next)) && (next != NOTHING)) {
         do_rawlog(LT_ERR, T("ERROR: Invalid next pointer #%d from object %s"),
@@ -1227,6 +1233,7 @@ check_fields(void)
           do_log(LT_ERR, NOTHING, NOTHING, T("Found '#%d' with no division and powers set, removing."), thing);
           mush_free(DPBITS(thing), "POWER_SPOT");
           DPBITS(thing) = NULL;
+          flag_columns_update(thing);
         }
       }
       /* Zap power allocation if they don't have any */
@@ -1245,14 +1252,17 @@ check_fields(void)
 
 static int
 attribute_owner_helper(dbref player __attribute__ ((__unused__)),
-                       dbref thing __attribute__ ((__unused__)),
+                       dbref thing,
                        dbref parent __attribute__ ((__unused__)),
                        char const *pattern
                        __attribute__ ((__unused__)), ATTR *atr, void *args
                        __attribute__ ((__unused__)))
 {
-  if (!GoodObject(AL_CREATOR(atr)))
+  if (!GoodObject(AL_CREATOR(atr))) {
     AL_CREATOR(atr) = options.powerless; /* set to a powerless object so twinchecks don't backfire */
+    atr_comm_forget(thing);
+    mark_dirty(thing);
+  }
   return 0;
 }
 
@@ -664,6 +664,7 @@ powergroup_db_set(dbref executor, dbref player, const char *powergroup,
               break;
             }
           }
+        flag_columns_update(player);
       }
       if (executor != NOTHING) {
         memset(tbuf, '\0', 128);
@@ -1052,7 +1053,7 @@ rem_pg_from_player(dbref player, POWERGROUP * powergroup)
           break;
         }
       }
-
+  flag_columns_update(player);
 }
 
 /* powergroup_add() {{{3 */
@@ -1497,6 +1498,7 @@ division_set(dbref exec, dbref target, const char *arg2)
       if (DPBITS(target))
         mush_free(DPBITS(target), "POWER_SPOT");
       DPBITS(target) = NULL;
+      flag_columns_update(target);
     }
 
     return;
@@ -1549,6 +1551,7 @@ division_set(dbref exec, dbref target, const char *arg2)
     Parent(target) = divi;
     moveto(target, divi);
   }
+  obj_index_update(target);
   /* kludged this in, because notify_format won't work right 
    * with 2 object_header's in a row 
    */
@@ -1606,6 +1609,7 @@ create_div(dbref owner, const char *name)
     PUSH(obj, Contents(owner));
   }
   Parent(obj) = SDIV(owner).object;
+  obj_index_update(obj);
   current_state.divisions++;
   sprintf(buf, object_header(owner, obj));
   notify_format(owner, T("Division created: %s  Parent division: %s"),
@@ -1814,6 +1818,7 @@ division_empower(dbref exec, dbref target, const char *arg2)
     safe_format(msg_buf, &mbp, "%s%s(%s)", *msg_buf != '\0' ? ", " : "",
                 power->name, yescode_str(flag));
   }
+  flag_columns_update(target);
   *mbp = '\0';
   if (*msg_buf) {
     notify_format(exec, T("%s : %s."), object_header(exec, target),
@@ -2028,6 +2033,7 @@ adjust_powers(dbref obj, dbref to)
         }
       }
     }
+  flag_columns_update(obj);
 }
 
 /* adjust_levels() {{{2 - cap levels of 'owner's object to 'level'  */
@@ -2052,6 +2058,7 @@ adjust_divisions(dbref owner, dbref from_division, dbref to_division)
   for (cur_obj = 0; cur_obj < db_top; cur_obj++) {
     if ((Owner(cur_obj) == owner) && !IsDivision(cur_obj) && Division(cur_obj) == from_division) {
       Division(cur_obj) = to_division;
+      obj_index_update(cur_obj);
       for (pg_l = SDIV(cur_obj).powergroups; pg_l; pg_l = next) {
         next = pg_l->next;
         if (!can_have_pg(cur_obj, pg_l->power_group))
@@ -2115,12 +2122,14 @@ clear_division(dbref divi)
       /* If we run across a division pass it up the divtree */
       SDIV(cur_obj).object = SDIV(divi).object;
       Parent(cur_obj) = SDIV(divi).object;
+      obj_index_update(cur_obj);
       if (GoodObject(Location(SDIV(divi).object)))
         moveto(cur_obj, SDIV(divi).object);
     } else if (SDIV(cur_obj).object == divi) {
       notify_format(cur_obj, T("GAME: Division '%s' has been cleared."),
                     object_header(cur_obj, divi));
       SDIV(cur_obj).object = NOTHING;
+      obj_index_update(cur_obj);
       if (Typeof(cur_obj) == TYPE_PLAYER && !God(cur_obj))      /* if player.. fix level & powerlevel */
         division_level(1, cur_obj, 2);
       /* Zap powergroups & powers as need be */
@@ -2130,6 +2139,7 @@ clear_division(dbref divi)
       if (DPBITS(cur_obj))
         mush_free(DPBITS(cur_obj), "POWER_SPOT");
       DPBITS(cur_obj) = NULL;
+      flag_columns_update(cur_obj);
     }
 }
 
@@ -2495,7 +2505,7 @@ power_delete(const char *key)
   /* Step 1, Remove Aliases */
   for (alias = ptab_firstentry_new(ps_tab.powers, pname); alias;
        alias = ptab_nextentry_new(ps_tab.powers, pname))
-    if (strcmp(pname, alias->name))
+    if (alias == power && strcmp(pname, alias->name))
       ptab_delete(ps_tab.powers, pname);
 
   /* Step 2, Unset bits on bits_taken */
@@ -2505,6 +2515,7 @@ power_delete(const char *key)
   for (i = 0; i < db_top; i++) {
     RESET_POWER(i, power);
   }
+  flag_columns_reset();
 
   /* Step 4: Unset power on every powergroup */
   for (pgrp = ptab_firstentry_new(ps_tab.powergroups, pname); pgrp;
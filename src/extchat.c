@@ -126,6 +126,8 @@ int num_channels;  /**< Number of channels defined */
 
 CHAN *channels;    /**< Pointer to channel list */
 
+int chanlist_slot = -1;    /**< Object data slot for channel lists */
+
 static PRIV priv_table[] = {
   {"Disabled", 'D', CHANNEL_DISABLED, CHANNEL_DISABLED},
   {"Admin", 'A', CHANNEL_ADMIN | CHANNEL_PLAYER, CHANNEL_ADMIN},
@@ -200,6 +202,7 @@ init_chatdb(void)
 {
   num_channels = 0;
   channels = NULL;
+  chanlist_slot = objdata_slot("CHANNELS");
 }
 
 /** Load the chat database from a file.
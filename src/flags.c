@@ -1070,6 +1070,424 @@ has_any_bits(const char *ns, object_flag_type source, object_flag_type bitmask)
   return ok;
 }
 
+
+/*----------------------------------------------------------------------
+ * Flag and power columns
+ *
+ * A column is a bitmap with one bit per dbref, set for the objects that
+ * have one particular flag or power bit. A column is built the first
+ * time a search asks about its flag, and is then kept up to date by
+ * flag_columns_update() wherever flags and powers are changed. Searches
+ * AND columns together a word at a time to find the few objects worth
+ * checking properly, instead of parsing the flag list for every object.
+ */
+
+/** Bits in a column word */
+#define COLUMN_BITS (8 * sizeof(unsigned long))
+/** Locate the word holding an object's bit in a column */
+#define ColumnWord(x) ((x) / COLUMN_BITS)
+/** Locate an object's bit within its column word */
+#define ColumnBit(x) (1UL << ((x) % COLUMN_BITS))
+
+static unsigned long **flag_columns = NULL;     /* By flag bitpos */
+static int flag_columns_size = 0;
+static unsigned long **power_columns = NULL;    /* By power bit */
+static int power_columns_size = 0;
+static int column_words = 0;    /* Length of every column */
+static int columns_built = 0;
+
+/* The object types that flag lookups can depend on */
+static int column_types[] = {
+  TYPE_ROOM, TYPE_THING, TYPE_EXIT, TYPE_PLAYER, TYPE_DIVISION,
+  TYPE_GARBAGE, 0
+};
+
+static void column_grow(dbref top);
+static unsigned long *column_resize(unsigned long *col, int words);
+static unsigned long *get_column(int power, int bit);
+static int column_has_bit(int power, int bit, dbref thing);
+static int column_or_item(FLAGSPACE * n, unsigned long *acc, int words,
+                          const char *s, int islong, int objtypes);
+
+/* Make every built column long enough to hold top objects */
+static void
+column_grow(dbref top)
+{
+  int words, i;
+
+  words = (top + COLUMN_BITS - 1) / COLUMN_BITS;
+  if (words <= column_words)
+    return;
+  words += words / 4 + 1;
+  for (i = 0; i < flag_columns_size; i++)
+    if (flag_columns[i])
+      flag_columns[i] = column_resize(flag_columns[i], words);
+  for (i = 0; i < power_columns_size; i++)
+    if (power_columns[i])
+      power_columns[i] = column_resize(power_columns[i], words);
+  column_words = words;
+}
+
+/* Move a column of column_words words (or a new one, if col is NULL)
+ * into a zero-filled one of the given length */
+static unsigned long *
+column_resize(unsigned long *col, int words)
+{
+  unsigned long *newcol;
+
+  newcol = (unsigned long *) mush_malloc((words ? words : 1) *
+                                         sizeof(unsigned long),
+                                         "flag_column");
+  if (!newcol)
+    mush_panic("Unable to allocate memory for a flag column");
+  memset(newcol, 0, (words ? words : 1) * sizeof(unsigned long));
+  if (col) {
+    memcpy(newcol, col, column_words * sizeof(unsigned long));
+    mush_free(col, "flag_column");
+  }
+  return newcol;
+}
+
+/* Does an object have the flag or power bit a column is for? */
+static int
+column_has_bit(int power, int bit, dbref thing)
+{
+  if (power)
+    return DPBITS(thing) && (bit < 8 * DP_BYTES)
+      && DPBIT_ISSET(DPBITS(thing), bit);
+  return has_bit(Flags(thing), bit) != 0;
+}
+
+/* Return the column for a flag or power bit, building it if need be */
+static unsigned long *
+get_column(int power, int bit)
+{
+  unsigned long ***cols;
+  int *size;
+  unsigned long *col;
+  dbref thing;
+
+  cols = power ? &power_columns : &flag_columns;
+  size = power ? &power_columns_size : &flag_columns_size;
+  if (bit >= *size) {
+    int newsize = bit + 8;
+    unsigned long **newcols;
+    newcols = (unsigned long **) mush_malloc(newsize *
+                                             sizeof(unsigned long *),
+                                             "flag_column");
+    if (!newcols)
+      mush_panic("Unable to allocate memory for flag columns");
+    memset(newcols, 0, newsize * sizeof(unsigned long *));
+    if (*cols) {
+      memcpy(newcols, *cols, *size * sizeof(unsigned long *));
+      mush_free(*cols, "flag_column");
+    }
+    *cols = newcols;
+    *size = newsize;
+  }
+  if ((col = (*cols)[bit]))
+    return col;
+  column_grow(db_top);
+  col = column_resize(NULL, column_words);
+  for (thing = 0; thing < db_top; thing++)
+    if (column_has_bit(power, bit, thing))
+      col[ColumnWord(thing)] |= ColumnBit(thing);
+  (*cols)[bit] = col;
+  columns_built++;
+  return col;
+}
+
+/** Bring an object's bits in the flag and power columns up to date.
+ * Call this after setting or clearing flags or powers on an object
+ * other than through twiddle_flag_internal() or set_flag(), or after
+ * giving it a new flag or power bitmask.
+ * \param thing the object that changed.
+ */
+void
+flag_columns_update(dbref thing)
+{
+  int i;
+  unsigned long word, bit;
+
+  if (!columns_built || !GoodObject(thing))
+    return;
+  column_grow(db_top);
+  word = ColumnWord(thing);
+  bit = ColumnBit(thing);
+  for (i = 0; i < flag_columns_size; i++)
+    if (flag_columns[i]) {
+      if (column_has_bit(0, i, thing))
+        flag_columns[i][word] |= bit;
+      else
+        flag_columns[i][word] &= ~bit;
+    }
+  for (i = 0; i < power_columns_size; i++)
+    if (power_columns[i]) {
+      if (column_has_bit(1, i, thing))
+        power_columns[i][word] |= bit;
+      else
+        power_columns[i][word] &= ~bit;
+    }
+}
+
+/** Throw away all the flag and power columns.
+ * Call this when a flag or power is changed on every object at once,
+ * or the database is replaced. Columns are rebuilt as they're needed.
+ */
+void
+flag_columns_reset(void)
+{
+  int i;
+
+  for (i = 0; i < flag_columns_size; i++)
+    if (flag_columns[i])
+      mush_free(flag_columns[i], "flag_column");
+  for (i = 0; i < power_columns_size; i++)
+    if (power_columns[i])
+      mush_free(power_columns[i], "flag_column");
+  if (flag_columns)
+    mush_free(flag_columns, "flag_column");
+  if (power_columns)
+    mush_free(power_columns, "flag_column");
+  flag_columns = power_columns = NULL;
+  flag_columns_size = power_columns_size = 0;
+  column_words = 0;
+  columns_built = 0;
+}
+
+/** Allocate a column with every object in it.
+ * Narrow it down with flag_column_select() and power_column_select().
+ * \return a newly allocated column.
+ */
+FLAG_COLUMN *
+new_flag_column(void)
+{
+  FLAG_COLUMN *col;
+
+  col = (FLAG_COLUMN *) mush_malloc(sizeof(FLAG_COLUMN), "flag_column");
+  if (!col)
+    mush_panic("Unable to allocate memory for a flag column");
+  col->words = (db_top + COLUMN_BITS - 1) / COLUMN_BITS;
+  col->bits = (unsigned long *) mush_malloc((col->words ? col->words : 1) *
+                                            sizeof(unsigned long),
+                                            "flag_column");
+  if (!col->bits)
+    mush_panic("Unable to allocate memory for a flag column");
+  memset(col->bits, 0xFF, col->words * sizeof(unsigned long));
+  return col;
+}
+
+/** Deallocate a column made by new_flag_column().
+ * \param col the column to free.
+ */
+void
+destroy_flag_column(FLAG_COLUMN *col)
+{
+  mush_free(col->bits, "flag_column");
+  mush_free(col, "flag_column");
+}
+
+/** Could an object be in a column?
+ * \param col the column.
+ * \param thing the object to look for.
+ * \retval 1 the object is in the column, or is newer than it.
+ * \retval 0 the object is not in the column.
+ */
+int
+flag_column_isset(FLAG_COLUMN *col, dbref thing)
+{
+  if (thing < 0)
+    return 0;
+  if ((int) ColumnWord(thing) >= col->words)
+    return 1;
+  return (col->bits[ColumnWord(thing)] & ColumnBit(thing)) != 0;
+}
+
+/* OR into acc the columns of the flags that one item of a flag list
+ * can mean, on any of the object types allowed. An object of a type
+ * for which the item isn't a flag can't match it at all. Returns 0
+ * if an object could match the item without having any flag (it's
+ * negated, or names an object type), in which case acc may be left
+ * half-done.
+ */
+static int
+column_or_item(FLAGSPACE * n, unsigned long *acc, int words, const char *s,
+               int islong, int objtypes)
+{
+  FLAG *f, *seen[8];
+  unsigned long *col;
+  int t, i, nseen = 0;
+
+  if (*s == '!' || !*s)
+    return 0;
+  for (t = 0; column_types[t]; t++) {
+    if (!(column_types[t] & objtypes))
+      continue;
+    if (islong)
+      f = flag_hash_lookup(n, s, column_types[t]);
+    else if (!(f = letter_to_flagptr(n, *s, column_types[t]))
+             && strchr("TREP", *s))
+      return 0;
+    if (!f)
+      continue;
+    /* Object types and the like aren't bits in the flag bitmask */
+    if (f->bitpos < 0 || f->bitpos >= n->flagbits
+        || n->flags[f->bitpos] != f)
+      return 0;
+    for (i = 0; i < nseen; i++)
+      if (seen[i] == f)
+        break;
+    if (i < nseen)
+      continue;
+    seen[nseen++] = f;
+    col = get_column(0, f->bitpos);
+    for (i = 0; i < words; i++)
+      acc[i] |= col[i];
+  }
+  return 1;
+}
+
+/** Narrow a column down to objects that could pass a flag list check.
+ * Objects are only kept if they have the flags flaglist_check() or
+ * flaglist_check_long() would need them to have; objects that are kept
+ * still have to be checked properly, because flags can be hidden from
+ * the player doing the checking.
+ * \param col the column to narrow down.
+ * \param fstr the flag list, as for flaglist_check().
+ * \param islong 1 if fstr is a list of flag names, 0 for flag letters.
+ * \param type 0 if any flag in the list will do, 1 if all are needed.
+ * \param objtypes mask of the object types that can be matched.
+ * \return the number of columns used; 0 if col is unchanged.
+ */
+int
+flag_column_select(FLAG_COLUMN *col, const char *fstr, int islong, int type,
+                   int objtypes)
+{
+  FLAGSPACE *n;
+  unsigned long *acc;
+  char *copy, *sp, *s;
+  char letter[2];
+  int i, used = 0, ok = 1;
+
+  if (!(n = (FLAGSPACE *) hashfind("FLAG", &htab_flagspaces)))
+    return 0;
+  acc = (unsigned long *) mush_malloc((col->words + 1) *
+                                      sizeof(unsigned long), "flag_column");
+  if (!acc)
+    return 0;
+  column_grow(db_top);
+  copy = mush_strdup(fstr, "flag_column");
+  sp = copy;
+  letter[1] = '\0';
+  if (!type)
+    memset(acc, 0, col->words * sizeof(unsigned long));
+  while (ok && sp && *sp) {
+    if (islong) {
+      s = split_token(&sp, ' ');
+      if (!*s)
+        continue;
+    } else {
+      /* A negated letter is one item, and so is a bare '!' at the end */
+      s = sp;
+      sp += (*sp == '!' && sp[1]) ? 2 : 1;
+      letter[0] = *s;
+      s = letter;
+    }
+    if (type) {
+      /* Every object has to match this item */
+      memset(acc, 0, col->words * sizeof(unsigned long));
+      if (!column_or_item(n, acc, col->words, s, islong, objtypes))
+        continue;
+      for (i = 0; i < col->words; i++)
+        col->bits[i] &= acc[i];
+      used++;
+    } else if (!column_or_item(n, acc, col->words, s, islong, objtypes))
+      ok = 0;
+    else
+      used++;
+  }
+  if (!type) {
+    if (ok && used)
+      for (i = 0; i < col->words; i++)
+        col->bits[i] &= acc[i];
+    else
+      used = 0;
+  }
+  mush_free(copy, "flag_column");
+  mush_free(acc, "flag_column");
+  return used;
+}
+
+/** Narrow a column down to objects that have all of a set of powers.
+ * God is always kept, since God has every power.
+ * \param col the column to narrow down.
+ * \param powers the power bits needed.
+ * \return the number of columns used; 0 if col is unchanged.
+ */
+int
+power_column_select(FLAG_COLUMN *col, div_pbits powers)
+{
+  unsigned long *pc;
+  int bit, i, used = 0, god;
+
+  column_grow(db_top);
+  god = GoodObject(GOD) && flag_column_isset(col, GOD);
+  for (bit = 0; bit < 8 * DP_BYTES; bit++) {
+    if (!DPBIT_ISSET(powers, bit))
+      continue;
+    pc = get_column(1, bit);
+    for (i = 0; i < col->words; i++)
+      col->bits[i] &= pc[i];
+    used++;
+  }
+  if (used && god && (int) ColumnWord(GOD) < col->words)
+    col->bits[ColumnWord(GOD)] |= ColumnBit(GOD);
+  return used;
+}
+
+/** Count the objects in part of a column.
+ * \param col the column.
+ * \param low the first dbref to count.
+ * \param high the last dbref to count.
+ * \return the number of objects from low to high in the column.
+ */
+int
+flag_column_count(FLAG_COLUMN *col, dbref low, dbref high)
+{
+  return flag_column_list(col, low, high, NULL);
+}
+
+/** List the objects in part of a column.
+ * \param col the column.
+ * \param low the first dbref to list.
+ * \param high the last dbref to list.
+ * \param list an array of at least flag_column_count() dbrefs to fill
+ * in, or NULL to just count them.
+ * \return the number of objects, which are put in list in dbref order.
+ */
+int
+flag_column_list(FLAG_COLUMN *col, dbref low, dbref high, dbref *list)
+{
+  unsigned long word;
+  dbref thing;
+  int w, count = 0;
+
+  if (low < 0)
+    low = 0;
+  if (high >= col->words * (dbref) COLUMN_BITS)
+    high = col->words * COLUMN_BITS - 1;
+  for (w = ColumnWord(low); low <= high && w <= (int) ColumnWord(high); w++) {
+    word = col->bits[w];
+    for (thing = w * COLUMN_BITS; word; thing++, word >>= 1)
+      if ((word & 1) && thing >= low && thing <= high) {
+        if (list)
+          list[count] = thing;
+        count++;
+      }
+  }
+  return count;
+}
+
 /** Produce a space-separated list of flag names, given a bitmask.
  * This function returns the string representation of a flag bitmask.
  * \param ns name of namespace to search.
@@ -1354,8 +1772,11 @@ twiddle_flag_internal(const char *ns, dbref thing, const char *flag, int negate)
     return;
   n = (FLAGSPACE *) hashfind(ns, &htab_flagspaces);
   if ((f = flag_hash_lookup(n, flag, Typeof(thing)))) {
-    if (n->flag_table == flag_table)
+    if (n->flag_table == flag_table) {
       twiddle_flag(thing, f, negate);
+      flag_columns_update(thing);
+      mark_dirty(thing);
+    }
   }
 }
 
@@ -1485,6 +1906,8 @@ set_flag(dbref player, dbref thing, const char *flag, int negate,
 #endif /* RPMODE_SYS */
 
   twiddle_flag(thing, f, negate);
+  flag_columns_update(thing);
+  mark_dirty(thing);
 
 #ifdef RPMODE_SYS
   if(is_flag(f, "RPMODE")) {
@@ -2460,6 +2883,7 @@ do_flag_delete(dbref player, const char *name)
   /* Reset the flag on all objects */
   for (i = 0; i < db_top; i++)
     twiddle_flag(i, f, 1);
+  flag_columns_reset();
   /* Remove the flag's entry in flags */
   n->flags[f->bitpos] = NULL;
   /* Remove the flag from the ptab */
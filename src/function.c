@@ -34,6 +34,11 @@ static int apply_restrictions(unsigned int result, const char *restriction);
 USERFN_ENTRY *userfn_tab;   /**< Table of user-defined functions */
 HASHTAB htab_function;      /**< Function hash table */
 HASHTAB htab_user_function; /**< User-defined function hash table */
+/** Bumped whenever a function is added, removed or restricted, so that
+ * anything caching FUN pointers (like compiled attributes) knows to
+ * look them up again.
+ */
+unsigned long function_table_version = 0;
 
 /* -------------------------------------------------------------------------*
  * Utilities.
@@ -671,6 +676,7 @@ FUNTAB flist[] = {
   {"TRIMTINY", fun_trim, 1, 3, FN_REG},
   {"TRUNC", fun_trunc, 1, 1, FN_REG},
   {"TYPE", fun_type, 1, 1, FN_REG},
+  {"UBENCH", fun_ubench, 2, 12, FN_REG | FN_DIRECTOR},
   {"UCSTR", fun_ucstr, 1, -1, FN_REG},
   {"UDEFAULT", fun_uldefault, 2, 12, FN_NOPARSE},
   {"UFUN", fun_ufun, 1, 11, FN_REG},
@@ -837,6 +843,7 @@ static void
 func_hash_insert(const char *name, FUN *func)
 {
   hashadd(name, (void *) func, &htab_function);
+  function_table_version++;
 }
 
 /** Initialize the function hash table.
@@ -1080,6 +1087,7 @@ restrict_function(const char *name, const char *restriction)
   if (!fp)
     return 0;
   fp->flags = apply_restrictions(fp->flags, restriction);
+  function_table_version++;
   return 1;
 }
 
@@ -1116,6 +1124,7 @@ do_function_restrict(dbref player, const char *name, const char *restriction)
   }
   flags = fp->flags;
   fp->flags = apply_restrictions(flags, restriction);
+  function_table_version++;
   if (fp->flags == flags)
     notify(player, T("Restrictions unchanged."));
   else
@@ -1253,6 +1262,7 @@ do_function(dbref player, char *name, char *argv[], int preserve)
     if (preserve)
       fp->flags |= FN_LOCALIZE;
     hashadd(name, fp, &htab_user_function);
+    function_table_version++;
 
     /* now add it to the user function table */
     userfn_tab[userfn_count].thing = thing;
@@ -1313,6 +1323,7 @@ do_function(dbref player, char *name, char *argv[], int preserve)
       fp->flags = 0;
     if (preserve)
       fp->flags |= FN_LOCALIZE;
+    function_table_version++;
 
     notify(player, T("Function updated."));
   }
@@ -1358,6 +1369,7 @@ do_function_restore(dbref player, const char *name)
   }
 
   fp->flags &= ~FN_OVERRIDE;
+  function_table_version++;
   notify(player, T("Restored."));
 
   /* Delete any @function with the same name */
@@ -1366,6 +1378,7 @@ do_function_restore(dbref player, const char *name)
     return;
   /* Remove it from the hash table */
   hashdelete(fp->name, &htab_user_function);
+  function_table_version++;
   /* Free its memory */
   table_index = fp->where.offset;
   mush_free((void *) fp->name, "func_hash.name");
@@ -1420,6 +1433,7 @@ do_function_delete(dbref player, char *name)
       return;
     }
     fp->flags |= FN_OVERRIDE;
+    function_table_version++;
     notify(player, T("Function deleted."));
     return;
   }
@@ -1431,6 +1445,7 @@ do_function_delete(dbref player, char *name)
   }
   /* Remove it from the hash table */
   hashdelete(fp->name, &htab_user_function);
+  function_table_version++;
   /* Free its memory */
   mush_free((void *) fp->name, "func_hash.name");
   mush_free(fp, "func_hash.FUN");
@@ -108,8 +108,10 @@ FUNCTION(fun_division)
   if (obj1 == NOTHING) {
     safe_str(unparse_dbref(obj1), buff, bp);
   } else {
-    if (!IsDivision(SDIV(obj1).object))
+    if (!IsDivision(SDIV(obj1).object)) {
       SDIV(obj1).object = -1;
+      obj_index_update(obj1);
+    }
     safe_str(unparse_dbref(SDIV(obj1).object), buff, bp);
   }
 }
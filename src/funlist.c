@@ -51,7 +51,6 @@ int iter_place[MAX_ITERS];  /**< inum numbers */
 int inum = 0;               /**< iter depth */
 int inum_limit = 0;         /**< limit of iter depth */
 int iter_break = 0; /**< iter break */
-extern const unsigned char *tables;
 
 static char *
 next_token(char *str, char sep)
@@ -3108,15 +3107,9 @@ FUNCTION(fun_table)
   free_ansi_string(as);
 }
 
-/* In the following regexp functions, we use pcre_study to potentially
- * make pcre_exec faster. If pcre_study() can't help, it returns right
- * away, and if it can, the savings in the actual matching are usually
- * worth it.  Ideally, all compiled regexps and their study patterns
- * should be cached somewhere. Especially nice for patterns in the
- * master room. Just need to come up with a good caching algorithm to
- * use. Easiest would be a hashtable that's just cleared every
- * dbck_interval seconds. Except some benchmarking showed that compiling
- * patterns is faster than I thought it'd be, so this is low priority.
+/* The following regexp functions get their compiled patterns, and the
+ * pcre_study() data that makes pcre_exec faster, from the regexp cache
+ * in wild.c. Every regexp_get() has to be matched by a regexp_release().
  */
 
 /* string, regexp, replacement string. Acts like sed or perl's s///g,
@@ -3128,7 +3121,6 @@ FUNCTION(fun_regreplace)
   const char *errptr;
   int subpatterns;
   int offsets[99];
-  int erroffset;
   const char *r, *obp;
   char *start, *oldbp;
   char tbuf[BUFFER_LEN], *tbp;
@@ -3176,26 +3168,12 @@ FUNCTION(fun_regreplace)
                        PT_DEFAULT, pe_info);
     *tbp = '\0';
 
-    if ((re = pcre_compile(tbuf, flags, &errptr, &erroffset, tables)) == NULL) {
+    if ((re = regexp_get(tbuf, flags, &study, &errptr)) == NULL) {
       /* Matching error. */
       safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
       safe_str(errptr, buff, bp);
       return;
     }
-    add_check("pcre");
-    /* If we're going to match the pattern multiple times, let's
-       study it. */
-    if (all) {
-      study = pcre_study(re, 0, &errptr);
-      if (errptr != NULL) {
-        mush_free((Malloc_t) re, "pcre");
-        safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
-        safe_str(errptr, buff, bp);
-        return;
-      }
-      if (study != NULL)
-        add_check("pcre.extra");
-    }
     len = strlen(prebuf);
     start = prebuf;
     subpatterns = pcre_exec(re, study, prebuf, len, 0, 0, offsets, 99);
@@ -3203,9 +3181,7 @@ FUNCTION(fun_regreplace)
     /* Match wasn't found... we're done */
     if (subpatterns < 0) {
       safe_str(prebuf, postbuf, &postp);
-      mush_free((Malloc_t) re, "pcre");
-      if (study)
-        mush_free((Malloc_t) study, "pcre.extra");
+      regexp_release(re);
       continue;
     }
 
@@ -3248,9 +3224,7 @@ FUNCTION(fun_regreplace)
     /* Now copy everything after the matched bit */
     safe_str(start, postbuf, &postp);
     *postp = '\0';
-    mush_free((Malloc_t) re, "pcre");
-    if (study)
-      mush_free((Malloc_t) study, "pcre.extra");
+    regexp_release(re);
 
     /* TODO: this was set to the declared variable "pcre **old_re_code".. 
      * it was initialized and set in this function. Should look into this more.
@@ -3283,8 +3257,8 @@ FUNCTION(fun_regmatch)
   int i, nqregs, curq;
   char *qregs[NUMQ];
   pcre *re;
+  pcre_extra *study;
   const char *errptr;
-  int erroffset;
   int offsets[99];
   int subpatterns;
   int flags = 0;
@@ -3298,14 +3272,13 @@ FUNCTION(fun_regmatch)
     return;
   }
 
-  if ((re = pcre_compile(args[1], flags, &errptr, &erroffset, tables)) == NULL) {
+  if ((re = regexp_get(args[1], flags, &study, &errptr)) == NULL) {
     /* Matching error. */
     safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
     safe_str(errptr, buff, bp);
     return;
   }
-  add_check("pcre");
-  subpatterns = pcre_exec(re, NULL, args[0], arglens[0], 0, 0, offsets, 99);
+  subpatterns = pcre_exec(re, study, args[0], arglens[0], 0, 0, offsets, 99);
   safe_integer(subpatterns >= 0, buff, bp);
 
   /* We need to parse the list of registers.  Anything that we don't parse
@@ -3351,7 +3324,7 @@ FUNCTION(fun_regmatch)
       pcre_copy_substring(args[0], offsets, subpatterns, subpattern,
                           global_eval_context.renv[curq], BUFFER_LEN);
   }
-  mush_free((Malloc_t) re, "pcre");
+  regexp_release(re);
 }
 
 
@@ -3370,7 +3343,6 @@ FUNCTION(fun_regrep)
 {
   struct regrep_data reharg;
   const char *errptr;
-  int erroffset;
   int flags = 0;
 
   dbref it = match_thing(executor, args[0]);
@@ -3392,32 +3364,19 @@ FUNCTION(fun_regrep)
   if (strcmp(called_as, "REGREPI") == 0)
     flags = PCRE_CASELESS;
 
-  if ((reharg.re = pcre_compile(args[2], flags,
-                                &errptr, &erroffset, tables)) == NULL) {
+  if ((reharg.re = regexp_get(args[2], flags, &reharg.study, &errptr))
+      == NULL) {
     /* Matching error. */
     safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
     safe_str(errptr, buff, bp);
     return;
   }
-  add_check("pcre");
-
-  reharg.study = pcre_study(reharg.re, 0, &errptr);
-  if (errptr != NULL) {
-    safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
-    safe_str(errptr, buff, bp);
-    mush_free(reharg.re, "pcre");
-    return;
-  }
-  if (reharg.study)
-    add_check("pcre.extra");
 
   reharg.buff = buff;
   reharg.bp = bp;
 
   atr_iter_get(executor, it, args[1], 0, regrep_helper, (void *) &reharg);
-  mush_free(reharg.re, "pcre");
-  if (reharg.study)
-    mush_free(reharg.study, "pcre.extra");
+  regexp_release(reharg.re);
 }
 
 static int
@@ -3452,7 +3411,6 @@ FUNCTION(fun_regrab)
   pcre *re;
   pcre_extra *study;
   const char *errptr;
-  int erroffset;
   int offsets[99];
   int flags = 0, all = 0;
   char *osep, osepd[2] = { '\0', '\0' };
@@ -3476,23 +3434,12 @@ FUNCTION(fun_regrab)
   if (string_prefix(called_as, "REGRABALL"))
     all = 1;
 
-  if ((re = pcre_compile(args[1], flags, &errptr, &erroffset, tables)) == NULL) {
+  if ((re = regexp_get(args[1], flags, &study, &errptr)) == NULL) {
     /* Matching error. */
     safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
     safe_str(errptr, buff, bp);
     return;
   }
-  add_check("pcre");
-
-  study = pcre_study(re, 0, &errptr);
-  if (errptr != NULL) {
-    safe_str(T("#-1 REGEXP ERROR: "), buff, bp);
-    safe_str(errptr, buff, bp);
-    mush_free(re, "pcre");
-    return;
-  }
-  if (study)
-    add_check("pcre.extra");
 
   do {
     r = split_token(&s, sep);
@@ -3505,9 +3452,7 @@ FUNCTION(fun_regrab)
     }
   } while (s);
 
-  mush_free((Malloc_t) re, "pcre");
-  if (study)
-    mush_free((Malloc_t) study, "pcre.extra");
+  regexp_release(re);
 }
 
 FUNCTION(fun_apply)
@@ -9,6 +9,8 @@
 #include "copyrite.h"
 
 #include "config.h"
+#include <string.h>
+#include <time.h>
 #include "conf.h"
 #include "externs.h"
 #include "match.h"
@@ -19,8 +21,12 @@
 #include "dbdefs.h"
 #include "flags.h"
 #include "lock.h"
+#include "pcode.h"
 #include "confmagic.h"
 
+extern int global_fun_invocations;
+extern int global_fun_recursions;
+
 void do_userfn(char *buff, char **bp, dbref obj, ATTR *attrib, int nargs,
                char **args, dbref executor, dbref caller, dbref enactor,
                PE_Info * pe_info);
@@ -116,6 +122,7 @@ do_userfn(char *buff, char **bp, dbref obj, ATTR *attrib, int nargs,
   char const *tp;
   int pe_flags = PE_DEFAULT;
   int old_args;
+  PCODE *pc;
 
   /* save our stack */
   for (j = 0; j < 10; j++)
@@ -133,12 +140,17 @@ do_userfn(char *buff, char **bp, dbref obj, ATTR *attrib, int nargs,
     pe_info->arg_count = nargs;
   }
 
-  tp = tbuf = safe_atr_value(attrib);
   if (attrib->flags & AF_DEBUG)
     pe_flags |= PE_DEBUG;
-  process_expression(buff, bp, &tp, obj, executor, enactor, pe_flags,
-                     PT_DEFAULT, pe_info);
-  free(tbuf);
+  pc = pcode_get(attrib, pe_flags);
+  if (pc) {
+    pcode_run(pc, buff, bp, obj, executor, enactor, pe_info);
+  } else {
+    tp = tbuf = safe_atr_value(attrib);
+    process_expression(buff, bp, &tp, obj, executor, enactor, pe_flags,
+                       PT_DEFAULT, pe_info);
+    free(tbuf);
+  }
 
   /* restore the stack */
   for (j = 0; j < 10; j++)
@@ -227,6 +239,81 @@ FUNCTION(fun_ulocal)
   return;
 }
 
+/* Time an attribute evaluated <count> times by the interpreter and
+ * then by its compiled form. Returns the microseconds of CPU each
+ * took and whether the results were the same.
+ */
+/* ARGSUSED */
+FUNCTION(fun_ubench)
+{
+  char ibuff[BUFFER_LEN];
+  char cbuff[BUFFER_LEN];
+  ufun_attrib ufun;
+  PE_Info pe;
+  unsigned long serial;
+  clock_t start;
+  double itime, ptime;
+  int count, i;
+  int invocations, recursions;
+  OOREF_DECL;
+
+  if (!is_integer(args[1])) {
+    safe_str(T(e_int), buff, bp);
+    return;
+  }
+  count = parse_integer(args[1]);
+  if (count < 1 || count > 100000) {
+    safe_str(T(e_range), buff, bp);
+    return;
+  }
+
+  ENTER_OOREF;
+
+  if (!fetch_ufun_attrib(args[0], executor, &ufun, 0)) {
+    safe_str(T(ufun.errmess), buff, bp);
+    LEAVE_OOREF;
+    return;
+  }
+  serial = ufun.serial;
+  if (!serial) {
+    safe_str(T("#-1 ATTRIBUTE NOT COMPILED"), buff, bp);
+    LEAVE_OOREF;
+    return;
+  }
+
+  /* Each run gets a fresh set of limits, as if it were its own u() */
+  ibuff[0] = cbuff[0] = '\0';
+  invocations = global_fun_invocations;
+  recursions = global_fun_recursions;
+  ufun.serial = 0;
+  start = clock();
+  for (i = 0; i < count; i++) {
+    memset(&pe, 0, sizeof(PE_Info));
+    global_fun_invocations = invocations;
+    global_fun_recursions = recursions;
+    call_ufun(&ufun, args + 2, nargs - 2, ibuff, executor, enactor, &pe);
+  }
+  itime = (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC;
+
+  ufun.serial = serial;
+  start = clock();
+  for (i = 0; i < count; i++) {
+    memset(&pe, 0, sizeof(PE_Info));
+    global_fun_invocations = invocations;
+    global_fun_recursions = recursions;
+    call_ufun(&ufun, args + 2, nargs - 2, cbuff, executor, enactor, &pe);
+  }
+  ptime = (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC;
+
+  global_fun_invocations = invocations;
+  global_fun_recursions = recursions;
+
+  safe_format(buff, bp, "%.0f %.0f %d", itime, ptime,
+              !strcmp(ibuff, cbuff));
+
+  LEAVE_OOREF;
+}
+
 /* Like fun_ufun, but takes as second argument a default message
  * to use if the attribute isn't there.  If called as uldefault,
  * then preserve registers, too.
@@ -33,6 +33,9 @@ void Win32MUSH_setup(void);
 #ifdef I_SYS_TYPES
 #include <sys/types.h>
 #endif
+#ifdef I_SYS_STAT
+#include <sys/stat.h>
+#endif
 #ifdef HAS_GETRUSAGE
 #include <sys/resource.h>
 #endif
@@ -75,6 +78,7 @@ void Win32MUSH_setup(void);
 #include "dbio.h"
 #include "pcre.h"
 #include "modules.h"
+#include "pcode.h"
 
 #ifdef hpux
 #include <sys/syscall.h>
@@ -96,6 +100,14 @@ void Win32MUSH_setup(void);
 /* declarations */
 GLOBALTAB globals = { 0, "", 0, 0, 0, 0, 0, 0, 0, 0 };
 static int epoch = 0;
+static FILE *dump_file = NULL;  /**< File being written by db_open_write() */
+static char dump_file_name[2048];       /**< Its name on disk */
+static double dump_bytes;       /**< Bytes on disk written by this dump */
+static int journal_seq = 0;     /**< Journals written since the last full dump */
+static char journal_base[100] = "";     /**< savedtime of that dump */
+static int dump_journal = 0;    /**< Is the dump being made a journal? */
+static int dump_generation = 0; /**< Names the shards of a sharded dump */
+static int pending_shards = 0;  /**< Shards written but not yet in use */
 static int reserved;                    /**< Reserved file descriptor */
 int depth = 0;                  /**< excessive recursion prevention */
 static dbref *errdblist = NULL; /**< List of dbrefs to return errors from */
@@ -110,9 +122,15 @@ extern void initialize_mt(void);
 extern const unsigned char *tables;
 extern void conf_default_set(void);
 static int dump_database_internal(void);
-static FILE *db_open(const char *filename);
+static void checkpoint_started(void);
 static FILE *db_open_write(const char *filename);
-static void db_close(FILE * f);
+static void dump_count(const char *filename);
+static void new_dump_generation(void);
+#ifndef WIN32
+static int dump_database_shards(const char *dumpfile, int generation);
+static void remove_shards(const char *dumpfile, int shards, int generation);
+#endif
+static int snapshot_is_newer(const char *textfile, const char *snapfile);
 static int fail_commands(dbref player);
 void do_readcache(dbref player);
 int check_alias(const char *command, const char *list);
@@ -337,7 +355,14 @@ dump_database_internal(void)
   FILE *f = NULL;
   struct module_entry_t *m;
   void (*handle)();
+  struct timeval start, end;
+  double secs;
+#ifndef WIN32
+  int sharded, old_shards, old_generation;
+#endif
 
+  gettimeofday(&start, NULL);
+  dump_bytes = 0;
 
 #ifndef PROFILING
 #ifndef WIN32
@@ -349,6 +374,12 @@ dump_database_internal(void)
     /* The dump failed. Disk might be full or something went bad with the
        compression slave. Boo! */
     do_rawlog(LT_ERR, T("ERROR! Database save failed."));
+#ifndef WIN32
+    if (pending_shards) {
+      remove_shards(globals.dumpfile, pending_shards, dump_generation);
+      pending_shards = 0;
+    }
+#endif
 #ifndef PROFILING
 #ifdef HAS_ITIMER
     install_sig_handler(SIGPROF, signal_cpu_limit);
@@ -372,7 +403,8 @@ dump_database_internal(void)
       if((f = db_open_write(tmpfl)) != NULL) {
         use_flagfile = 1;
         db_write_flag_db(f);
-        db_close(f);
+        if (db_close(f) < 0)
+          longjmp(db_err, 1);
 #ifdef WIN32
         unlink(realdumpfile);
 #endif
@@ -386,29 +418,47 @@ dump_database_internal(void)
       }
     }
 
-    sprintf(realdumpfile, "%s%s", globals.dumpfile, options.compresssuff);
-    strcpy(tmpfl, make_new_epoch_file(globals.dumpfile, epoch));
-    sprintf(realtmpfl, "%s%s", tmpfl, options.compresssuff);
-
-    if ((f = db_open_write(tmpfl)) != NULL) {
-      switch (globals.paranoid_dump) {
-      case 0:
-#ifdef ALWAYS_PARANOID
-        db_paranoid_write(f, 0);
-#else
-        db_write(f, 0);
-#endif
-        break;
-      case 1:
-        db_paranoid_write(f, 0);
-        break;
-      case 2:
-        db_paranoid_write(f, 1);
-        break;
+    if (dump_journal) {
+      /* Only the objects changed since the last checkpoint */
+      sprintf(realdumpfile, "%s.j%d", globals.dumpfile, journal_seq + 1);
+      strcpy(tmpfl, make_new_epoch_file(realdumpfile, epoch));
+      strcat(realdumpfile, options.compresssuff);
+      sprintf(realtmpfl, "%s%s", tmpfl, options.compresssuff);
+      if ((f = db_open_write(tmpfl)) != NULL) {
+        db_write_journal(f, journal_base);
+        if (db_close(f) < 0)
+          longjmp(db_err, 1);
+#ifdef WIN32
+        unlink(realdumpfile);
+#endif
+        if (rename(realtmpfl, realdumpfile) < 0) {
+          perror(realtmpfl);
+          longjmp(db_err, 1);
+        }
+      } else {
+        perror(realtmpfl);
+        longjmp(db_err, 1);
+      }
+      /* A journal from an older chain must not be read after this one */
+      sprintf(realdumpfile, "%s.j%d%s", globals.dumpfile, journal_seq + 2,
+              options.compresssuff);
+      unlink(realdumpfile);
+    } else if (options.binary_dump && !globals.paranoid_dump) {
+      /* Snapshots seek back to fill in their header, so they go
+       * to a plain file rather than through the compression program. */
+      sprintf(realdumpfile, "%s%s", globals.dumpfile, SNAPSHOT_SUFFIX);
+      strcpy(tmpfl, make_new_epoch_file(globals.dumpfile, epoch));
+      sprintf(realtmpfl, "%s%s", tmpfl, SNAPSHOT_SUFFIX);
+      if ((f = fopen(realtmpfl, FOPEN_WRITE)) == NULL) {
+        perror(realtmpfl);
+        longjmp(db_err, 1);
+      }
+      db_write_snapshot(f);
+      if (fclose(f) != 0) {
+        perror(realtmpfl);
+        longjmp(db_err, 1);
       }
-      db_close(f);
 #ifdef WIN32
-      /* Win32 systems can't rename over an existing file, so unlink first */
       unlink(realdumpfile);
 #endif
       if (rename(realtmpfl, realdumpfile) < 0) {
@@ -416,8 +466,69 @@ dump_database_internal(void)
         longjmp(db_err, 1);
       }
     } else {
-      perror(realtmpfl);
-      longjmp(db_err, 1);
+      sprintf(realdumpfile, "%s%s", globals.dumpfile, options.compresssuff);
+      strcpy(tmpfl, make_new_epoch_file(globals.dumpfile, epoch));
+      sprintf(realtmpfl, "%s%s", tmpfl, options.compresssuff);
+
+#ifndef WIN32
+      /* Shards are written under a new generation before the manifest
+       * that names them. Nothing uses them until the manifest is
+       * renamed into place, and the shards of the old manifest stay
+       * until then, so a dump that fails part way leaves the old one
+       * as it was. */
+      sharded = old_shards = old_generation = 0;
+      if (options.dump_shards > 1 && !globals.paranoid_dump) {
+        sharded = dump_database_shards(globals.dumpfile, dump_generation);
+        if (sharded) {
+          pending_shards = options.dump_shards;
+          if ((f = db_open(globals.dumpfile)) != NULL) {
+            old_shards = db_read_manifest(f, &old_generation);
+            db_close(f);
+          }
+        }
+      }
+#endif
+
+      if ((f = db_open_write(tmpfl)) != NULL) {
+        switch (globals.paranoid_dump) {
+        case 0:
+#ifdef ALWAYS_PARANOID
+          db_paranoid_write(f, 0);
+#else
+#ifndef WIN32
+          if (sharded)
+            db_write_manifest(f, options.dump_shards, dump_generation);
+          else
+#endif
+            db_write(f, 0);
+#endif
+          break;
+        case 1:
+          db_paranoid_write(f, 0);
+          break;
+        case 2:
+          db_paranoid_write(f, 1);
+          break;
+        }
+        if (db_close(f) < 0)
+          longjmp(db_err, 1);
+#ifdef WIN32
+        /* Win32 systems can't rename over an existing file, so unlink first */
+        unlink(realdumpfile);
+#endif
+        if (rename(realtmpfl, realdumpfile) < 0) {
+          perror(realtmpfl);
+          longjmp(db_err, 1);
+        }
+#ifndef WIN32
+        pending_shards = 0;
+        if (old_shards && old_generation != dump_generation)
+          remove_shards(globals.dumpfile, old_shards, old_generation);
+#endif
+      } else {
+        perror(realtmpfl);
+        longjmp(db_err, 1);
+      }
     }
 #ifdef USE_MAILER
     sprintf(realdumpfile, "%s%s", options.mail_db, options.compresssuff);
@@ -426,7 +537,8 @@ dump_database_internal(void)
     if (mdb_top >= 0) {
       if ((f = db_open_write(tmpfl)) != NULL) {
         dump_mail(f);
-        db_close(f);
+        if (db_close(f) < 0)
+          longjmp(db_err, 1);
 #ifdef WIN32
         unlink(realdumpfile);
 #endif
@@ -446,7 +558,8 @@ dump_database_internal(void)
     sprintf(realtmpfl, "%s%s", tmpfl, options.compresssuff);
     if ((f = db_open_write(tmpfl)) != NULL) {
       save_chatdb(f);
-      db_close(f);
+      if (db_close(f) < 0)
+        longjmp(db_err, 1);
 #ifdef WIN32
       unlink(realdumpfile);
 #endif
@@ -460,6 +573,12 @@ dump_database_internal(void)
     }
 #endif /* CHAT_SYSTEM */
     time(&globals.last_dump_time);
+    gettimeofday(&end, NULL);
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1000000.0;
+    do_rawlog(LT_CHECK,
+              "CHECKPOINTED: %s.#%d# (%.0f KB in %.2f seconds, %.1f MB/s)",
+              globals.dumpfile, epoch, dump_bytes / 1024.0, secs,
+              secs > 0 ? dump_bytes / 1048576.0 / secs : 0.0);
   }
 
 #endif
@@ -472,6 +591,92 @@ dump_database_internal(void)
   return 0;
 }
 
+#ifndef WIN32
+/* Work out which objects go in a shard */
+#define SHARD_START(n, shards) ((dbref) (((long) db_top * (n)) / (shards)))
+
+/* Write the object database as options.dump_shards shards of the
+ * dump file, each from its own process, so that formatting and
+ * compressing the objects is spread over the processors. The shards
+ * are named for the given generation, which no other dump uses, so
+ * they can be written in place. A failed shard longjmps to db_err
+ * like any other failed write.
+ * Returns 0, having written nothing, if the processes can't be made.
+ */
+static int
+dump_database_shards(const char *dumpfile, int generation)
+{
+  char shardfile[2048];
+  Pid_t *pids;
+  FILE *f;
+  WAIT_TYPE status;
+  int shards = options.dump_shards;
+  int n, forked, failed = 0;
+
+  pids = mush_malloc(shards * sizeof(Pid_t), "dump.shards");
+  if (!pids)
+    return 0;
+  /* Keep reaper() from collecting the shard writers before we do */
+  block_a_signal(SIGCHLD);
+  for (forked = 0; forked < shards; forked++) {
+    db_shard_name(shardfile, sizeof shardfile, dumpfile, forked, generation);
+    pids[forked] = fork();
+    if (pids[forked] < 0)
+      break;
+    if (pids[forked] == 0) {
+      /* An error here must not unwind into the rest of the dump */
+      if (setjmp(db_err))
+        _exit(1);
+      if ((f = db_open_write(shardfile)) == NULL)
+        _exit(1);
+      db_write_shard(f, SHARD_START(forked, shards),
+                     SHARD_START(forked + 1, shards));
+      if (db_close(f) < 0)
+        _exit(1);
+      _exit(0);
+    }
+  }
+  for (n = 0; n < forked; n++) {
+    if (waitpid(pids[n], &status, 0) != pids[n] || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+      failed = 1;
+  }
+  unblock_a_signal(SIGCHLD);
+  mush_free(pids, "dump.shards");
+
+  if (forked < shards) {
+    remove_shards(dumpfile, forked, generation);
+    do_rawlog(LT_ERR,
+              T("Unable to fork database shard writers; dumping one file."));
+    return 0;
+  }
+  if (failed) {
+    remove_shards(dumpfile, shards, generation);
+    do_rawlog(LT_ERR, T("ERROR! A database shard could not be written."));
+    longjmp(db_err, 1);
+  }
+
+  for (n = 0; n < shards; n++) {
+    db_shard_name(shardfile, sizeof shardfile, dumpfile, n, generation);
+    dump_count(tprintf("%s%s", shardfile, options.compresssuff));
+  }
+  return 1;
+}
+
+/* Delete the shards of one generation of a sharded dump */
+static void
+remove_shards(const char *dumpfile, int shards, int generation)
+{
+  char shardfile[2048];
+  int n;
+
+  for (n = 0; n < shards; n++) {
+    db_shard_name(shardfile, sizeof shardfile, dumpfile, n, generation);
+    unlink(tprintf("%s%s", shardfile, options.compresssuff));
+  }
+}
+#endif                          /* !WIN32 */
+
 /** Crash gracefully.
  * This function is called when something disastrous happens - typically
  * a failure to malloc memory or a signal like segfault.
@@ -562,6 +767,20 @@ mush_panicf(const char *msg, ...)
   _exit(136);           /* Not reached but kills warnings */
 }
 
+/* Pick the generation of the next dump. It's taken from the clock,
+ * so it keeps going up across restarts, and is made in the parent of
+ * a forking dump so that two dumps in the same second still differ. */
+static void
+new_dump_generation(void)
+{
+  int now = (int) time(NULL);
+
+  if (now > dump_generation)
+    dump_generation = now;
+  else
+    dump_generation++;
+}
+
 /** Dump the database.
  * This function is a wrapper for dump_database_internal() that does
  * a little logging before and after the dump.
@@ -570,6 +789,7 @@ void
 dump_database(void)
 {
   epoch++;
+  new_dump_generation();
 
   do_rawlog(LT_ERR, "DUMPING: %s.#%d#", globals.dumpfile, epoch);
   dump_database_internal();
@@ -590,6 +810,7 @@ fork_and_dump(int forking)
 {
   int child, nofork, status, split;
   epoch++;
+  new_dump_generation();
 #if (MALLOC_PACKAGE == 2)
   FILE *memory_file;
 #endif
@@ -639,6 +860,7 @@ fork_and_dump(int forking)
     } else if (child > 0) {
       forked_dump_pid = child;
       chunk_fork_parent();
+      checkpoint_started();
     } else {
       chunk_fork_child();
 #ifdef HAS_SETPRIORITY
@@ -675,6 +897,10 @@ fork_and_dump(int forking)
       _exit(status);            /* !!! */
     } else {
       reserve_fd();
+      if (status)
+        checkpoint_failed();
+      else
+        checkpoint_started();
       if (DUMP_NOFORK_COMPLETE && *DUMP_NOFORK_COMPLETE)
         flag_broadcast(0, 0, "%s", DUMP_NOFORK_COMPLETE);
     }
@@ -684,6 +910,104 @@ fork_and_dump(int forking)
 #endif
 }
 
+/* Keep track of the chain of journals once a dump has been made. */
+static void
+checkpoint_started(void)
+{
+  if (dump_journal) {
+    journal_seq++;
+    db_journal_clear();
+  } else if (options.dump_journals > 0 && !options.binary_dump
+             && !globals.paranoid_dump) {
+    strcpy(journal_base, show_time(mudtime, 1));
+    journal_seq = 0;
+    db_journal_reset();
+  } else {
+    journal_base[0] = '\0';
+    db_journal_stop();
+  }
+}
+
+/** Note that a dump failed.
+ * Journals can't follow a dump that isn't there, so the next
+ * checkpoint is a full dump. Safe to call from a signal handler.
+ */
+void
+checkpoint_failed(void)
+{
+  journal_base[0] = '\0';
+}
+
+/** Save the database when the dump_interval is up.
+ * With dump_journals set, this writes only the objects changed since
+ * the last save, to a journal that follows the last full dump. After
+ * dump_journals journals, the next save is a full dump again, which
+ * starts a new chain.
+ */
+void
+checkpoint_database(void)
+{
+  if (options.dump_journals > 0 && !options.binary_dump && *journal_base
+      && journal_seq < options.dump_journals) {
+    do_rawlog(LT_CHECK, "JOURNAL: %d changed objects", db_journal_scan());
+    dump_journal = 1;
+    fork_and_dump(1);
+    dump_journal = 0;
+  } else
+    fork_and_dump(1);
+}
+
+/** Write the object database for the process that replaces us.
+ * With hot_restart on, @shutdown/reboot calls this after its dump to
+ * leave a binary snapshot at <dumpfile>.hot, which the new process
+ * loads in place of the text dump. A binary_dump save already is
+ * such a snapshot, so nothing more is written then.
+ * \retval 1 the image was written.
+ * \retval 0 no image was written.
+ */
+int
+dump_hot_image(void)
+{
+  char hotfile[2048], tmpfl[sizeof hotfile + sizeof ".tmp"];
+  struct timeval start, end;
+  FILE *f = NULL;
+
+  if (!options.hot_restart || options.binary_dump)
+    return 0;
+
+  snprintf(hotfile, sizeof hotfile, "%s%s", globals.dumpfile,
+           HOT_IMAGE_SUFFIX);
+  snprintf(tmpfl, sizeof tmpfl, "%s.tmp", hotfile);
+  if (setjmp(db_err)) {
+    do_rawlog(LT_ERR, "ERROR: Unable to write %s: %s", hotfile,
+              strerror(errno));
+    if (f)
+      fclose(f);
+    unlink(tmpfl);
+    return 0;
+  }
+
+  gettimeofday(&start, NULL);
+  if ((f = fopen(tmpfl, FOPEN_WRITE)) == NULL)
+    longjmp(db_err, 1);
+  db_write_snapshot(f);
+  if (fclose(f) != 0) {
+    f = NULL;
+    longjmp(db_err, 1);
+  }
+  f = NULL;
+#ifdef WIN32
+  unlink(hotfile);
+#endif
+  if (rename(tmpfl, hotfile) < 0)
+    longjmp(db_err, 1);
+  gettimeofday(&end, NULL);
+  do_rawlog(LT_CHECK, "HOT IMAGE: %s (done in %.2f seconds)", hotfile,
+            (end.tv_sec - start.tv_sec) +
+            (end.tv_usec - start.tv_usec) / 1000000.0);
+  return 1;
+}
+
 /** Start up the MUSH.
  * This function does all of the work that's necessary to start up
  * MUSH objects and code for the game. It sets up player aliases,
@@ -876,6 +1200,20 @@ init_game_postdb(const char *conf)
 
 extern int dbline;
 
+/* Is there a binary snapshot of the database at least as new as the
+ * text dump? */
+static int
+snapshot_is_newer(const char *textfile, const char *snapfile)
+{
+  struct stat snap, text;
+
+  if (stat(snapfile, &snap) < 0)
+    return 0;
+  if (stat(tprintf("%s%s", textfile, options.compresssuff), &text) < 0)
+    return 1;
+  return snap.st_mtime >= text.st_mtime;
+}
+
 /** Read the game databases.
  * This function reads in the object, mail, and chat databases.
  * \retval -1 error.
@@ -891,7 +1229,11 @@ init_game_dbs(void)
   const char *mailfile;
 #endif
   const char *flag_file;
-  int panicdb;
+  char snapfile[BUFFER_LEN], shardfile[BUFFER_LEN], hotfile[BUFFER_LEN];
+  FILE *sf;
+  int panicdb, shards, generation;
+  volatile int use_snapshot, use_hot;   /* Read after longjmp(db_err) */
+  struct timeval load_start, load_end;
 
 #ifdef WIN32
   Win32MUSH_setup();            /* create index files, copy databases etc. */
@@ -918,66 +1260,140 @@ init_game_dbs(void)
       if(load_flag_db(f) != 0)
         use_flagfile = 0;
       do_rawlog(LT_ERR, "LOADING: %s(done)", flag_file);
-      db_close(f);
+      /* A corrupt flag file is dropped for the flags in the main db */
+      if (db_close(f) < 0)
+        use_flagfile = 0;
     }
   } else use_flagfile = 0;
 
   if(ps_tab._Read_Powers_ == 0)
     init_powers();
 
-  f = db_open(infile);
+  sprintf(snapfile, "%s%s", infile, SNAPSHOT_SUFFIX);
+  use_snapshot = snapshot_is_newer(infile, snapfile);
 
-  if (!f) {
-    do_rawlog(LT_ERR, "Couldn't open %s! Creating minimal world.", infile);
+  /* After @shutdown/reboot, take the database over from the image
+   * the old process left, unless this server can't read it. An image
+   * found at any other time is left over from a failed reboot. */
+  sprintf(hotfile, "%s%s", infile, HOT_IMAGE_SUFFIX);
+  use_hot = 0;
+  if (restarting && options.hot_restart && snapshot_is_newer(infile, hotfile)) {
     init_compress(NULL);
-    create_minimal_db();
-    return 0;
+    do_rawlog(LT_ERR, "LOADING: %s", hotfile);
+    gettimeofday(&load_start, NULL);
+    if (setjmp(db_err) == 0 && db_read_snapshot(hotfile) >= 0) {
+      gettimeofday(&load_end, NULL);
+      do_rawlog(LT_ERR, "LOADING: %s (done in %.2f seconds)", hotfile,
+                (load_end.tv_sec - load_start.tv_sec) +
+                (load_end.tv_usec - load_start.tv_usec) / 1000000.0);
+      use_hot = 1;
+      use_snapshot = 0;
+    } else {
+      do_rawlog(LT_ERR, "ERROR LOADING %s, trying %s", hotfile,
+                use_snapshot ? snapfile : infile);
+      clear_players();
+      db_free();
+    }
   }
+  unlink(hotfile);
 
-  c = getc(f);
-  if (c == EOF) {
-    do_rawlog(LT_ERR, "Couldn't read %s! Creating minimal world.", infile);
-    init_compress(NULL);
-    create_minimal_db();
-    return 0;
-  }
+  if (!use_snapshot && !use_hot) {
+    f = db_open(infile);
 
-  ungetc(c, f);
+    if (!f) {
+      do_rawlog(LT_ERR, "Couldn't open %s! Creating minimal world.", infile);
+      init_compress(NULL);
+      create_minimal_db();
+      return 0;
+    }
 
-  if (setjmp(db_err) == 0) {
-    /* ok, read it in */
-    do_rawlog(LT_ERR, "ANALYZING: %s", infile);
-    if (init_compress(f) < 0) {
+    c = getc(f);
+    if (c == EOF && ferror(f)) {
+      /* Not an empty file, but one that can't be read */
       do_rawlog(LT_ERR, "ERROR LOADING %s", infile);
+      db_close(f);
       return -1;
     }
-    do_rawlog(LT_ERR, "ANALYZING: %s (done)", infile);
+    if (c == EOF) {
+      do_rawlog(LT_ERR, "Couldn't read %s! Creating minimal world.", infile);
+      init_compress(NULL);
+      create_minimal_db();
+      return 0;
+    }
 
-    /* everything ok */
-    db_close(f);
+    ungetc(c, f);
+  }
 
-    f = db_open(infile);
-    if (!f)
-      return -1;
+  if (setjmp(db_err) == 0) {
+    if (use_hot) {
+      panicdb = 0;
+    } else if (use_snapshot) {
+      /* There's no text to analyze for the compression tables */
+      init_compress(NULL);
+      do_rawlog(LT_ERR, "LOADING: %s", snapfile);
+      gettimeofday(&load_start, NULL);
+      if (db_read_snapshot(snapfile) < 0) {
+        do_rawlog(LT_ERR, "ERROR LOADING %s", snapfile);
+        return -1;
+      }
+      gettimeofday(&load_end, NULL);
+      do_rawlog(LT_ERR, "LOADING: %s (done in %.2f seconds)", snapfile,
+                (load_end.tv_sec - load_start.tv_sec) +
+                (load_end.tv_usec - load_start.tv_usec) / 1000000.0);
+      panicdb = 0;
+    } else {
+      /* ok, read it in. The manifest of a sharded dump has no
+       * attribute text in it, so look at the first shard instead. */
+      strcpy(shardfile, infile);
+      if ((shards = db_read_manifest(f, &generation)) > 0) {
+        db_shard_name(shardfile, sizeof shardfile, infile, 0, generation);
+        if ((sf = db_open(shardfile)) != NULL) {
+          db_close(f);
+          f = sf;
+        }
+      }
+      do_rawlog(LT_ERR, "ANALYZING: %s", shardfile);
+      if (init_compress(f) < 0) {
+        do_rawlog(LT_ERR, "ERROR LOADING %s", shardfile);
+        return -1;
+      }
+      do_rawlog(LT_ERR, "ANALYZING: %s (done)", shardfile);
 
-    /* ok, read it in */
-    do_rawlog(LT_ERR, "LOADING: %s", infile);
-    dbline = 0;
-    if (db_read(f) < 0) {
-      do_rawlog(LT_ERR, "ERROR LOADING %s", infile);
-      db_close(f);
-      return -1;
-    }
-    do_rawlog(LT_ERR, "LOADING: %s (done)", infile);
+      /* everything ok */
+      if (db_close(f) < 0) {
+        do_rawlog(LT_ERR, "ERROR LOADING %s", shardfile);
+        return -1;
+      }
 
-    /* If there's stuff at the end of the db, we may have a panic
-     * format db, with everything shoved together. In that case,
-     * don't close the file
-     */
-    panicdb = ((globals.indb_flags & DBF_PANIC) && !feof(f));
+      f = db_open(infile);
+      if (!f)
+        return -1;
 
-    if (!panicdb)
-      db_close(f);
+      /* ok, read it in */
+      do_rawlog(LT_ERR, "LOADING: %s", infile);
+      dbline = 0;
+      gettimeofday(&load_start, NULL);
+      if (db_read(f, infile) < 0) {
+        do_rawlog(LT_ERR, "ERROR LOADING %s", infile);
+        db_close(f);
+        return -1;
+      }
+      gettimeofday(&load_end, NULL);
+      do_rawlog(LT_ERR, "LOADING: %s (done in %.2f seconds)", infile,
+                (load_end.tv_sec - load_start.tv_sec) +
+                (load_end.tv_usec - load_start.tv_usec) / 1000000.0);
+
+      /* If there's stuff at the end of the db, we may have a panic
+       * format db, with everything shoved together. In that case,
+       * don't close the file
+       */
+      panicdb = ((globals.indb_flags & DBF_PANIC) && !feof(f));
+
+      if (!panicdb && db_close(f) < 0) {
+        do_rawlog(LT_ERR, "ERROR LOADING %s", infile);
+        return -1;
+      }
+    }
 
     /* complain about bad config options */
     if (!GoodObject(PLAYER_START) || (!IsRoom(PLAYER_START)))
@@ -1015,8 +1431,11 @@ init_game_dbs(void)
         do_rawlog(LT_ERR, "LOADING: %s", mailfile);
         dbline = 0;
         load_mail(f);
+        if (db_close(f) < 0) {
+          do_rawlog(LT_ERR, "ERROR LOADING %s", mailfile);
+          return -1;
+        }
         do_rawlog(LT_ERR, "LOADING: %s (done)", mailfile);
-        db_close(f);
       }
     }
 #endif /* USE_MAILER */
@@ -1038,13 +1457,12 @@ init_game_dbs(void)
       if (f) {
         do_rawlog(LT_ERR, "LOADING: %s", options.chatdb);
         dbline = 0;
-        if (load_chatdb(f)) {
+        if (load_chatdb(f) && db_close(f) == 0) {
           do_rawlog(LT_ERR, "LOADING: %s (done)", options.chatdb);
         } else {
           do_rawlog(LT_ERR, "ERROR LOADING %s", options.chatdb);
           return -1;
         }
-        db_close(f);
       }
     }
 #endif /* CHAT_SYSTEM */
@@ -2297,12 +2715,20 @@ do_uptime(dbref player, int mortal)
 }
 
 
-/* Open a db file, which may be compressed, and return a file pointer */
-static FILE *
+/** Open a db file, which may be compressed, and return a file pointer.
+ * \param filename name of the file, without the compression suffix.
+ * \return file pointer, or NULL if the file can't be opened.
+ */
+FILE *
 db_open(const char *filename)
 {
   FILE *f;
 #ifndef WIN32
+#ifdef BUILTIN_COMPRESSION
+  if (options.compress_builtin) {
+    f = dbz_open(tprintf("%s%s", filename, options.compresssuff), "rb");
+  } else
+#endif
   if (options.uncompressprog && *options.uncompressprog) {
     /* We do this because on some machines (SGI Irix, for example),
      * the popen will not return NULL if the mailfile isn't there.
@@ -2355,6 +2781,14 @@ db_open_write(const char *filename)
             "getcwd failed during db_open_write, errno %d (%s)\n",
             errno, strerror(errno));
   }
+#ifdef BUILTIN_COMPRESSION
+  if (options.compress_builtin) {
+    char mode[4];
+
+    snprintf(mode, sizeof mode, "wb%d", options.compress_level);
+    f = dbz_open(tprintf("%s%s", filename, options.compresssuff), mode);
+  } else
+#endif
 #ifndef WIN32
   if (options.compressprog && *options.compressprog) {
     f =
@@ -2374,24 +2808,66 @@ db_open_write(const char *filename)
   }
   if (!f)
     longjmp(db_err, 1);
+  dump_file = f;
+  if (options.compress_builtin || *options.compressprog)
+    snprintf(dump_file_name, sizeof dump_file_name, "%s%s", filename,
+             options.compresssuff);
+  else
+    snprintf(dump_file_name, sizeof dump_file_name, "%s", filename);
   return f;
 }
 
 
-/* Close a db file, which may really be a pipe */
-static void
+/** Close a db file, which may really be a pipe.
+ * Closing a file compressed by zlib checks it: the data written must
+ * all reach the disk, and the data read must match the checksum in
+ * the gzip trailer. Errors in the compression program can't be seen.
+ * \param f file pointer to close.
+ * \retval 0 the file was closed.
+ * \retval -1 there was an error, which has been logged.
+ */
+int
 db_close(FILE * f)
 {
+  int ret;
+  int writing = (f == dump_file);
+
+#ifdef BUILTIN_COMPRESSION
+  if (options.compress_builtin) {
+    ret = fclose(f) ? -1 : 0;
+  } else
+#endif
 #ifndef WIN32
   if (options.compressprog && *options.compressprog) {
     pclose(f);
+    ret = 0;
   } else
 #endif                          /* WIN32 */
   {
-    fclose(f);
+    ret = fclose(f) ? -1 : 0;
+  }
+  if (writing) {
+    dump_file = NULL;
+    if (ret < 0)
+      do_rawlog(LT_ERR, T("ERROR: Unable to finish writing %s: %s"),
+                dump_file_name, strerror(errno));
+    else
+      dump_count(dump_file_name);
   }
+  return ret;
 }
 
+/* Add the size of a file written by a dump to the total for the dump */
+static void
+dump_count(const char *filename)
+{
+  struct stat st;
+
+  if (stat(filename, &st) == 0)
+    dump_bytes += st.st_size;
+}
+
+
 /** List various goodies.
  * \verbatim
  * This function implements @list.
@@ -2428,7 +2904,6 @@ extern HASHTAB htab_tag;
 extern HASHTAB htab_player_list;
 extern HASHTAB htab_reserved_aliases;
 extern HASHTAB help_files;
-extern HASHTAB htab_objdata;
 extern StrTree atr_names;
 extern StrTree lock_names;
 extern StrTree object_names;
@@ -2451,7 +2926,6 @@ do_list_memstats(dbref player)
   hash_stats(player, &htab_player_list, "Players");
   hash_stats(player, &htab_reserved_aliases, "Aliases");
   hash_stats(player, &help_files, "HelpFiles");
-  hash_stats(player, &htab_objdata, "ObjData");
   notify(player, "Prefix Trees:");
   ptab_stats_header(player);
   ptab_stats(player, &ptab_attrib, "AttrPerms");
@@ -2462,6 +2936,12 @@ do_list_memstats(dbref player)
   st_stats(player, &atr_names, "AttrNames");
   st_stats(player, &object_names, "ObjNames");
   st_stats(player, &lock_names, "LockNames");
+  pcode_stats(player);
+  atr_value_stats(player);
+  objdata_stats(player);
+  regexp_cache_stats(player);
+  output_queue_stats(player);
+  queue_arena_stats(player);
 #if (COMPRESSION_TYPE >= 3) && defined(COMP_STATS)
   if (Site(player)) {
     long items, used, total_comp, total_uncomp;
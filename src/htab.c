@@ -19,7 +19,16 @@
 #include "confmagic.h"
 
 HASHENT *hash_new(HASHTAB *htab, const char *key);
-static int hash_val(register const char *k, int mask);
+static unsigned int hash_val(register const char *k);
+static void hash_alloc(HASHTAB *htab, int size);
+static void hash_place(HASHTAB *htab, HASHENT *hent);
+static int hash_slot(unsigned int *hashes, HASHENT **buckets, int mask,
+                     const char *key, unsigned int hval);
+static void hash_migrate(HASHTAB *htab, int slots);
+static void hash_grow(HASHTAB *htab, int size);
+static HASHENT *hash_lookup(HASHTAB *htab, const char *key,
+                            unsigned int hval);
+static HASHENT *hash_iter(HASHTAB *htab, int hval);
 
 /* ---------------------------------------------------------------------------
  * hash_val: Compute hash value of a string for a hash table.
@@ -47,8 +56,8 @@ typedef unsigned char u1;       /**< unsigned 1-byte type */
 }
 
 /* The whole new hash function */
-static int
-hash_val(register const char *k, int mask)
+static unsigned int
+hash_val(register const char *k)
 {
   register u4 a, b, c;          /* the internal state */
   u4 len, length;               /* how many key bytes still need mixing */
@@ -99,33 +108,40 @@ hash_val(register const char *k, int mask)
   }
   mix(a, b, c);
    /*-------------------------------------------- report the result */
-  return c & mask;
+  return c;
 }
 
 
 #else                           /* NEW_HASH_FUN */
 /** Compute a hash value for mask-style hashing.
  * Given a null key, return 0. Otherwise, add up the numeric value
- * of all the characters and return the sum modulo the size of the
- * hash table.
+ * of all the characters, then mix the bits so that the low ones,
+ * which the caller masks the result down to, depend on the whole key.
  * \param key key to hash.
- * \param hashmask hash table size to use as modulus.
  * \return hash value.
  */
-int
-hash_val(const char *key, int hashmask)
+static unsigned int
+hash_val(const char *key)
 {
-  int hash = 0;
+  unsigned int hash = 0;
   const char *sp;
 
   if (!key || !*key)
     return 0;
   for (sp = key; *sp; sp++)
     hash = (hash << 5) + hash + *sp;
-  return (hash & hashmask);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
+  return hash;
 }
 #endif                          /* NEW_HASH_FUN */
 
+/* Slot markers in the hashes array. Real hashes are bumped past them. */
+#define HTAB_EMPTY   0
+#define HTAB_DELETED 1
+#define Hash_Fix(h)  (((h) > HTAB_DELETED) ? (h) : (h) + 2)
+
 /* ----------------------------------------------------------------------
  * hash_getmask: Get hash mask for mask-style hashing.
  */
@@ -148,6 +164,24 @@ hash_getmask(int *size)
   return tsize - 1;
 }
 
+/* Give a table fresh, empty slot arrays of the given size. */
+static void
+hash_alloc(HASHTAB *htab, int size)
+{
+  if (size < HTAB_MIN_SIZE)
+    size = HTAB_MIN_SIZE;
+  htab->mask = get_hashmask(&size);
+  htab->hashsize = size;
+  htab->deleted = 0;
+  /* One block: the entry pointers, then the hashes */
+  htab->buckets = mush_malloc(size * (sizeof(HASHENT *) + sizeof(unsigned int)),
+                              "hash_buckets");
+  if (!htab->buckets)
+    mush_panic("Unable to allocate memory for a hash table");
+  htab->hashes = (unsigned int *) (htab->buckets + size);
+  memset(htab->hashes, 0, size * sizeof(unsigned int));
+}
+
 /** Initialize a hashtable.
  * \param htab pointer to hash table to initialize.
  * \param size size of hashtable.
@@ -155,17 +189,101 @@ hash_getmask(int *size)
  */
 void
 hash_init(HASHTAB *htab, int size, int data_size)
+{
+  htab->entries = 0;
+  htab->old_size = 0;
+  htab->migrated = 0;
+  htab->old_hashes = NULL;
+  htab->old_buckets = NULL;
+  htab->last_hval = 0;
+  htab->last_entry = NULL;
+  hash_alloc(htab, size);
+  htab->entry_size = data_size;
+}
+
+/* Find the slot holding key, or -1. */
+static int
+hash_slot(unsigned int *hashes, HASHENT **buckets, int mask,
+          const char *key, unsigned int hval)
 {
   int i;
 
-  htab->mask = get_hashmask(&size);
-  htab->hashsize = size;
-  htab->entries = 0;
-  htab->buckets = mush_malloc(size * sizeof(HASHENT *), "hash_buckets");
-  for (i = 0; i < size; i++)
-    htab->buckets[i] = NULL;
+  for (i = hval & mask; hashes[i] != HTAB_EMPTY; i = (i + 1) & mask)
+    if (hashes[i] == hval && !strcmp(key, buckets[i]->key))
+      return i;
+  return -1;
+}
 
-  htab->entry_size = data_size;
+/* Put an entry that isn't in the table into the first free slot. */
+static void
+hash_place(HASHTAB *htab, HASHENT *hent)
+{
+  int i;
+
+  for (i = hent->hashval & htab->mask; htab->hashes[i] > HTAB_DELETED;
+       i = (i + 1) & htab->mask) ;
+  if (htab->hashes[i] == HTAB_DELETED)
+    htab->deleted--;
+  htab->hashes[i] = hent->hashval;
+  htab->buckets[i] = hent;
+}
+
+/* Move some slots of the table being resized from into the new one,
+ * and free the old arrays when they're empty. */
+static void
+hash_migrate(HASHTAB *htab, int slots)
+{
+  int i;
+
+  if (!htab->old_hashes)
+    return;
+  for (i = htab->migrated; i < htab->old_size && slots > 0; i++, slots--)
+    if (htab->old_hashes[i] > HTAB_DELETED) {
+      hash_place(htab, htab->old_buckets[i]);
+      /* Leave a tombstone so the entry only lives in one table,
+       * but probes for entries past it still get there. */
+      htab->old_hashes[i] = HTAB_DELETED;
+      htab->old_buckets[i] = NULL;
+    }
+  htab->migrated = i;
+  if (i >= htab->old_size) {
+    mush_free(htab->old_buckets, "hash_buckets");
+    htab->old_hashes = NULL;
+    htab->old_buckets = NULL;
+    htab->old_size = 0;
+    htab->migrated = 0;
+  }
+}
+
+/* Start moving the table into new slot arrays of the given size.
+ * The entries are moved a few at a time by later calls. */
+static void
+hash_grow(HASHTAB *htab, int size)
+{
+  hash_migrate(htab, htab->old_size);
+  htab->old_size = htab->hashsize;
+  htab->old_hashes = htab->hashes;
+  htab->old_buckets = htab->buckets;
+  htab->migrated = 0;
+  hash_alloc(htab, size);
+}
+
+/* Look up a key whose hash is already known. */
+static HASHENT *
+hash_lookup(HASHTAB *htab, const char *key, unsigned int hval)
+{
+  int i;
+
+  if (htab->old_hashes) {
+    hash_migrate(htab, HTAB_MIGRATE);
+    if (htab->old_hashes
+        && (i = hash_slot(htab->old_hashes, htab->old_buckets,
+                          htab->old_size - 1, key, hval)) >= 0)
+      return htab->old_buckets[i];
+  }
+  if ((i = hash_slot(htab->hashes, htab->buckets, htab->mask, key, hval)) >= 0)
+    return htab->buckets[i];
+  return NULL;
 }
 
 /** Return a hashtable entry given a key.
@@ -176,21 +294,13 @@ hash_init(HASHTAB *htab, int size, int data_size)
 HASHENT *
 hash_find(HASHTAB *htab, const char *key)
 {
-  int hval, cmp;
-  HASHENT *hptr;
+  unsigned int hval;
 
   if (!htab->buckets)
     return NULL;
 
-  hval = hash_val(key, htab->mask);
-  for (hptr = htab->buckets[hval]; hptr != NULL; hptr = hptr->next) {
-    cmp = strcmp(key, hptr->key);
-    if (cmp == 0) {
-      return hptr;
-    } else if (cmp < 0)
-      break;
-  }
-  return NULL;
+  hval = hash_val(key);
+  return hash_lookup(htab, key, Hash_Fix(hval));
 }
 
 /** Return the value stored in a hash entry.
@@ -220,107 +330,51 @@ hash_key(HASHENT *entry)
 }
 
 /** Resize a hash table.
+ * The entries are all moved into the new slots before this returns.
  * \param htab pointer to hashtable.
  * \param size new size.
  */
 void
 hash_resize(HASHTAB *htab, int size)
 {
-  int i;
-  HASHENT **oldarr;
-  HASHENT **newarr;
-  HASHENT *hent, *nent, *curr, *old;
-  int hval;
-  int osize;
-  int mask;
-
   /* We don't want hashes outside these limits */
-  if ((size < (1 << 4)) || (size > (1 << 20)))
+  if ((size < HTAB_MIN_SIZE) || (size > (1 << 24)))
     return;
-
-  /* Save the old data we need */
-  osize = htab->hashsize;
-  oldarr = htab->buckets;
-
-  mask = htab->mask = get_hashmask(&size);
-
-  if (size == htab->hashsize)
+  get_hashmask(&size);
+  /* Too small to hold everything */
+  if (size < (htab->entries + 1) * 2)
     return;
-
-  htab->hashsize = size;
-  newarr =
-    (HASHENT **) mush_malloc(size * sizeof(struct hashentry *), "hash_buckets");
-  htab->buckets = newarr;
-  for (i = 0; i < size; i++)
-    newarr[i] = NULL;
-
-  for (i = 0; i < osize; i++) {
-    hent = oldarr[i];
-    while (hent) {
-      nent = hent->next;
-      hval = hash_val(hent->key, mask);
-      for (curr = newarr[hval], old = NULL; curr; old = curr, curr = curr->next) {
-        if (strcmp(curr->key, hent->key) > 0)
-          break;
-      }
-      if (old) {
-        old->next = hent;
-        hent->next = curr;
-      } else {
-        hent->next = newarr[hval];
-        newarr[hval] = hent;
-      }
-      hent = nent;
-    }
-  }
-  mush_free(oldarr, "hash_buckets");
-
-  return;
+  hash_grow(htab, size);
+  hash_migrate(htab, htab->old_size);
 }
 
 HASHENT *
 hash_new(HASHTAB *htab, const char *key)
 {
-  int hval;
   size_t keylen;
-  HASHENT *hptr, *curr, *old;
+  unsigned int hval;
+  HASHENT *hptr;
 
-  hptr = hash_find(htab, key);
+  hval = hash_val(key);
+  hval = Hash_Fix(hval);
+  hptr = hash_lookup(htab, key, hval);
   if (hptr)
     return hptr;
 
-  if (htab->entries > (htab->hashsize * HTAB_UPSCALE))
-    hash_resize(htab, htab->hashsize << 1);
+  /* Keep at least a quarter of the slots empty, so probes stay short.
+   * Mostly-deleted tables are just cleaned up at the same size. */
+  if (!htab->old_hashes
+      && (htab->entries + htab->deleted + 1) * 4 > htab->hashsize * 3)
+    hash_grow(htab, (htab->entries * 2 < htab->hashsize) ?
+              htab->hashsize : htab->hashsize << 1);
 
-  hval = hash_val(key, htab->mask);
   htab->entries++;
   keylen = strlen(key) + 1;
   hptr = (HASHENT *) mush_malloc(HASHENT_SIZE + keylen, "hash_entry");
   memcpy(hptr->key, key, keylen);
+  hptr->hashval = hval;
   hptr->data = NULL;
-
-  if (!htab->buckets[hval] || strcmp(key, htab->buckets[hval]->key) < 0) {
-    hptr->next = htab->buckets[hval];
-    htab->buckets[hval] = hptr;
-    return hptr;
-  }
-
-  /* Insert in sorted order. There's always at least one item in 
-     the chain already at this point. */
-  old = htab->buckets[hval];
-  for (curr = old->next; curr; old = curr, curr = curr->next) {
-    /* Comparison will never be 0 because hash_add checks to see
-       if the entry is already present. */
-    if (strcmp(key, curr->key) < 0) {   /* Insert before curr */
-      old->next = hptr;
-      hptr->next = curr;
-      return hptr;
-    }
-  }
-
-  /* If we get here, we reached the end of the chain */
-  old->next = hptr;
-  hptr->next = NULL;
+  hash_place(htab, hptr);
 
   return hptr;
 }
@@ -338,14 +392,12 @@ hash_add(HASHTAB *htab, const char *key, void *hashdata,
          int extra_size __attribute__ ((__unused__)))
 {
   HASHENT *hptr;
-
-  if (hash_find(htab, key) != NULL) {
-    return -1;
-  }
+  int entries = htab->entries;
 
   hptr = hash_new(htab, key);
 
-  if (!hptr)
+  /* hash_new() returns the old entry if the key is already there */
+  if (!hptr || htab->entries == entries)
     return -1;
 
   hptr->data = hashdata;
@@ -354,34 +406,36 @@ hash_add(HASHTAB *htab, const char *key, void *hashdata,
 }
 
 /** Delete an entry in a hash table.
+ * The slot is only marked deleted, so iterating over a table with
+ * hash_nextentry() can carry on past an entry deleted along the way.
  * \param htab pointer to hash table.
  * \param entry pointer to hash entry to delete (and free).
  */
 void
 hash_delete(HASHTAB *htab, HASHENT *entry)
 {
-  int hval;
-  HASHENT *hptr, *last;
+  int i;
 
   if (!entry)
     return;
 
-  hval = hash_val(entry->key, htab->mask);
-  last = NULL;
-  for (hptr = htab->buckets[hval]; hptr; last = hptr, hptr = hptr->next) {
-    if (entry == hptr) {
-      if (last == NULL)
-        htab->buckets[hval] = hptr->next;
-      else
-        last->next = hptr->next;
-      mush_free(hptr, "hash_entry");
-      htab->entries--;
-      return;
-    }
-  }
-
-  if (htab->entries < (htab->hashsize * HTAB_DOWNSCALE))
-    hash_resize(htab, htab->hashsize >> 1);
+  i = hash_slot(htab->hashes, htab->buckets, htab->mask, entry->key,
+                entry->hashval);
+  if (i >= 0 && htab->buckets[i] == entry) {
+    htab->hashes[i] = HTAB_DELETED;
+    htab->buckets[i] = NULL;
+    htab->deleted++;
+  } else if (htab->old_hashes
+             && (i = hash_slot(htab->old_hashes, htab->old_buckets,
+                               htab->old_size - 1, entry->key,
+                               entry->hashval)) >= 0
+             && htab->old_buckets[i] == entry) {
+    htab->old_hashes[i] = HTAB_DELETED;
+    htab->old_buckets[i] = NULL;
+  } else
+    return;
+  mush_free(entry, "hash_entry");
+  htab->entries--;
 }
 
 /** Flush a hash table, freeing all entries.
@@ -391,30 +445,38 @@ hash_delete(HASHTAB *htab, HASHENT *entry)
 void
 hash_flush(HASHTAB *htab, int size)
 {
-  HASHENT *hent, *thent;
   int i;
 
   if (htab->buckets) {
-    for (i = 0; i < htab->hashsize; i++) {
-      hent = htab->buckets[i];
-      while (hent != NULL) {
-        thent = hent;
-        hent = hent->next;
-        mush_free(thent, "hash_entry");
-      }
-      htab->buckets[i] = NULL;
-    }
-  }
-  if (size == 0) {
+    hash_migrate(htab, htab->old_size);
+    for (i = 0; i < htab->hashsize; i++)
+      if (htab->hashes[i] > HTAB_DELETED)
+        mush_free(htab->buckets[i], "hash_entry");
     mush_free(htab->buckets, "hash_buckets");
+    htab->hashes = NULL;
     htab->buckets = NULL;
-  } else if (size != htab->hashsize) {
-    if (htab->buckets)
-      mush_free(htab->buckets, "hash_buckets");
-    hashinit(htab, size, htab->entry_size);
-  } else {
-    htab->entries = 0;
   }
+  htab->entries = 0;
+  if (size != 0)
+    hashinit(htab, size, htab->entry_size);
+}
+
+/* Find the first used slot at or after a slot, finishing any resize
+ * first so entries don't move under the iteration. */
+static HASHENT *
+hash_iter(HASHTAB *htab, int hval)
+{
+  if (!htab->buckets)
+    return NULL;
+  hash_migrate(htab, htab->old_size);
+  for (; hval < htab->hashsize; hval++)
+    if (htab->hashes[hval] > HTAB_DELETED) {
+      htab->last_hval = hval;
+      htab->last_entry = htab->buckets[hval];
+      return htab->buckets[hval];
+    }
+  htab->last_hval = htab->hashsize;
+  return NULL;
 }
 
 /** Return the first entry of a hash table.
@@ -426,15 +488,7 @@ hash_flush(HASHTAB *htab, int size)
 void *
 hash_firstentry(HASHTAB *htab)
 {
-  int hval;
-
-  for (hval = 0; hval < htab->hashsize; hval++)
-    if (htab->buckets[hval]) {
-      htab->last_hval = hval;
-      htab->last_entry = htab->buckets[hval];
-      return htab->buckets[hval]->data;
-    }
-  return NULL;
+  return hash_value(hash_iter(htab, 0));
 }
 
 /** Return the first key of a hash table.
@@ -446,15 +500,7 @@ hash_firstentry(HASHTAB *htab)
 char *
 hash_firstentry_key(HASHTAB *htab)
 {
-  int hval;
-
-  for (hval = 0; hval < htab->hashsize; hval++)
-    if (htab->buckets[hval]) {
-      htab->last_hval = hval;
-      htab->last_entry = htab->buckets[hval];
-      return htab->buckets[hval]->key;
-    }
-  return NULL;
+  return hash_key(hash_iter(htab, 0));
 }
 
 /** Return the next entry of a hash table.
@@ -467,25 +513,7 @@ hash_firstentry_key(HASHTAB *htab)
 void *
 hash_nextentry(HASHTAB *htab)
 {
-  int hval;
-  HASHENT *hptr;
-
-  hval = htab->last_hval;
-  hptr = htab->last_entry;
-  if (hptr->next) {
-    htab->last_entry = hptr->next;
-    return hptr->next->data;
-  }
-  hval++;
-  while (hval < htab->hashsize) {
-    if (htab->buckets[hval]) {
-      htab->last_hval = hval;
-      htab->last_entry = htab->buckets[hval];
-      return htab->buckets[hval]->data;
-    }
-    hval++;
-  }
-  return NULL;
+  return hash_value(hash_iter(htab, htab->last_hval + 1));
 }
 
 /** Return the next key of a hash table.
@@ -498,25 +526,7 @@ hash_nextentry(HASHTAB *htab)
 char *
 hash_nextentry_key(HASHTAB *htab)
 {
-  int hval;
-  HASHENT *hptr;
-
-  hval = htab->last_hval;
-  hptr = htab->last_entry;
-  if (hptr->next) {
-    htab->last_entry = hptr->next;
-    return hptr->next->key;
-  }
-  hval++;
-  while (hval < htab->hashsize) {
-    if (htab->buckets[hval]) {
-      htab->last_hval = hval;
-      htab->last_entry = htab->buckets[hval];
-      return htab->buckets[hval]->key;
-    }
-    hval++;
-  }
-  return NULL;
+  return hash_key(hash_iter(htab, htab->last_hval + 1));
 }
 
 /** Display a header for a stats listing.
@@ -526,10 +536,12 @@ void
 hash_stats_header(dbref player)
 {
   notify_format(player,
-                "Table      Buckets Entries LChain  ECh  1Ch  2Ch  3Ch 4+Ch  AvgCh ~Memory");
+                "Table        Slots Entries LProbe  0Pr  1Pr  2Pr  3Pr 4+Pr AvgPr ~Memory");
 }
 
 /** Display stats on a hashtable.
+ * The probe columns count entries by how many slots past their home
+ * slot they ended up.
  * \param player player to notify with stats.
  * \param htab pointer to the hash table.
  * \param hname name of the hash table.
@@ -537,10 +549,9 @@ hash_stats_header(dbref player)
 void
 hash_stats(dbref player, HASHTAB *htab, const char *hname)
 {
-  int longest = 0, n;
+  int longest = 0, n, probe;
   int lengths[5];
-  double chainlens = 0.0;
-  double totchains = 0.0;
+  double probes = 0.0;
   unsigned int bytes = 0;
 
   if (!htab || !hname)
@@ -551,28 +562,23 @@ hash_stats(dbref player, HASHTAB *htab, const char *hname)
   bytes += sizeof(HASHTAB);
   bytes += htab->entry_size * htab->entries;
   if (htab->buckets) {
-    bytes += HASHENT_SIZE * htab->hashsize;
+    bytes += (sizeof(unsigned int) + sizeof(HASHENT *)) *
+      (htab->hashsize + htab->old_size);
     for (n = 0; n < htab->hashsize; n++) {
-      int chain = 0;
-      HASHENT *b;
-      if (htab->buckets[n]) {
-        for (b = htab->buckets[n]; b; b = b->next) {
-          chain++;
-          bytes += strlen(b->key) + 1 /* + b->extra_size */ ;
-        }
-        if (chain > longest)
-          longest = chain;
-      }
-      lengths[(chain > 4) ? 4 : chain]++;
-      chainlens += chain;
+      if (htab->hashes[n] <= HTAB_DELETED)
+        continue;
+      bytes += HASHENT_SIZE + strlen(htab->buckets[n]->key) + 1;
+      probe = (n - (int) (htab->hashes[n] & htab->mask)) & htab->mask;
+      if (probe > longest)
+        longest = probe;
+      lengths[(probe > 4) ? 4 : probe]++;
+      probes += probe;
     }
   }
-  for (n = 1; n < 5; n++)
-    totchains += lengths[n];
 
   notify_format(player,
-                "%-10s %7d %7d %6d %4d %4d %4d %4d %4d %6.3f %7u", hname,
+                "%-10s %7d %7d %6d %4d %4d %4d %4d %4d %5.2f %7u", hname,
                 htab->hashsize, htab->entries, longest, lengths[0], lengths[1],
                 lengths[2], lengths[3], lengths[4],
-                totchains > 0 ? chainlens / totchains : 0.0, bytes);
+                htab->entries > 0 ? probes / htab->entries : 0.0, bytes);
 }
@@ -452,6 +452,7 @@ add_lock(dbref player, dbref thing, lock_type type, boolexp key, int flags)
       return 0;
     }
     /* We're replacing an existing lock. */
+    mark_dirty(thing);
     free_boolexp(ll->key);
     ll->key = key;
     ll->creator = player;
@@ -486,6 +487,7 @@ add_lock(dbref player, dbref thing, lock_type type, boolexp key, int flags)
         t = &L_NEXT(*t);
       L_NEXT(ll) = *t;
       *t = ll;
+      mark_dirty(thing);
     }
   }
   return 1;
@@ -539,6 +541,7 @@ add_lock_raw(dbref player, dbref thing, lock_type type, boolexp key, int flags)
       t = &L_NEXT(*t);
     L_NEXT(ll) = *t;
     *t = ll;
+    mark_dirty(thing);
   }
   return 1;
 }
@@ -576,6 +579,7 @@ delete_lock(dbref player, dbref thing, lock_type type)
       ll = *llp;
       *llp = ll->next;
       free_one_lock_list(ll);
+      mark_dirty(thing);
       return 1;
     } else
       return 0;
@@ -967,6 +971,7 @@ do_lset(dbref player, char *what, char *flags)
     L_FLAGS(l) &= ~flag;
   else
     L_FLAGS(l) |= flag;
+  mark_dirty(thing);
 
   if (!Quiet(player) && !(Quiet(thing) && (Owner(thing) == player)))
     notify_format(player, "%s/%s - %s.", Name(thing), L_TYPE(l),
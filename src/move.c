@@ -70,8 +70,10 @@ moveit(dbref what, dbref where, int nomovemsgs)
 
   /* remove what from old loc */
   absold = absolute_room(what);
+  mark_dirty(what);
   if ((loc = old = Location(what)) != NOTHING) {
     Contents(loc) = remove_first(Contents(loc), what);
+    mark_dirty(loc);
   }
   /* test for special cases */
   switch (where) {
@@ -88,6 +90,7 @@ moveit(dbref what, dbref where, int nomovemsgs)
 
   /* now put what in where */
   PUSH(what, Contents(where));
+  mark_dirty(where);
 
   Location(what) = where;
   absloc = absolute_room(what);
@@ -385,6 +385,18 @@ ssl_want_write(int state)
   return (state & MYSSL_WB);
 }
 
+/** Given connection state, determine if it's blocked on read.
+ * This is a just a wrapper so we don't have to expose
+ * our internal state management stuff.
+ * \param state an ssl connection state.
+ * \return 0 if the socket has not been read dry, non-zero otherwise.
+ */
+int
+ssl_want_read(int state)
+{
+  return (state & MYSSL_RB);
+}
+
 /** Call SSL_accept and return the connection state.
  * \param ssl pointer to an SSL object.
  * \return ssl state flags indicating success, pending, or failure.
@@ -13,6 +13,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
 #ifdef I_SYS_TYPES
 #include <sys/types.h>
 #endif
@@ -710,6 +711,115 @@ notify_type(DESC *d)
   return poutput;
 }
 
+/* A message that reaches many players (a channel, a crowded room,
+ * a @wall) would otherwise scan the whole descriptor list once per
+ * player. Once a second player turns up, notify_anything_loc() sorts
+ * the connected descriptors by player instead, noting how each one
+ * renders output, and looks recipients up in that.
+ */
+
+/** A connected descriptor, as indexed by notify_anything_loc(). */
+struct na_desc {
+  dbref player;                 /**< Player connected on d */
+  int order;                    /**< Position of d in descriptor_list */
+  enum na_type type;            /**< How output to d is rendered */
+  DESC *d;                      /**< The descriptor */
+};
+
+/** The descriptor index for one notify_anything_loc() call. */
+struct na_descs {
+  struct na_desc *list;         /**< Descriptors sorted by player */
+  int count;                    /**< Number of entries in list */
+  int lookups;                  /**< Players looked up so far */
+};
+
+static int
+na_desc_cmp(const void *a, const void *b)
+{
+  const struct na_desc *x = a, *y = b;
+
+  if (x->player != y->player)
+    return (x->player < y->player) ? -1 : 1;
+  return x->order - y->order;
+}
+
+static void
+na_desc_build(struct na_descs *nd)
+{
+  DESC *d;
+  int n = 0;
+
+  for (d = descriptor_list; d; d = d->next)
+    if (d->connected)
+      n++;
+  nd->list = (struct na_desc *) mush_malloc(sizeof(struct na_desc) * (n + 1),
+                                            "na_descs");
+  if (!nd->list)
+    mush_panic("Out of memory");
+  n = 0;
+  for (d = descriptor_list; d; d = d->next)
+    if (d->connected) {
+      nd->list[n].player = d->player;
+      nd->list[n].order = n;
+      nd->list[n].type = notify_type(d);
+      nd->list[n].d = d;
+      n++;
+    }
+  qsort(nd->list, n, sizeof(struct na_desc), na_desc_cmp);
+  nd->count = n;
+}
+
+/** Find the next descriptor a player is connected on.
+ * \param nd descriptor index for this notify_anything_loc() call.
+ * \param target player to look for.
+ * \param prev descriptor returned by the last call, or NULL to start.
+ * \param pos iterator state to pass back unchanged.
+ * \param type set to the rendering type for the descriptor found.
+ * \return the next descriptor, or NULL when there are no more.
+ */
+static DESC *
+na_desc_next(struct na_descs *nd, dbref target, DESC *prev, int *pos,
+             enum na_type *type)
+{
+  DESC *d;
+  int lo, hi, mid;
+
+  if (!prev) {
+    if (!nd->list && nd->lookups++ > 0)
+      na_desc_build(nd);
+    if (nd->list) {
+      lo = 0;
+      hi = nd->count;
+      while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (nd->list[mid].player < target)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      *pos = lo;
+    }
+    d = descriptor_list;
+  } else {
+    (*pos)++;
+    d = prev->next;
+  }
+
+  if (nd->list) {
+    if (*pos < nd->count && nd->list[*pos].player == target) {
+      *type = nd->list[*pos].type;
+      return nd->list[*pos].d;
+    }
+    return NULL;
+  }
+  for (; d; d = d->next)
+    if (d->connected && d->player == target) {
+      *type = notify_type(d);
+      return d;
+    }
+  return NULL;
+}
+
 /** Send a message to a series of dbrefs.
  * This key function takes a speaker's utterance and looks up each
  * object that should hear it. For each, it may need to render
@@ -751,6 +861,8 @@ notify_anything_loc(dbref speaker, na_lookup func,
   char eocm[BUFFER_LEN];
   static dbref puppet = NOTHING;
   int nsflags;
+  struct na_descs nd;
+  int pos = 0;
 
   if (!message || *message == '\0' || !func)
     return;
@@ -770,6 +882,10 @@ notify_anything_loc(dbref speaker, na_lookup func,
     paranoids[i].made = 0;
   }
 
+  nd.list = NULL;
+  nd.count = 0;
+  nd.lookups = 0;
+
   msgbuf = mush_strdup(message, "string");
 
   target = NOTHING;
@@ -816,48 +932,45 @@ notify_anything_loc(dbref speaker, na_lookup func,
           global_eval_context.wenv[j] = wsave[j];
       }
 
-      for (d = descriptor_list; d; d = d->next) {
-        if (d->connected && d->player == target) {
-          poutput = notify_type(d);
-
-          if ((flags & NA_PONLY) && (poutput != NA_PUEBLO))
-            continue;
-
-          if (!(flags & NA_SPOOF)
-              && (nsfunc && ((Nospoof(target) && (target != speaker))
-                             || (flags & NA_NOSPOOF)))) {
-            if (Paranoid(target) || (flags & NA_PARANOID)) {
-              if (!havepara) {
-                paranoid = nsfunc(speaker, func, fdata, 1);
-                havepara = 1;
-              }
-              pstring = notify_makestring(paranoid, paranoids, poutput);
-              plen = paranoids[poutput].len;
-            } else {
-              if (!havespoof) {
-                nospoof = nsfunc(speaker, func, fdata, 0);
-                havespoof = 1;
-              }
-              pstring = notify_makestring(nospoof, nospoofs, poutput);
-              plen = nospoofs[poutput].len;
+      for (d = na_desc_next(&nd, target, NULL, &pos, &poutput); d;
+           d = na_desc_next(&nd, target, d, &pos, &poutput)) {
+        if ((flags & NA_PONLY) && (poutput != NA_PUEBLO))
+          continue;
+
+        if (!(flags & NA_SPOOF)
+            && (nsfunc && ((Nospoof(target) && (target != speaker))
+                           || (flags & NA_NOSPOOF)))) {
+          if (Paranoid(target) || (flags & NA_PARANOID)) {
+            if (!havepara) {
+              paranoid = nsfunc(speaker, func, fdata, 1);
+              havepara = 1;
+            }
+            pstring = notify_makestring(paranoid, paranoids, poutput);
+            plen = paranoids[poutput].len;
+          } else {
+            if (!havespoof) {
+              nospoof = nsfunc(speaker, func, fdata, 0);
+              havespoof = 1;
             }
-            queue_newwrite(d, pstring, plen);
+            pstring = notify_makestring(nospoof, nospoofs, poutput);
+            plen = nospoofs[poutput].len;
           }
+          queue_newwrite(d, pstring, plen);
+        }
 
-          pstring = notify_makestring((flags & NA_EVALONCONTACT) ? eocm : msgbuf, messages, poutput);
-          plen = messages[poutput].len;
-          if (pstring && *pstring)
-            queue_newwrite(d, pstring, plen);
+        pstring = notify_makestring((flags & NA_EVALONCONTACT) ? eocm : msgbuf, messages, poutput);
+        plen = messages[poutput].len;
+        if (pstring && *pstring)
+          queue_newwrite(d, pstring, plen);
 
-          if (!(flags & NA_NOENTER)) {
-            if ((poutput == NA_PUEBLO) || (poutput == NA_NPUEBLO)) {
-              if (flags & NA_NOPENTER)
-                queue_newwrite(d, (unsigned char *) "\n", 1);
-              else
-                queue_newwrite(d, (unsigned char *) "<BR>\n", 5);
-            } else {
-              queue_newwrite(d, (unsigned char *) "\r\n", 2);
-            }
+        if (!(flags & NA_NOENTER)) {
+          if ((poutput == NA_PUEBLO) || (poutput == NA_NPUEBLO)) {
+            if (flags & NA_NOPENTER)
+              queue_newwrite(d, (unsigned char *) "\n", 1);
+            else
+              queue_newwrite(d, (unsigned char *) "<BR>\n", 5);
+          } else {
+            queue_newwrite(d, (unsigned char *) "\r\n", 2);
           }
         }
       }
@@ -916,7 +1029,10 @@ notify_anything_loc(dbref speaker, na_lookup func,
 #endif /* RPMODE_SYS */
 
     /* do @listen stuff */
-    a = atr_get_noparent(target, "LISTEN");
+    if (atr_comm_hears(target) & HEARS_LISTEN)
+      a = atr_get_noparent(target, "LISTEN");
+    else
+      a = NULL;
     if (a) {
       if (!tbuf1)
         tbuf1 = (char *) mush_malloc(BUFFER_LEN, "string");
@@ -976,6 +1092,7 @@ notify_anything_loc(dbref speaker, na_lookup func,
      *    */
 
     if ((ThingListen(target) || RoomListen(target))
+        && (atr_comm_hears(target) & HEARS_PATTERNS)
 	&& eval_lock(speaker, target, Listen_Lock)
       )
       atr_comm_match(target, speaker, '^', ':',
@@ -1006,6 +1123,8 @@ notify_anything_loc(dbref speaker, na_lookup func,
     mush_free((Malloc_t) paranoid, "string");
   if (tbuf1)
     mush_free((Malloc_t) tbuf1, "string");
+  if (nd.list)
+    mush_free((Malloc_t) nd.list, "na_descs");
   mush_free((Malloc_t) msgbuf, "string");
   na_depth--;
 }
@@ -1282,6 +1401,7 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
   char tbuf1[BUFFER_LEN];
   DESC *d;
   int ok;
+  FLAG_COLUMN *col = NULL;
 
   va_start(args, fmt);
 #ifdef HAS_VSNPRINTF
@@ -1292,7 +1412,19 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
   va_end(args);
   tbuf1[BUFFER_LEN - 1] = '\0';
 
+  /* Rule out players without the flags once, instead of parsing the
+   * flag lists for every connection */
+  if (flag1 || flag2) {
+    col = new_flag_column();
+    if (flag1)
+      flag_column_select(col, flag1, 1, 0, NOTYPE);
+    if (flag2)
+      flag_column_select(col, flag2, 1, 0, NOTYPE);
+  }
+
   DESC_ITER_CONN(d) {
+    if (col && !flag_column_isset(col, d->player))
+      continue;
     ok = 1;
     if (flag1)
       ok = ok && flaglist_check_long("FLAG", GOD, d->player, flag1, 0);
@@ -1303,22 +1435,55 @@ flag_broadcast(const char *flag1, const char *flag2, const char *fmt, ...)
       process_output(d);
     }
   }
+  if (col)
+    destroy_flag_column(col);
 }
 
 
 
+/* Text blocks are allocated TEXT_BLOCK_SIZE bytes at a time and
+ * recycled through a free list, so queueing output doesn't normally
+ * touch malloc at all. Output is appended to the tail block of a
+ * descriptor's queue while it has room, so a burst of short messages
+ * fills a few blocks that process_output() can hand to one writev().
+ */
+#define TEXT_BLOCK_SIZE 2048
+#define TEXT_BLOCK_POOL 256     /**< Most free blocks kept for reuse */
+
+static struct text_block *text_block_pool = NULL;
+static int text_block_pooled = 0;
+static unsigned long text_block_allocs = 0;
+static unsigned long text_block_reuses = 0;
+
+/* The block whose nxt field q->tail points at, or NULL if q is empty. */
+#define queue_tail_block(q) \
+  ((q)->head ? (struct text_block *) ((char *) (q)->tail - \
+                                      offsetof(struct text_block, nxt)) \
+   : NULL)
+
 static struct text_block *
 make_text_block(const unsigned char *s, int n)
 {
   struct text_block *p;
-  p =
-    (struct text_block *) mush_malloc(sizeof(struct text_block), "text_block");
-  if (!p)
-    mush_panic("Out of memory");
-  p->buf =
-    (unsigned char *) mush_malloc(sizeof(unsigned char) * n, "text_block_buff");
-  if (!p->buf)
-    mush_panic("Out of memory");
+
+  if (n <= TEXT_BLOCK_SIZE && text_block_pool) {
+    p = text_block_pool;
+    text_block_pool = p->nxt;
+    text_block_pooled--;
+    text_block_reuses++;
+  } else {
+    p = (struct text_block *) mush_malloc(sizeof(struct text_block),
+                                          "text_block");
+    if (!p)
+      mush_panic("Out of memory");
+    p->size = (n > TEXT_BLOCK_SIZE) ? n : TEXT_BLOCK_SIZE;
+    p->buf =
+      (unsigned char *) mush_malloc(sizeof(unsigned char) * p->size,
+                                    "text_block_buff");
+    if (!p->buf)
+      mush_panic("Out of memory");
+    text_block_allocs++;
+  }
 
   memcpy(p->buf, s, n);
   p->nchars = n;
@@ -1328,19 +1493,28 @@ make_text_block(const unsigned char *s, int n)
 }
 
 /** Free a text_block structure.
+ * Standard-sized blocks go back on the free list instead.
  * \param t pointer to text_block to free.
  */
 void
 free_text_block(struct text_block *t)
 {
   if (t) {
+    if (t->size == TEXT_BLOCK_SIZE && text_block_pooled < TEXT_BLOCK_POOL) {
+      t->nxt = text_block_pool;
+      text_block_pool = t;
+      text_block_pooled++;
+      return;
+    }
     if (t->buf)
       mush_free((Malloc_t) t->buf, "text_block_buff");
     mush_free((Malloc_t) t, "text_block");
   }
 }
 
-/** Add a new chunk of text to a player's output queue.
+/** Add a new chunk of text to a queue.
+ * The chunk gets a block of its own; input queues rely on this to
+ * keep one command per block.
  * \param q pointer to text_queue to add the chunk to.
  * \param b text to add to the queue.
  * \param n length of text to add.
@@ -1359,6 +1533,41 @@ add_to_queue(struct text_queue *q, const unsigned char *b, int n)
   q->tail = &p->nxt;
 }
 
+/** Append text to an output queue, filling the tail block first.
+ * \param q pointer to text_queue to add the text to.
+ * \param b text to add to the queue.
+ * \param n length of text to add.
+ * \param keep_head if true, never append into the head block. SSL
+ * connections need this, since a retried SSL_write() must be passed
+ * the same buffer it was first given.
+ */
+static void
+append_to_queue(struct text_queue *q, const unsigned char *b, int n,
+                int keep_head)
+{
+  struct text_block *p;
+  int room;
+
+  p = queue_tail_block(q);
+  if (p && !(keep_head && p == q->head)) {
+    room = p->size - (p->start - p->buf) - p->nchars;
+    if (room > n)
+      room = n;
+    if (room > 0) {
+      memcpy(p->start + p->nchars, b, room);
+      p->nchars += room;
+      b += room;
+      n -= room;
+    }
+  }
+  while (n > 0) {
+    room = (n > TEXT_BLOCK_SIZE) ? TEXT_BLOCK_SIZE : n;
+    add_to_queue(q, b, room);
+    b += room;
+    n -= room;
+  }
+}
+
 static int
 flush_queue(struct text_queue *q, int n)
 {
@@ -1484,7 +1693,11 @@ queue_newwrite(DESC *d, const unsigned char *b, int n)
         d->output_size -= flush_queue(&d->output, -space);
     }
   }
-  add_to_queue(&d->output, b, n);
+#ifdef HAS_OPENSSL
+  append_to_queue(&d->output, b, n, d->ssl != NULL);
+#else
+  append_to_queue(&d->output, b, n, 0);
+#endif
   d->output_size += n;
   feed_snoop(d, (char *) b, 1);
   return n;
@@ -1580,6 +1793,51 @@ freeqs(DESC *d)
   d->raw_input_at = 0;
 }
 
+/** Report output queue statistics for \@stats/tables.
+ * Site-privileged players also get a line per connection.
+ * \param player the enactor.
+ */
+void
+output_queue_stats(dbref player)
+{
+  DESC *d;
+  struct text_block *p;
+  int conns = 0, blocks, total_blocks = 0;
+  long queued = 0;
+  unsigned long sent = 0, writes = 0;
+
+  for (d = descriptor_list; d; d = d->next) {
+    conns++;
+    queued += d->output_size;
+    sent += d->output_chars;
+    writes += d->output_flushes;
+    for (p = d->output.head; p; p = p->nxt)
+      total_blocks++;
+  }
+  notify(player, "Output Queues:");
+  notify_format(player,
+                "%d connections, %ld bytes queued in %d blocks. %lu bytes "
+                "sent in %lu writes.", conns, queued, total_blocks, sent,
+                writes);
+  notify_format(player,
+                "%d of %d free blocks pooled. %lu blocks allocated, %lu "
+                "reused.", text_block_pooled, TEXT_BLOCK_POOL,
+                text_block_allocs, text_block_reuses);
+  if (!Site(player))
+    return;
+  for (d = descriptor_list; d; d = d->next) {
+    blocks = 0;
+    for (p = d->output.head; p; p = p->nxt)
+      blocks++;
+    notify_format(player,
+                  "%4d %-16s %6d bytes queued in %d blocks, %lu bytes sent "
+                  "in %lu writes.", d->descriptor,
+                  (d->connected && GoodObject(d->player)) ? Name(d->player) :
+                  T("Connecting..."), d->output_size, blocks, d->output_chars,
+                  d->output_flushes);
+  }
+}
+
 /** A notify_anything function for formatting speaker data for NOSPOOF.
  *  * \param speaker the speaker.
  *   * \param func unused.
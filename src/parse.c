@@ -397,6 +397,438 @@ extern signed char qreg_indexes[UCHAR_MAX + 1];
 #pragma warning( disable : 4761)        /* NJG: disable warning re conversion */
 #endif
 
+static int pe_parse(char *buff, char **bp, char const **str,
+                    dbref executor, dbref caller, dbref enactor,
+                    int eflags, int tflags, PE_Info * pe_info,
+                    PE_State * state);
+
+
+/** Perform a single %-substitution.
+ * This handles an evaluated %-sequence for process_expression(), and
+ * is shared with the compiled attribute evaluator in pcode.c.
+ * \param buff buffer to store returns of parsing.
+ * \param bp pointer to pointer into buff marking insert position.
+ * \param str pointer to the string being parsed, pointing at the %.
+ * \param executor dbref of the object invoking the function.
+ * \param caller dbref of  the last object to use u()
+ * \param enactor dbref of the enactor.
+ * \param pe_info pointer to parser context data.
+ * \param gcache pointer to the cached gender of the enactor, or -1.
+ * \retval 0 keep parsing.
+ * \retval 1 the expression ended inside the substitution.
+ */
+int
+pe_substitute(char *buff, char **bp, char const **str,
+              dbref executor, dbref caller, dbref enactor,
+              PE_Info * pe_info, int *gcache)
+{
+  int inum_this;
+  char temp[3];
+  int qindex;
+  char savec, nextc;
+  char *savepos;
+  ATTR *attrib;
+
+  (*str)++;
+  savec = **str;
+  if (!savec) {
+    /* Line ended in %, so treat it as a literal */
+    safe_chr('%', buff, bp);
+    return 1;
+  }
+  savepos = *bp;
+  (*str)++;
+
+  switch (savec) {
+  case '%':                     /* %% - a real % */
+    safe_chr('%', buff, bp);
+    break;
+  case ' ':                     /* "% " for more natural typing */
+    safe_str("% ", buff, bp);
+    break;
+  case '!':                     /* executor dbref */
+    safe_dbref(executor, buff, bp);
+    break;
+  case '@':                     /* caller dbref */
+    safe_dbref(caller, buff, bp);
+    break;
+  case '#':                     /* enactor dbref */
+    safe_dbref(enactor, buff, bp);
+    break;
+  case ':':                     /* enactor unique id */
+    safe_dbref(enactor, buff, bp);
+    safe_chr(':', buff, bp);
+    safe_integer(CreTime(enactor), buff, bp);
+    break;
+  case '?':                     /* function limits */
+    if (pe_info) {
+      safe_integer(pe_info->fun_invocations, buff, bp);
+      safe_chr(' ', buff, bp);
+      safe_integer(pe_info->fun_depth, buff, bp);
+    } else {
+      safe_str("0 0", buff, bp);
+    }
+    break;
+  case '~':                     /* enactor accented name */
+    safe_str(accented_name(enactor), buff, bp);
+    break;
+  case '+':                     /* argument count */
+    if (pe_info)
+      safe_integer(pe_info->arg_count, buff, bp);
+    else
+      safe_integer(0, buff, bp);
+    break;
+  case '0':
+  case '1':
+  case '2':
+  case '3':
+  case '4':
+  case '5':
+  case '6':
+  case '7':
+  case '8':
+  case '9':                     /* positional argument */
+    if (global_eval_context.wenv[savec - '0'])
+      safe_str(global_eval_context.wenv[savec - '0'], buff, bp);
+    break;
+  case 'A':
+  case 'a':                     /* enactor absolute possessive pronoun */
+    if (*gcache < 0)
+      *gcache = get_gender(enactor);
+    safe_str(absp[*gcache], buff, bp);
+    break;
+  case 'B':
+  case 'b':                     /* blank space */
+    safe_chr(' ', buff, bp);
+    break;
+  case 'C':
+  case 'c':                     /* command line */
+    safe_str(global_eval_context.ccom, buff, bp);
+    break;
+  case 'I':
+  case 'i':
+    nextc = **str;
+    if (!nextc)
+      return 1;
+    (*str)++;
+    if (!isdigit(nextc)) {
+      safe_str(T(e_int), buff, bp);
+      break;
+    }
+    inum_this = nextc - '0';
+    if (inum_this < 0 || inum_this >= inum
+        || (inum - inum_this) <= inum_limit) {
+      safe_str(T("#-1 ARGUMENT OUT OF RANGE"), buff, bp);
+    } else {
+      safe_str(iter_rep[inum - inum_this], buff, bp);
+    }
+    break;
+  case 'U':
+  case 'u':
+    safe_str(global_eval_context.ucom, buff, bp);
+    break;
+  case 'L':
+  case 'l':                     /* enactor location dbref */
+    /* The security implications of this have
+     * already been talked to death.  Deal. */
+    safe_dbref(Location(enactor), buff, bp);
+    break;
+  case 'N':
+  case 'n':                     /* enactor name */
+    safe_str(Name(enactor), buff, bp);
+    break;
+  case 'O':
+  case 'o':                     /* enactor objective pronoun */
+    if (*gcache < 0)
+      *gcache = get_gender(enactor);
+    safe_str(obj[*gcache], buff, bp);
+    break;
+  case 'P':
+  case 'p':                     /* enactor possessive pronoun */
+    if (*gcache < 0)
+      *gcache = get_gender(enactor);
+    safe_str(poss[*gcache], buff, bp);
+    break;
+  case '<':
+    if (!**str)
+      return 1;
+    {
+      const char *tmp;
+      char atrname[BUFFER_LEN];
+      ATTR *atr;
+
+      for(tmp = *str; *tmp && *tmp != '>'; tmp++)
+        ;
+      if(!*tmp || tmp == *str) {
+        (*str)--;
+        return 1;
+      }
+      strncpy(atrname, *str, tmp - *str);
+      atrname[tmp - *str] = '\0';
+
+      atr = atr_get(executor, strupper(atrname));
+      if(atr)
+        safe_str(atr_value(atr), buff, bp);
+      *str = tmp + 1;
+    }
+    break;
+  case 'Q':
+  case 'q':                     /* temporary storage */
+    nextc = **str;
+    if (!nextc)
+      return 1;
+    (*str)++;
+    if (nextc == '<') {
+      const char *tmp;
+      char regname[BUFFER_LEN];
+      for(tmp = *str; *tmp && *tmp != '>'; tmp++)
+        ;
+      if(!*tmp || tmp == *str) {
+        (*str)--;
+        return 1;
+      }
+      strncpy(regname, *str, tmp - *str);
+      regname[tmp - *str] = '\0';
+      safe_str(get_namedreg(&global_eval_context.namedregs, regname), buff, bp);
+      *str = tmp + 1;
+    } else {
+      if ((qindex = qreg_indexes[(unsigned char) nextc]) == -1)
+        break;
+      if (global_eval_context.renv[qindex])
+        safe_str(global_eval_context.renv[qindex], buff, bp);
+    }
+    break;
+  case 'R':
+  case 'r':                     /* newline */
+    if (NEWLINE_ONE_CHAR)
+      safe_chr('\n', buff, bp);
+    else
+      safe_str("\r\n", buff, bp);
+    break;
+  case 'S':
+  case 's':                     /* enactor subjective pronoun */
+    if (*gcache < 0)
+      *gcache = get_gender(enactor);
+    safe_str(subj[*gcache], buff, bp);
+    break;
+  case 'T':
+  case 't':                     /* tab */
+    safe_chr('\t', buff, bp);
+    break;
+  case 'V':
+  case 'v':
+  case 'W':
+  case 'w':
+  case 'X':
+  case 'x':                     /* attribute substitution */
+    nextc = **str;
+    if (!nextc)
+      return 1;
+    (*str)++;
+    temp[0] = UPCASE(savec);
+    temp[1] = UPCASE(nextc);
+    temp[2] = '\0';
+    attrib = atr_get(executor, temp);
+    if (attrib)
+      safe_str(atr_value(attrib), buff, bp);
+    break;
+  case 'z':
+  case 'Z':
+    nextc = **str;
+    (*str)++;
+    if (!nextc) {
+      return 1;
+    } else {
+      switch (nextc) {
+      case 'h':             /* hilite */
+        safe_str(ANSI_HILITE, buff, bp);
+        break;
+      case 'i':             /* inverse */
+        safe_str(ANSI_INVERSE, buff, bp);
+        break;
+      case 'f':             /* flash */
+        safe_str(ANSI_BLINK, buff, bp);
+        break;
+      case 'u':             /* underscore */
+        safe_str(ANSI_UNDERSCORE, buff, bp);
+        break;
+      case 'n':             /* normal */
+        safe_str(ANSI_NORMAL, buff, bp);
+        break;
+      case 'x':             /* black fg */
+        safe_str(ANSI_BLACK, buff, bp);
+        break;
+      case 'r':             /* red fg */
+        safe_str(ANSI_RED, buff, bp);
+        break;
+      case 'g':             /* green fg */
+        safe_str(ANSI_GREEN, buff, bp);
+        break;
+      case 'y':             /* yellow fg */
+        safe_str(ANSI_YELLOW, buff, bp);
+        break;
+      case 'b':             /* blue fg */
+        safe_str(ANSI_BLUE, buff, bp);
+        break;
+      case 'm':             /* magenta fg */
+        safe_str(ANSI_MAGENTA, buff, bp);
+        break;
+      case 'c':             /* cyan fg */
+        safe_str(ANSI_CYAN, buff, bp);
+        break;
+      case 'w':             /* white fg */
+        safe_str(ANSI_WHITE, buff, bp);
+        break;
+      case 'X':             /* black bg */
+        safe_str(ANSI_BBLACK, buff, bp);
+        break;
+      case 'R':             /* red bg */
+        safe_str(ANSI_BRED, buff, bp);
+        break;
+      case 'G':             /* green bg */
+        safe_str(ANSI_BGREEN, buff, bp);
+        break;
+      case 'Y':             /* yellow bg */
+        safe_str(ANSI_BYELLOW, buff, bp);
+        break;
+      case 'B':             /* blue bg */
+        safe_str(ANSI_BBLUE, buff, bp);
+        break;
+      case 'M':             /* magenta bg */
+        safe_str(ANSI_BMAGENTA, buff, bp);
+        break;
+      case 'C':             /* cyan bg */
+        safe_str(ANSI_BCYAN, buff, bp);
+        break;
+      case 'W':             /* white bg */
+        safe_str(ANSI_BWHITE, buff, bp);
+        break;
+      }
+      break;
+    }
+  default:                      /* just copy */
+    safe_chr(savec, buff, bp);
+  }
+
+  if (isupper((unsigned char) savec))
+    *savepos = UPCASE(*savepos);
+  return 0;
+}
+
+/** Call a softcode function with already-evaluated arguments.
+ * This checks the argument count and runs a builtin or @function,
+ * writing the result to buff. It's shared by process_expression()
+ * and the compiled attribute evaluator in pcode.c.
+ * \param fp the function to call.
+ * \param buff buffer to store the result.
+ * \param bp pointer to pointer into buff marking insert position.
+ * \param nfargs number of arguments.
+ * \param fargs the arguments, which may be freed and set to NULL.
+ * \param arglens lengths of the arguments.
+ * \param executor dbref of the object invoking the function.
+ * \param caller dbref of  the last object to use u()
+ * \param enactor dbref of the enactor.
+ * \param pe_info pointer to parser context data.
+ */
+void
+pe_call_function(FUN *fp, char *buff, char **bp, int nfargs, char **fargs,
+                 int *arglens, dbref executor, dbref caller, dbref enactor,
+                 PE_Info * pe_info)
+{
+  /* If we have the right number of args, eval the function.
+   * Otherwise, return an error message.
+   * Special case: zero args is recognized as one null arg.
+   */
+  if ((fp->minargs == 0 || (fp->minargs == 1 && (fp->flags & FN_ONEARG))) && (nfargs == 1) && (!*fargs[0] || arglens[0]== 0)) {
+    mush_free((Malloc_t) fargs[0],
+              "process_expression.function_argument");
+    fargs[0] = NULL;
+    arglens[0] = 0;
+    nfargs = 0;
+  }
+  if ((nfargs < fp->minargs) || (nfargs > abs(fp->maxargs))) {
+    safe_str(T("#-1 FUNCTION ("), buff, bp);
+    safe_str(fp->name, buff, bp);
+    safe_str(") EXPECTS ", buff, bp);
+    if (fp->minargs == abs(fp->maxargs)) {
+      safe_integer(fp->minargs, buff, bp);
+    } else if ((fp->minargs + 1) == abs(fp->maxargs)) {
+      safe_integer(fp->minargs, buff, bp);
+      safe_str(" OR ", buff, bp);
+      safe_integer(abs(fp->maxargs), buff, bp);
+    } else if (fp->maxargs == INT_MAX) {
+      safe_str("AT LEAST ", buff, bp);
+      safe_integer(fp->minargs, buff, bp);
+    } else {
+      safe_str("BETWEEN ", buff, bp);
+      safe_integer(fp->minargs, buff, bp);
+      safe_str(" AND ", buff, bp);
+      safe_integer(abs(fp->maxargs), buff, bp);
+    }
+    safe_str(" ARGUMENTS BUT GOT ", buff, bp);
+    safe_integer(nfargs, buff, bp);
+  } else {
+    global_fun_recursions++;
+    pe_info->fun_depth++;
+    if (fp->flags & FN_BUILTIN) {
+      global_fun_invocations++;
+      pe_info->fun_invocations++;
+      fp->where.fun(fp, buff, bp, nfargs, fargs, arglens, executor,
+                    caller, enactor, fp->name, pe_info);
+      if (fp->flags & FN_LOGARGS) {
+        char logstr[BUFFER_LEN];
+        char *logp;
+        int logi;
+        logp = logstr;
+        safe_str(fp->name, logstr, &logp);
+        safe_chr('(', logstr, &logp);
+        for (logi = 0; logi < nfargs; logi++) {
+          safe_str(fargs[logi], logstr, &logp);
+          if (logi + 1 < nfargs)
+            safe_chr(',', logstr, &logp);
+        }
+        safe_chr(')', logstr, &logp);
+        *logp = '\0';
+        do_log(LT_CMD, executor, caller, "%s", logstr);
+      } else if (fp->flags & FN_LOGNAME)
+        do_log(LT_CMD, executor, caller, "%s()", fp->name);
+    } else {
+      dbref thing;
+      ATTR *attrib;
+      global_fun_invocations++;
+      pe_info->fun_invocations++;
+      thing = userfn_tab[fp->where.offset].thing;
+      attrib = atr_get(thing, userfn_tab[fp->where.offset].name);
+      if (!attrib) {
+        do_rawlog(LT_ERR,
+                  T("ERROR: @function (%s) without attribute (#%d/%s)"),
+                  fp->name, thing, userfn_tab[fp->where.offset].name);
+        safe_str("#-1 @FUNCTION (", buff, bp);
+        safe_str(fp->name, buff, bp);
+        safe_str(") MISSING ATTRIBUTE (", buff, bp);
+        safe_dbref(thing, buff, bp);
+        safe_chr('/', buff, bp);
+        safe_str(userfn_tab[fp->where.offset].name, buff, bp);
+        safe_chr(')', buff, bp);
+      } else { 
+        char *preserve[NUMQ];
+        dbref local_ooref;
+        if (fp->flags & FN_LOCALIZE)
+          save_global_regs("@function.save", preserve);
+        /* Temporarily change ooref */
+        local_ooref = ooref;
+        ooref = attrib->creator;
+        do_userfn(buff, bp, thing, attrib, nfargs, fargs,
+                  executor, caller, enactor, pe_info);
+        ooref = local_ooref;
+        if (fp->flags & FN_LOCALIZE)
+          restore_global_regs("@function.save", preserve);
+      }
+    }
+    pe_info->fun_depth--;
+    global_fun_recursions--;
+  }
+}
 
 /** Function and other substitution evaluation.
  * This is the PennMUSH function/expression parser. Big stuff.
@@ -452,24 +884,69 @@ int
 process_expression(char *buff, char **bp, char const **str,
                    dbref executor, dbref caller, dbref enactor,
                    int eflags, int tflags, PE_Info * pe_info)
+{
+  return pe_parse(buff, bp, str, executor, caller, enactor, eflags, tflags,
+                  pe_info, NULL);
+}
+
+/** Continue evaluating an expression partway through.
+ * This picks up parsing at *str as though process_expression() had
+ * already been working on this level of the expression, with the
+ * local parser state given in state. It's used by the compiled
+ * attribute evaluator in pcode.c whenever it has to hand control
+ * back to the interpreter. The level's call depth must already have
+ * been counted in pe_info, which may not be NULL.
+ * \param buff buffer to store returns of parsing.
+ * \param bp pointer to pointer into buff marking insert position.
+ * \param str pointer to the rest of the string to parse.
+ * \param executor dbref of the object invoking the function.
+ * \param caller dbref of  the last object to use u()
+ * \param enactor dbref of the enactor.
+ * \param eflags flags to control what is evaluated.
+ * \param tflags flags to control what terminates an expression.
+ * \param pe_info pointer to parser context data.
+ * \param state parser state for this level.
+ * \retval 0 success.
+ * \retval 1 CPU time limit exceeded.
+ */
+int
+pe_resume(char *buff, char **bp, char const **str,
+          dbref executor, dbref caller, dbref enactor,
+          int eflags, int tflags, PE_Info * pe_info, PE_State * state)
+{
+  return pe_parse(buff, bp, str, executor, caller, enactor, eflags, tflags,
+                  pe_info, state);
+}
+
+/* The guts of process_expression() and pe_resume(). */
+static int
+pe_parse(char *buff, char **bp, char const **str,
+         dbref executor, dbref caller, dbref enactor,
+         int eflags, int tflags, PE_Info * pe_info, PE_State * state)
 {
   int debugging = 0, made_info = 0;
   char *debugstr = NULL, *sourcestr = NULL;
   char *realbuff = NULL, *realbp = NULL;
   int gender = -1;
-  int inum_this;
   char *startpos = *bp;
   int had_space = 0;
-  char temp[3];
   int temp_eflags;
   int old_iter_limit;
-  int qindex;
   int e_len;
   int retval = 0;
   const char *e_msg;
 
   if (!buff || !bp || !str || !*str)
     return 0;
+  if (state) {
+    /* Skip the setup; the caller has already done it for this level. */
+    startpos = state->startpos;
+    had_space = state->had_space;
+    gender = state->gender;
+    retval = state->retval;
+    old_iter_limit = -1;
+    goto parse_loop;
+  }
   if (cpu_time_limit_hit) {
     if (!cpu_limit_warning_sent) {
       cpu_limit_warning_sent = 1;
@@ -580,6 +1057,7 @@ process_expression(char *buff, char **bp, char const **str,
   if (**str != '{')
     eflags &= ~PE_COMMAND_BRACES;
 
+parse_loop:
   for (;;) {
      if(iter_break > 0) {
         while(*str && **str)
@@ -761,293 +1239,9 @@ process_expression(char *buff, char **bp, char const **str,
         }
         break;
       } else {
-        char savec, nextc;
-        char *savepos;
-        ATTR *attrib;
-
-        (*str)++;
-        savec = **str;
-        if (!savec) {
-          /* Line ended in %, so treat it as a literal */
-          safe_chr('%', buff, bp);
+        if (pe_substitute(buff, bp, str, executor, caller, enactor,
+                          pe_info, &gender))
           goto exit_sequence;
-        }
-        savepos = *bp;
-        (*str)++;
-
-        switch (savec) {
-        case '%':               /* %% - a real % */
-          safe_chr('%', buff, bp);
-          break;
-        case ' ':               /* "% " for more natural typing */
-          safe_str("% ", buff, bp);
-          break;
-        case '!':               /* executor dbref */
-          safe_dbref(executor, buff, bp);
-          break;
-        case '@':               /* caller dbref */
-          safe_dbref(caller, buff, bp);
-          break;
-        case '#':               /* enactor dbref */
-          safe_dbref(enactor, buff, bp);
-          break;
-        case ':':               /* enactor unique id */
-          safe_dbref(enactor, buff, bp);
-          safe_chr(':', buff, bp);
-          safe_integer(CreTime(enactor), buff, bp);
-          break;
-        case '?':               /* function limits */
-          if (pe_info) {
-            safe_integer(pe_info->fun_invocations, buff, bp);
-            safe_chr(' ', buff, bp);
-            safe_integer(pe_info->fun_depth, buff, bp);
-          } else {
-            safe_str("0 0", buff, bp);
-          }
-          break;
-        case '~':               /* enactor accented name */
-          safe_str(accented_name(enactor), buff, bp);
-          break;
-        case '+':               /* argument count */
-          if (pe_info)
-            safe_integer(pe_info->arg_count, buff, bp);
-          else
-            safe_integer(0, buff, bp);
-          break;
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':               /* positional argument */
-          if (global_eval_context.wenv[savec - '0'])
-            safe_str(global_eval_context.wenv[savec - '0'], buff, bp);
-          break;
-        case 'A':
-        case 'a':               /* enactor absolute possessive pronoun */
-          if (gender < 0)
-            gender = get_gender(enactor);
-          safe_str(absp[gender], buff, bp);
-          break;
-        case 'B':
-        case 'b':               /* blank space */
-          safe_chr(' ', buff, bp);
-          break;
-        case 'C':
-        case 'c':               /* command line */
-          safe_str(global_eval_context.ccom, buff, bp);
-          break;
-        case 'I':
-        case 'i':
-          nextc = **str;
-          if (!nextc)
-            goto exit_sequence;
-          (*str)++;
-          if (!isdigit(nextc)) {
-            safe_str(T(e_int), buff, bp);
-            break;
-          }
-          inum_this = nextc - '0';
-          if (inum_this < 0 || inum_this >= inum
-              || (inum - inum_this) <= inum_limit) {
-            safe_str(T("#-1 ARGUMENT OUT OF RANGE"), buff, bp);
-          } else {
-            safe_str(iter_rep[inum - inum_this], buff, bp);
-          }
-          break;
-        case 'U':
-        case 'u':
-          safe_str(global_eval_context.ucom, buff, bp);
-          break;
-        case 'L':
-        case 'l':               /* enactor location dbref */
-          /* The security implications of this have
-           * already been talked to death.  Deal. */
-          safe_dbref(Location(enactor), buff, bp);
-          break;
-        case 'N':
-        case 'n':               /* enactor name */
-          safe_str(Name(enactor), buff, bp);
-          break;
-        case 'O':
-        case 'o':               /* enactor objective pronoun */
-          if (gender < 0)
-            gender = get_gender(enactor);
-          safe_str(obj[gender], buff, bp);
-          break;
-        case 'P':
-        case 'p':               /* enactor possessive pronoun */
-          if (gender < 0)
-            gender = get_gender(enactor);
-          safe_str(poss[gender], buff, bp);
-          break;
-        case '<':
-          if (!**str)
-            goto exit_sequence;
-          {
-            const char *tmp;
-            char atrname[BUFFER_LEN];
-            ATTR *atr;
-
-            for(tmp = *str; *tmp && *tmp != '>'; tmp++)
-              ;
-            if(!*tmp || tmp == *str) {
-              (*str)--;
-              goto exit_sequence;
-            }
-            strncpy(atrname, *str, tmp - *str);
-            atrname[tmp - *str] = '\0';
-
-            atr = atr_get(executor, strupper(atrname));
-            if(atr)
-              safe_str(atr_value(atr), buff, bp);
-            *str = tmp + 1;
-          }
-          break;
-        case 'Q':
-        case 'q':               /* temporary storage */
-          nextc = **str;
-          if (!nextc)
-            goto exit_sequence;
-          (*str)++;
-          if (nextc == '<') {
-            const char *tmp;
-            char regname[BUFFER_LEN];
-            for(tmp = *str; *tmp && *tmp != '>'; tmp++)
-              ;
-            if(!*tmp || tmp == *str) {
-              (*str)--;
-              goto exit_sequence;
-            }
-            strncpy(regname, *str, tmp - *str);
-            regname[tmp - *str] = '\0';
-            safe_str(get_namedreg(&global_eval_context.namedregs, regname), buff, bp);
-            *str = tmp + 1;
-          } else {
-            if ((qindex = qreg_indexes[(unsigned char) nextc]) == -1)
-              break;
-            if (global_eval_context.renv[qindex])
-              safe_str(global_eval_context.renv[qindex], buff, bp);
-          }
-          break;
-        case 'R':
-        case 'r':               /* newline */
-          if (NEWLINE_ONE_CHAR)
-            safe_chr('\n', buff, bp);
-          else
-            safe_str("\r\n", buff, bp);
-          break;
-        case 'S':
-        case 's':               /* enactor subjective pronoun */
-          if (gender < 0)
-            gender = get_gender(enactor);
-          safe_str(subj[gender], buff, bp);
-          break;
-        case 'T':
-        case 't':               /* tab */
-          safe_chr('\t', buff, bp);
-          break;
-        case 'V':
-        case 'v':
-        case 'W':
-        case 'w':
-        case 'X':
-        case 'x':               /* attribute substitution */
-          nextc = **str;
-          if (!nextc)
-            goto exit_sequence;
-          (*str)++;
-          temp[0] = UPCASE(savec);
-          temp[1] = UPCASE(nextc);
-          temp[2] = '\0';
-          attrib = atr_get(executor, temp);
-          if (attrib)
-            safe_str(atr_value(attrib), buff, bp);
-          break;
-        case 'z':
-        case 'Z':
-          nextc = **str;
-          (*str)++;
-          if (!nextc) {
-            goto exit_sequence;
-          } else {
-            switch (nextc) {
-            case 'h':       /* hilite */
-              safe_str(ANSI_HILITE, buff, bp);
-              break;
-            case 'i':       /* inverse */
-              safe_str(ANSI_INVERSE, buff, bp);
-              break;
-            case 'f':       /* flash */
-              safe_str(ANSI_BLINK, buff, bp);
-              break;
-            case 'u':       /* underscore */
-              safe_str(ANSI_UNDERSCORE, buff, bp);
-              break;
-            case 'n':       /* normal */
-              safe_str(ANSI_NORMAL, buff, bp);
-              break;
-            case 'x':       /* black fg */
-              safe_str(ANSI_BLACK, buff, bp);
-              break;
-            case 'r':       /* red fg */
-              safe_str(ANSI_RED, buff, bp);
-              break;
-            case 'g':       /* green fg */
-              safe_str(ANSI_GREEN, buff, bp);
-              break;
-            case 'y':       /* yellow fg */
-              safe_str(ANSI_YELLOW, buff, bp);
-              break;
-            case 'b':       /* blue fg */
-              safe_str(ANSI_BLUE, buff, bp);
-              break;
-            case 'm':       /* magenta fg */
-              safe_str(ANSI_MAGENTA, buff, bp);
-              break;
-            case 'c':       /* cyan fg */
-              safe_str(ANSI_CYAN, buff, bp);
-              break;
-            case 'w':       /* white fg */
-              safe_str(ANSI_WHITE, buff, bp);
-              break;
-            case 'X':       /* black bg */
-              safe_str(ANSI_BBLACK, buff, bp);
-              break;
-            case 'R':       /* red bg */
-              safe_str(ANSI_BRED, buff, bp);
-              break;
-            case 'G':       /* green bg */
-              safe_str(ANSI_BGREEN, buff, bp);
-              break;
-            case 'Y':       /* yellow bg */
-              safe_str(ANSI_BYELLOW, buff, bp);
-              break;
-            case 'B':       /* blue bg */
-              safe_str(ANSI_BBLUE, buff, bp);
-              break;
-            case 'M':       /* magenta bg */
-              safe_str(ANSI_BMAGENTA, buff, bp);
-              break;
-            case 'C':       /* cyan bg */
-              safe_str(ANSI_BCYAN, buff, bp);
-              break;
-            case 'W':       /* white bg */
-              safe_str(ANSI_BWHITE, buff, bp);
-              break;
-            }
-            break;
-          }
-        default:                /* just copy */
-          safe_chr(savec, buff, bp);
-        }
-
-        if (isupper((unsigned char) savec))
-          *savepos = UPCASE(*savepos);
       }
       break;
     case '{':                   /* "{}" parse group; recurse with no function check */
@@ -1291,99 +1485,8 @@ process_expression(char *buff, char **bp, char const **str,
             safe_str(T(e_perm), buff, bp);
           goto free_func_args;
         } else {
-          /* If we have the right number of args, eval the function.
-           * Otherwise, return an error message.
-           * Special case: zero args is recognized as one null arg.
-           */
-          if ((fp->minargs == 0 || (fp->minargs == 1 && (fp->flags & FN_ONEARG))) && (nfargs == 1) && (!*fargs[0] || arglens[0]== 0)) {
-            mush_free((Malloc_t) fargs[0],
-                      "process_expression.function_argument");
-            fargs[0] = NULL;
-            arglens[0] = 0;
-            nfargs = 0;
-          }
-          if ((nfargs < fp->minargs) || (nfargs > abs(fp->maxargs))) {
-            safe_str(T("#-1 FUNCTION ("), buff, bp);
-            safe_str(fp->name, buff, bp);
-            safe_str(") EXPECTS ", buff, bp);
-            if (fp->minargs == abs(fp->maxargs)) {
-              safe_integer(fp->minargs, buff, bp);
-            } else if ((fp->minargs + 1) == abs(fp->maxargs)) {
-              safe_integer(fp->minargs, buff, bp);
-              safe_str(" OR ", buff, bp);
-              safe_integer(abs(fp->maxargs), buff, bp);
-            } else if (fp->maxargs == INT_MAX) {
-              safe_str("AT LEAST ", buff, bp);
-              safe_integer(fp->minargs, buff, bp);
-            } else {
-              safe_str("BETWEEN ", buff, bp);
-              safe_integer(fp->minargs, buff, bp);
-              safe_str(" AND ", buff, bp);
-              safe_integer(abs(fp->maxargs), buff, bp);
-            }
-            safe_str(" ARGUMENTS BUT GOT ", buff, bp);
-            safe_integer(nfargs, buff, bp);
-          } else {
-            global_fun_recursions++;
-            pe_info->fun_depth++;
-            if (fp->flags & FN_BUILTIN) {
-              global_fun_invocations++;
-              pe_info->fun_invocations++;
-              fp->where.fun(fp, buff, bp, nfargs, fargs, arglens, executor,
-                            caller, enactor, fp->name, pe_info);
-              if (fp->flags & FN_LOGARGS) {
-                char logstr[BUFFER_LEN];
-                char *logp;
-                int logi;
-                logp = logstr;
-                safe_str(fp->name, logstr, &logp);
-                safe_chr('(', logstr, &logp);
-                for (logi = 0; logi < nfargs; logi++) {
-                  safe_str(fargs[logi], logstr, &logp);
-                  if (logi + 1 < nfargs)
-                    safe_chr(',', logstr, &logp);
-                }
-                safe_chr(')', logstr, &logp);
-                *logp = '\0';
-                do_log(LT_CMD, executor, caller, "%s", logstr);
-              } else if (fp->flags & FN_LOGNAME)
-                do_log(LT_CMD, executor, caller, "%s()", fp->name);
-            } else {
-              dbref thing;
-              ATTR *attrib;
-              global_fun_invocations++;
-              pe_info->fun_invocations++;
-              thing = userfn_tab[fp->where.offset].thing;
-              attrib = atr_get(thing, userfn_tab[fp->where.offset].name);
-              if (!attrib) {
-                do_rawlog(LT_ERR,
-                          T("ERROR: @function (%s) without attribute (#%d/%s)"),
-                          fp->name, thing, userfn_tab[fp->where.offset].name);
-                safe_str("#-1 @FUNCTION (", buff, bp);
-                safe_str(fp->name, buff, bp);
-                safe_str(") MISSING ATTRIBUTE (", buff, bp);
-                safe_dbref(thing, buff, bp);
-                safe_chr('/', buff, bp);
-                safe_str(userfn_tab[fp->where.offset].name, buff, bp);
-                safe_chr(')', buff, bp);
-              } else { 
-                char *preserve[NUMQ];
-                dbref local_ooref;
-                if (fp->flags & FN_LOCALIZE)
-                  save_global_regs("@function.save", preserve);
-                /* Temporarily change ooref */
-                local_ooref = ooref;
-                ooref = attrib->creator;
-                do_userfn(buff, bp, thing, attrib, nfargs, fargs,
-                          executor, caller, enactor, pe_info);
-                ooref = local_ooref;
-                if (fp->flags & FN_LOCALIZE)
-                  restore_global_regs("@function.save", preserve);
-              }
-            }
-            pe_info->fun_depth--;
-            global_fun_recursions--;
-          }
+          pe_call_function(fp, buff, bp, nfargs, fargs, arglens,
+                           executor, caller, enactor, pe_info);
         }
         /* Free up the space allocated for the args */
       free_func_args:
@@ -0,0 +1,1112 @@
+/**
+ * \file pcode.c
+ *
+ * \brief Compiled attribute values.
+ *
+ * The same handful of attributes get u()'d and @function'd over and
+ * over, and every time process_expression() walks the raw text a
+ * character at a time, hunting for brackets and looking up function
+ * names in the hash table. Here we walk an attribute once, turning it
+ * into a tree that mirrors the recursion process_expression() would
+ * do: runs of plain text with their output worked out ahead of time,
+ * %-substitutions, {} [] () groups, and function calls with the FUN
+ * already looked up and each argument compiled in turn.
+ *
+ * Running the tree has to give exactly the same results as the
+ * interpreter, down to the byte, so the runner is deliberately timid.
+ * It keeps the same local state process_expression() would at each
+ * level and checks after every node that it's still where the compiler
+ * expected it to be. Anything unusual - DEBUG, a full buffer, limits
+ * being hit, an @function that changed, a dynamically built function
+ * name, $-substitutions while a regexp is active - and it hands the
+ * rest of that level to the interpreter with pe_resume().
+ *
+ * Compiled attributes are kept in a small LRU cache keyed on the ATTR,
+ * which attrib.c tells us about whenever an attribute's value changes
+ * or it is freed. The cache size is the compiled_attribute_cache
+ * option in mush.cnf; 0 turns the whole thing off.
+ */
+#include "copyrite.h"
+
+#include "config.h"
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+#include "conf.h"
+#include "externs.h"
+#include "dbdefs.h"
+#include "flags.h"
+#include "function.h"
+#include "case.h"
+#include "attrib.h"
+#include "parse.h"
+#include "log.h"
+#include "mymalloc.h"
+#include "pcode.h"
+#include "confmagic.h"
+
+extern char active_table[UCHAR_MAX + 1];
+extern sig_atomic_t cpu_time_limit_hit;
+extern int iter_break;
+extern int global_fun_invocations;
+extern int global_fun_recursions;
+
+/* Node types */
+#define PC_TEXT         0       /**< Text with its output precomputed */
+#define PC_SUBST        1       /**< An evaluated %-substitution */
+#define PC_BRACE        2       /**< A {} group */
+#define PC_BRACKET      3       /**< A [] group */
+#define PC_PAREN        4       /**< A () group that isn't a function call */
+#define PC_NOFUNC       5       /**< A call to a function that doesn't exist */
+#define PC_FUNC         6       /**< A function call */
+#define PC_INTERP       7       /**< Let the interpreter do the rest */
+
+/* Conditions a text node needs before it can be copied out */
+#define PC_GUARD_NONE   0       /**< Always safe */
+#define PC_GUARD_CALLS  1       /**< Only if under the call limit */
+#define PC_GUARD_DOLLAR 2       /**< Only if no regexp $-subs are active */
+
+/** Size of the compiled attribute hash table. Must be a power of 2. */
+#define PCODE_HASH_SIZE 1024
+
+typedef struct pc_seq PC_SEQ;
+typedef struct pc_node PC_NODE;
+
+/** One node of a compiled expression. */
+struct pc_node {
+  int op;               /**< Node type */
+  int guard;            /**< Precondition for text nodes */
+  const char *src;      /**< Where in the source this node starts */
+  const char *next;     /**< Where the next node starts, or NULL if unknown */
+  const char *text;     /**< Output of a text node */
+  int len;              /**< Length of text */
+  int space;            /**< Does the text count as a space? */
+  PC_SEQ *sub;          /**< Contents of a group */
+  FUN *fp;              /**< The function for a function call */
+  int namelen;          /**< Length of the function name's output */
+  unsigned int argmask; /**< FN_ARG_MASK bits of fp at compile time */
+  int maxargs;          /**< maxargs of fp at compile time */
+  int nargs;            /**< Number of compiled arguments */
+  PC_SEQ **args;        /**< Compiled arguments */
+};
+
+/** A compiled level of process_expression() recursion. */
+struct pc_seq {
+  const char *start;    /**< Where this level starts in the source */
+  const char *end;      /**< Where it should stop, or NULL if unknown */
+  int eflags;           /**< Evaluation flags on entry */
+  int tflags;           /**< Termination flags */
+  int count;            /**< Number of nodes */
+  int alloced;          /**< Number of nodes allocated */
+  PC_NODE *nodes;       /**< The nodes */
+};
+
+/** A compiled attribute. */
+struct pcode {
+  ATTR *atr;            /**< The attribute, or NULL once it's been dropped */
+  unsigned long serial; /**< Unique id for this compilation */
+  unsigned long version;        /**< function_table_version when compiled */
+  int eflags;           /**< Evaluation flags it was compiled for */
+  int refcount;         /**< Cache reference plus running evaluations */
+  char *source;         /**< Copy of the attribute text */
+  char *pool;           /**< Storage for text node output */
+  int poolused;         /**< Bytes of pool used */
+  int poolsize;         /**< Bytes of pool allocated */
+  size_t size;          /**< Memory used, roughly */
+  PC_SEQ *top;          /**< The whole expression */
+  PCODE *hnext;         /**< Next in hash bucket */
+  PCODE *prev;          /**< Previous in LRU list (more recently used) */
+  PCODE *next;          /**< Next in LRU list (less recently used) */
+};
+
+static PCODE *pcode_hash[PCODE_HASH_SIZE];
+static PCODE *lru_head = NULL, *lru_tail = NULL;
+static int pcode_count = 0;
+static size_t pcode_memory = 0;
+static unsigned long pcode_next_serial = 1;
+static unsigned long pcode_hits = 0, pcode_misses = 0, pcode_dropped = 0;
+
+static PC_SEQ *pc_compile(PCODE *pc, const char *s, int eflags, int tflags);
+static void pc_free_seq(PC_SEQ *seq);
+static PC_NODE *pc_node(PCODE *pc, PC_SEQ *seq, int op, const char *src);
+static void pc_text(PCODE *pc, PC_SEQ *seq, const char *src,
+                    const char *next, const char *out, int len, int space,
+                    int guard);
+static const char *pc_skip_escape(const char *s);
+static const char *pc_skip_subst(const char *s);
+static int pc_exec(PCODE *pc, PC_SEQ *seq, char *buff, char **bp,
+                   char const **str, dbref executor, dbref caller,
+                   dbref enactor, PE_Info * pe_info);
+static PCODE *pcode_compile(ATTR *atr, int eflags);
+static void pcode_release(PCODE *pc);
+static void pcode_drop(PCODE *pc);
+
+#define pcode_bucket(atr) \
+  ((((size_t) (atr)) / sizeof(ATTR)) & (PCODE_HASH_SIZE - 1))
+
+/* -------------------------------------------------------------------------*
+ * The compiler.
+ */
+
+/* Add a node to the end of a sequence */
+static PC_NODE *
+pc_node(PCODE *pc, PC_SEQ *seq, int op, const char *src)
+{
+  PC_NODE *n;
+
+  if (seq->count >= seq->alloced) {
+    PC_NODE *nodes;
+    int alloced = seq->alloced ? seq->alloced * 2 : 4;
+    nodes = (PC_NODE *) mush_malloc(alloced * sizeof(PC_NODE),
+                                    "pcode.nodes");
+    if (seq->count)
+      memcpy(nodes, seq->nodes, seq->count * sizeof(PC_NODE));
+    if (seq->nodes)
+      mush_free(seq->nodes, "pcode.nodes");
+    pc->size += (alloced - seq->alloced) * sizeof(PC_NODE);
+    seq->nodes = nodes;
+    seq->alloced = alloced;
+  }
+  n = &seq->nodes[seq->count++];
+  memset(n, 0, sizeof(PC_NODE));
+  n->op = op;
+  n->src = src;
+  n->guard = PC_GUARD_NONE;
+  return n;
+}
+
+/* Add some text to a sequence, merging it with the previous text
+ * node when we can.
+ */
+static void
+pc_text(PCODE *pc, PC_SEQ *seq, const char *src, const char *next,
+        const char *out, int len, int space, int guard)
+{
+  PC_NODE *n = NULL;
+  char *p;
+
+  /* Text output never takes more room than its source, but be paranoid */
+  if (pc->poolused + len > pc->poolsize)
+    len = pc->poolsize - pc->poolused;
+  p = pc->pool + pc->poolused;
+  if (len > 0)
+    memcpy(p, out, len);
+  pc->poolused += len;
+
+  if (guard == PC_GUARD_NONE && seq->count) {
+    n = &seq->nodes[seq->count - 1];
+    if (n->op != PC_TEXT || n->guard != PC_GUARD_NONE || n->next != src ||
+        n->text + n->len != p)
+      n = NULL;
+  }
+  if (!n) {
+    n = pc_node(pc, seq, PC_TEXT, src);
+    n->guard = guard;
+    n->text = p;
+  }
+  n->len += len;
+  if (space)
+    n->space = 1;
+  n->next = next;
+}
+
+/* How far an unevaluated %-sequence reaches. This mirrors the escape
+ * handling in process_expression(), which copies everything it skips.
+ */
+static const char *
+pc_skip_escape(const char *s)
+{
+  char c;
+
+  s++;
+  c = *s;
+  if (!c)
+    return s;
+  s++;
+  switch (c) {
+  case '<':
+    if (!*s)
+      return s;
+    while (*s && *s != '>')
+      s++;
+    if (*s)
+      s++;
+    break;
+  case 'Q':
+  case 'q':
+    if (!*s)
+      return s;
+    c = *s++;
+    if (c == '<') {
+      while (*s && *s != '>')
+        s++;
+      if (*s)
+        s++;
+    }
+    break;
+  case 'V':
+  case 'v':
+  case 'W':
+  case 'w':
+  case 'X':
+  case 'x':
+    if (*s)
+      s++;
+    break;
+  }
+  return s;
+}
+
+/* How far an evaluated %-sequence reaches, as pe_substitute() would
+ * consume it. Returns NULL if the substitution ends the expression.
+ */
+static const char *
+pc_skip_subst(const char *s)
+{
+  const char *t;
+  char c;
+
+  s++;
+  c = *s;
+  if (!c)
+    return NULL;
+  s++;
+  switch (c) {
+  case 'I':
+  case 'i':
+  case 'V':
+  case 'v':
+  case 'W':
+  case 'w':
+  case 'X':
+  case 'x':
+  case 'Z':
+  case 'z':
+    if (!*s)
+      return NULL;
+    return s + 1;
+  case 'Q':
+  case 'q':
+    if (!*s)
+      return NULL;
+    if (*s++ != '<')
+      return s;
+    /* FALL THROUGH */
+  case '<':
+    if (!*s)
+      return NULL;
+    for (t = s; *t && *t != '>'; t++) ;
+    if (!*t || t == s)
+      return NULL;
+    return t + 1;
+  }
+  return s;
+}
+
+/* Compile one level of expression starting at s, mirroring what
+ * process_expression() would do with these flags. The sequence's end
+ * is left NULL if we can't tell statically where the level stops, in
+ * which case everything after the last node is left to the interpreter.
+ */
+static PC_SEQ *
+pc_compile(PCODE *pc, const char *s, int eflags, int tflags)
+{
+  PC_SEQ *seq;
+  PC_NODE *n;
+  const char *p;
+  int plain = 1;
+  int temp_eflags, temp_tflags;
+
+  seq = (PC_SEQ *) mush_malloc(sizeof(PC_SEQ), "pcode.seq");
+  pc->size += sizeof(PC_SEQ);
+  seq->start = s;
+  seq->end = NULL;
+  seq->eflags = eflags;
+  seq->tflags = tflags;
+  seq->count = 0;
+  seq->alloced = 0;
+  seq->nodes = NULL;
+
+  if (eflags & PE_COMPRESS_SPACES)
+    while (*s == ' ')
+      s++;
+  if (*s != '{')
+    eflags &= ~PE_COMMAND_BRACES;
+
+  for (;;) {
+    p = s;
+    while (!active_table[*(unsigned char const *) s])
+      s++;
+    if (s > p)
+      pc_text(pc, seq, p, s, p, s - p, 0, PC_GUARD_NONE);
+
+    switch (*s) {
+    case '}':
+      if (tflags & PT_BRACE)
+        goto done;
+      break;
+    case ']':
+      if (tflags & PT_BRACKET)
+        goto done;
+      break;
+    case ')':
+      if (tflags & PT_PAREN)
+        goto done;
+      break;
+    case ',':
+      if (tflags & PT_COMMA)
+        goto done;
+      break;
+    case ';':
+      if (tflags & PT_SEMI)
+        goto done;
+      break;
+    case '=':
+      if (tflags & PT_EQUALS)
+        goto done;
+      break;
+    case ' ':
+      if (tflags & PT_SPACE)
+        goto done;
+      break;
+    case '\0':
+      goto done;
+    }
+
+    switch (*s) {
+    case 0x1B:
+      p = s;
+      while (*s && *s != 'm')
+        s++;
+      if (*s)
+        s++;
+      pc_text(pc, seq, p, s, p, s - p, 0, PC_GUARD_NONE);
+      break;
+    case '$':
+      pc_text(pc, seq, s, s + 1, s, 1, 0,
+              (eflags & (PE_DOLLAR | PE_EVALUATE)) ==
+              (PE_DOLLAR | PE_EVALUATE) ? PC_GUARD_DOLLAR : PC_GUARD_NONE);
+      s++;
+      break;
+    case '%':
+      if (!(eflags & PE_EVALUATE)) {
+        p = s;
+        s = pc_skip_escape(s);
+        pc_text(pc, seq, p, s, p, s - p, 0, PC_GUARD_NONE);
+      } else {
+        p = pc_skip_subst(s);
+        if (!p) {
+          pc_node(pc, seq, PC_INTERP, s);
+          return seq;
+        }
+        n = pc_node(pc, seq, PC_SUBST, s);
+        n->next = s = p;
+        plain = 0;
+      }
+      break;
+    case '{':
+      if (eflags & PE_LITERAL) {
+        pc_text(pc, seq, s, s + 1, s, 1, 0, PC_GUARD_CALLS);
+        s++;
+        break;
+      }
+      n = pc_node(pc, seq, PC_BRACE, s);
+      plain = 0;
+      n->sub = pc_compile(pc, s + 1, eflags & PE_COMMAND_BRACES
+                          ? (eflags & ~PE_COMMAND_BRACES)
+                          : (eflags & ~(PE_STRIP_BRACES | PE_FUNCTION_CHECK)),
+                          PT_BRACE);
+      if (!(s = n->sub->end))
+        return seq;
+      if (*s == '}')
+        s++;
+      n->next = s;
+      eflags &= ~PE_COMMAND_BRACES;
+      break;
+    case '[':
+      if (eflags & PE_LITERAL) {
+        pc_text(pc, seq, s, s + 1, s, 1, 0, PC_GUARD_CALLS);
+        s++;
+        break;
+      }
+      n = pc_node(pc, seq, PC_BRACKET, s);
+      plain = 0;
+      if (!(eflags & PE_EVALUATE))
+        temp_eflags = eflags & ~PE_STRIP_BRACES;
+      else
+        temp_eflags = eflags | PE_FUNCTION_CHECK | PE_FUNCTION_MANDATORY;
+      n->sub = pc_compile(pc, s + 1, temp_eflags, PT_BRACKET);
+      if (!(s = n->sub->end))
+        return seq;
+      if (*s == ']')
+        s++;
+      n->next = s;
+      break;
+    case '(':
+      if (!(eflags & PE_EVALUATE) || !(eflags & PE_FUNCTION_CHECK)) {
+        n = pc_node(pc, seq, PC_PAREN, s);
+        plain = 0;
+        p = s + 1;
+        if (*p == ' ')
+          p++;
+        n->sub = pc_compile(pc, p, eflags & ~PE_STRIP_BRACES, PT_PAREN);
+        if (!(s = n->sub->end))
+          return seq;
+        if (*s == ')')
+          s++;
+        n->next = s;
+        break;
+      } else {
+        char name[BUFFER_LEN];
+        char *np = name;
+        FUN *fp;
+        int namelen = 0;
+
+        /* We can only look the function up now if its name is
+         * nothing but text we already know.
+         */
+        if (!plain) {
+          pc_node(pc, seq, PC_INTERP, s);
+          return seq;
+        }
+        if (seq->count) {
+          const char *t;
+          t = seq->nodes[0].text;
+          namelen = pc->pool + pc->poolused - t;
+          for (; t < pc->pool + pc->poolused; t++)
+            safe_chr(UPCASE(*t), name, &np);
+        }
+        *np = '\0';
+        fp = func_hash_lookup(name);
+        eflags &= ~PE_FUNCTION_CHECK;
+        plain = 0;
+        if (!fp) {
+          if (eflags & PE_FUNCTION_MANDATORY) {
+            pc_node(pc, seq, PC_INTERP, s);
+            return seq;
+          }
+          n = pc_node(pc, seq, PC_NOFUNC, s);
+          n->namelen = namelen;
+          p = s + 1;
+          if (*p == ' ')
+            p++;
+          n->sub = pc_compile(pc, p, eflags, PT_PAREN);
+          if (!(s = n->sub->end))
+            return seq;
+          if (*s == ')')
+            s++;
+          n->next = s;
+          break;
+        }
+        n = pc_node(pc, seq, PC_FUNC, s);
+        n->fp = fp;
+        n->namelen = namelen;
+        n->argmask = fp->flags & FN_ARG_MASK;
+        n->maxargs = fp->maxargs;
+        temp_eflags = (eflags & ~PE_FUNCTION_MANDATORY)
+          | PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK;
+        switch (n->argmask) {
+        case FN_LITERAL:
+          temp_eflags |= PE_LITERAL;
+          /* FALL THROUGH */
+        case FN_NOPARSE:
+          temp_eflags &= ~(PE_COMPRESS_SPACES | PE_EVALUATE |
+                           PE_FUNCTION_CHECK);
+          break;
+        }
+        temp_tflags = PT_COMMA | PT_PAREN;
+        s++;
+        do {
+          PC_SEQ *arg;
+          if ((fp->maxargs < 0) && ((n->nargs + 1) >= -fp->maxargs))
+            temp_tflags = PT_PAREN;
+          if (!(n->nargs % 4)) {
+            PC_SEQ **args;
+            args = (PC_SEQ **) mush_malloc((n->nargs + 4) * sizeof(PC_SEQ *),
+                                           "pcode.args");
+            if (n->nargs) {
+              memcpy(args, n->args, n->nargs * sizeof(PC_SEQ *));
+              mush_free(n->args, "pcode.args");
+            }
+            pc->size += 4 * sizeof(PC_SEQ *);
+            n->args = args;
+          }
+          arg = pc_compile(pc, s, temp_eflags, temp_tflags);
+          n->args[n->nargs++] = arg;
+          if (!(s = arg->end))
+            return seq;
+          s++;
+        } while (s[-1] == ',');
+        if (s[-1] != ')')
+          s--;
+        n->next = s;
+      }
+      break;
+    case ' ':
+      p = s;
+      s++;
+      while (*s == ' ')
+        s++;
+      pc_text(pc, seq, p, s, p,
+              (eflags & PE_COMPRESS_SPACES) ? 1 : s - p, 1, PC_GUARD_NONE);
+      break;
+    case '\\':
+      p = s;
+      s++;
+      if (!*s) {
+        pc_text(pc, seq, p, s, p, (eflags & PE_EVALUATE) ? 0 : 1, 0,
+                PC_GUARD_NONE);
+        break;
+      }
+      s++;
+      if (eflags & PE_EVALUATE)
+        pc_text(pc, seq, p, s, p + 1, 1, 0, PC_GUARD_NONE);
+      else
+        pc_text(pc, seq, p, s, p, 2, 0, PC_GUARD_NONE);
+      break;
+    default:
+      pc_text(pc, seq, s, s + 1, s, 1, 0, PC_GUARD_NONE);
+      s++;
+      break;
+    }
+  }
+
+done:
+  seq->end = s;
+  return seq;
+}
+
+/* Free a compiled sequence and everything under it */
+static void
+pc_free_seq(PC_SEQ *seq)
+{
+  int i, j;
+  PC_NODE *n;
+
+  for (i = 0, n = seq->nodes; i < seq->count; i++, n++) {
+    if (n->sub)
+      pc_free_seq(n->sub);
+    if (n->args) {
+      for (j = 0; j < n->nargs; j++)
+        pc_free_seq(n->args[j]);
+      mush_free(n->args, "pcode.args");
+    }
+  }
+  if (seq->nodes)
+    mush_free(seq->nodes, "pcode.nodes");
+  mush_free(seq, "pcode.seq");
+}
+
+/* -------------------------------------------------------------------------*
+ * The runner.
+ */
+
+/* Run one compiled level. This is process_expression() with the
+ * parsing already done; every path either does exactly what the
+ * interpreter would or hands over to it via pe_resume().
+ */
+static int
+pc_exec(PCODE *pc, PC_SEQ *seq, char *buff, char **bp, char const **str,
+        dbref executor, dbref caller, dbref enactor, PE_Info * pe_info)
+{
+  int eflags = seq->eflags;
+  int tflags = seq->tflags;
+  char const *s = *str;
+  PE_State st;
+  PC_NODE *n;
+  int i, len;
+
+  /* Anything out of the ordinary on the way in, and the interpreter
+   * gets the whole level.
+   */
+  if (!pe_info || cpu_time_limit_hit || iter_break > 0 || Halted(executor)
+      || (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT))
+      || ((eflags != PE_NOTHING) &&
+          (Debug(executor) || (eflags & PE_DEBUG) ||
+           ((*bp - buff) > (BUFFER_LEN - SBUF_LEN)))))
+    return process_expression(buff, bp, str, executor, caller, enactor,
+                              eflags, tflags, pe_info);
+
+  if (eflags & PE_COMPRESS_SPACES)
+    while (*s == ' ')
+      s++;
+  if ((eflags & PE_EVALUATE) &&
+      ((last_activity_type() != LA_PE) || !strstr(last_activity(), s))) {
+    log_activity(LA_PE, executor, s);
+  }
+  if (CALL_LIMIT)
+    pe_info->call_depth++;
+  if (*s != '{')
+    eflags &= ~PE_COMMAND_BRACES;
+
+  st.startpos = *bp;
+  st.had_space = 0;
+  st.gender = -1;
+  st.retval = 0;
+
+  for (i = 0, n = seq->nodes; i < seq->count; i++, n++) {
+    if (s != n->src || iter_break > 0)
+      goto interpret;
+    switch (n->op) {
+    case PC_TEXT:
+      if (n->guard == PC_GUARD_CALLS) {
+        if (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT))
+          goto interpret;
+      } else if (n->guard == PC_GUARD_DOLLAR) {
+        if (global_eval_context.re_subpatterns >= 0 &&
+            global_eval_context.re_offsets != NULL &&
+            global_eval_context.re_from != NULL)
+          goto interpret;
+      }
+      len = BUFFER_LEN - 1 - (*bp - buff);
+      if (len > n->len)
+        len = n->len;
+      if (len > 0) {
+        memcpy(*bp, n->text, len);
+        *bp += len;
+      }
+      if (n->space)
+        st.had_space = 1;
+      s = n->next;
+      break;
+    case PC_SUBST:
+      if (*bp - buff >= BUFFER_LEN - 1)
+        goto interpret;
+      if (pe_substitute(buff, bp, &s, executor, caller, enactor,
+                        pe_info, &st.gender))
+        goto exit_sequence;
+      break;
+    case PC_BRACE:
+      if (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT))
+        goto interpret;
+      if (!(eflags & (PE_STRIP_BRACES | PE_COMMAND_BRACES)))
+        safe_chr('{', buff, bp);
+      s++;
+      if (pc_exec(pc, n->sub, buff, bp, &s, executor, caller, enactor,
+                  pe_info)) {
+        st.retval = 1;
+        break;
+      }
+      if (*s == '}') {
+        if (!(eflags & (PE_STRIP_BRACES | PE_COMMAND_BRACES)))
+          safe_chr('}', buff, bp);
+        s++;
+      }
+      eflags &= ~PE_COMMAND_BRACES;
+      break;
+    case PC_BRACKET:
+      if (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT))
+        goto interpret;
+      if (!(eflags & PE_EVALUATE))
+        safe_chr('[', buff, bp);
+      s++;
+      if (pc_exec(pc, n->sub, buff, bp, &s, executor, caller, enactor,
+                  pe_info)) {
+        st.retval = 1;
+        break;
+      }
+      if (*s == ']') {
+        if (!(eflags & PE_EVALUATE))
+          safe_chr(']', buff, bp);
+        s++;
+      }
+      break;
+    case PC_PAREN:
+    case PC_NOFUNC:
+      if (CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT))
+        goto interpret;
+      if (n->op == PC_NOFUNC) {
+        if ((pc->version != function_table_version) ||
+            (*bp - st.startpos != n->namelen))
+          goto interpret;
+        eflags &= ~PE_FUNCTION_CHECK;
+      }
+      s++;
+      safe_chr('(', buff, bp);
+      if (*s == ' ') {
+        safe_chr(*s, buff, bp);
+        s++;
+      }
+      if (pc_exec(pc, n->sub, buff, bp, &s, executor, caller, enactor,
+                  pe_info)) {
+        st.retval = 1;
+        if (n->op == PC_NOFUNC)
+          break;
+      }
+      if (*s == ')') {
+        if (eflags & PE_COMPRESS_SPACES && s[-1] == ' ')
+          safe_chr(' ', buff, bp);
+        safe_chr(')', buff, bp);
+        s++;
+      }
+      break;
+    case PC_FUNC:
+      {
+        char *sargs[10];
+        char **fargs;
+        int sarglens[10];
+        int *arglens;
+        int args_alloced;
+        int nfargs;
+        int j;
+        FUN *fp = n->fp;
+        int temp_eflags, temp_tflags;
+        int denied;
+
+        /* Limits, and anything that's changed since we compiled, are
+         * the interpreter's problem.
+         */
+        if ((CALL_LIMIT && (pe_info->call_depth > CALL_LIMIT)) ||
+            (pc->version != function_table_version) ||
+            (*bp - st.startpos != n->namelen) ||
+            ((fp->flags & FN_ARG_MASK) != n->argmask) ||
+            (fp->maxargs != n->maxargs) ||
+            (pe_info->fun_invocations >= FUNCTION_LIMIT) ||
+            (global_fun_invocations >= FUNCTION_LIMIT * 5) ||
+            (pe_info->fun_depth + 1 >= RECURSION_LIMIT) ||
+            (global_fun_recursions + 1 >= RECURSION_LIMIT * 5))
+          goto interpret;
+
+        s++;
+        fargs = sargs;
+        arglens = sarglens;
+        for (j = 0; j < 10; j++) {
+          fargs[j] = NULL;
+          arglens[j] = 0;
+        }
+        args_alloced = 10;
+        eflags &= ~PE_FUNCTION_CHECK;
+        *bp = st.startpos;
+
+        temp_eflags = (eflags & ~PE_FUNCTION_MANDATORY)
+          | PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK;
+        switch (fp->flags & FN_ARG_MASK) {
+        case FN_LITERAL:
+          temp_eflags |= PE_LITERAL;
+          /* FALL THROUGH */
+        case FN_NOPARSE:
+          temp_eflags &= ~(PE_COMPRESS_SPACES | PE_EVALUATE |
+                           PE_FUNCTION_CHECK);
+          break;
+        }
+        denied = !check_func(executor, fp);
+        if (denied)
+          temp_eflags &=
+            ~(PE_COMPRESS_SPACES | PE_EVALUATE | PE_FUNCTION_CHECK);
+        temp_tflags = PT_COMMA | PT_PAREN;
+        nfargs = 0;
+        do {
+          char *argp;
+          int r;
+          if ((fp->maxargs < 0) && ((nfargs + 1) >= -fp->maxargs))
+            temp_tflags = PT_PAREN;
+          if (nfargs >= args_alloced) {
+            char **nargs;
+            int *narglens;
+            nargs = (char **) mush_malloc((nfargs + 10) * sizeof(char *),
+                                          "process_expression.function_arglist");
+            narglens = (int *) mush_malloc((nfargs + 10) * sizeof(int),
+                                           "process_expression.function_arglens");
+            for (j = 0; j < nfargs; j++) {
+              nargs[j] = fargs[j];
+              narglens[j] = arglens[j];
+            }
+            if (fargs != sargs)
+              mush_free((Malloc_t) fargs,
+                        "process_expression.function_arglist");
+            if (arglens != sarglens)
+              mush_free((Malloc_t) arglens,
+                        "process_expression.function_arglens");
+            fargs = nargs;
+            arglens = narglens;
+            args_alloced += 10;
+          }
+          fargs[nfargs] = (char *) mush_malloc(BUFFER_LEN,
+                                               "process_expression.function_argument");
+          argp = fargs[nfargs];
+          if (!denied && (nfargs < n->nargs) && (s == n->args[nfargs]->start))
+            r = pc_exec(pc, n->args[nfargs], fargs[nfargs], &argp, &s,
+                        executor, caller, enactor, pe_info);
+          else
+            r = process_expression(fargs[nfargs], &argp, &s,
+                                   executor, caller, enactor,
+                                   temp_eflags, temp_tflags, pe_info);
+          if (r) {
+            st.retval = 1;
+            nfargs++;
+            goto free_func_args;
+          }
+          *argp = '\0';
+          arglens[nfargs] = argp - fargs[nfargs];
+          s++;
+          nfargs++;
+        } while (s[-1] == ',');
+        if (s[-1] != ')')
+          s--;
+        if (denied) {
+          if (fp->flags & FN_DISABLED)
+            safe_str(T(e_disabled), buff, bp);
+          else
+            safe_str(T(e_perm), buff, bp);
+        } else {
+          pe_call_function(fp, buff, bp, nfargs, fargs, arglens,
+                           executor, caller, enactor, pe_info);
+        }
+      free_func_args:
+        for (j = 0; j < nfargs; j++)
+          if (fargs[j])
+            mush_free((Malloc_t) fargs[j],
+                      "process_expression.function_argument");
+        if (fargs != sargs)
+          mush_free((Malloc_t) fargs, "process_expression.function_arglist");
+        if (arglens != sarglens)
+          mush_free((Malloc_t) arglens, "process_expression.function_arglens");
+      }
+      break;
+    default:
+      goto interpret;
+    }
+  }
+  if (s != seq->end || iter_break > 0)
+    goto interpret;
+
+exit_sequence:
+  if (eflags != PE_NOTHING) {
+    if ((eflags & PE_COMPRESS_SPACES) && st.had_space &&
+        (s[-1] == ' ') && ((*bp)[-1] == ' '))
+      (*bp)--;
+  }
+  if (CALL_LIMIT && pe_info->call_depth <= CALL_LIMIT)
+    pe_info->call_depth--;
+  *str = s;
+  return st.retval;
+
+interpret:
+  *str = s;
+  return pe_resume(buff, bp, str, executor, caller, enactor, eflags, tflags,
+                   pe_info, &st);
+}
+
+/* -------------------------------------------------------------------------*
+ * The cache.
+ */
+
+/* Compile an attribute's value */
+static PCODE *
+pcode_compile(ATTR *atr, int eflags)
+{
+  PCODE *pc;
+  char const *text;
+  int len;
+
+  text = atr_value(atr);
+  len = strlen(text);
+  pc = (PCODE *) mush_malloc(sizeof(PCODE), "pcode");
+  if (!pc)
+    return NULL;
+  pc->atr = atr;
+  pc->serial = pcode_next_serial++;
+  pc->version = function_table_version;
+  pc->eflags = eflags;
+  pc->refcount = 1;
+  pc->source = mush_strdup(text, "pcode.source");
+  pc->pool = (char *) mush_malloc(len + 1, "pcode.pool");
+  pc->poolused = 0;
+  pc->poolsize = len;
+  pc->size = sizeof(PCODE) + 2 * (len + 1);
+  pc->hnext = pc->prev = pc->next = NULL;
+  pc->top = pc_compile(pc, pc->source, eflags, PT_DEFAULT);
+  return pc;
+}
+
+/* Drop a reference to a compiled attribute, freeing it if that was
+ * the last one.
+ */
+static void
+pcode_release(PCODE *pc)
+{
+  if (--pc->refcount > 0)
+    return;
+  pc_free_seq(pc->top);
+  mush_free(pc->source, "pcode.source");
+  mush_free(pc->pool, "pcode.pool");
+  mush_free(pc, "pcode");
+}
+
+/* Remove a compiled attribute from the cache. Anything still running
+ * it keeps it alive until it's done.
+ */
+static void
+pcode_drop(PCODE *pc)
+{
+  PCODE **pp;
+
+  for (pp = &pcode_hash[pcode_bucket(pc->atr)]; *pp; pp = &(*pp)->hnext)
+    if (*pp == pc) {
+      *pp = pc->hnext;
+      break;
+    }
+  if (pc->prev)
+    pc->prev->next = pc->next;
+  else
+    lru_head = pc->next;
+  if (pc->next)
+    pc->next->prev = pc->prev;
+  else
+    lru_tail = pc->prev;
+  pc->atr = NULL;
+  pcode_count--;
+  pcode_memory -= pc->size;
+  pcode_release(pc);
+}
+
+/** Get the compiled form of an attribute.
+ * Compiles the attribute if it isn't in the cache yet. The result
+ * belongs to the cache and is only good until the attribute is
+ * changed, so it should be run immediately.
+ * \param atr the attribute.
+ * \param eflags evaluation flags it's going to be run with.
+ * \return the compiled attribute, or NULL if it can't be compiled.
+ */
+PCODE *
+pcode_get(ATTR *atr, int eflags)
+{
+  PCODE *pc;
+  size_t b;
+
+  if (!atr || COMPILED_ATTR_CACHE <= 0 || (eflags & PE_DEBUG) ||
+      (AL_FLAGS(atr) & AF_ANON))
+    return NULL;
+  b = pcode_bucket(atr);
+  for (pc = pcode_hash[b]; pc; pc = pc->hnext)
+    if (pc->atr == atr)
+      break;
+  if (pc) {
+    if (pc->eflags == eflags && pc->version == function_table_version) {
+      pcode_hits++;
+      if (pc != lru_head) {
+        pc->prev->next = pc->next;
+        if (pc->next)
+          pc->next->prev = pc->prev;
+        else
+          lru_tail = pc->prev;
+        pc->prev = NULL;
+        pc->next = lru_head;
+        lru_head->prev = pc;
+        lru_head = pc;
+      }
+      return pc;
+    }
+    pcode_drop(pc);
+    pcode_dropped++;
+  }
+  pcode_misses++;
+  pc = pcode_compile(atr, eflags);
+  if (!pc)
+    return NULL;
+  pc->hnext = pcode_hash[b];
+  pcode_hash[b] = pc;
+  pc->next = lru_head;
+  if (lru_head)
+    lru_head->prev = pc;
+  lru_head = pc;
+  if (!lru_tail)
+    lru_tail = pc;
+  pcode_count++;
+  pcode_memory += pc->size;
+  while (pcode_count > COMPILED_ATTR_CACHE && lru_tail != pc)
+    pcode_drop(lru_tail);
+  return pc;
+}
+
+/** Find a particular compilation of an attribute.
+ * This is for callers that looked up the attribute earlier and want
+ * to be sure it hasn't changed since.
+ * \param atr the attribute.
+ * \param serial serial number from pcode_serial().
+ * \return the compiled attribute, or NULL if it's gone.
+ */
+PCODE *
+pcode_lookup(ATTR *atr, unsigned long serial)
+{
+  PCODE *pc;
+
+  if (!atr || !serial)
+    return NULL;
+  for (pc = pcode_hash[pcode_bucket(atr)]; pc; pc = pc->hnext)
+    if (pc->atr == atr)
+      return (pc->serial == serial) ? pc : NULL;
+  return NULL;
+}
+
+/** The serial number of a compiled attribute.
+ * \param pc the compiled attribute.
+ * \return its serial number, which is never 0.
+ */
+unsigned long
+pcode_serial(PCODE *pc)
+{
+  return pc->serial;
+}
+
+/** Evaluate a compiled attribute.
+ * This is the same as calling process_expression() on the attribute's
+ * text with PT_DEFAULT and the eflags it was compiled for.
+ * \param pc the compiled attribute.
+ * \param buff buffer to store returns of parsing.
+ * \param bp pointer to pointer into buff marking insert position.
+ * \param executor dbref of the object invoking the function.
+ * \param caller dbref of  the last object to use u()
+ * \param enactor dbref of the enactor.
+ * \param pe_info pointer to parser context data.
+ * \retval 0 success.
+ * \retval 1 CPU time limit exceeded.
+ */
+int
+pcode_run(PCODE *pc, char *buff, char **bp, dbref executor, dbref caller,
+          dbref enactor, PE_Info * pe_info)
+{
+  char const *s;
+  int retval;
+
+  pc->refcount++;
+  s = pc->source;
+  retval = pc_exec(pc, pc->top, buff, bp, &s, executor, caller, enactor,
+                   pe_info);
+  pcode_release(pc);
+  return retval;
+}
+
+/** Forget any compiled form of an attribute.
+ * attrib.c calls this whenever an attribute's value is changed or
+ * the attribute is freed.
+ * \param atr the attribute.
+ */
+void
+pcode_forget(ATTR *atr)
+{
+  PCODE *pc;
+
+  if (!pcode_count)
+    return;
+  for (pc = pcode_hash[pcode_bucket(atr)]; pc; pc = pc->hnext)
+    if (pc->atr == atr) {
+      pcode_drop(pc);
+      pcode_dropped++;
+      return;
+    }
+}
+
+/** Report on the compiled attribute cache.
+ * \param player player to notify.
+ */
+void
+pcode_stats(dbref player)
+{
+  notify(player, "Compiled Attributes:");
+  notify_format(player,
+                "%d of %d cached, using %lu bytes. %lu hits, %lu compiles, "
+                "%lu dropped.", pcode_count, COMPILED_ATTR_CACHE,
+                (unsigned long) pcode_memory, pcode_hits, pcode_misses,
+                pcode_dropped);
+}
@@ -224,6 +224,7 @@ dbref create_guest(const char *host, const char *ip) {
                 object_flag_type flags;
                 flags = string_to_bits("FLAG", options.player_flags);
                 copy_flag_bitmask("FLAG", Flags(gst_id), flags);
+                flag_columns_update(gst_id);
         }
         mush_free((Malloc_t) guest_name, "gst_buf");
         atr_add(gst_id, "DESCRIBE", GUEST_DESCRIBE, gst_id, NOTHING);
@@ -428,10 +429,12 @@ make_player(const char *name, const char *password, const char *host,
   Home(player) = PLAYER_START;
   Owner(player) = player;
   Parent(player) = NOTHING;
+  obj_index_update(player);
   Type(player) = TYPE_PLAYER;
   flags = string_to_bits("FLAG", options.player_flags);
   copy_flag_bitmask("FLAG", Flags(player), flags);
   destroy_flag_bitmask(flags);
+  flag_columns_update(player);
   if (Suspect_Site(host, player) || Suspect_Site(ip, player))
     set_flag_internal(player, "SUSPECT");
   set_initial_warnings(player);
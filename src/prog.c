@@ -575,6 +575,7 @@ pw_div_connect(DESC * d, char *input __attribute__ ((__unused__)))
   did_it(d->player, Division(d->player), "SDOUT", NULL, NULL, NULL,
          "ASDOUT", Location(d->player));
   Division(d->player) = d->pinfo.object;
+  obj_index_update(d->player);
   /* Now Trigger Sdin */
   did_it(d->player, Division(d->player), "SDIN",
          tprintf("You have switched into Division: %s",
@@ -3,29 +3,233 @@
  *
  * \brief Prefix tables for PennMUSH.
  *
+ * A prefix table is a compressed radix trie. Each node holds the
+ * (lower-cased) string on the edge leading to it, and the children of
+ * a node are kept sorted by the first character of their edges. A node
+ * that ends a key holds the key as it was inserted and its data.
+ *
+ * Interior nodes that don't end a key always have at least two
+ * children, so a prefix names a unique entry exactly when it runs out
+ * on the edge to, or at, a node with no children. Lookups, unique
+ * prefix matches and the start of a walk over all keys with a given
+ * prefix all take time proportional to the length of the key, no
+ * matter how many entries the table holds.
  *
  */
 #include "config.h"
 #include "copyrite.h"
 #include <string.h>
-#include <stdlib.h>
-#include <math.h>
 #include "conf.h"
 #include "externs.h"
+#include "case.h"
 #include "ptab.h"
 #include "confmagic.h"
 
-static int ptab_find_exact_nun(PTAB *tab, const char *key);
-static int WIN32_CDECL ptab_cmp(const void *, const void *);
-
-/** A ptab entry. */
-typedef struct ptab_entry {
+/** A ptab trie node. */
+typedef struct ptab_node {
+  struct ptab_node *parent;     /**< parent node, NULL for the root */
+  struct ptab_node **kids;      /**< children, sorted by edge[0] */
+  int nkids;                    /**< number of children */
+  int maxkids;                  /**< allocated size of kids */
+  int elen;                     /**< length of edge */
+  char *edge;                   /**< lower-cased edge label */
+  char *key;                    /**< the index key, if an entry ends here */
   void *data;                   /**< pointer to data */
-  char key[BUFFER_LEN];         /**< the index key */
-} ptab_entry;
+} ptab_node;
+
+static ptab_node *new_node(const char *edge, int elen);
+static void free_node(ptab_node *n);
+static void free_tree(ptab_node *n);
+static int kid_index(ptab_node *n, unsigned char c, int *pos);
+static void add_kid(ptab_node *n, ptab_node *kid, int pos);
+static void remove_kid(ptab_node *n, int i);
+static void merge_node(PTAB *tab, ptab_node *n);
+static ptab_node *ptab_walk(PTAB *tab, const char *key, int *exact);
+static ptab_node *next_entry(ptab_node *n, ptab_node *stop);
+static void tree_stats(ptab_node *n, int depth, int *nodes, int *depths,
+                       int *mem);
+
+static ptab_node *
+new_node(const char *edge, int elen)
+{
+  ptab_node *n;
+  int i;
+
+  n = mush_malloc(sizeof(ptab_node), "ptab.node");
+  n->edge = mush_malloc(elen + 1, "ptab.edge");
+  for (i = 0; i < elen; i++)
+    n->edge[i] = DOWNCASE(edge[i]);
+  n->edge[elen] = '\0';
+  n->elen = elen;
+  n->parent = NULL;
+  n->kids = NULL;
+  n->nkids = n->maxkids = 0;
+  n->key = NULL;
+  n->data = NULL;
+  return n;
+}
 
-/** The memory usage of a ptab entry, not including data. */
-#define PTAB_SIZE (sizeof(struct ptab_entry) - BUFFER_LEN)
+static void
+free_node(ptab_node *n)
+{
+  if (n->kids)
+    mush_free(n->kids, "ptab.kids");
+  if (n->key)
+    mush_free(n->key, "ptab.entry");
+  mush_free(n->edge, "ptab.edge");
+  mush_free(n, "ptab.node");
+}
+
+static void
+free_tree(ptab_node *n)
+{
+  int i;
+
+  for (i = 0; i < n->nkids; i++)
+    free_tree(n->kids[i]);
+  free_node(n);
+}
+
+/* Find the child of n whose edge starts with c. Returns its index, or
+ * -1 and the index it would be inserted at in *pos.
+ */
+static int
+kid_index(ptab_node *n, unsigned char c, int *pos)
+{
+  int left = 0, right = n->nkids - 1, mid;
+  unsigned char k;
+
+  while (left <= right) {
+    mid = (left + right) / 2;
+    k = (unsigned char) n->kids[mid]->edge[0];
+    if (k == c)
+      return mid;
+    else if (k < c)
+      left = mid + 1;
+    else
+      right = mid - 1;
+  }
+  if (pos)
+    *pos = left;
+  return -1;
+}
+
+static void
+add_kid(ptab_node *n, ptab_node *kid, int pos)
+{
+  if (n->nkids == n->maxkids) {
+    ptab_node **tmp;
+    n->maxkids = n->maxkids ? n->maxkids * 2 : 2;
+    tmp = mush_malloc(n->maxkids * sizeof(ptab_node *), "ptab.kids");
+    if (n->kids) {
+      memcpy(tmp, n->kids, n->nkids * sizeof(ptab_node *));
+      mush_free(n->kids, "ptab.kids");
+    }
+    n->kids = tmp;
+  }
+  if (pos < n->nkids)
+    memmove(n->kids + pos + 1, n->kids + pos,
+            (n->nkids - pos) * sizeof(ptab_node *));
+  n->kids[pos] = kid;
+  n->nkids++;
+  kid->parent = n;
+}
+
+static void
+remove_kid(ptab_node *n, int i)
+{
+  n->nkids--;
+  if (i < n->nkids)
+    memmove(n->kids + i, n->kids + i + 1,
+            (n->nkids - i) * sizeof(ptab_node *));
+}
+
+/* Fold a keyless interior node with a single child into that child. */
+static void
+merge_node(PTAB *tab, ptab_node *n)
+{
+  ptab_node *kid, *parent;
+  char *edge;
+
+  kid = n->kids[0];
+  parent = n->parent;
+  edge = mush_malloc(n->elen + kid->elen + 1, "ptab.edge");
+  memcpy(edge, n->edge, n->elen);
+  memcpy(edge + n->elen, kid->edge, kid->elen + 1);
+  mush_free(kid->edge, "ptab.edge");
+  kid->edge = edge;
+  kid->elen += n->elen;
+  kid->parent = parent;
+  parent->kids[kid_index(parent, (unsigned char) edge[0], NULL)] = kid;
+  /* The child now heads the same subtree */
+  if (tab->stop == n)
+    tab->stop = kid;
+  n->nkids = 0;
+  free_node(n);
+}
+
+/* Follow key down the trie. Returns the node on (or at the end of)
+ * whose edge the key runs out, or NULL if the key isn't a prefix of
+ * anything in the table. *exact is set if the key ends at the end of
+ * the returned node's edge.
+ */
+static ptab_node *
+ptab_walk(PTAB *tab, const char *key, int *exact)
+{
+  ptab_node *n, *kid;
+  int i, j;
+
+  n = tab->root;
+  if (!n)
+    return NULL;
+  while (*key) {
+    i = kid_index(n, DOWNCASE(*key), NULL);
+    if (i < 0)
+      return NULL;
+    kid = n->kids[i];
+    for (j = 1; j < kid->elen; j++) {
+      if (!key[j]) {
+        *exact = 0;
+        return kid;
+      }
+      if (DOWNCASE(key[j]) != (unsigned char) kid->edge[j])
+        return NULL;
+    }
+    key += kid->elen;
+    n = kid;
+  }
+  *exact = 1;
+  return n;
+}
+
+/* Return the next node holding an entry after n, in key order, without
+ * leaving the subtree rooted at stop.
+ */
+static ptab_node *
+next_entry(ptab_node *n, ptab_node *stop)
+{
+  ptab_node *p;
+  int i;
+
+  do {
+    if (n->nkids) {
+      n = n->kids[0];
+      continue;
+    }
+    for (;;) {
+      if (n == stop || !n->parent)
+        return NULL;
+      p = n->parent;
+      i = kid_index(p, (unsigned char) n->edge[0], NULL);
+      if (i + 1 < p->nkids) {
+        n = p->kids[i + 1];
+        break;
+      }
+      n = p;
+    }
+  } while (!n->key);
+  return n;
+}
 
 /** Initialize a ptab.
  * \param tab pointer to a ptab.
@@ -35,8 +239,8 @@ ptab_init(PTAB *tab)
 {
   if (!tab)
     return;
-  tab->state = tab->maxlen = tab->len = tab->current = 0;
-  tab->tab = NULL;
+  tab->state = tab->len = 0;
+  tab->root = tab->current = tab->stop = NULL;
 }
 
 /** Free all entries in a ptab.
@@ -47,19 +251,15 @@ ptab_free(PTAB *tab)
 {
   if (!tab)
     return;
-  if (tab->tab) {
-    int n;
-    for (n = 0; n < tab->len; n++)
-      mush_free(tab->tab[n], "ptab.entry");
-    mush_free(tab->tab, "ptab");
-  }
-  tab->tab = NULL;
-  tab->state = tab->maxlen = tab->len = tab->current = 0;
+  if (tab->root)
+    free_tree(tab->root);
+  tab->root = tab->current = tab->stop = NULL;
+  tab->state = tab->len = 0;
 }
 
 /** Search a ptab for an entry that prefix-matches a given key.
- * We search through unique prefixes of keys in the table to try
- * to match the key we're looking for.
+ * An exact match wins; otherwise the key has to be a prefix of
+ * exactly one key in the table.
  * \param tab pointer to a ptab.
  * \param key key to search for.
  * \return void pointer to ptab data indexed by key, or NULL if none.
@@ -67,71 +267,20 @@ ptab_free(PTAB *tab)
 void *
 ptab_find(PTAB *tab, const char *key)
 {
-  int nun;
+  ptab_node *n;
+  int exact;
 
   if (!tab || !key || !*key || tab->state)
     return NULL;
 
-  if (tab->len < 10) {          /* Just do a linear search for small tables */
-    for (nun = 0; nun < tab->len; nun++) {
-      if (string_prefix(tab->tab[nun]->key, key)) {
-        if (nun + 1 < tab->len && string_prefix(tab->tab[nun + 1]->key, key))
-          return NULL;
-        else
-          return tab->tab[nun]->data;
-      }
-    }
-  } else {                      /* Binary search of the index */
-    int left = 0;
-    int cmp;
-    int right = tab->len - 1;
-
-    while (1) {
-      nun = (left + right) / 2;
-
-      if (left > right)
-        break;
-
-      cmp = strcasecmp(key, tab->tab[nun]->key);
-
-      if (cmp == 0) {
-        return tab->tab[nun]->data;
-      } else if (cmp < 0) {
-        int mem;
-        /* We need to catch the first unique prefix */
-        if (string_prefix(tab->tab[nun]->key, key)) {
-          for (mem = nun - 1; mem >= 0; mem--) {
-            if (string_prefix(tab->tab[mem]->key, key)) {
-              if (strcasecmp(tab->tab[mem]->key, key) == 0)
-                return tab->tab[mem]->data;
-            } else
-              break;
-          }
-          /* Non-unique prefix */
-          if (mem != nun - 1)
-            return NULL;
-          for (mem = nun + 1; mem < tab->len; mem++) {
-            if (string_prefix(tab->tab[mem]->key, key)) {
-              if (strcasecmp(tab->tab[mem]->key, key) == 0)
-                return tab->tab[mem]->data;
-            } else
-              break;
-          }
-          if (mem != nun + 1)
-            return NULL;
-          return tab->tab[nun]->data;
-        }
-        if (left == right)
-          break;
-        right = nun - 1;
-      } else {                  /* cmp > 0 */
-        if (left == right)
-          break;
-        left = nun + 1;
-      }
-    }
-  }
-  return NULL;
+  n = ptab_walk(tab, key, &exact);
+  if (!n)
+    return NULL;
+  if (exact && n->key)
+    return n->data;
+  if (!n->nkids)
+    return n->data;
+  return NULL;                  /* Non-unique prefix */
 }
 
 /** Search a ptab for an entry that exactly matches a given key.
@@ -144,85 +293,56 @@ ptab_find(PTAB *tab, const char *key)
 void *
 ptab_find_exact(PTAB *tab, const char *key)
 {
-  int nun;
-  nun = ptab_find_exact_nun(tab, key);
-  if (nun < 0)
-    return NULL;
-  else
-    return tab->tab[nun]->data;
-}
-
-static int
-ptab_find_exact_nun(PTAB *tab, const char *key)
-{
-  int nun;
+  ptab_node *n;
+  int exact;
 
   if (!tab || !key || tab->state)
-    return -1;
-
-  if (tab->len < 10) {          /* Just do a linear search for small tables */
-    int cmp;
-    for (nun = 0; nun < tab->len; nun++) {
-      cmp = strcasecmp(tab->tab[nun]->key, key);
-      if (cmp == 0)
-        return nun;
-      else if (cmp > 0)
-        return -1;
-    }
-  } else {                      /* Binary search of the index */
-    int left = 0;
-    int cmp;
-    int right = tab->len - 1;
-
-    while (1) {
-      nun = (left + right) / 2;
-
-      if (left > right)
-        break;
-
-      cmp = strcasecmp(key, tab->tab[nun]->key);
-
-      if (cmp == 0)
-        return nun;
-      if (left == right)
-        break;
-      if (cmp < 0)
-        right = nun - 1;
-      else                      /* cmp > 0 */
-        left = nun + 1;
-    }
-  }
-  return -1;
-}
+    return NULL;
 
-static void
-delete_entry(PTAB *tab, int n)
-{
-  mush_free(tab->tab[n], "ptab.entry");
-
-  /* If we're deleting the last item in the list, just decrement the length.
-   *  Otherwise, we have to fill in the hole
-   */
-  if (n < tab->len - 1) {
-    int i;
-    for (i = n + 1; i < tab->len; i++)
-      tab->tab[i - 1] = tab->tab[i];
-  }
-  tab->len--;
+  n = ptab_walk(tab, key, &exact);
+  if (n && exact && n->key)
+    return n->data;
+  return NULL;
 }
 
 /** Delete a ptab entry indexed by key.
+ * A walk over the table in progress carries on with the entry after
+ * the deleted one.
  * \param tab pointer to a ptab.
  * \param key key to search for.
  */
 void
 ptab_delete(PTAB *tab, const char *key)
 {
-  int nun;
-  nun = ptab_find_exact_nun(tab, key);
-  if (nun >= 0)
-    delete_entry(tab, nun);
-  return;
+  ptab_node *n, *p;
+  int exact;
+
+  if (!tab || !key)
+    return;
+  n = ptab_walk(tab, key, &exact);
+  if (!n || !exact || !n->key)
+    return;
+
+  if (tab->current == n)
+    tab->current = next_entry(n, tab->stop);
+  mush_free(n->key, "ptab.entry");
+  n->key = NULL;
+  n->data = NULL;
+  tab->len--;
+
+  if (n == tab->root)
+    return;
+  if (n->nkids == 0) {
+    p = n->parent;
+    remove_kid(p, kid_index(p, (unsigned char) n->edge[0], NULL));
+    /* A walk of just this entry's subtree is over */
+    if (tab->stop == n)
+      tab->stop = tab->current = NULL;
+    free_node(n);
+    if (p != tab->root && !p->key && p->nkids == 1)
+      merge_node(tab, p);
+  } else if (n->nkids == 1)
+    merge_node(tab, n);
 }
 
 /** Put a ptab into insertion state.
@@ -236,35 +356,19 @@ ptab_start_inserts(PTAB *tab)
   tab->state = 1;
 }
 
-static int WIN32_CDECL
-ptab_cmp(const void *a, const void *b)
-{
-  const struct ptab_entry *const *ra = a;
-  const struct ptab_entry *const *rb = b;
-
-  return strcasecmp((*ra)->key, (*rb)->key);
-}
-
-/** Complete the ptab insertion process by re-sorting the entries.
+/** Complete the ptab insertion process.
  * \param tab pointer to a ptab.
  */
 void
 ptab_end_inserts(PTAB *tab)
 {
-  struct ptab_entry **tmp;
   if (!tab)
     return;
   tab->state = 0;
-  qsort(tab->tab, tab->len, sizeof(struct ptab_entry *), ptab_cmp);
-
-  tmp = realloc(tab->tab, (tab->len + 10) * sizeof(struct ptab_entry *));
-  if (!tmp)
-    return;
-  tab->tab = tmp;
-  tab->maxlen = tab->len + 10;
 }
 
 /** Insert an entry into a ptab.
+ * Inserting a key that's already in the table replaces its data.
  * \param tab pointer to a ptab.
  * \param key key to insert entry under.
  * \param data pointer to entry data.
@@ -272,37 +376,56 @@ ptab_end_inserts(PTAB *tab)
 void
 ptab_insert(PTAB *tab, const char *key, void *data)
 {
-  int lamed;
+  ptab_node *n, *kid, *mid;
+  const char *s;
+  int i, j, pos;
+  size_t lamed;
 
   if (!tab || tab->state != 1)
     return;
 
-  if (tab->len == tab->maxlen) {
-    struct ptab_entry **tmp;
-    if (tab->maxlen == 0)
-      tab->maxlen = 200;
-    else
-      tab->maxlen *= 2;
-    tmp = realloc(tab->tab, tab->maxlen * sizeof(struct ptab_entry **));
-    if (tab->tab == NULL)
-      add_check("ptab");
-    if (!tmp)
-      return;
-    tab->tab = tmp;
+  if (!tab->root)
+    tab->root = new_node("", 0);
+
+  n = tab->root;
+  s = key;
+  while (*s) {
+    i = kid_index(n, DOWNCASE(*s), &pos);
+    if (i < 0) {
+      kid = new_node(s, strlen(s));
+      add_kid(n, kid, pos);
+      n = kid;
+      break;
+    }
+    kid = n->kids[i];
+    for (j = 1; j < kid->elen && s[j] && DOWNCASE(s[j])
+         == (unsigned char) kid->edge[j]; j++) ;
+    if (j < kid->elen) {
+      /* Split the edge where the key leaves it */
+      mid = new_node(kid->edge, j);
+      n->kids[i] = mid;
+      mid->parent = n;
+      memmove(kid->edge, kid->edge + j, kid->elen - j + 1);
+      kid->elen -= j;
+      add_kid(mid, kid, 0);
+      kid = mid;
+    }
+    s += kid->elen;
+    n = kid;
   }
 
   lamed = strlen(key) + 1;
-
-  tab->tab[tab->len] = mush_malloc(PTAB_SIZE + lamed, "ptab.entry");
-
-  tab->tab[tab->len]->data = data;
-  memcpy(tab->tab[tab->len]->key, key, lamed);
-  tab->len++;
-
+  if (n->key)
+    mush_free(n->key, "ptab.entry");
+  else
+    tab->len++;
+  n->key = mush_malloc(lamed, "ptab.entry");
+  memcpy(n->key, key, lamed);
+  n->data = data;
 }
 
 /** Return the data (and optionally the key) of the first entry in a ptab.
- * This function resets the 'current' index in the ptab to the start
+ * This function resets the iteration point in the ptab to the start
  * of the table.
  * \param tab pointer to a ptab.
  * \param key memory location to store first key unless NULL is passed in.
@@ -313,14 +436,40 @@ ptab_firstentry_new(PTAB *tab, char *key)
 {
   if (!tab || tab->len == 0)
     return NULL;
-  tab->current = 1;
-  if (key)
-    strcpy(key, tab->tab[0]->key);
-  return tab->tab[0]->data;
+  tab->stop = tab->root;
+  tab->current = tab->root->key ? tab->root : next_entry(tab->root, tab->root);
+  return ptab_nextentry_new(tab, key);
+}
+
+/** Return the data (and optionally the key) of the first entry in a ptab
+ * whose key starts with a prefix.
+ * Following calls to ptab_nextentry_new() return the rest of the
+ * entries with that prefix, in order.
+ * \param tab pointer to a ptab.
+ * \param prefix prefix of the keys to return.
+ * \param key memory location to store first key unless NULL is passed in.
+ * \return void pointer to data from first entry, or NULL if none.
+ */
+void *
+ptab_firstentry_prefix(PTAB *tab, const char *prefix, char *key)
+{
+  ptab_node *n;
+  int exact;
+
+  if (!tab || !prefix)
+    return NULL;
+  n = ptab_walk(tab, prefix, &exact);
+  if (!n) {
+    tab->current = tab->stop = NULL;
+    return NULL;
+  }
+  tab->stop = n;
+  tab->current = n->key ? n : next_entry(n, n);
+  return ptab_nextentry_new(tab, key);
 }
 
 /** Return the data (and optionally the key) of the next entry in a ptab.
- * This function increments the 'current' index in the ptab.
+ * This function advances the iteration point in the ptab.
  * \param tab pointer to a ptab.
  * \param key memory location to store next key unless NULL is passed in.
  * \return void pointer to data from next entry, or NULL if none.
@@ -328,11 +477,15 @@ ptab_firstentry_new(PTAB *tab, char *key)
 void *
 ptab_nextentry_new(PTAB *tab, char *key)
 {
-  if (!tab || tab->current >= tab->len)
+  ptab_node *n;
+
+  if (!tab || !tab->current)
     return NULL;
+  n = tab->current;
+  tab->current = next_entry(n, tab->stop);
   if (key)
-    strcpy(key, tab->tab[tab->current]->key);
-  return tab->tab[tab->current++]->data;
+    strcpy(key, n->key);
+  return n->data;
 }
 
 /** Header for report of ptab stats.
@@ -341,7 +494,22 @@ ptab_nextentry_new(PTAB *tab, char *key)
 void
 ptab_stats_header(dbref player)
 {
-  notify_format(player, "Table      Entries AvgComparisons %39s", "~Memory");
+  notify_format(player, "Table      Entries   Nodes AvgDepth %31s", "~Memory");
+}
+
+static void
+tree_stats(ptab_node *n, int depth, int *nodes, int *depths, int *mem)
+{
+  int i;
+
+  (*nodes)++;
+  *mem += sizeof(ptab_node) + n->elen + 1 + n->maxkids * sizeof(ptab_node *);
+  if (n->key) {
+    *depths += depth;
+    *mem += strlen(n->key) + 1;
+  }
+  for (i = 0; i < n->nkids; i++)
+    tree_stats(n->kids[i], depth + 1, nodes, depths, mem);
 }
 
 /** Data for one line of report of ptab stats.
@@ -352,13 +520,11 @@ ptab_stats_header(dbref player)
 void
 ptab_stats(dbref player, PTAB *tab, const char *pname)
 {
-  int mem, nun;
-
-  mem = sizeof(struct ptab_entry *) * tab->maxlen;
+  int nodes = 0, depths = 0, mem = 0;
 
-  for (nun = 0; nun < tab->len; nun++)
-    mem += PTAB_SIZE + strlen(tab->tab[nun]->key) + 1;
+  if (tab->root)
+    tree_stats(tab->root, 0, &nodes, &depths, &mem);
 
-  notify_format(player, "%-10s %7d %14.3f %39d", pname, tab->len, log(tab->len),
-                mem);
+  notify_format(player, "%-10s %7d %7d %8.3f %31d", pname, tab->len, nodes,
+                tab->len ? (double) depths / tab->len : 0.0, mem);
 }
@@ -307,12 +307,14 @@ chown_object(dbref player, dbref thing, dbref newowner, int preserve)
     Owner(thing) = Owner(newowner);
   }
   if(!preserve) Zone(thing) = Zone(newowner);
+  obj_index_update(thing);
   clear_flag_internal(thing, "CHOWN_OK");
   if (!preserve || !Director(player)) {
     set_flag_internal(thing, "HALT");
     if(DPBITS(thing)) 
       mush_free(DPBITS(thing), "POWER_SPOT");   /* wipe out all powers */
     DPBITS(thing) = NULL;
+    flag_columns_update(thing);
     do_halt(thing, "", thing);
   } else {
     adjust_powers(thing, newowner);
@@ -427,6 +429,7 @@ do_chzone(dbref player, char const *name, char const *newobj, int noisy)
   }
   /* everything is okay, do the change */
   Zone(thing) = zone;
+  obj_index_update(thing);
   /* If we're not unzoning, and we're working with a non-player object,
    * we'll remove inherit and powers, for security.
    */
@@ -475,6 +478,8 @@ af_helper(dbref player, dbref thing, dbref parent __attribute__ ((__unused__)),
     return 0;
   }
 
+  atr_comm_forget(thing);
+  mark_dirty(thing);
   /* Clear flags first, then set flags */
   if (af->clrf) {
     AL_FLAGS(atr) &= ~af->clrf;
@@ -504,6 +509,8 @@ copy_attrib_flags(dbref player, dbref target, ATTR *atr, int flags)
     return;
   }
   AL_FLAGS(atr) = flags;
+  atr_comm_forget(target);
+  mark_dirty(target);
 }
 
 /** Set a flag on an attribute.
@@ -1072,6 +1079,7 @@ do_parent(dbref player, char *name, char *parent_name)
   }
   /* everything is okay, do the change */
   Parent(thing) = parent;
+  obj_index_update(thing);
   if (!AreQuiet(player, thing))
     notify(player, T("Parent changed."));
 }
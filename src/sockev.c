@@ -0,0 +1,588 @@
+/**
+ * \file sockev.c
+ *
+ * \brief Socket readiness backends and the main loop timer wheel.
+ *
+ * shovechars() used to rebuild a pair of fd_sets from the whole
+ * descriptor list and hand them to select() on every pass. Now each
+ * socket is registered here once, when it is opened, and dropped when
+ * it is closed, and sockev_wait() reports only the ones that became
+ * ready.
+ *
+ * Two backends are provided. Where <sys/epoll.h> exists, player
+ * connections are registered edge-triggered for both directions at
+ * once, so nothing has to be touched while they idle; the caller
+ * latches what it is told in the descriptor and clears it again when
+ * recv() or send() would block. Everywhere else, or if the kernel
+ * won't give us an epoll instance, a select() emulation is used. It is
+ * always level-triggered, so the interest mask passed to sockev_mod()
+ * decides which sockets it waits on, just like the old fd_sets.
+ *
+ * The timer wheel holds the main loop's deadlines (the per-second
+ * tick that drives dispatch(), for now) so that shovechars() can sleep
+ * until the next one is due instead of polling every pass.
+ */
+
+#include "copyrite.h"
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifdef I_SYS_TYPES
+#include <sys/types.h>
+#endif
+#ifdef WIN32
+#define FD_SETSIZE 256
+#include <winsock.h>
+#else
+#ifdef I_SYS_TIME
+#include <sys/time.h>
+#endif
+#endif
+#include <time.h>
+#ifdef I_SYS_SELECT
+#include <sys/select.h>
+#endif
+#ifdef I_UNISTD
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+#include <limits.h>
+#if defined(I_SYS_EPOLL) && !defined(COMPILE_CONSOLE)
+#define SOCKEV_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include "conf.h"
+#include "externs.h"
+#include "mymalloc.h"
+#include "log.h"
+#include "sockev.h"
+#include "confmagic.h"
+
+/** What we know about one registered file descriptor. */
+struct sockev_fd {
+  int events;           /**< Registration flags, or 0 if unregistered */
+  int active;           /**< Interest currently given to the backend */
+  void *data;           /**< Caller's pointer, usually a DESC */
+};
+
+/** One socket reported ready by the last sockev_wait(). */
+struct sockev_res {
+  int fd;               /**< The file descriptor */
+  int ready;            /**< SOCKEV_READ and/or SOCKEV_WRITE */
+};
+
+/** A readiness backend. */
+struct sockev_backend {
+  const char *name;                     /**< Shown in the log */
+  int (*init) (void);                   /**< Set up; 0 on success */
+  int max_fds;                          /**< Highest fd + 1 it can watch */
+  int edge;                             /**< Can it do edge triggering? */
+  int (*ctl) (int fd, int oldev, int newev);    /**< Change interest */
+  int (*wait) (long msec);              /**< Wait and fill results */
+};
+
+static struct sockev_fd *fdtab = NULL;
+static int fdtab_size = 0;
+static int fd_top = -1;
+static struct sockev_res *results = NULL;
+static int results_size = 0;
+static int nresults = 0;
+static struct sockev_backend *backend = NULL;
+
+static int grow_fdtab(int fd);
+static void add_result(int fd, int ready);
+
+#define SOCKEV_BATCH    256     /**< Results fetched per epoll_wait() */
+#define SOCKEV_LIVE     0x100   /**< fdtab entry is registered */
+
+/* The select() backend */
+
+static int select_init(void);
+static int select_ctl(int fd, int oldev, int newev);
+static int select_wait(long msec);
+
+static struct sockev_backend select_backend = {
+  "select", select_init, FD_SETSIZE, 0, select_ctl, select_wait
+};
+
+static int
+select_init(void)
+{
+  return 0;
+}
+
+static int
+select_ctl(int fd __attribute__ ((__unused__)),
+           int oldev __attribute__ ((__unused__)),
+           int newev __attribute__ ((__unused__)))
+{
+  /* The fd_sets are built from fdtab on each wait */
+  return 0;
+}
+
+static int
+select_wait(long msec)
+{
+  fd_set input_set, output_set;
+  struct timeval timeout, *tp = NULL;
+  int fd, maxfd = 0, found, ready;
+
+  FD_ZERO(&input_set);
+  FD_ZERO(&output_set);
+  for (fd = 0; fd <= fd_top; fd++) {
+    if (fdtab[fd].active & SOCKEV_READ)
+      FD_SET(fd, &input_set);
+    if (fdtab[fd].active & SOCKEV_WRITE)
+      FD_SET(fd, &output_set);
+    if (fdtab[fd].active)
+      maxfd = fd + 1;
+  }
+  if (msec >= 0) {
+    timeout.tv_sec = msec / 1000;
+    timeout.tv_usec = (msec % 1000) * 1000;
+    tp = &timeout;
+  }
+  found = select(maxfd, &input_set, &output_set, (fd_set *) 0, tp);
+  if (found <= 0)
+    return found;
+  for (fd = 0; fd < maxfd; fd++) {
+    ready = 0;
+    if (FD_ISSET(fd, &input_set))
+      ready |= SOCKEV_READ;
+    if (FD_ISSET(fd, &output_set))
+      ready |= SOCKEV_WRITE;
+    if (ready)
+      add_result(fd, ready);
+  }
+  return nresults;
+}
+
+#ifdef SOCKEV_EPOLL
+/* The epoll backend */
+
+static int epoll_fd = -1;
+
+static int sepoll_init(void);
+static int sepoll_ctl(int fd, int oldev, int newev);
+static int sepoll_wait(long msec);
+
+static struct sockev_backend epoll_backend = {
+  "epoll", sepoll_init, INT_MAX, 1, sepoll_ctl, sepoll_wait
+};
+
+static int
+sepoll_init(void)
+{
+  epoll_fd = epoll_create(SOCKEV_BATCH);
+  if (epoll_fd < 0)
+    return -1;
+  /* Don't leak it into the info_slave or across @reboot */
+  fcntl(epoll_fd, F_SETFD, FD_CLOEXEC);
+  return 0;
+}
+
+static int
+sepoll_ctl(int fd, int oldev, int newev)
+{
+  struct epoll_event ev;
+  int op;
+
+  if (!newev)
+    return epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+
+  memset(&ev, 0, sizeof ev);
+  ev.data.fd = fd;
+  if (newev & SOCKEV_EDGE)
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+  else {
+    if (newev & SOCKEV_READ)
+      ev.events |= EPOLLIN;
+    if (newev & SOCKEV_WRITE)
+      ev.events |= EPOLLOUT;
+  }
+  op = oldev ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  if (epoll_ctl(epoll_fd, op, fd, &ev) == 0)
+    return 0;
+  /* The kernel forgets about fds when they're closed, and we may not
+   * have been told. Try the other way around. */
+  if (errno == EEXIST)
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  if (errno == ENOENT)
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+  return -1;
+}
+
+static int
+sepoll_wait(long msec)
+{
+  struct epoll_event evs[SOCKEV_BATCH];
+  int found, n, ready;
+
+  found = epoll_wait(epoll_fd, evs, SOCKEV_BATCH, msec < 0 ? -1 : (int) msec);
+  for (n = 0; n < found; n++) {
+    ready = 0;
+    if (evs[n].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      ready |= SOCKEV_READ;
+    if (evs[n].events & EPOLLOUT)
+      ready |= SOCKEV_WRITE;
+    add_result(evs[n].data.fd, ready);
+  }
+  return found < 0 ? found : nresults;
+}
+#endif                          /* SOCKEV_EPOLL */
+
+/** Pick and set up a readiness backend.
+ * epoll is preferred where it was compiled in; select() always works.
+ * \return 0.
+ */
+int
+sockev_init(void)
+{
+#ifdef SOCKEV_EPOLL
+  if (epoll_backend.init() == 0)
+    backend = &epoll_backend;
+  else
+    do_rawlog(LT_ERR, "epoll_create: %s; falling back to select()",
+              strerror(errno));
+#endif
+  if (!backend) {
+    select_backend.init();
+    backend = &select_backend;
+  }
+  do_rawlog(LT_ERR, "Using %s for socket events.", backend->name);
+  return 0;
+}
+
+/** Name of the readiness backend in use. */
+const char *
+sockev_backend(void)
+{
+  return backend ? backend->name : "none";
+}
+
+/** How many file descriptors the backend can watch.
+ * select() can't go past FD_SETSIZE, and shovechars() stops accepting
+ * connections before it gets there.
+ */
+int
+sockev_max_fds(void)
+{
+  return backend ? backend->max_fds : FD_SETSIZE;
+}
+
+static int
+grow_fdtab(int fd)
+{
+  struct sockev_fd *newtab;
+  int newsize;
+
+  if (fd < fdtab_size)
+    return 0;
+  newsize = fdtab_size ? fdtab_size : 64;
+  while (newsize <= fd)
+    newsize *= 2;
+  newtab = (struct sockev_fd *) mush_malloc(newsize * sizeof *newtab,
+                                            "sockev.fdtab");
+  if (!newtab)
+    return -1;
+  memset(newtab, 0, newsize * sizeof *newtab);
+  if (fdtab) {
+    memcpy(newtab, fdtab, fdtab_size * sizeof *newtab);
+    mush_free(fdtab, "sockev.fdtab");
+  }
+  fdtab = newtab;
+  fdtab_size = newsize;
+  return 0;
+}
+
+/** Start watching a file descriptor.
+ * Registering a descriptor that is already registered replaces the
+ * old registration.
+ * \param fd the file descriptor.
+ * \param events SOCKEV_READ and/or SOCKEV_WRITE, plus SOCKEV_EDGE to
+ * ask for edge-triggered reports where the backend can do them.
+ * \param data pointer handed back by sockev_result().
+ * \retval 0 success.
+ * \retval -1 the backend can't watch this descriptor.
+ */
+int
+sockev_add(int fd, int events, void *data)
+{
+  if (!backend || fd < 0 || fd >= backend->max_fds || grow_fdtab(fd) < 0)
+    return -1;
+  if (!backend->edge)
+    events &= ~SOCKEV_EDGE;
+  if (events && backend->ctl(fd, fdtab[fd].active, events) < 0) {
+    do_rawlog(LT_ERR, "sockev_add(%d): %s", fd, strerror(errno));
+    return -1;
+  }
+  fdtab[fd].events = events | SOCKEV_LIVE;
+  fdtab[fd].active = events;
+  fdtab[fd].data = data;
+  if (fd > fd_top)
+    fd_top = fd;
+  return 0;
+}
+
+/** Change which directions a descriptor is watched for.
+ * Edge-triggered registrations always report both directions, so
+ * this only costs anything on level-triggered ones, and only when the
+ * mask actually changes.
+ * \param fd a registered file descriptor.
+ * \param events SOCKEV_READ and/or SOCKEV_WRITE, or 0 to stop
+ * watching for now without forgetting the descriptor.
+ */
+void
+sockev_mod(int fd, int events)
+{
+  struct sockev_fd *f;
+
+  if (!backend || fd < 0 || fd > fd_top || !fdtab[fd].events)
+    return;
+  f = &fdtab[fd];
+  if (f->events & SOCKEV_EDGE)
+    return;
+  events &= (SOCKEV_READ | SOCKEV_WRITE);
+  if (f->active == events)
+    return;
+  if (backend->ctl(fd, f->active, events) == 0 || !events)
+    f->active = events;
+}
+
+/** Stop watching a file descriptor.
+ * Call this before closing it; the fd number may be handed out again
+ * right away.
+ * \param fd the file descriptor.
+ */
+void
+sockev_del(int fd)
+{
+  int n;
+
+  if (!backend || fd < 0 || fd > fd_top || !fdtab[fd].events)
+    return;
+  if (fdtab[fd].active)
+    backend->ctl(fd, fdtab[fd].active, 0);
+  fdtab[fd].events = 0;
+  fdtab[fd].active = 0;
+  fdtab[fd].data = NULL;
+  /* Anything already reported for it is stale now */
+  for (n = 0; n < nresults; n++)
+    if (results[n].fd == fd)
+      results[n].ready = 0;
+  while (fd_top >= 0 && !fdtab[fd_top].events)
+    fd_top--;
+}
+
+static void
+add_result(int fd, int ready)
+{
+  struct sockev_res *newres;
+
+  if (fd < 0 || fd > fd_top || !fdtab[fd].events || !ready)
+    return;
+  if (nresults >= results_size) {
+    newres = (struct sockev_res *)
+      mush_malloc((results_size + SOCKEV_BATCH) * sizeof *newres,
+                  "sockev.results");
+    if (!newres)
+      return;
+    if (results) {
+      memcpy(newres, results, results_size * sizeof *newres);
+      mush_free(results, "sockev.results");
+    }
+    results = newres;
+    results_size += SOCKEV_BATCH;
+  }
+  results[nresults].fd = fd;
+  results[nresults].ready = ready;
+  nresults++;
+}
+
+/** Wait for registered descriptors to become ready.
+ * \param msec longest time to wait, in milliseconds. 0 polls, and a
+ * negative value waits indefinitely.
+ * \return the number of results to fetch with sockev_result(), or -1
+ * with errno set on error (including EINTR).
+ */
+int
+sockev_wait(long msec)
+{
+  nresults = 0;
+  return backend->wait(msec);
+}
+
+/** Fetch one result of the last sockev_wait().
+ * \param n index of the result, from 0.
+ * \param fd pointer to store the file descriptor in.
+ * \param data pointer to store the registered data pointer in.
+ * \return SOCKEV_READ and/or SOCKEV_WRITE, or 0 if the descriptor was
+ * dropped since.
+ */
+int
+sockev_result(int n, int *fd, void **data)
+{
+  if (n < 0 || n >= nresults || !results[n].ready)
+    return 0;
+  *fd = results[n].fd;
+  *data = fdtab[*fd].data;
+  return results[n].ready;
+}
+
+
+/* The timer wheel. Timers are hashed by their expiry tick into one of
+ * WHEEL_SLOTS lists; timers further away than a full turn just sit in
+ * their slot until the wheel comes round to their tick. */
+
+#define WHEEL_TICK      10      /**< Milliseconds per tick */
+#define WHEEL_SLOTS     256     /**< Ticks per turn of the wheel */
+
+static SOCKEV_TIMER *wheel[WHEEL_SLOTS];
+static struct timeval wheel_base;
+static int wheel_started = 0;
+static unsigned long wheel_tick = 0;
+static int wheel_count = 0;
+
+static unsigned long wheel_msec(struct timeval *now);
+static void wheel_insert(SOCKEV_TIMER *t);
+
+static unsigned long
+wheel_msec(struct timeval *now)
+{
+  long ms;
+
+  if (!wheel_started) {
+    wheel_base = *now;
+    wheel_started = 1;
+  }
+  ms = (now->tv_sec - wheel_base.tv_sec) * 1000 +
+    (now->tv_usec - wheel_base.tv_usec) / 1000;
+  /* Never let the clock run backwards on us */
+  if (ms < (long) (wheel_tick * WHEEL_TICK))
+    ms = wheel_tick * WHEEL_TICK;
+  return (unsigned long) ms;
+}
+
+static void
+wheel_insert(SOCKEV_TIMER *t)
+{
+  SOCKEV_TIMER **slot = &wheel[t->expires % WHEEL_SLOTS];
+
+  t->next = *slot;
+  if (t->next)
+    t->next->prevp = &t->next;
+  t->prevp = slot;
+  *slot = t;
+  wheel_count++;
+}
+
+/** Arm a timer.
+ * An armed timer is moved rather than added twice.
+ * \param t the timer, which the caller owns.
+ * \param msec milliseconds from the last sockev_timer_run() until it
+ * fires.
+ * \param interval if non-zero, rearm it this many milliseconds after
+ * each time it is due.
+ * \param fn function to call.
+ * \param data argument for fn.
+ */
+void
+sockev_timer_set(SOCKEV_TIMER *t, long msec, long interval,
+                 void (*fn) (void *), void *data)
+{
+  sockev_timer_cancel(t);
+  if (msec < 0)
+    msec = 0;
+  t->expires = wheel_tick + (msec + WHEEL_TICK - 1) / WHEEL_TICK;
+  t->interval = interval;
+  t->fn = fn;
+  t->data = data;
+  wheel_insert(t);
+}
+
+/** Disarm a timer. It's fine if it isn't armed.
+ * \param t the timer.
+ */
+void
+sockev_timer_cancel(SOCKEV_TIMER *t)
+{
+  if (!t->prevp)
+    return;
+  *t->prevp = t->next;
+  if (t->next)
+    t->next->prevp = t->prevp;
+  t->next = NULL;
+  t->prevp = NULL;
+  wheel_count--;
+}
+
+/** Fire all timers that are due.
+ * \param now the current time.
+ */
+void
+sockev_timer_run(struct timeval *now)
+{
+  SOCKEV_TIMER *t, *tnext, *due = NULL;
+  unsigned long cur, spins, i, step;
+
+  cur = wheel_msec(now) / WHEEL_TICK;
+  spins = cur - wheel_tick + 1;
+  if (spins > WHEEL_SLOTS)
+    spins = WHEEL_SLOTS;
+  /* Collect first, since the callbacks are free to rearm timers */
+  for (i = 0; i < spins; i++) {
+    for (t = wheel[(wheel_tick + i) % WHEEL_SLOTS]; t; t = tnext) {
+      tnext = t->next;
+      if (t->expires <= cur) {
+        sockev_timer_cancel(t);
+        t->next = due;
+        due = t;
+      }
+    }
+  }
+  wheel_tick = cur;
+  for (t = due; t; t = tnext) {
+    tnext = t->next;
+    t->next = NULL;
+    if (t->interval > 0) {
+      step = (t->interval + WHEEL_TICK - 1) / WHEEL_TICK;
+      t->expires += step;
+      /* If we've fallen a whole interval behind, skip the lost beats */
+      if (t->expires <= cur)
+        t->expires = cur + step;
+      wheel_insert(t);
+    }
+    t->fn(t->data);
+  }
+}
+
+/** How long until the next timer is due.
+ * \param now the current time.
+ * \return milliseconds until the next timer, 0 if one is overdue, or
+ * -1 if no timers are armed.
+ */
+long
+sockev_timer_next(struct timeval *now)
+{
+  SOCKEV_TIMER *t;
+  unsigned long ms, cur, i;
+  long left;
+
+  if (!wheel_count)
+    return -1;
+  ms = wheel_msec(now);
+  cur = ms / WHEEL_TICK;
+  for (i = 0; i < WHEEL_SLOTS; i++) {
+    for (t = wheel[(cur + i) % WHEEL_SLOTS]; t; t = t->next) {
+      if (t->expires <= cur + i) {
+        left = (long) (t->expires * WHEEL_TICK) - (long) ms;
+        return left > 0 ? left : 0;
+      }
+    }
+  }
+  /* Nothing within a turn of the wheel; look again then. */
+  return (long) ((cur + WHEEL_SLOTS) * WHEEL_TICK - ms);
+}
@@ -54,7 +54,9 @@ extern void reopen_logs(void);
 #ifdef _SWMP_
 extern void sql_timer();
 #endif
-static void migrate_stuff(int amount);
+static int migrate_stuff(int amount);
+static void schedule_migration(void);
+int que_next(void);             /* from cque.c */
 
 #ifndef WIN32
 void hup_handler(int);
@@ -118,8 +120,9 @@ init_timer(void)
  * migrated will be more or less due to always migrating all the
  * attributes, locks, and mail on any given object together.
  * \param amount the suggested number of attributes to migrate.
+ * \return the number of attributes actually submitted.
  */
-static void
+static int
 migrate_stuff(int amount)
 {
   static int start_obj = 0;
@@ -132,7 +135,7 @@ migrate_stuff(int amount)
   MAIL *mp;
 
   if (db_top == 0)
-    return;
+    return 0;
 
   end_obj = start_obj;
   actual = 0;
@@ -154,7 +157,7 @@ migrate_stuff(int amount)
   } while (actual < amount && end_obj != start_obj);
 
   if (actual == 0)
-    return;
+    return 0;
 
   if (!refs || actual > refs_size) {
     if (refs)
@@ -196,6 +199,65 @@ migrate_stuff(int amount)
   } while (start_obj != end_obj);
 
   chunk_migration(actual, refs);
+  return actual;
+}
+
+/* Fragmentation (see chunk_fragmentation()) that speeds up or slows
+ * down adaptive migration */
+#define MIGRATE_FRAG_LOW 10
+#define MIGRATE_FRAG_HIGH 40
+
+/** Do this second's chunk migration.
+ * With chunk_migrate_time set, migration gets a slice of time that
+ * grows when the chunk pool is fragmented or the queue is idle, and
+ * shrinks when it isn't or commands are waiting to run. The number of
+ * attributes to submit is worked out from how long earlier rounds
+ * took per attribute. Otherwise, a fixed CHUNK_MIGRATE_AMOUNT is done.
+ */
+static void
+schedule_migration(void)
+{
+  static double usec_per_ref = 0.0;
+  struct timeval start, end;
+  double budget, usecs;
+  int frag, next, amount, actual;
+
+  if (options.chunk_migrate_time <= 0) {
+    migrate_stuff(CHUNK_MIGRATE_AMOUNT);
+    return;
+  }
+
+  budget = options.chunk_migrate_time * 1000.0;
+  frag = chunk_fragmentation();
+  if (frag >= MIGRATE_FRAG_HIGH)
+    budget *= 2;
+  else if (frag < MIGRATE_FRAG_LOW)
+    budget /= 2;
+  amount = CHUNK_MIGRATE_AMOUNT;
+  next = que_next();
+  if (next == 0) {
+    /* Commands are waiting; get out of their way */
+    budget /= 4;
+    amount = amount / 4 + 1;
+  } else if (next > 1)
+    budget *= 2;
+
+  if (usec_per_ref > 0.0 && budget / usec_per_ref > amount)
+    amount = budget / usec_per_ref < db_top * 4.0
+      ? (int) (budget / usec_per_ref) : db_top * 4;
+
+  gettimeofday(&start, NULL);
+  actual = migrate_stuff(amount);
+  gettimeofday(&end, NULL);
+  if (actual > 0) {
+    usecs = (end.tv_sec - start.tv_sec) * 1000000.0 +
+      (end.tv_usec - start.tv_usec);
+    /* A running average, so one slow round doesn't stall migration */
+    if (usec_per_ref > 0.0)
+      usec_per_ref = (usec_per_ref * 3 + usecs / actual) / 4;
+    else
+      usec_per_ref = usecs / actual;
+  }
 }
 
 /** Handle events that may need handling.
@@ -236,7 +298,7 @@ dispatch(void)
 
   do_second();
 
-  migrate_stuff(CHUNK_MIGRATE_AMOUNT);
+  schedule_migration();
 
   if (options.purge_counter <= mudtime) {
     /* Free list reconstruction */
@@ -268,7 +330,7 @@ dispatch(void)
     options.dump_counter = options.dump_interval + mudtime;
     global_eval_context.cplr = NOTHING;
     strcpy(global_eval_context.ccom, "dump");
-    fork_and_dump(1);
+    checkpoint_database();
     strcpy(global_eval_context.ccom, "");
     flag_broadcast(0, "ON-VACATION", "%s",
                    T
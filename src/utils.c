@@ -45,6 +45,7 @@
 #include "attrib.h"
 #include "parse.h"
 #include "lock.h"
+#include "pcode.h"
 #include "confmagic.h"
 #include "modules.h"
 
@@ -185,10 +186,13 @@ fetch_ufun_attrib(char *attrname, dbref executor, ufun_attrib * ufun,
   ATTR *attrib;
   dbref thing;
   int pe_flags = PE_UDEFAULT;
+  PCODE *pc;
     
   if (!ufun)
     return 0;           /* We should never NOT receive a ufun. */
   ufun->errmess = (char *) "";
+  ufun->attrib = NULL;
+  ufun->serial = 0;
     
   /* find our object and attribute */
   if (accept_lambda) {
@@ -229,6 +233,13 @@ fetch_ufun_attrib(char *attrname, dbref executor, ufun_attrib * ufun,
   strncpy(ufun->contents, atr_value(attrib), BUFFER_LEN);
   ufun->thing = thing;
   ufun->pe_flags = pe_flags;
+
+  /* Remember which compiled version matches what we just copied */
+  pc = pcode_get(attrib, pe_flags);
+  if (pc) {
+    ufun->attrib = attrib;
+    ufun->serial = pcode_serial(pc);
+  }
   
   /* Cleanup */
   free_anon_attrib(attrib);
@@ -263,6 +274,7 @@ call_ufun(ufun_attrib * ufun, char **wenv_args, int wenv_argc, char *ret,
   int i;
   int pe_ret;
   char const *ap;
+  PCODE *pc;
 
   int old_re_subpatterns;
   int *old_re_offsets;
@@ -304,9 +316,15 @@ call_ufun(ufun_attrib * ufun, char **wenv_args, int wenv_argc, char *ret,
     pe_info->arg_count = wenv_argc;
   }
 
-  ap = ufun->contents;
-  pe_ret = process_expression(ret, &rp, &ap, ufun->thing, executor,
-                              enactor, ufun->pe_flags, PT_DEFAULT, pe_info);
+  pc = pcode_lookup(ufun->attrib, ufun->serial);
+  if (pc) {
+    pe_ret = pcode_run(pc, ret, &rp, ufun->thing, executor, enactor,
+                       pe_info);
+  } else {
+    ap = ufun->contents;
+    pe_ret = process_expression(ret, &rp, &ap, ufun->thing, executor,
+                                enactor, ufun->pe_flags, PT_DEFAULT, pe_info);
+  }
   *rp = '\0';
 
   /* Restore the old wenv */
@@ -463,6 +463,218 @@ wild_match_case(const char *RESTRICT s, const char *RESTRICT d, int cs)
   return wild(s, d, 0, cs);
 }
 
+/* Compiled regular expressions.
+ *
+ * The same few patterns get matched over and over - regexp $-commands
+ * are tried against every line typed near them, and softcode tends to
+ * call regmatch() and friends with the same pattern each time - so
+ * compiled and studied patterns are kept in an LRU cache keyed on the
+ * pattern and its case flag. Patterns that don't compile are cached
+ * too, along with their error message.
+ *
+ * regexp_get() hands out a pattern that stays valid until the matching
+ * regexp_release(), even if the cache is trimmed in the meantime. While
+ * in use, an entry sits on a separate list so it is never evicted.
+ * The size of the cache is the regexp_cache option in mush.cnf.
+ */
+
+/** A cached compiled regexp. */
+typedef struct re_cache RE_CACHE;
+struct re_cache {
+  char *key;            /**< Case flag followed by the pattern */
+  pcre *re;             /**< Compiled pattern, or NULL if it had an error */
+  pcre_extra *study;    /**< pcre_study() data, or NULL */
+  const char *errptr;   /**< Compile error message */
+  size_t size;          /**< Bytes used by re and study */
+  int refs;             /**< Number of regexp_get()s not yet released */
+  RE_CACHE *prev;       /**< Previous in list (more recently used) */
+  RE_CACHE *next;       /**< Next in list (less recently used) */
+};
+
+static HASHTAB htab_regexp;
+static int regexp_htab_ready = 0;
+static RE_CACHE *re_lru_head = NULL, *re_lru_tail = NULL;
+static RE_CACHE *re_pinned = NULL;
+static int re_count = 0;
+static size_t re_memory = 0;
+static unsigned long re_hits = 0, re_misses = 0, re_dropped = 0;
+
+static void re_unlink(RE_CACHE *rc);
+static void re_unpin(RE_CACHE *rc);
+static void re_drop(RE_CACHE *rc);
+
+static void
+re_unlink(RE_CACHE *rc)
+{
+  if (rc->prev)
+    rc->prev->next = rc->next;
+  else if (rc == re_pinned)
+    re_pinned = rc->next;
+  else
+    re_lru_head = rc->next;
+  if (rc->next)
+    rc->next->prev = rc->prev;
+  else if (rc == re_lru_tail)
+    re_lru_tail = rc->prev;
+  rc->prev = rc->next = NULL;
+}
+
+static void
+re_unpin(RE_CACHE *rc)
+{
+  if (--rc->refs == 0) {
+    re_unlink(rc);
+    rc->next = re_lru_head;
+    if (re_lru_head)
+      re_lru_head->prev = rc;
+    re_lru_head = rc;
+    if (!re_lru_tail)
+      re_lru_tail = rc;
+  }
+  while (re_count > REGEXP_CACHE && re_lru_tail)
+    re_drop(re_lru_tail);
+}
+
+static void
+re_drop(RE_CACHE *rc)
+{
+  re_unlink(rc);
+  hashdelete(rc->key, &htab_regexp);
+  if (rc->re)
+    mush_free(rc->re, "pcre");
+  if (rc->study)
+    mush_free(rc->study, "pcre.extra");
+  mush_free(rc->key, "regexp.key");
+  re_memory -= rc->size;
+  re_count--;
+  re_dropped++;
+  mush_free(rc, "regexp.cache");
+}
+
+/** Get a compiled regexp, from the cache if possible.
+ * A successful result must be given back with regexp_release() once
+ * the caller is done with it and with any study data.
+ * \param s the pattern.
+ * \param flags pcre_compile() flags; only PCRE_CASELESS is allowed.
+ * \param study where to store the pcre_study() data, or NULL.
+ * \param errptr where to store the error message if s doesn't compile.
+ * \return the compiled pattern, or NULL on error.
+ */
+pcre *
+regexp_get(const char *s, int flags, pcre_extra **study, const char **errptr)
+{
+  char key[BUFFER_LEN + 2];
+  RE_CACHE *rc;
+  int erroffset;
+  size_t sz;
+
+  if (!regexp_htab_ready) {
+    hashinit(&htab_regexp, 256, sizeof(RE_CACHE));
+    regexp_htab_ready = 1;
+  }
+
+  key[0] = (flags & PCRE_CASELESS) ? 'i' : 's';
+  strncpy(key + 1, s, BUFFER_LEN);
+  key[BUFFER_LEN + 1] = '\0';
+
+  rc = hashfind(key, &htab_regexp);
+  if (rc) {
+    re_hits++;
+    if (rc->refs++ == 0) {
+      re_unlink(rc);
+      rc->next = re_pinned;
+      if (re_pinned)
+        re_pinned->prev = rc;
+      re_pinned = rc;
+    }
+  } else {
+    re_misses++;
+    rc = mush_malloc(sizeof(RE_CACHE), "regexp.cache");
+    if (!rc)
+      mush_panic("Unable to allocate memory for regexp cache");
+    rc->key = mush_strdup(key, "regexp.key");
+    rc->study = NULL;
+    rc->errptr = NULL;
+    rc->size = 0;
+    rc->re = pcre_compile(s, flags & PCRE_CASELESS, &rc->errptr, &erroffset,
+                          tables);
+    if (rc->re) {
+      add_check("pcre");
+      if (pcre_fullinfo(rc->re, NULL, PCRE_INFO_SIZE, &sz) == 0)
+        rc->size += sz;
+      /* pcre_study() only complains about things pcre_compile() has
+       * already vetted, but be careful anyway. */
+      rc->study = pcre_study(rc->re, 0, &rc->errptr);
+      if (rc->errptr) {
+        mush_free(rc->re, "pcre");
+        rc->re = NULL;
+        rc->study = NULL;
+        rc->size = 0;
+      } else if (rc->study) {
+        add_check("pcre.extra");
+        if (pcre_fullinfo(rc->re, rc->study, PCRE_INFO_STUDYSIZE, &sz) == 0)
+          rc->size += sz;
+      }
+    }
+    rc->size += strlen(key) + 1 + sizeof(RE_CACHE);
+    rc->refs = 1;
+    rc->prev = NULL;
+    rc->next = re_pinned;
+    if (re_pinned)
+      re_pinned->prev = rc;
+    re_pinned = rc;
+    hashadd(rc->key, rc, &htab_regexp);
+    re_count++;
+    re_memory += rc->size;
+  }
+
+  while (re_count > REGEXP_CACHE && re_lru_tail)
+    re_drop(re_lru_tail);
+
+  if (study)
+    *study = rc->study;
+  if (!rc->re) {
+    if (errptr)
+      *errptr = rc->errptr;
+    re_unpin(rc);
+    return NULL;
+  }
+  return rc->re;
+}
+
+/** Give back a regexp obtained from regexp_get().
+ * \param re the compiled pattern, which may be NULL.
+ */
+void
+regexp_release(pcre *re)
+{
+  RE_CACHE *rc;
+
+  if (!re)
+    return;
+  for (rc = re_pinned; rc; rc = rc->next)
+    if (rc->re == re)
+      break;
+  if (rc)
+    re_unpin(rc);
+}
+
+/** Report on the regexp cache for \@stats/tables.
+ * \param player the enactor.
+ */
+void
+regexp_cache_stats(dbref player)
+{
+  unsigned long total = re_hits + re_misses;
+
+  notify(player, "Compiled Regexps:");
+  notify_format(player,
+                "%d of %d cached, using %lu bytes. %lu hits, %lu compiles "
+                "(%lu%% hit rate), %lu dropped.", re_count, REGEXP_CACHE,
+                (unsigned long) re_memory, re_hits, re_misses,
+                total ? (re_hits * 100) / total : 0UL, re_dropped);
+}
+
 /** Regexp match, possibly case-sensitive, and remember matched subexpressions.
  *
  * This routine will cause crashes if fed NULLs instead of strings.
@@ -478,30 +690,26 @@ regexp_match_case(const char *RESTRICT s, const char *RESTRICT d, int cs)
 {
   int j;
   pcre *re;
+  pcre_extra *study;
   int i;
   static char wtmp[NUMARGS][BUFFER_LEN];
-  const char *errptr;
-  int erroffset;
   int offsets[99];
   int subpatterns;
 
-  if ((re = pcre_compile(s, (cs ? 0 : PCRE_CASELESS), &errptr, &erroffset,
-                         tables)) == NULL) {
+  if ((re = regexp_get(s, (cs ? 0 : PCRE_CASELESS), &study, NULL)) == NULL) {
     /*
-     * This is a matching error. We have an error message in
-     * errptr that we can ignore, since we're doing
-     * command-matching.
+     * This is a matching error. There's an error message
+     * that we can ignore, since we're doing command-matching.
      */
     return 0;
   }
-  add_check("pcre");
   /* 
    * Now we try to match the pattern. The relevant fields will
    * automatically be filled in by this.
    */
-  if ((subpatterns = pcre_exec(re, NULL, d, strlen(d), 0, 0, offsets, 99))
+  if ((subpatterns = pcre_exec(re, study, d, strlen(d), 0, 0, offsets, 99))
       < 0) {
-    mush_free(re, "pcre");
+    regexp_release(re);
     return 0;
   }
   /* If we had too many subpatterns for the offsets vector, set the number
@@ -531,7 +739,7 @@ regexp_match_case(const char *RESTRICT s, const char *RESTRICT d, int cs)
     global_eval_context.wnxt[i] = wtmp[i];
   }
 
-  mush_free(re, "pcre");
+  regexp_release(re);
   return 1;
 }
 
@@ -550,8 +758,7 @@ int
 quick_regexp_match(const char *RESTRICT s, const char *RESTRICT d, int cs)
 {
   pcre *re;
-  const char *errptr;
-  int erroffset;
+  pcre_extra *study;
   int offsets[99];
   int r;
   int flags = 0;                /* There's a PCRE_NO_AUTO_CAPTURE flag to turn all raw
@@ -562,22 +769,20 @@ quick_regexp_match(const char *RESTRICT s, const char *RESTRICT d, int cs)
   if (!cs)
     flags |= PCRE_CASELESS;
 
-  if ((re = pcre_compile(s, flags, &errptr, &erroffset, tables)) == NULL) {
+  if ((re = regexp_get(s, flags, &study, NULL)) == NULL) {
     /*
-     * This is a matching error. We have an error message in
-     * errptr that we can ignore, since we're doing
-     * command-matching.
+     * This is a matching error. There's an error message
+     * that we can ignore, since we're doing command-matching.
      */
     return 0;
   }
-  add_check("pcre");
   /* 
    * Now we try to match the pattern. The relevant fields will
    * automatically be filled in by this.
    */
-  r = pcre_exec(re, NULL, d, strlen(d), 0, 0, offsets, 99);
+  r = pcre_exec(re, study, d, strlen(d), 0, 0, offsets, 99);
 
-  mush_free(re, "pcre");
+  regexp_release(re);
 
   return r >= 0;
 }
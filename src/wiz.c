@@ -86,6 +86,9 @@ static int raw_search(dbref player, const char *owner, int nargs,
                       const char **args, dbref **result, PE_Info * pe_info);
 static int fill_search_spec(dbref player, const char *owner, int nargs,
                             const char **args, struct search_spec *spec);
+static int search_check(dbref player, struct search_spec *spec, dbref n,
+                        PE_Info * pe_info);
+static dbref *search_candidates(struct search_spec *spec, int *count);
 
 #ifdef INFO_SLAVE
 void kill_info_slave(void);
@@ -1978,7 +1981,8 @@ raw_search(dbref player, const char *owner, int nargs, const char **args,
 {
   size_t result_size;
   size_t nresults = 0;
-  int n;
+  int n, c, ncands;
+  dbref *cands;
   struct search_spec spec;
   int count = 0;
 
@@ -2007,57 +2011,20 @@ raw_search(dbref player, const char *owner, int nargs, const char **args,
     (dbref *) mush_malloc(sizeof(dbref) * result_size, "search_results");
   if (!*result)
     mush_panic(T("Couldn't allocate memory in search!"));
-  
-  for (n = spec.low; n <= spec.high; n++) {
-    if (IsGarbage(n) && spec.type != TYPE_GARBAGE)
-      continue;
-    if (spec.owner == ANY_OWNER && !CanSearch(player, Owner(n)))
-      continue;
-    if (spec.owner != ANY_OWNER && Owner(n) != spec.owner)
-      continue;
-    if (spec.type != NOTYPE && Typeof(n) != spec.type)
-      continue;
-    if (spec.zone != ANY_OWNER && Zone(n) != spec.zone)
-      continue;
-    if (spec.division != ANY_OWNER && Division(n) != spec.division)
-      continue;
-    if (spec.subdivision != ANY_OWNER
-        && !(div_inscope(spec.subdivision, n) && SDIV(n).object != NOTHING))
-      continue;
-    if (spec.parent != ANY_OWNER && Parent(n) != spec.parent)
-      continue;
-    if (*spec.name && !string_match(Name(n), spec.name))
-      continue;
-    if (*spec.flags && !flaglist_check("FLAG", player, n, spec.flags, 1))
-      continue;
-    if (*spec.lflags && !flaglist_check_long("FLAG", player, n, spec.lflags, 1))
-      continue;
-    if (spec.search_powers) {
-      int i;
-      if (!DPBITS(n))
-        continue;
-      for (i = 0; i < (8 * DP_BYTES); i++)
-        if (DPBIT_ISSET(spec.powers, i) && !HAS_DPBIT(n, i))
-          break;
-      if (i < (8 * DP_BYTES))
-        continue;
-    }
-    if (*spec.eval) {
-      char *ebuf1;
-      const char *ebuf2;
-      char tbuf1[BUFFER_LEN];
-      char *bp;
-
-      ebuf1 = replace_string("##", unparse_dbref(n), spec.eval);
-      ebuf2 = ebuf1;
-      bp = tbuf1;
-      process_expression(tbuf1, &bp, &ebuf2, player, player, player,
-                         PE_DEFAULT, PT_DEFAULT, pe_info);
-      mush_free((Malloc_t) ebuf1, "replace_string.buff");
-      *bp = '\0';
-      if (!parse_boolean(tbuf1))
-        continue;
+
+  cands = search_candidates(&spec, &ncands);
+  for (c = 0;; c++) {
+    if (cands) {
+      if (c >= ncands)
+        break;
+      n = cands[c];
+    } else {
+      n = spec.low + c;
+      if (n > spec.high)
+        break;
     }
+    if (!search_check(player, &spec, n, pe_info))
+      continue;
 
     /* Only include the matching dbrefs from start to start+count */
     count++;
@@ -2080,6 +2047,136 @@ raw_search(dbref player, const char *owner, int nargs, const char **args,
 
     (*result)[nresults++] = (dbref) n;
   }
+  if (cands)
+    mush_free(cands, "search_candidates");
 
   return (int) nresults;
 }
+
+/* Does one object pass all the restrictions of a search? */
+static int
+search_check(dbref player, struct search_spec *spec, dbref n,
+             PE_Info * pe_info)
+{
+  if (IsGarbage(n) && spec->type != TYPE_GARBAGE)
+    return 0;
+  if (spec->owner == ANY_OWNER && !CanSearch(player, Owner(n)))
+    return 0;
+  if (spec->owner != ANY_OWNER && Owner(n) != spec->owner)
+    return 0;
+  if (spec->type != NOTYPE && Typeof(n) != spec->type)
+    return 0;
+  if (spec->zone != ANY_OWNER && Zone(n) != spec->zone)
+    return 0;
+  if (spec->division != ANY_OWNER && Division(n) != spec->division)
+    return 0;
+  if (spec->subdivision != ANY_OWNER
+      && !(div_inscope(spec->subdivision, n) && SDIV(n).object != NOTHING))
+    return 0;
+  if (spec->parent != ANY_OWNER && Parent(n) != spec->parent)
+    return 0;
+  if (*spec->name && !string_match(Name(n), spec->name))
+    return 0;
+  if (*spec->flags && !flaglist_check("FLAG", player, n, spec->flags, 1))
+    return 0;
+  if (*spec->lflags
+      && !flaglist_check_long("FLAG", player, n, spec->lflags, 1))
+    return 0;
+  if (spec->search_powers) {
+    int i;
+    if (!DPBITS(n))
+      return 0;
+    for (i = 0; i < (8 * DP_BYTES); i++)
+      if (DPBIT_ISSET(spec->powers, i) && !HAS_DPBIT(n, i))
+        break;
+    if (i < (8 * DP_BYTES))
+      return 0;
+  }
+  if (*spec->eval) {
+    char *ebuf1;
+    const char *ebuf2;
+    char tbuf1[BUFFER_LEN];
+    char *bp;
+
+    ebuf1 = replace_string("##", unparse_dbref(n), spec->eval);
+    ebuf2 = ebuf1;
+    bp = tbuf1;
+    process_expression(tbuf1, &bp, &ebuf2, player, player, player,
+                       PE_DEFAULT, PT_DEFAULT, pe_info);
+    mush_free((Malloc_t) ebuf1, "replace_string.buff");
+    *bp = '\0';
+    if (!parse_boolean(tbuf1))
+      return 0;
+  }
+  return 1;
+}
+
+/* If the search is restricted to one owner, zone, parent or division,
+ * get the objects that could match from the most selective of those
+ * indexes, in dbref order. Objects without the flags or powers asked
+ * for are dropped using the flag columns. Returns NULL if it's quicker
+ * to look at every object in the search range.
+ */
+static dbref *
+search_candidates(struct search_spec *spec, int *count)
+{
+  dbref keys[OBJ_INDEXES];
+  dbref *cands;
+  FLAG_COLUMN *col;
+  int i, n, best = -1, bestcount, used = 0;
+
+  keys[OBJ_INDEX_OWNER] = spec->owner;
+  keys[OBJ_INDEX_ZONE] = spec->zone;
+  keys[OBJ_INDEX_PARENT] = spec->parent;
+  keys[OBJ_INDEX_DIVISION] = spec->division;
+  bestcount = spec->high - spec->low + 1;
+  for (i = 0; i < OBJ_INDEXES; i++) {
+    if (keys[i] == ANY_OWNER)
+      continue;
+    n = obj_index_count(i, keys[i]);
+    if (n >= 0 && n < bestcount) {
+      best = i;
+      bestcount = n;
+    }
+  }
+
+  col = NULL;
+  if (*spec->flags || *spec->lflags || spec->search_powers) {
+    col = new_flag_column();
+    if (*spec->flags)
+      used += flag_column_select(col, spec->flags, 0, 1, spec->type);
+    if (*spec->lflags)
+      used += flag_column_select(col, spec->lflags, 1, 1, spec->type);
+    if (spec->search_powers)
+      used += power_column_select(col, spec->powers);
+    if (!used) {
+      destroy_flag_column(col);
+      col = NULL;
+    } else if (best < 0)
+      bestcount = flag_column_count(col, spec->low, spec->high);
+  }
+
+  if (best < 0 && !col)
+    return NULL;
+  cands = (dbref *) mush_malloc(sizeof(dbref) * (bestcount + 1),
+                                "search_candidates");
+  if (!cands) {
+    if (col)
+      destroy_flag_column(col);
+    return NULL;
+  }
+  if (best < 0) {
+    *count = flag_column_list(col, spec->low, spec->high, cands);
+    destroy_flag_column(col);
+    return cands;
+  }
+  n = obj_index_list(best, keys[best], cands);
+  /* Keep to the range asked for */
+  for (i = *count = 0; i < n; i++)
+    if (cands[i] >= spec->low && cands[i] <= spec->high
+        && (!col || flag_column_isset(col, cands[i])))
+      cands[(*count)++] = cands[i];
+  if (col)
+    destroy_flag_column(col);
+  return cands;
+}